@@ -27,6 +27,7 @@
 #include <string.h>
 #include <fcntl.h>
 #include <stdarg.h>
+#include <errno.h>
 
 #include <sys/types.h> // for struct dirent
 #include <sys/dir.h> // for struct dirent
@@ -34,6 +35,8 @@
 #include <openssl/md5.h> // for MD5_xxx foo
 #include <pthread.h> // for pthread_self()
 
+#include <zlib.h>
+
 #include "curl/curl.h"
 #include "curlapi.h"
 #include "regexapi.h"
@@ -44,6 +47,8 @@
 #define CURL_BASE_DIR "/tmp/json_fdw_cache"
 // Maximum length of on disk tempoarary file names
 #define MAXFILENAME 1024
+// Number of idle easy handles, and their connections, kept for reuse
+#define CURL_HANDLE_POOL_SIZE 16
 
 #define FREEPTR(a) do { if((a) != NULL) { free((a)); (a) = NULL; }; } while(0)
 
@@ -204,12 +209,15 @@ static size_t curlHeaderCallback(void *contents, size_t size, size_t nmemb, void
 // if we receive content from the fetch operation
 // Also, figure out what filename we should use for
 // content caching purposes.
-static void curlCacheFileOpen(ccf_t *pCcf)
+// Returns false if either can't be, ie. a cache
+// directory can't be created, and nothing is open
+static bool curlCacheFileOpen(ccf_t *pCcf)
 {	int fd = -1;
 	char tmpfnamebuf[MAXFILENAME];
 
 	// make sure we can store our files
-	mkdir(CURL_BASE_DIR, 0755);
+	if(mkdir(CURL_BASE_DIR, 0755) != 0 && errno != EEXIST)
+		return false;
 
 	// create a temporary file, for possible use later
 	memset(tmpfnamebuf, 0, sizeof(tmpfnamebuf));
@@ -225,53 +233,56 @@ static void curlCacheFileOpen(ccf_t *pCcf)
 	}
 
 	// Figure out what the on disk filename should be after the retrieval
+	FREEPTR(pCcf->pFileName);
 	if(pCcf->pUrlBaseName == NULL || !*pCcf->pUrlBaseName)
 	{
 		FREEPTR(pCcf->pUrlBaseName);
-		FREEPTR(pCcf->pFileName);
 
 		// The URL didn't specify a file, use the urlhash as the filename
 		asprintf(&pCcf->pFileName, "%s/%s", CURL_BASE_DIR, pCcf->pUrlHash);
 	}
-	else	// Use the specified basename of the filename from the URL
-		// so that file handling semantics based on filenames work
-		asprintf(&pCcf->pFileName, "%s/%s", CURL_BASE_DIR, pCcf->pUrlBaseName);
+	else
+	{	char *pDir = NULL;
+
+		// Use the specified basename of the filename from the URL
+		// so that file handling semantics based on filenames work,
+		// in a directory per urlhash, because urls that differ only
+		// by their parameters, ie. pages, or where clauses, have
+		// the same basename
+		asprintf(&pDir, "%s/%s", CURL_BASE_DIR, pCcf->pUrlHash);
+		if(pDir != NULL)
+		{
+			if(mkdir(pDir, 0755) == 0 || errno == EEXIST)
+				asprintf(&pCcf->pFileName, "%s/%s", pDir, pCcf->pUrlBaseName);
+			free(pDir);
+		}
+	}
+
+	if(pCcf->pFile == NULL || pCcf->pFileName == NULL)
+	{
+		if(pCcf->pFile != NULL)
+			fclose(pCcf->pFile);
+		pCcf->pFile = NULL;
+		if(pCcf->pFileNameTmp != NULL)
+			unlink(pCcf->pFileNameTmp);
+		FREEPTR(pCcf->pFileNameTmp);
+		pCcf->bNeedUnlink = false;
+
+		return false;
+	}
+
+	return true;
 }
 
 // Test if pUrl is a CURL supported URL
 // If so, grab the basename, for use later
 static bool curlIsUrl(const char *pUrl, ccf_t *pCcf)
-{	bool bIsUrl = false;
-	regexapi_t *pRat = regexapi_url(pUrl);
-
-	// If we found a regex match, then we assume that CURL supports the url
-	if(pRat != NULL)
-	{	int regexNSubs = regexapi_nsubs(pRat, 0);
-		// Assume that the last subcomponent of the regex is the filename portion
-		const char *pRegexSub = (regexNSubs > 1 ? regexapi_sub(pRat, 0, regexNSubs - 1) : NULL);
-		// and get the basename of that
-		char *pBaseName = (pRegexSub != NULL ? strrchr(pRegexSub, '/') : NULL);
-
-		bIsUrl = (pBaseName != NULL && *pBaseName);
-		if(bIsUrl)
-		{	char *pTerm = strchr(pBaseName, '?');
-
-			// The string returned to us is not const, so we'll terminate it
-			// at the URI point, so as to not have silly basenames
-			if(pTerm != NULL)
-				*pTerm = 0;
-
-			// no basename, just a plain url ?
-			if(*pBaseName == '/')
-				pBaseName++;
-
-			if(*pBaseName)
-				pCcf->pUrlBaseName = strdup(pBaseName);
-		}
+{	urlparts_t parts;
+	bool bIsUrl = urlParse(pUrl, &parts);
 
-		// Cleanup the regex
-		regexapi_free(pRat);
-	}
+	// The basename stops at the query, so as to not have silly basenames
+	if(bIsUrl && parts.basename.len > 0)
+		pCcf->pUrlBaseName = strndup(parts.basename.p, parts.basename.len);
 
 	return bIsUrl;
 }
@@ -348,6 +359,8 @@ void curlCfrFree(cfr_t *pCfr)
 			FREEPTR(pCfr->ccf.pHdrs[i]);
 
 		FREEPTR(pCfr->pContentType);
+		FREEPTR(pCfr->pLinkNext);
+		FREEPTR(pCfr->pCursor);
 
 		free(pCfr);
 	}
@@ -506,11 +519,119 @@ static void curlCacheFileFinalize(cfr_t *pCfr)
 	}
 }
 
+// Backend lifetime curl state. The share handle holds the DNS cache, the TLS
+// session cache, and (for libcurl >= 7.57) the connection cache, so that keep-alive
+// connections are reused across curlFetchFile, curlPut and ROM fetches.
+// Easy handles are pooled as well, because older libcurl versions keep the
+// connection cache in the easy handle. A backend is single threaded, so no
+// share locking callbacks are needed.
+static bool gCurlGlobalInit = false;
+static CURLSH *gCurlShare = NULL;
+static CURL *gCurlHandlePool[CURL_HANDLE_POOL_SIZE];
+static int gCurlHandlePoolCount = 0;
+
+static curlInitFn_t gCurlInitFn = NULL;
+
+// Set the function that is called once curl is first used by the process,
+// ie. to arrange for curlCleanup as it exits
+void curlInitFnSet(curlInitFn_t initFn)
+{
+	gCurlInitFn = initFn;
+}
+
+static CURLSH *curlShareGet(void)
+{
+	if(!gCurlGlobalInit)
+	{
+		curl_global_init(CURL_GLOBAL_ALL);
+		gCurlGlobalInit = true;
+		if(gCurlInitFn != NULL)
+			gCurlInitFn();
+	}
+
+	if(gCurlShare == NULL)
+	{
+		gCurlShare = curl_share_init();
+		if(gCurlShare != NULL)
+		{
+			curl_share_setopt(gCurlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+			curl_share_setopt(gCurlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+			curl_share_setopt(gCurlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+		}
+	}
+
+	return gCurlShare;
+}
+
+// Get an easy handle from the pool, or make a new one
+// The handle is reset, but retains it's live connections and caches
+static CURL *curlHandleGet(void)
+{	CURLSH *pShare = curlShareGet();
+	CURL *curl_handle = NULL;
+
+	if(gCurlHandlePoolCount > 0)
+	{
+		curl_handle = gCurlHandlePool[--gCurlHandlePoolCount];
+		curl_easy_reset(curl_handle);
+	}
+	else
+		curl_handle = curl_easy_init();
+
+	if(curl_handle != NULL && pShare != NULL)
+		curl_easy_setopt(curl_handle, CURLOPT_SHARE, pShare);
+
+	return curl_handle;
+}
+
+// Return an easy handle to the pool, for reuse by the next request
+static void curlHandleRelease(CURL *curl_handle)
+{
+	if(curl_handle != NULL)
+	{
+		if(gCurlHandlePoolCount < CURL_HANDLE_POOL_SIZE)
+			gCurlHandlePool[gCurlHandlePoolCount++] = curl_handle;
+		else
+			curl_easy_cleanup(curl_handle);
+	}
+}
+
+static curlWaitFn_t gCurlWaitFn = NULL;
+
+// Set the function that is called while waiting on requests in flight,
+// which may not return, ie. if the wait is cancelled
+void curlWaitFnSet(curlWaitFn_t waitFn)
+{
+	gCurlWaitFn = waitFn;
+}
+
+// Close all pooled connections, and release the backend lifetime curl state
+void curlCleanup(void)
+{
+	while(gCurlHandlePoolCount > 0)
+		curl_easy_cleanup(gCurlHandlePool[--gCurlHandlePoolCount]);
+
+	if(gCurlShare != NULL)
+	{
+		curl_share_cleanup(gCurlShare);
+		gCurlShare = NULL;
+	}
+
+	if(gCurlGlobalInit)
+	{
+		curl_global_cleanup();
+		gCurlGlobalInit = false;
+	}
+}
+
+// Returns NULL if there is no easy handle
 static CURL *curlCoreInit(const char *pUrl, void *pHeaderFn, void *pHeaderData)
-{	CURL *curl_handle = NULL;
+{	CURL *curl_handle = curlHandleGet();
+
+	if(curl_handle == NULL)
+		return NULL;
 
-	curl_global_init(CURL_GLOBAL_ALL);
-	curl_handle = curl_easy_init();
 	curl_easy_setopt(curl_handle, CURLOPT_URL, pUrl);
 
 	curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "json_fdw/1.2 (+http://github.com/nkhorman/json_fdw) libcurl-agent/1.0");
@@ -524,6 +645,8 @@ static CURL *curlCoreInit(const char *pUrl, void *pHeaderFn, void *pHeaderData)
 	curl_easy_setopt(curl_handle, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL); // maintain a post as a post on redirects
 	curl_easy_setopt(curl_handle, CURLOPT_AUTOREFERER, 1L); // turn on Refer when redirecting
 
+	curl_easy_setopt(curl_handle, CURLOPT_TCP_KEEPALIVE, 1L); // keep idle pooled connections alive
+
 	if(pHeaderFn != NULL)
 	{
 		curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, pHeaderFn);
@@ -536,6 +659,9 @@ static CURL *curlCoreInit(const char *pUrl, void *pHeaderFn, void *pHeaderData)
 static CURL *curlCoreInitGetOrPost(const char *pUrl, void *pWriteFn, void *pWriteData, void *pHeaderFn, void *pHeaderData, const char *pPostStr)
 {	CURL *curl_handle = curlCoreInit(pUrl, pHeaderFn, pHeaderData);
 
+	if(curl_handle == NULL)
+		return NULL;
+
 	if(pWriteFn != NULL)
 	{
 		curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, pWriteFn);
@@ -557,18 +683,81 @@ typedef struct _cprfc_t
 	const char *buffer; // data to send
 	size_t len; // size to send
 	size_t index; // current index into buffer where the next send operations should start from
+	bool bDeflate; // compress the data as it is sent
+	bool bDeflateEnd; // all of the compressed data has been sent
+	z_stream zs;
 }cprfc_t; // Curl Put Read Fn Callback Type
 
 static size_t curlPutReadFnCallback(char *buffer, size_t size, size_t nmemb, void *instream)
 {	cprfc_t *pCprfc = (cprfc_t *)instream;
 	size_t curl_size = nmemb * size;
-	size_t left_to_copy = pCprfc->len - pCprfc->index;
-	size_t to_copy = (left_to_copy < curl_size) ? left_to_copy : curl_size;
 
-	memcpy(buffer, &pCprfc->buffer[pCprfc->index], to_copy);
-	pCprfc->index += to_copy;
+	if(pCprfc->bDeflate)
+	{	int rc;
+
+		if(pCprfc->bDeflateEnd)
+			return 0;
+
+		// compress straight into curl's buffer, all of the input is
+		// available, so each call is a Z_FINISH with more output space
+		pCprfc->zs.next_in = (Bytef *)&pCprfc->buffer[pCprfc->index];
+		pCprfc->zs.avail_in = pCprfc->len - pCprfc->index;
+		pCprfc->zs.next_out = (Bytef *)buffer;
+		pCprfc->zs.avail_out = curl_size;
+
+		rc = deflate(&pCprfc->zs, Z_FINISH);
+		pCprfc->index = pCprfc->len - pCprfc->zs.avail_in;
+
+		if(rc == Z_STREAM_END)
+			pCprfc->bDeflateEnd = true;
+		else if(rc != Z_OK && rc != Z_BUF_ERROR)
+			return CURL_READFUNC_ABORT;
 
-	return to_copy;
+		return curl_size - pCprfc->zs.avail_out;
+	}
+	else
+	{	size_t left_to_copy = pCprfc->len - pCprfc->index;
+		size_t to_copy = (left_to_copy < curl_size) ? left_to_copy : curl_size;
+
+		memcpy(buffer, &pCprfc->buffer[pCprfc->index], to_copy);
+		pCprfc->index += to_copy;
+
+		return to_copy;
+	}
+}
+
+// Setup the request body source, and if a supported content encoding is
+// specified, the compressor that encodes the body as curl reads it
+static void curlPutBodyInit(cprfc_t *pCprfc, const char *pBuffer, size_t bufferSize, const char *pContentEncoding)
+{	int windowBits = 0;
+
+	memset(pCprfc, 0, sizeof(cprfc_t));
+	pCprfc->buffer = pBuffer;
+	pCprfc->len = bufferSize;
+
+	if(pContentEncoding != NULL && strcasecmp(pContentEncoding, "gzip") == 0)
+		windowBits = MAX_WBITS + 16; // gzip wrapper
+	else if(pContentEncoding != NULL && strcasecmp(pContentEncoding, "deflate") == 0)
+		windowBits = MAX_WBITS; // zlib wrapper
+
+	if(windowBits != 0)
+		pCprfc->bDeflate = (deflateInit2(&pCprfc->zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+}
+
+static void curlPutBodyFree(cprfc_t *pCprfc)
+{
+	if(pCprfc->bDeflate)
+	{
+		deflateEnd(&pCprfc->zs);
+		pCprfc->bDeflate = false;
+	}
+}
+
+bool curlContentEncodingSupported(const char *pContentEncoding)
+{
+	return (pContentEncoding != NULL
+		&& (strcasecmp(pContentEncoding, "gzip") == 0 || strcasecmp(pContentEncoding, "deflate") == 0)
+		);
 }
 
 static size_t curlPutHeaderFnCallback(void *buffer, size_t size, size_t nmemb, void *userp)
@@ -590,6 +779,9 @@ static size_t curlPutWriteFnCallback(void *buffer, size_t size, size_t nmemb, vo
 static CURL *curlCoreInitPut(const char *pUrl, void *pReadFn, void *pReadData, void *pHeaderFn, void *pHeaderData, size_t size)
 {	CURL *curl_handle = curlCoreInit(pUrl, pHeaderFn, pHeaderData);
 
+	if(curl_handle == NULL)
+		return NULL;
+
 	if(pReadFn != NULL)
 	{
 		curl_easy_setopt(curl_handle, CURLOPT_READFUNCTION, pReadFn);
@@ -654,21 +846,22 @@ cfr_t *curlFetchFile(const char *pUrl, const char *pHttpPostVars)
 		char *pPostStr = curlEncodeUrlCharacters(pHttpPostVars);
 		CURL *curl_handle = curlCoreInitGetOrPost(pUrl, curlWriteCallback, (void *)&pCfr->ccf, curlHeaderCallback, (void *)&pCfr->ccf, pPostStr);
 		unsigned long queryStart = 0;
+		bool bOpen = false;
 
 		pCfr->ccf.pUrlHash = curlUrlHash(pUrl, pHttpPostVars);
 		curlCacheMetaGet(&pCfr->ccf);
-		curlCacheFileOpen(&pCfr->ccf);
+		bOpen = curlCacheFileOpen(&pCfr->ccf);
 
 		// inject etag header request ?
 		// TODO;
 		//	1. don't if the actual file is missing, so that we get a new one
 		// 	2. don't if stale acording to cache-control
-		if(pCfr->ccf.pHdrs[HDR_IDX_ETAG] != NULL)
+		if(curl_handle != NULL && pCfr->ccf.pHdrs[HDR_IDX_ETAG] != NULL)
 			chunk = curlCoreInitHeader(curl_handle, chunk, "If-None-Match", pCfr->ccf.pHdrs[HDR_IDX_ETAG]);
 
 		// the file should already be open, get it
 		queryStart = GetTickCount();
-		res = curl_easy_perform(curl_handle);
+		res = (curl_handle == NULL ? CURLE_FAILED_INIT : bOpen ? curl_easy_perform(curl_handle) : CURLE_WRITE_ERROR);
 		pCfr->queryDuration = GetTickCount() - queryStart; // how long did the fetch take ?
 
 		// clean up post data
@@ -728,39 +921,596 @@ cfr_t *curlFetchFile(const char *pUrl, const char *pHttpPostVars)
 		}
 
 		// all done, cleanup
-		curl_easy_cleanup(curl_handle);
-		curl_global_cleanup();
+		curlHandleRelease(curl_handle);
 		curl_slist_free_all(chunk);
 	}
 
 	return pCfr;
 }
 
-// Put
-int curlPut(const char *pUrl, const char *pBuffer, size_t bufferSize, const char *pContentType)
-{	int ok = 0;
+// Setup a put request of the body in pCprfc, or if pMethod is
+// not NULL, a request of that method, that sends a body, ie. DELETE
+static CURL *curlCoreInitPutBody(const char *pUrl, const char *pMethod, cprfc_t *pCprfc, const char *pContentType, const char *pContentEncoding, struct curl_slist **ppChunk)
+{	CURL *curl_handle = curlCoreInitPut(pUrl, &curlPutReadFnCallback, pCprfc, NULL, NULL, pCprfc->len);
+
+	if(curl_handle == NULL)
+		return NULL;
+
+	if(pMethod != NULL && strcasecmp(pMethod, "PUT") != 0)
+		curl_easy_setopt(curl_handle, CURLOPT_CUSTOMREQUEST, pMethod);
+
+	*ppChunk = curlCoreInitHeader(curl_handle, NULL, "Content-Type", pContentType);
+
+	// the compressed size isn't known until it has been sent, so libcurl sends it chunked
+	if(pCprfc->bDeflate)
+	{
+		curl_easy_setopt(curl_handle, CURLOPT_INFILESIZE_LARGE, (curl_off_t)-1);
+		*ppChunk = curlCoreInitHeader(curl_handle, *ppChunk, "Content-Encoding", pContentEncoding);
+	}
+
+	return curl_handle;
+}
+
+// A response header to capture, of a put
+typedef struct _cprh_t
+{
+	char *pHdr; // the header name, with a trailing ':'
+	char *pValue; // must be free()'d
+}cprh_t; // Curl Put Response Header Type
 
+static size_t curlPutResponseHeaderCallback(void *contents, size_t size, size_t nmemb, void *userp)
+{	cprh_t *pCprh = (cprh_t *)userp;
+	size_t len = size * nmemb;
+
+	if(pCprh->pValue == NULL)
+		pCprh->pValue = curlHeaderCallbackMatch((const char *)contents, len, pCprh->pHdr);
+
+	return len;
+}
+
+// Put, or the request method pMethod, if not NULL
+// If pHeader is not NULL, the value of that response header is
+// returned in ppValue, or NULL if there isn't one, which the
+// caller must free()
+// Returns the http response code, or 0 if we could not communicate with the server
+unsigned long curlPutHeader(const char *pUrl, const char *pMethod, const char *pBuffer, size_t bufferSize, const char *pContentType, const char *pContentEncoding, const char *pHeader, char **ppValue)
+{	unsigned long httpResponseCode = 0;
 	CURLcode res;
-	cprfc_t cprfc = { pBuffer, bufferSize, 0 };
-	CURL *curl_handle = curlCoreInitPut(pUrl, &curlPutReadFnCallback, &cprfc, NULL, NULL, cprfc.len);
-	struct curl_slist *chunk = curlCoreInitHeader(curl_handle, NULL, "Content-Type", pContentType);
+	cprfc_t cprfc;
+	cprh_t cprh;
+	struct curl_slist *chunk = NULL;
+	CURL *curl_handle = NULL;
+
+	curlPutBodyInit(&cprfc, pBuffer, bufferSize, pContentEncoding);
+	curl_handle = curlCoreInitPutBody(pUrl, pMethod, &cprfc, pContentType, pContentEncoding, &chunk);
+
+	memset(&cprh, 0, sizeof(cprh));
+	if(curl_handle != NULL && pHeader != NULL && ppValue != NULL)
+	{
+		asprintf(&cprh.pHdr, "%s:", pHeader);
+		if(cprh.pHdr != NULL)
+		{
+			curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, &curlPutResponseHeaderCallback);
+			curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, &cprh);
+		}
+	}
 
-	res = curl_easy_perform(curl_handle);
+	res = (curl_handle != NULL ? curl_easy_perform(curl_handle) : CURLE_FAILED_INIT);
 
 	// this means that we communicated with the server
 	if(res == CURLE_OK)
-	{	unsigned long httpResponseCode = 0;
-
 		curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &httpResponseCode);
-		ok = (httpResponseCode == 200);
-	}
 
 	// all done, cleanup
-	curl_easy_cleanup(curl_handle);
-	curl_global_cleanup();
+	curlHandleRelease(curl_handle);
 	curl_slist_free_all(chunk);
+	curlPutBodyFree(&cprfc);
+	FREEPTR(cprh.pHdr);
+
+	if(ppValue != NULL)
+		*ppValue = cprh.pValue;
+	else
+		FREEPTR(cprh.pValue);
 
-	return ok;
+	return httpResponseCode;
+}
+
+// Put, or the request method pMethod, if not NULL
+// Returns the http response code, or 0 if we could not communicate with the server
+unsigned long curlPut(const char *pUrl, const char *pMethod, const char *pBuffer, size_t bufferSize, const char *pContentType, const char *pContentEncoding)
+{
+	return curlPutHeader(pUrl, pMethod, pBuffer, bufferSize, pContentType, pContentEncoding, NULL, NULL);
+}
+
+// One put request of a pipelined set
+typedef struct _cpmx_t
+{
+	struct _cpmx_t *pNext; // the other requests in flight
+	CURL *curl_handle;
+	struct curl_slist *chunk;
+	cprfc_t cprfc; // curl reads the request body from here
+	char *pBuffer; // our copy of the request body
+	unsigned long firstRow;
+	unsigned long rows;
+}cpmx_t; // Curl Put Multi Xfer Type
+
+struct _cpm_t
+{
+	CURLM *multi_handle;
+	int window; // maximum number of requests in flight
+	int inFlight; // number of requests in flight
+	cpmx_t *pXfers; // the requests in flight, so that they can be freed without waiting on them
+	bool bFailed; // the first failure is retained
+	unsigned long failedFirstRow;
+	unsigned long failedRows;
+	unsigned long failedHttpResponseCode;
+};
+
+cpm_t *curlPutMultiInit(int window)
+{	cpm_t *pCpm = calloc(1, sizeof(cpm_t));
+
+	if(pCpm != NULL)
+	{
+		curlShareGet();
+		pCpm->multi_handle = curl_multi_init();
+		pCpm->window = (window > 0 ? window : 1);
+
+		if(pCpm->multi_handle == NULL)
+			FREEPTR(pCpm);
+	}
+
+	return pCpm;
+}
+
+static void curlPutMultiXferFree(cpmx_t *pCpmx)
+{
+	if(pCpmx != NULL)
+	{
+		curlHandleRelease(pCpmx->curl_handle);
+		curl_slist_free_all(pCpmx->chunk);
+		curlPutBodyFree(&pCpmx->cprfc);
+		FREEPTR(pCpmx->pBuffer);
+		free(pCpmx);
+	}
+}
+
+// Remove a request from the list of those in flight
+static void curlPutMultiXferUnlink(cpm_t *pCpm, cpmx_t *pCpmx)
+{	cpmx_t **ppCpmx = &pCpm->pXfers;
+
+	while(*ppCpmx != NULL && *ppCpmx != pCpmx)
+		ppCpmx = &(*ppCpmx)->pNext;
+
+	if(*ppCpmx != NULL)
+		*ppCpmx = pCpmx->pNext;
+}
+
+// Collect the results of completed requests, and free them
+static void curlPutMultiInfoRead(cpm_t *pCpm)
+{	CURLMsg *pMsg = NULL;
+	int msgsLeft = 0;
+
+	while((pMsg = curl_multi_info_read(pCpm->multi_handle, &msgsLeft)) != NULL)
+	{
+		if(pMsg->msg == CURLMSG_DONE)
+		{	CURL *curl_handle = pMsg->easy_handle;
+			cpmx_t *pCpmx = NULL;
+			unsigned long httpResponseCode = 0;
+
+			curl_easy_getinfo(curl_handle, CURLINFO_PRIVATE, (char **)&pCpmx);
+			if(pMsg->data.result == CURLE_OK)
+				curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &httpResponseCode);
+
+			if(!CURL_HTTP_OK(httpResponseCode) && !pCpm->bFailed)
+			{
+				pCpm->bFailed = true;
+				pCpm->failedFirstRow = pCpmx->firstRow;
+				pCpm->failedRows = pCpmx->rows;
+				pCpm->failedHttpResponseCode = httpResponseCode;
+			}
+
+			curl_multi_remove_handle(pCpm->multi_handle, curl_handle);
+			curlPutMultiXferUnlink(pCpm, pCpmx);
+			curlPutMultiXferFree(pCpmx);
+			pCpm->inFlight--;
+		}
+	}
+}
+
+// Drive the requests in flight, reap the completed ones
+// and if bWait, wait until at least one completes
+void curlPutMultiReap(cpm_t *pCpm, bool bWait)
+{
+	if(pCpm != NULL)
+	{	int running = 0;
+		int inFlight = pCpm->inFlight;
+
+		curl_multi_perform(pCpm->multi_handle, &running);
+		curlPutMultiInfoRead(pCpm);
+
+		while(bWait && pCpm->inFlight > 0 && pCpm->inFlight == inFlight)
+		{
+			if(gCurlWaitFn != NULL)
+				gCurlWaitFn();
+			curl_multi_wait(pCpm->multi_handle, NULL, 0, 1000, NULL);
+			curl_multi_perform(pCpm->multi_handle, &running);
+			curlPutMultiInfoRead(pCpm);
+		}
+	}
+}
+
+// Queue a put request, after waiting for room in the window
+// The buffer is copied, so the caller may reuse it on return
+void curlPutMultiAdd(cpm_t *pCpm, const char *pUrl, const char *pMethod, const char *pBuffer, size_t bufferSize, const char *pContentType
+	, const char *pContentEncoding, unsigned long firstRow, unsigned long rows)
+{	cpmx_t *pCpmx = NULL;
+
+	// the window is full, so wait for a request to complete, and reap it
+	if(pCpm->inFlight >= pCpm->window)
+		curlPutMultiReap(pCpm, true);
+
+	pCpmx = calloc(1, sizeof(cpmx_t));
+	if(pCpmx != NULL)
+	{
+		pCpmx->pBuffer = malloc(bufferSize > 0 ? bufferSize : 1);
+		if(pCpmx->pBuffer != NULL)
+			memcpy(pCpmx->pBuffer, pBuffer, bufferSize);
+		curlPutBodyInit(&pCpmx->cprfc, pCpmx->pBuffer, bufferSize, pContentEncoding);
+		pCpmx->firstRow = firstRow;
+		pCpmx->rows = rows;
+
+		pCpmx->curl_handle = curlCoreInitPutBody(pUrl, pMethod, &pCpmx->cprfc, pContentType, pContentEncoding, &pCpmx->chunk);
+		if(pCpmx->curl_handle != NULL)
+			curl_easy_setopt(pCpmx->curl_handle, CURLOPT_PRIVATE, pCpmx);
+
+		if(pCpmx->curl_handle != NULL && pCpmx->pBuffer != NULL && curl_multi_add_handle(pCpm->multi_handle, pCpmx->curl_handle) == CURLM_OK)
+		{
+			pCpmx->pNext = pCpm->pXfers;
+			pCpm->pXfers = pCpmx;
+			pCpm->inFlight++;
+		}
+		else
+		{	// treat it as a failed request
+			if(!pCpm->bFailed)
+			{
+				pCpm->bFailed = true;
+				pCpm->failedFirstRow = firstRow;
+				pCpm->failedRows = rows;
+				pCpm->failedHttpResponseCode = 0;
+			}
+			curlPutMultiXferFree(pCpmx);
+		}
+	}
+
+	// get things moving, without blocking
+	curlPutMultiReap(pCpm, false);
+}
+
+// Wait for all of the requests in flight to complete
+void curlPutMultiFinish(cpm_t *pCpm)
+{
+	while(pCpm != NULL && pCpm->inFlight > 0)
+		curlPutMultiReap(pCpm, true);
+}
+
+// Report the first failed request, if any
+bool curlPutMultiFailed(cpm_t *pCpm, unsigned long *pFirstRow, unsigned long *pRows, unsigned long *pHttpResponseCode)
+{
+	if(pCpm != NULL && pCpm->bFailed)
+	{
+		*pFirstRow = pCpm->failedFirstRow;
+		*pRows = pCpm->failedRows;
+		*pHttpResponseCode = pCpm->failedHttpResponseCode;
+	}
+
+	return (pCpm != NULL && pCpm->bFailed);
+}
+
+// Abandon any requests still in flight, and free everything
+// Doesn't wait on the server, so it may be called by an abort
+void curlPutMultiFree(cpm_t *pCpm)
+{
+	if(pCpm != NULL)
+	{
+		curlPutMultiInfoRead(pCpm);
+		while(pCpm->pXfers != NULL)
+		{	cpmx_t *pCpmx = pCpm->pXfers;
+
+			pCpm->pXfers = pCpmx->pNext;
+			curl_multi_remove_handle(pCpm->multi_handle, pCpmx->curl_handle);
+			curlPutMultiXferFree(pCpmx);
+		}
+		pCpm->inFlight = 0;
+		curl_multi_cleanup(pCpm->multi_handle);
+		free(pCpm);
+	}
+}
+
+typedef struct _cmfx_t
+{
+	struct _cmfx_t *pNext;
+	CURL *curl_handle;
+	cfr_t *pCfr;
+	int id;
+	bool bDone;
+	char *pCursorHeader; // name of a response header to capture
+}cmfx_t; // Curl Multi Fetch Xfer Type
+
+struct _cmf_t
+{
+	CURLM *multi_handle;
+	cmfx_t *pXfers; // transfers in flight, or done, but not yet waited for
+};
+
+cmf_t *curlMultiFetchInit(void)
+{	cmf_t *pCmf = calloc(1, sizeof(cmf_t));
+
+	if(pCmf != NULL)
+	{
+		curlShareGet();
+		pCmf->multi_handle = curl_multi_init();
+
+		if(pCmf->multi_handle == NULL)
+			FREEPTR(pCmf);
+	}
+
+	return pCmf;
+}
+
+// The target of a Link header entry with rel="next", or NULL
+// ie. 'Link: <http://host/x?page=2>; rel="next", <http://host/x?page=9>; rel="last"'
+static char *curlLinkNext(const char *pLink)
+{	char *pNext = NULL;
+
+	while(pNext == NULL && pLink != NULL && (pLink = strchr(pLink, '<')) != NULL)
+	{	const char *pr = strchr(pLink, '>');
+		const char *pEnd = (pr != NULL ? strchr(pr, ',') : NULL);
+		const char *pRel = (pr != NULL ? strstr(pr, "rel=") : NULL);
+
+		if(pr == NULL)
+			break;
+
+		if(pRel != NULL && (pEnd == NULL || pRel < pEnd))
+		{
+			pRel += 4;
+			if(*pRel == '"')
+				pRel++;
+			if(strncasecmp(pRel, "next", 4) == 0 && (pRel[4] == '"' || pRel[4] == ';' || pRel[4] == ',' || pRel[4] == ' ' || pRel[4] == 0))
+				asprintf(&pNext, "%.*s", (int)(pr - pLink - 1), pLink + 1);
+		}
+
+		pLink = pEnd;
+	}
+
+	return pNext;
+}
+
+// Callback from CURL for header examination of a page
+// Collect the paging headers, the Link header, and the cursor header
+static size_t curlMultiFetchHeaderCallback(void *contents, size_t size, size_t nmemb, void *userp)
+{	cmfx_t *pCmfx = (cmfx_t *)userp;
+	size_t len = size * nmemb;
+	char *pHdrVal = curlHeaderCallbackMatch((const char *)contents, len, "Link:");
+
+	if(pHdrVal != NULL)
+	{
+		if(pCmfx->pCfr->pLinkNext == NULL)
+			pCmfx->pCfr->pLinkNext = curlLinkNext(pHdrVal);
+		free(pHdrVal);
+	}
+	else if(pCmfx->pCursorHeader != NULL
+		&& (pHdrVal = curlHeaderCallbackMatch((const char *)contents, len, pCmfx->pCursorHeader)) != NULL
+		)
+	{
+		FREEPTR(pCmfx->pCfr->pCursor);
+		pCmfx->pCfr->pCursor = pHdrVal;
+	}
+
+	return len;
+}
+
+static void curlMultiFetchXferFree(cmf_t *pCmf, cmfx_t *pCmfx)
+{
+	if(pCmfx != NULL)
+	{
+		curl_multi_remove_handle(pCmf->multi_handle, pCmfx->curl_handle);
+		curlHandleRelease(pCmfx->curl_handle);
+		curlCfrFree(pCmfx->pCfr);
+		FREEPTR(pCmfx->pCursorHeader);
+		free(pCmfx);
+	}
+}
+
+// Start fetching pUrl into a temporary file, identified by id
+// If pCursorHeader is not NULL, that response header is captured
+// The fetched file is not cached, it is removed by curlCfrFree
+bool curlMultiFetchAdd(cmf_t *pCmf, const char *pUrl, int id, const char *pCursorHeader)
+{	cmfx_t *pCmfx = (pCmf != NULL ? calloc(1, sizeof(cmfx_t)) : NULL);
+	bool bOk = false;
+
+	if(pCmfx != NULL)
+	{
+		pCmfx->id = id;
+		pCmfx->pCfr = calloc(1, sizeof(cfr_t));
+		if(pCursorHeader != NULL && *pCursorHeader)
+			asprintf(&pCmfx->pCursorHeader, "%s:", pCursorHeader);
+
+		if(pCmfx->pCfr != NULL)
+		{
+			pCmfx->pCfr->ccf.pUrlHash = curlUrlHash(pUrl, NULL);
+			curlCacheFileOpen(&pCmfx->pCfr->ccf);
+			FREEPTR(pCmfx->pCfr->ccf.pFileName);
+		}
+
+		if(pCmfx->pCfr != NULL && pCmfx->pCfr->ccf.pFile != NULL)
+		{
+			pCmfx->curl_handle = curlCoreInitGetOrPost(pUrl, curlWriteCallback, (void *)&pCmfx->pCfr->ccf, curlMultiFetchHeaderCallback, pCmfx, NULL);
+			if(pCmfx->curl_handle != NULL)
+				curl_easy_setopt(pCmfx->curl_handle, CURLOPT_PRIVATE, pCmfx);
+
+			bOk = (pCmfx->curl_handle != NULL && curl_multi_add_handle(pCmf->multi_handle, pCmfx->curl_handle) == CURLM_OK);
+		}
+
+		if(bOk)
+		{
+			pCmfx->pNext = pCmf->pXfers;
+			pCmf->pXfers = pCmfx;
+		}
+		else
+		{
+			curlHandleRelease(pCmfx->curl_handle);
+			pCmfx->curl_handle = NULL;
+			curlCfrFree(pCmfx->pCfr);
+			FREEPTR(pCmfx->pCursorHeader);
+			free(pCmfx);
+		}
+	}
+
+	return bOk;
+}
+
+// Mark the completed transfers as done
+static void curlMultiFetchInfoRead(cmf_t *pCmf)
+{	CURLMsg *pMsg = NULL;
+	int msgsLeft = 0;
+
+	while((pMsg = curl_multi_info_read(pCmf->multi_handle, &msgsLeft)) != NULL)
+	{
+		if(pMsg->msg == CURLMSG_DONE)
+		{	cmfx_t *pCmfx = NULL;
+			cfr_t *pCfr = NULL;
+
+			curl_easy_getinfo(pMsg->easy_handle, CURLINFO_PRIVATE, (char **)&pCmfx);
+			pCfr = pCmfx->pCfr;
+			pCmfx->bDone = true;
+			curlCfrClose(pCfr);
+
+			if(pMsg->data.result == CURLE_OK)
+			{	char *pContentType = NULL;
+
+				curl_easy_getinfo(pMsg->easy_handle, CURLINFO_RESPONSE_CODE, &pCfr->httpResponseCode);
+				curl_easy_getinfo(pMsg->easy_handle, CURLINFO_CONTENT_TYPE, &pContentType);
+				if(pContentType != NULL)
+					pCfr->pContentType = strdup(pContentType);
+
+				// a relative next link, is relative to the origin of this page
+				if(pCfr->pLinkNext != NULL && *pCfr->pLinkNext == '/')
+				{	char *pEffectiveUrl = NULL;
+					const char *pHost = NULL;
+
+					curl_easy_getinfo(pMsg->easy_handle, CURLINFO_EFFECTIVE_URL, &pEffectiveUrl);
+					pHost = (pEffectiveUrl != NULL ? strstr(pEffectiveUrl, "://") : NULL);
+					if(pHost != NULL)
+					{	const char *pPath = strchr(pHost + 3, '/');
+						int originLen = (pPath != NULL ? pPath - pEffectiveUrl : strlen(pEffectiveUrl));
+						char *pLinkNext = NULL;
+
+						asprintf(&pLinkNext, "%.*s%s", originLen, pEffectiveUrl, pCfr->pLinkNext);
+						free(pCfr->pLinkNext);
+						pCfr->pLinkNext = pLinkNext;
+					}
+				}
+			}
+
+			pCfr->bFileFetched = (pCfr->httpResponseCode == 200);
+			if(pCfr->bFileFetched)
+			{
+				// a gzip'd page gets a name that the file handlers recognize
+				if(pCfr->pContentType != NULL && strcasecmp(pCfr->pContentType, "application/x-gzip") == 0)
+					asprintf(&pCfr->ccf.pFileName, "%s.gz", pCfr->ccf.pFileNameTmp);
+				else
+					pCfr->ccf.pFileName = strdup(pCfr->ccf.pFileNameTmp);
+
+				if(pCfr->ccf.pFileName != NULL && strcmp(pCfr->ccf.pFileName, pCfr->ccf.pFileNameTmp) != 0)
+				{
+					rename(pCfr->ccf.pFileNameTmp, pCfr->ccf.pFileName);
+					FREEPTR(pCfr->ccf.pFileNameTmp);
+					pCfr->ccf.pFileNameTmp = strdup(pCfr->ccf.pFileName);
+				}
+			}
+		}
+	}
+}
+
+// Wait for the fetch identified by id to complete, while the others
+// carry on. The caller owns the result, and must curlCfrFree it.
+// Returns NULL if there is no such fetch.
+cfr_t *curlMultiFetchWait(cmf_t *pCmf, int id)
+{	cmfx_t **ppCmfx = (pCmf != NULL ? &pCmf->pXfers : NULL);
+	cfr_t *pCfr = NULL;
+
+	while(ppCmfx != NULL && *ppCmfx != NULL && (*ppCmfx)->id != id)
+		ppCmfx = &(*ppCmfx)->pNext;
+
+	if(ppCmfx != NULL && *ppCmfx != NULL)
+	{	cmfx_t *pCmfx = *ppCmfx;
+		int running = 0;
+		unsigned long queryStart = GetTickCount();
+
+		curl_multi_perform(pCmf->multi_handle, &running);
+		curlMultiFetchInfoRead(pCmf);
+		while(!pCmfx->bDone)
+		{
+			if(gCurlWaitFn != NULL)
+				gCurlWaitFn();
+			curl_multi_wait(pCmf->multi_handle, NULL, 0, 1000, NULL);
+			curl_multi_perform(pCmf->multi_handle, &running);
+			curlMultiFetchInfoRead(pCmf);
+		}
+
+		// hand the result over to the caller
+		*ppCmfx = pCmfx->pNext;
+		pCfr = pCmfx->pCfr;
+		pCfr->queryDuration = GetTickCount() - queryStart; // how long did we wait ?
+		pCmfx->pCfr = NULL;
+		curlMultiFetchXferFree(pCmf, pCmfx);
+	}
+
+	return pCfr;
+}
+
+// Abandon the fetch identified by id, whether it is in flight, or done,
+// but not yet waited for. Does nothing if there is no such fetch.
+void curlMultiFetchCancel(cmf_t *pCmf, int id)
+{	cmfx_t **ppCmfx = (pCmf != NULL ? &pCmf->pXfers : NULL);
+
+	while(ppCmfx != NULL && *ppCmfx != NULL && (*ppCmfx)->id != id)
+		ppCmfx = &(*ppCmfx)->pNext;
+
+	if(ppCmfx != NULL && *ppCmfx != NULL)
+	{	cmfx_t *pCmfx = *ppCmfx;
+
+		*ppCmfx = pCmfx->pNext;
+		curlMultiFetchXferFree(pCmf, pCmfx);
+	}
+}
+
+// Let the fetches in flight progress, without waiting
+void curlMultiFetchPoll(cmf_t *pCmf)
+{
+	if(pCmf != NULL)
+	{	int running = 0;
+
+		curl_multi_perform(pCmf->multi_handle, &running);
+		curlMultiFetchInfoRead(pCmf);
+	}
+}
+
+// Abandon any fetches still in flight, and free everything
+void curlMultiFetchFree(cmf_t *pCmf)
+{
+	if(pCmf != NULL)
+	{
+		while(pCmf->pXfers != NULL)
+		{	cmfx_t *pCmfx = pCmf->pXfers;
+
+			pCmf->pXfers = pCmfx->pNext;
+			curlMultiFetchXferFree(pCmf, pCmfx);
+		}
+
+		curl_multi_cleanup(pCmf->multi_handle);
+		free(pCmf);
+	}
 }
 
 #ifdef _CURL_UNIT_TEST
@@ -823,7 +1573,7 @@ void test2(int argc, char **argv)
 	i++;
 	pBuffer = (argc >= i ? argv[i] : NULL);
 
-	ok = curlPut(pUrl, pBuffer, strlen(pBuffer), "application/json");
+	ok = CURL_HTTP_OK(curlPut(pUrl, NULL, pBuffer, strlen(pBuffer), "application/json", NULL));
 
 	printf("'%s' --> '%s' == %s\n", pUrl, pBuffer, (ok ? "OK" : "FAIL"));
 }
@@ -870,6 +1620,8 @@ int main(int argc, char **argv)
 			i++;
 	}
 
+	curlCleanup();
+
 	return 0;
 }
 #endif
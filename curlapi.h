@@ -61,13 +61,50 @@ typedef struct _cfr_t
 	unsigned long httpResponseCode;
 	char *pContentType;
 	unsigned long queryDuration;
+	char *pLinkNext; // target of a "Link: <...>; rel=next" header, pages only
+	char *pCursor; // value of the cursor header, pages only
 } cfr_t; // "CurlFetchResult_Type"
 
 cfr_t *curlFetchFile(const char *pUrl, const char *pHttpPostVars);
 void curlPost(const char *pUrl, const char *pHttpPostVars);
 void curlCfrFree(cfr_t *pCfr);
 
-int curlPut(const char *pUrl, const char *pBuffer, size_t bufferSize, const char *pContentType);
+// Any 2xx http response code is a success
+#define CURL_HTTP_OK(code) ((code) >= 200 && (code) < 300)
+
+unsigned long curlPut(const char *pUrl, const char *pMethod, const char *pBuffer, size_t bufferSize, const char *pContentType, const char *pContentEncoding);
+unsigned long curlPutHeader(const char *pUrl, const char *pMethod, const char *pBuffer, size_t bufferSize, const char *pContentType, const char *pContentEncoding, const char *pHeader, char **ppValue);
+bool curlContentEncodingSupported(const char *pContentEncoding);
+void curlCleanup(void);
+
+// Called once curl is first used by the process
+typedef void (*curlInitFn_t)(void);
+void curlInitFnSet(curlInitFn_t initFn);
+
+// Called while waiting on requests in flight, so that a wait can be cancelled
+typedef void (*curlWaitFn_t)(void);
+void curlWaitFnSet(curlWaitFn_t waitFn);
+
+// Pipelined put requests, with a bounded number of requests in flight
+typedef struct _cpm_t cpm_t; // Curl Put Multi Type
+
+cpm_t *curlPutMultiInit(int window);
+void curlPutMultiAdd(cpm_t *pCpm, const char *pUrl, const char *pMethod, const char *pBuffer, size_t bufferSize, const char *pContentType
+	, const char *pContentEncoding, unsigned long firstRow, unsigned long rows);
+void curlPutMultiReap(cpm_t *pCpm, bool bWait);
+void curlPutMultiFinish(cpm_t *pCpm);
+bool curlPutMultiFailed(cpm_t *pCpm, unsigned long *pFirstRow, unsigned long *pRows, unsigned long *pHttpResponseCode);
+void curlPutMultiFree(cpm_t *pCpm); // doesn't wait, so may be called by an abort
+
+// Concurrent fetches, ie. pages, into temporary files
+typedef struct _cmf_t cmf_t; // Curl Multi Fetch Type
+
+cmf_t *curlMultiFetchInit(void);
+bool curlMultiFetchAdd(cmf_t *pCmf, const char *pUrl, int id, const char *pCursorHeader);
+cfr_t *curlMultiFetchWait(cmf_t *pCmf, int id);
+void curlMultiFetchPoll(cmf_t *pCmf);
+void curlMultiFetchCancel(cmf_t *pCmf, int id);
+void curlMultiFetchFree(cmf_t *pCmf);
 
 #ifdef DEBUG_WLOGIT
 void curlLogItSet(void (*pfn)(const char *));
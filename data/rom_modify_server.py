@@ -0,0 +1,61 @@
+#
+# Serves the files of the current directory, and logs the method, path and
+# body of each put and delete request as a line of the log file, with the
+# line ends of the body as \n, answering that it changed one row, ie.
+#
+#     python3 rom_modify_server.py 8766 /tmp/rom_modify.log
+#
+# A compressed body is decoded, and logged after its encoding, and how it was
+# sent, ie. (gzip, chunked). One that can't be decoded is refused.
+#
+import http.server
+import sys
+import zlib
+
+port = int(sys.argv[1])
+log = sys.argv[2]
+
+open(log, 'wb').close()
+
+
+class Handler(http.server.SimpleHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+
+    def read_chunked(self):
+        body = b''
+        while True:
+            size = int(self.rfile.readline().split(b';')[0], 16)
+            if size == 0:
+                while self.rfile.readline() not in (b'\r\n', b'\n', b''):
+                    pass
+                return body
+            body += self.rfile.read(size)
+            self.rfile.readline()
+
+    def do_PUT(self):
+        chunked = (self.headers.get('Transfer-Encoding', '').lower() == 'chunked')
+        encoding = self.headers.get('Content-Encoding')
+        body = (self.read_chunked() if chunked else self.rfile.read(int(self.headers.get('Content-Length', 0))))
+        status = 200
+        if encoding is not None:
+            try:
+                # gzip, or deflate, ie. zlib
+                body = zlib.decompress(body, 16 + zlib.MAX_WBITS if encoding == 'gzip' else zlib.MAX_WBITS)
+            except zlib.error:
+                body = b'undecodable'
+                status = 400
+            body = ('(%s%s) ' % (encoding, ', chunked' if chunked else '')).encode() + body
+        with open(log, 'ab') as f:
+            f.write(self.command.encode() + b' ' + self.path.encode() + (b' ' + body.replace(b'\n', b'\\n') if body else b'') + b'\n')
+        self.send_response(status)
+        self.send_header('X-Rows-Changed', '1')
+        self.send_header('Content-Length', '0')
+        self.end_headers()
+
+    do_DELETE = do_PUT
+
+    def log_message(self, *args):
+        pass
+
+
+http.server.HTTPServer(('127.0.0.1', port), Handler).serve_forever()
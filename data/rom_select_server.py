@@ -0,0 +1,43 @@
+#
+# Serves the files of the current directory, and a page of the rows of a
+# file, one a line, for a request with an offset url parameter, of limit
+# rows, ie.
+#
+#     python3 rom_select_server.py 8765
+#
+# answers /data.json?offset=3&limit=3 with the fourth to sixth lines of
+# data.json.
+#
+import http.server
+import os
+import sys
+import urllib.parse
+
+port = int(sys.argv[1])
+
+
+class Handler(http.server.SimpleHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+
+    def do_GET(self):
+        url = urllib.parse.urlsplit(self.path)
+        query = urllib.parse.parse_qs(url.query)
+        path = self.translate_path(url.path)
+        if 'offset' not in query or not os.path.isfile(path):
+            return super().do_GET()
+
+        offset = int(query['offset'][0])
+        limit = int(query.get('limit', ['1000'])[0])
+        with open(path, 'rb') as f:
+            body = b''.join(f.readlines()[offset:offset + limit])
+        self.send_response(200)
+        self.send_header('Content-Type', 'application/json')
+        self.send_header('Content-Length', str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, *args):
+        pass
+
+
+http.server.HTTPServer(('127.0.0.1', port), Handler).serve_forever()
@@ -0,0 +1,19 @@
+/* contrib/json_fdw/json_fdw--1.0--1.1.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION json_fdw UPDATE TO '1.1'" to load this file. \quit
+
+-- What ANALYZE measured of each foreign table, for costing its scans
+CREATE TABLE json_fdw_stats
+(
+	relid oid PRIMARY KEY,
+	rows float8 NOT NULL,			-- rows read
+	sources int NOT NULL,			-- files and urls read
+	file_bytes float8 NOT NULL,		-- bytes of the files, as stored or fetched, ie. compressed
+	bytes_per_row float8 NOT NULL,		-- uncompressed bytes per row
+	compression_ratio float8 NOT NULL,	-- uncompressed bytes per stored byte
+	parse_usec_per_row float8 NOT NULL,	-- time to read, parse and convert a row
+	analyzed timestamptz NOT NULL DEFAULT now()
+);
+
+GRANT SELECT ON json_fdw_stats TO PUBLIC;
@@ -0,0 +1,11 @@
+/* contrib/json_fdw/json_fdw--1.2--1.3.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION json_fdw UPDATE TO '1.3'" to load this file. \quit
+
+-- The CREATE FOREIGN TABLE of a json source, from the keys of its first rows
+CREATE FUNCTION json_fdw_infer_schema(source text, sample_rows int DEFAULT 1000,
+	table_name text DEFAULT NULL, server_name text DEFAULT 'json_server')
+RETURNS text
+AS 'MODULE_PATHNAME'
+LANGUAGE C VOLATILE;
@@ -0,0 +1,71 @@
+/* contrib/json_fdw/json_fdw--1.2.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION json_fdw" to load this file. \quit
+
+CREATE FUNCTION json_fdw_handler()
+RETURNS fdw_handler
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION json_fdw_validator(text[], oid)
+RETURNS void
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE FOREIGN DATA WRAPPER json_fdw
+  HANDLER json_fdw_handler
+  VALIDATOR json_fdw_validator;
+
+-- What ANALYZE measured of each foreign table, for costing its scans
+CREATE TABLE json_fdw_stats
+(
+	relid oid PRIMARY KEY,
+	rows float8 NOT NULL,			-- rows read
+	sources int NOT NULL,			-- files and urls read
+	file_bytes float8 NOT NULL,		-- bytes of the files, as stored or fetched, ie. compressed
+	bytes_per_row float8 NOT NULL,		-- uncompressed bytes per row
+	compression_ratio float8 NOT NULL,	-- uncompressed bytes per stored byte
+	parse_usec_per_row float8 NOT NULL,	-- time to read, parse and convert a row
+	analyzed timestamptz NOT NULL DEFAULT now()
+);
+
+GRANT SELECT ON json_fdw_stats TO PUBLIC;
+
+-- What ANALYZE found of each json key, mapped to a column or not, over the sampled rows
+CREATE TABLE json_fdw_key_stats
+(
+	relid oid NOT NULL,
+	key text NOT NULL,			-- dotted path of the key, ie. "review.rating"
+	mapped bool NOT NULL,			-- a column of the table reads the key
+	present_frac float8 NOT NULL,		-- rows the key is in
+	null_frac float8 NOT NULL,		-- rows by the json type of its value
+	string_frac float8 NOT NULL,
+	number_frac float8 NOT NULL,
+	boolean_frac float8 NOT NULL,
+	object_frac float8 NOT NULL,
+	array_frac float8 NOT NULL,
+	PRIMARY KEY (relid, key)
+);
+
+GRANT SELECT ON json_fdw_key_stats TO PUBLIC;
+
+-- The keys that no column reads, with the column that would
+CREATE VIEW json_fdw_key_suggestions AS
+	SELECT relid::regclass AS foreign_table, key, present_frac, suggested_type,
+		format('ALTER FOREIGN TABLE %s ADD COLUMN %I %s;', relid::regclass, key, suggested_type) AS ddl
+	FROM
+	(
+		SELECT relid, key, present_frac,
+			CASE
+				WHEN array_frac > 0 AND string_frac + number_frac + boolean_frac = 0 THEN 'text[]'
+				WHEN number_frac > 0 AND string_frac + boolean_frac + array_frac = 0 THEN 'numeric'
+				WHEN boolean_frac > 0 AND string_frac + number_frac + array_frac = 0 THEN 'boolean'
+				ELSE 'text'
+			END AS suggested_type
+		FROM json_fdw_key_stats
+		WHERE NOT mapped AND string_frac + number_frac + boolean_frac + array_frac > 0
+	) AS keys
+	ORDER BY relid, present_frac DESC, key;
+
+GRANT SELECT ON json_fdw_key_suggestions TO PUBLIC;
@@ -0,0 +1,171 @@
+/* contrib/json_fdw/json_fdw--1.4.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION json_fdw" to load this file. \quit
+
+CREATE FUNCTION json_fdw_handler()
+RETURNS fdw_handler
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION json_fdw_validator(text[], oid)
+RETURNS void
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT;
+
+CREATE FOREIGN DATA WRAPPER json_fdw
+  HANDLER json_fdw_handler
+  VALIDATOR json_fdw_validator;
+
+-- What ANALYZE measured of each foreign table, for costing its scans
+CREATE TABLE json_fdw_stats
+(
+	relid oid PRIMARY KEY,
+	rows float8 NOT NULL,			-- rows read
+	sources int NOT NULL,			-- files and urls read
+	file_bytes float8 NOT NULL,		-- bytes of the files, as stored or fetched, ie. compressed
+	bytes_per_row float8 NOT NULL,		-- uncompressed bytes per row
+	compression_ratio float8 NOT NULL,	-- uncompressed bytes per stored byte
+	parse_usec_per_row float8 NOT NULL,	-- time to read, parse and convert a row
+	analyzed timestamptz NOT NULL DEFAULT now()
+);
+
+GRANT SELECT ON json_fdw_stats TO PUBLIC;
+
+-- What ANALYZE found of each json key, mapped to a column or not, over the sampled rows
+CREATE TABLE json_fdw_key_stats
+(
+	relid oid NOT NULL,
+	key text NOT NULL,			-- dotted path of the key, ie. "review.rating"
+	mapped bool NOT NULL,			-- a column of the table reads the key
+	present_frac float8 NOT NULL,		-- rows the key is in
+	null_frac float8 NOT NULL,		-- rows by the json type of its value
+	string_frac float8 NOT NULL,
+	number_frac float8 NOT NULL,
+	boolean_frac float8 NOT NULL,
+	object_frac float8 NOT NULL,
+	array_frac float8 NOT NULL,
+	PRIMARY KEY (relid, key)
+);
+
+GRANT SELECT ON json_fdw_key_stats TO PUBLIC;
+
+-- The keys that no column reads, with the column that would
+CREATE VIEW json_fdw_key_suggestions AS
+	SELECT relid::regclass AS foreign_table, key, present_frac, suggested_type,
+		format('ALTER FOREIGN TABLE %s ADD COLUMN %I %s;', relid::regclass, key, suggested_type) AS ddl
+	FROM
+	(
+		SELECT relid, key, present_frac,
+			CASE
+				WHEN array_frac > 0 AND string_frac + number_frac + boolean_frac = 0 THEN 'text[]'
+				WHEN number_frac > 0 AND string_frac + boolean_frac + array_frac = 0 THEN 'numeric'
+				WHEN boolean_frac > 0 AND string_frac + number_frac + array_frac = 0 THEN 'boolean'
+				ELSE 'text'
+			END AS suggested_type
+		FROM json_fdw_key_stats
+		WHERE NOT mapped AND string_frac + number_frac + boolean_frac + array_frac > 0
+	) AS keys
+	ORDER BY relid, present_frac DESC, key;
+
+GRANT SELECT ON json_fdw_key_suggestions TO PUBLIC;
+
+-- The CREATE FOREIGN TABLE of a json source, from the keys of its first rows
+CREATE FUNCTION json_fdw_infer_schema(source text, sample_rows int DEFAULT 1000,
+	table_name text DEFAULT NULL, server_name text DEFAULT 'json_server')
+RETURNS text
+AS 'MODULE_PATHNAME'
+LANGUAGE C VOLATILE;
+
+-- Replaces the stats of a foreign table, and of its keys if they are given,
+-- for ANALYZE run by the owner of the table, who may not write the tables
+CREATE FUNCTION json_fdw_stats_put(relid oid, rows float8, sources int,
+	file_bytes float8, bytes_per_row float8, compression_ratio float8,
+	parse_usec_per_row float8, keys text[], mapped bool[],
+	present_frac float8[], null_frac float8[], string_frac float8[],
+	number_frac float8[], boolean_frac float8[], object_frac float8[],
+	array_frac float8[])
+RETURNS void
+LANGUAGE plpgsql VOLATILE SECURITY DEFINER
+SET search_path = pg_catalog, pg_temp
+AS $$
+DECLARE
+	stats_table text;
+	key_stats_table text;
+BEGIN
+	IF NOT EXISTS (SELECT 1 FROM pg_class c
+		WHERE c.oid = json_fdw_stats_put.relid AND c.relkind = 'f'
+		AND pg_has_role(session_user, c.relowner, 'USAGE'))
+	THEN
+		RAISE EXCEPTION 'must be owner of foreign table %', json_fdw_stats_put.relid::regclass;
+	END IF;
+
+	-- the tables of the extension, wherever it has been moved to
+	SELECT format('%I.%I', n.nspname, c.relname) INTO stats_table
+		FROM pg_extension e
+		JOIN pg_depend d ON d.refclassid = 'pg_extension'::regclass AND d.refobjid = e.oid
+			AND d.deptype = 'e' AND d.classid = 'pg_class'::regclass
+		JOIN pg_class c ON c.oid = d.objid AND c.relname = 'json_fdw_stats'
+		JOIN pg_namespace n ON n.oid = c.relnamespace
+		WHERE e.extname = 'json_fdw';
+	SELECT format('%I.%I', n.nspname, c.relname) INTO key_stats_table
+		FROM pg_extension e
+		JOIN pg_depend d ON d.refclassid = 'pg_extension'::regclass AND d.refobjid = e.oid
+			AND d.deptype = 'e' AND d.classid = 'pg_class'::regclass
+		JOIN pg_class c ON c.oid = d.objid AND c.relname = 'json_fdw_key_stats'
+		JOIN pg_namespace n ON n.oid = c.relnamespace
+		WHERE e.extname = 'json_fdw';
+
+	EXECUTE format('DELETE FROM %s WHERE relid = $1', stats_table)
+		USING json_fdw_stats_put.relid;
+	EXECUTE format('INSERT INTO %s (relid, rows, sources, file_bytes, bytes_per_row,'
+		' compression_ratio, parse_usec_per_row) VALUES ($1, $2, $3, $4, $5, $6, $7)', stats_table)
+		USING json_fdw_stats_put.relid, json_fdw_stats_put.rows, json_fdw_stats_put.sources,
+			json_fdw_stats_put.file_bytes, json_fdw_stats_put.bytes_per_row,
+			json_fdw_stats_put.compression_ratio, json_fdw_stats_put.parse_usec_per_row;
+
+	IF keys IS NOT NULL THEN
+		EXECUTE format('DELETE FROM %s WHERE relid = $1', key_stats_table)
+			USING json_fdw_stats_put.relid;
+		EXECUTE format('INSERT INTO %s (relid, key, mapped, present_frac, null_frac,'
+			' string_frac, number_frac, boolean_frac, object_frac, array_frac)'
+			' SELECT $1, k.* FROM unnest($2, $3, $4, $5, $6, $7, $8, $9, $10) AS k', key_stats_table)
+			USING json_fdw_stats_put.relid, keys, mapped, present_frac, null_frac,
+				string_frac, number_frac, boolean_frac, object_frac, array_frac;
+	END IF;
+END;
+$$;
+
+REVOKE ALL ON FUNCTION json_fdw_stats_put(oid, float8, int, float8, float8, float8,
+	float8, text[], bool[], float8[], float8[], float8[], float8[], float8[],
+	float8[], float8[]) FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION json_fdw_stats_put(oid, float8, int, float8, float8, float8,
+	float8, text[], bool[], float8[], float8[], float8[], float8[], float8[],
+	float8[], float8[]) TO PUBLIC;
+
+-- Drops the stats of the tables that are dropped, as they are keyed by oid
+CREATE FUNCTION json_fdw_stats_drop()
+RETURNS event_trigger
+LANGUAGE plpgsql SECURITY DEFINER
+SET search_path = pg_catalog, pg_temp
+AS $$
+DECLARE
+	stats_table text;
+BEGIN
+	FOR stats_table IN
+		SELECT format('%I.%I', n.nspname, c.relname)
+		FROM pg_extension e
+		JOIN pg_depend d ON d.refclassid = 'pg_extension'::regclass AND d.refobjid = e.oid
+			AND d.deptype = 'e' AND d.classid = 'pg_class'::regclass
+		JOIN pg_class c ON c.oid = d.objid AND c.relname IN ('json_fdw_stats', 'json_fdw_key_stats')
+		JOIN pg_namespace n ON n.oid = c.relnamespace
+		WHERE e.extname = 'json_fdw'
+	LOOP
+		EXECUTE format('DELETE FROM %s WHERE relid IN (SELECT objid FROM pg_event_trigger_dropped_objects()'
+			' WHERE classid = ''pg_class''::regclass AND objsubid = 0)', stats_table);
+	END LOOP;
+END;
+$$;
+
+CREATE EVENT TRIGGER json_fdw_stats_drop ON sql_drop
+	EXECUTE PROCEDURE json_fdw_stats_drop();
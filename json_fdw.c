@@ -17,45 +17,78 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <sys/stat.h>
+#include <errno.h>
+#include <time.h>
+#include <utime.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <dirent.h>
+#include <float.h>
+#include <math.h>
 
 #include "postgres.h"
 #include "json_fdw.h"
 
+#include <yajl/yajl_parse.h>
 #include <yajl/yajl_tree.h>
 #include <yajl/yajl_tree_path.h>
 
 #include <zlib.h>
 
 #include "access/reloptions.h"
+#include "access/xact.h"
 #include "catalog/pg_foreign_table.h"
 #include "catalog/pg_type.h"
 #include "commands/defrem.h"
 #include "commands/explain.h"
 #include "commands/vacuum.h"
+#include "executor/executor.h"
+#include "executor/spi.h"
 #include "foreign/fdwapi.h"
 #include "foreign/foreign.h"
+#include "libpq/md5.h"
 #include "miscadmin.h"
 #include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
 #include "optimizer/cost.h"
 #include "optimizer/plancat.h"
 #include "optimizer/pathnode.h"
+#include "optimizer/paths.h"
 #include "optimizer/planmain.h"
 #include "optimizer/restrictinfo.h"
 #include "optimizer/var.h"
 #include "port.h"
+#include "portability/instr_time.h"
 #include "storage/fd.h"
+#include "storage/ipc.h"
+#include "storage/shmem.h"
+#include "utils/acl.h"
 #include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/date.h"
 #include "utils/datetime.h"
+#include "utils/guc.h"
 #include "utils/int8.h"
 #include "utils/timestamp.h"
 #include "utils/hsearch.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
+#include "utils/syscache.h"
 #include "parser/parsetree.h"
 #include "nodes/relation.h"
+#include "utils/datum.h"
+#include "utils/typcache.h"
+
+#if PG_VERSION_NUM >= 90600
+	#include "catalog/pg_aggregate.h"
+	#include "catalog/pg_namespace.h"
+	#include "optimizer/tlist.h"
+	#include "utils/selfuncs.h"
+#endif
 
 #if PG_VERSION_NUM >= 90300
 	#include "access/htup_details.h"
@@ -63,6 +96,8 @@
 
 #include "curlapi.h"
 #include "rciapi.h"
+#include "regexapi.h"
+#include "regexapi_helper.h"
 
 
 #define ELog(elevel, ...)  \
@@ -87,18 +122,88 @@ static void JsonExplainForeignScan(ForeignScanState *scanState,
 								   ExplainState *explainState);
 static void JsonBeginForeignScan(ForeignScanState *scanState, int executorFlags);
 static TupleTableSlot * JsonIterateForeignScan(ForeignScanState *scanState);
+static TupleTableSlot *JsonIterateRow(ForeignScanState *scanState, TupleTableSlot *tupleSlot);
 static void JsonReScanForeignScan(ForeignScanState *scanState);
 static void JsonEndForeignScan(ForeignScanState *scanState);
 static JsonFdwOptions * JsonGetOptions(Oid foreignTableId);
 static char * JsonGetOptionValue(Oid foreignTableId, const char *optionName);
-static double TupleCount(RelOptInfo *baserel, const char *filename);
-static BlockNumber PageCount(const char *filename);
+static double TupleCount(RelOptInfo *baserel, JsonFdwOptions *options, List *sources, JsonFdwStats *stats);
+static BlockNumber PageCount(JsonFdwOptions *options, List *sources, JsonFdwStats *stats);
+static JsonFdwStats *JsonStatsGet(Oid foreignTableId);
+static void JsonStatsPut(JsonFdwStats *pStats, jks_t *pJks, int logLevel);
+static jks_t *JsonKeyStatsInit(int slotCount);
+static void JsonKeyStatsRow(jks_t *pJks, yajl_val jsonObject);
+static void JsonKeyStatsKeep(jks_t *pJks, int slot);
+static void JsonKeyStatsCount(jks_t *pJks, int sampleRowCount, HTAB *columnMappingHash);
+static Selectivity JsonClauseSelectivity(PlannerInfo *root, RelOptInfo *baserel, Oid foreignTableId);
+static double JsonStatsScale(List *sources, JsonFdwStats *stats);
+static int SourcesSize(JsonFdwOptions *options, List *sources, double *pSize);
+static List *JsonSourceList(const char *filename, const char *manifest, bool bManifest);
+static bool JsonSourceIsUrl(const char *source);
+static List *JsonPruneClauses(RelOptInfo *baserel);
+static List *JsonSourcesPrune(PlannerInfo *root, PlanState *planState, Index relid, Oid foreignTableId, List *clauses, List *sources);
+static List *JsonSourcesFromPrivate(List *sourcesPrivate);
+static void JsonPartitionValuesSet(JsonFdwExecState *execState, const char *source);
+static jss_t *JsonSourceInit(List *sources, int window, const char *pPostVars);
+static bool JsonSourceOpenNext(JsonFdwExecState *execState);
+static void JsonSourceEnd(jss_t *pJss);
+static cmf_t *JsonMultiFetchGet(void);
+static void JsonMultiFetchXactCallback(XactEvent event, void *arg);
+static void JsonMultiFetchSubXactCallback(SubXactEvent event, SubTransactionId mySubid, SubTransactionId parentSubid, void *arg);
+static void JsonMultiFetchTrack(cmf_t *pCmf, int idBase, int count, bool bOwned);
+static void JsonMultiFetchUntrack(cmf_t *pCmf, int idBase);
+static void JsonPutMultiXactCallback(XactEvent event, void *arg);
+static void JsonPutMultiSubXactCallback(SubXactEvent event, SubTransactionId mySubid, SubTransactionId parentSubid, void *arg);
+static void JsonCurlWait(void);
+static void JsonCurlInit(void);
+static void JsonFileOpen(JsonFdwExecState *execState, const char *filename);
+static uint64 JsonFileBytes(const char *filename);
+static void JsonFileClose(JsonFdwExecState *execState);
+static bool JsonScanRewind(JsonFdwExecState *execState);
+static char *JsonCacheKey(TupleDesc tupleDescriptor, const char *pSourceName, const char *filename, cfr_t *pCfr);
+static List *JsonCacheColumnList(TupleDesc tupleDescriptor, bool *pColumns);
+static const char *JsonCacheDirectory(void);
+static void JsonCacheEvict(const char *pDirectory);
+static jcc_t *JsonCacheOpen(TupleDesc tupleDescriptor, const char *key, bool *pWanted);
+static void JsonCacheWriteRow(jcc_t *pJcc, Datum *columnValues, bool *columnNulls);
+static bool JsonCacheReadRow(jcc_t *pJcc, Datum *columnValues, bool *columnNulls);
+static bool JsonCacheRewind(jcc_t *pJcc);
+static void JsonCacheClose(jcc_t *pJcc);
+static Size JsonSharedCacheShmemSize(void);
+static void JsonSharedCacheStartup(void);
+static jsc_t *JsonSharedCacheOpen(Oid foreignTableId, const char *key, bool *pWanted, int columnCount);
+static void JsonSharedCacheWriteRow(jsc_t *pJsc, TupleDesc tupleDescriptor, Datum *columnValues, bool *columnNulls);
+static void JsonSharedCacheReadRow(jsc_t *pJsc, TupleTableSlot *tupleSlot);
+static void JsonSharedCacheClose(jsc_t *pJsc);
+static bool JsonSampleBlockNext(JsonFdwExecState *execState, jbs_t *pJbs);
+static bool JsonSkipLine(JsonFdwExecState *execState);
+static void JsonLineCount(JsonFdwExecState *execState, size_t lineLength);
 static List * ColumnList(RelOptInfo *baserel);
 static HTAB * ColumnMappingHash(Oid foreignTableId, List *columnList);
+static char *JsonAttributeNameGet(int varno, int varattno, PlannerInfo *root);
+static bool JsonQualToUrlParam(PlannerInfo *root, Index relid, rci_t *pRci, Expr *qual, StringInfo url);
+static bool JsonQualToParamExpr(PlannerInfo *root, Index relid, rci_t *pRci, Expr *qual, char const **ppParam, Expr **ppExpr);
+static void JsonParamPathsAdd(PlannerInfo *root, RelOptInfo *baserel, JsonFdwOptions *options, double cpuCostPerTuple, double pagesPerTuple);
+static char *JsonParamUrl(ForeignScanState *scanState, const char *pUrl, List *paramNames, List *exprStates);
+static JsonFdwExecState *JsonEmptyScanBegin(ForeignScanState *scanState, HTAB *columnMappingHash, JsonFdwOptions *options);
+static void JsonParamRescan(JsonFdwExecState *execState);
+static void JsonParamFetch(ForeignScanState *scanState);
+static jas_t *JsonAggInit(ForeignScanState *scanState, List *aggColumns);
+static TupleTableSlot *JsonAggIterate(ForeignScanState *scanState);
+static void JsonAggEnd(jas_t *pJas);
+static void JsonUrlParamAppend(StringInfo url, const char *name, const char *value);
+static char *JsonSelectUrlPlan(PlannerInfo *root, RelOptInfo *baserel, JsonFdwOptions *options, List *scanClauses,
+	List **pParamNames, List **pParamExprs);
+static jsp_t *JsonPageInit(rci_t *pRci);
+static void JsonPageStart(jsp_t *pJsp, const char *pUrl);
+static cfr_t *JsonPageNext(jsp_t *pJsp);
+static bool JsonPageOpenNext(JsonFdwExecState *execState);
 static bool GzipFilename(const char *filename);
 static bool HdfsBlockName(const char *filename);
 static StringInfo ReadLineFromFile(FILE *filePointer);
 static StringInfo ReadLineFromGzipFile(gzFile gzFilePointer);
+static size_t SkipLineFromFile(FILE *filePointer, void *gzFilePointer);
+static bool JsonObjectValidate(const char *pLine, size_t lineLength, char *pErrorBuffer, size_t errorBufferSize);
 static void FillTupleSlot(const yajl_val jsonObject, const char *jsonObjectKey,
 						  HTAB *columnMappingHash, Datum *columnValues,
 						  bool *columnNulls);
@@ -118,7 +223,17 @@ static void JsonBeginForeignModify( ModifyTableState *mtstate, ResultRelInfo *re
 static TupleTableSlot *JsonExecForeignInsert( EState *estate, ResultRelInfo *resultRelInfo, TupleTableSlot *slot, TupleTableSlot *planSlot);
 static void JsonAddForeignUpdateTargets(Query *parsetree, RangeTblEntry *target_rte, Relation target_relation);
 static TupleTableSlot * JsonExecForeignUpdate( EState *estate, ResultRelInfo *resultRelInfo, TupleTableSlot *slot, TupleTableSlot *planSlot);
+static TupleTableSlot * JsonExecForeignDelete( EState *estate, ResultRelInfo *resultRelInfo, TupleTableSlot *slot, TupleTableSlot *planSlot);
 static void JsonEndForeignModify(EState *estate, ResultRelInfo *resultRelInfo);
+#if PG_VERSION_NUM >= 90600
+static bool JsonPlanDirectModify(PlannerInfo *root, ModifyTable *plan, Index resultRelation, int subplan_index);
+static void JsonBeginDirectModify(ForeignScanState *node, int eflags);
+static TupleTableSlot *JsonIterateDirectModify(ForeignScanState *node);
+static void JsonEndDirectModify(ForeignScanState *node);
+static void JsonExplainDirectModify(ForeignScanState *node, ExplainState *explainState);
+static void JsonGetForeignUpperPaths(PlannerInfo *root, UpperRelationKind stage, RelOptInfo *input_rel, RelOptInfo *output_rel);
+static ForeignScan *JsonGetForeignAggPlan(PlannerInfo *root, ForeignPath *bestPath, List *targetList);
+#endif
 
 
 // Array of options that are valid for json_fdw
@@ -130,6 +245,16 @@ static const JsonValidOption ValidOptionArray[] =
 	{ OPTION_NAME_HTTP_POST_VARS, ForeignTableRelationId },
 	{ OPTION_NAME_ROM_URL, ForeignTableRelationId },
 	{ OPTION_NAME_ROM_PATH, ForeignTableRelationId },
+	{ OPTION_NAME_BATCH_SIZE, ForeignTableRelationId },
+	{ OPTION_NAME_BATCH_BYTES, ForeignTableRelationId },
+	{ OPTION_NAME_BATCH_FORMAT, ForeignTableRelationId },
+	{ OPTION_NAME_WRITE_WINDOW, ForeignTableRelationId },
+	{ OPTION_NAME_CONTENT_ENCODING, ForeignTableRelationId },
+	{ OPTION_NAME_MANIFEST, ForeignTableRelationId },
+	{ OPTION_NAME_SOURCE_COLUMN, ForeignTableRelationId },
+	{ OPTION_NAME_READ_WINDOW, ForeignTableRelationId },
+	{ OPTION_NAME_COLUMNAR_CACHE, ForeignTableRelationId },
+	{ OPTION_NAME_SHARED_CACHE, ForeignTableRelationId },
 };
 // Never maintain by hand, what the compiler could do for you
 static const uint32 ValidOptionCount = (sizeof(ValidOptionArray)/sizeof(ValidOptionArray[0]));
@@ -140,6 +265,115 @@ PG_MODULE_MAGIC;
 
 PG_FUNCTION_INFO_V1(json_fdw_handler);
 PG_FUNCTION_INFO_V1(json_fdw_validator);
+PG_FUNCTION_INFO_V1(json_fdw_infer_schema);
+
+void _PG_init(void);
+
+// Directory of the columnar cache files, relative to the data directory, and their size in kB
+static char *JsonCacheDirectoryPath = NULL;
+static int JsonCacheSize = JSON_CACHE_SIZE;
+
+// Size of the shared cache, in kB, or zero for none
+static int JsonSharedCacheSize = 0;
+
+// The time of a tuple that is costed as cpu_tuple_cost, in usec, see JsonGetForeignPaths
+static double JsonCpuTupleUsec = JSON_CPU_TUPLE_USEC;
+
+// The time that ANALYZE reads a gzip file for, in ms, or -1 to read it through
+static int JsonSampleGzipMsec = JSON_SAMPLE_GZIP_MSEC;
+
+static JsonSharedCache *JsonSharedCachePtr = NULL;
+static shmem_startup_hook_type prevShmemStartupHook = NULL;
+
+// The fetches of the sources of every scan of the backend, and the next fetch id
+static cmf_t *JsonMultiFetch = NULL;
+static int JsonMultiFetchNextId = 0;
+
+// The fetches of the scans that haven't ended, of JsonMultiFetchScan in TopMemoryContext
+static List *JsonMultiFetchScans = NIL;
+
+// The pipelined puts of the modifies of the backend, of JsonPutMulti in TopMemoryContext
+static List *JsonPutMultiList = NIL;
+
+// The rows of the shared cache follow its header
+#define JsonSharedCacheArena(pCache) ((char *) (pCache) + MAXALIGN(sizeof(JsonSharedCache)))
+
+
+/*
+ * _PG_init defines the settings of json_fdw, and when json_fdw is preloaded,
+ * requests the shared memory of the shared cache.
+ */
+void
+_PG_init(void)
+{
+	RegisterXactCallback(JsonMultiFetchXactCallback, NULL);
+	RegisterSubXactCallback(JsonMultiFetchSubXactCallback, NULL);
+	RegisterXactCallback(JsonPutMultiXactCallback, NULL);
+	RegisterSubXactCallback(JsonPutMultiSubXactCallback, NULL);
+	curlWaitFnSet(JsonCurlWait);
+	curlInitFnSet(JsonCurlInit);
+
+	DefineCustomStringVariable("json_fdw.columnar_cache_directory",
+							   "Directory of the columnar cache files.",
+							   "A relative path is relative to the data directory. It is created with mode 0700.",
+							   &JsonCacheDirectoryPath,
+							   JSON_CACHE_DIR,
+							   PGC_SUSET,
+							   0,
+							   NULL, NULL, NULL);
+
+	DefineCustomIntVariable("json_fdw.columnar_cache_size",
+							"Size of the columnar cache files, beyond which the least recently used are removed.",
+							NULL,
+							&JsonCacheSize,
+							JSON_CACHE_SIZE, 0, MAX_KILOBYTES,
+							PGC_SUSET,
+							GUC_UNIT_KB,
+							NULL, NULL, NULL);
+
+	DefineCustomRealVariable("json_fdw.cpu_tuple_usec",
+							 "Time of a tuple that is costed as cpu_tuple_cost, in microseconds.",
+							 "The time that ANALYZE measures to parse a row is costed as this many tuples. "
+							 "The default makes a table that isn't analyzed cost the same as one that takes 2 microseconds a row.",
+							 &JsonCpuTupleUsec,
+							 JSON_CPU_TUPLE_USEC, 0.001, 1000.0,
+							 PGC_USERSET,
+							 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomIntVariable("json_fdw.analyze_gzip_time",
+							"Time that ANALYZE reads a gzip file for, from its head.",
+							"-1 reads the file through.",
+							&JsonSampleGzipMsec,
+							JSON_SAMPLE_GZIP_MSEC, -1, INT_MAX,
+							PGC_USERSET,
+							GUC_UNIT_MS,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("json_fdw.shared_cache_size",
+							"Size of the shared memory cache of the rows of small tables.",
+							"json_fdw must be in shared_preload_libraries. Zero disables the cache.",
+							&JsonSharedCacheSize,
+							0, 0, MAX_KILOBYTES,
+							PGC_POSTMASTER,
+							GUC_UNIT_KB,
+							NULL, NULL, NULL);
+
+	if (!process_shared_preload_libraries_in_progress || JsonSharedCacheSize <= 0)
+	{
+		return;
+	}
+
+	RequestAddinShmemSpace(JsonSharedCacheShmemSize());
+#if PG_VERSION_NUM >= 90600
+	RequestNamedLWLockTranche(JSON_SHARED_CACHE_NAME, 1);
+#else
+	RequestAddinLWLocks(1);
+#endif
+
+	prevShmemStartupHook = shmem_startup_hook;
+	shmem_startup_hook = JsonSharedCacheStartup;
+}
 
 
 /*
@@ -166,9 +400,18 @@ json_fdw_handler(PG_FUNCTION_ARGS)
 	fdwRoutine->AddForeignUpdateTargets = JsonAddForeignUpdateTargets; // update and delete
 	fdwRoutine->ExecForeignInsert = JsonExecForeignInsert;
 	fdwRoutine->ExecForeignUpdate = JsonExecForeignUpdate;
-	//fdwRoutine->ExecForeignDelete = JsonExecForeignDelete;
+	fdwRoutine->ExecForeignDelete = JsonExecForeignDelete;
 	fdwRoutine->EndForeignModify = JsonEndForeignModify;
 
+#if PG_VERSION_NUM >= 90600
+	fdwRoutine->PlanDirectModify = JsonPlanDirectModify;
+	fdwRoutine->BeginDirectModify = JsonBeginDirectModify;
+	fdwRoutine->IterateDirectModify = JsonIterateDirectModify;
+	fdwRoutine->EndDirectModify = JsonEndDirectModify;
+	fdwRoutine->ExplainDirectModify = JsonExplainDirectModify;
+	fdwRoutine->GetForeignUpperPaths = JsonGetForeignUpperPaths;
+#endif
+
 	PG_RETURN_POINTER(fdwRoutine);
 }
 
@@ -223,23 +466,36 @@ json_fdw_validator(PG_FUNCTION_ARGS)
 		else // test for particular option existence
 		{
 			filenameFound |= (strncmp(optionName, OPTION_NAME_FILENAME, NAMEDATALEN) == 0);
+			filenameFound |= (strncmp(optionName, OPTION_NAME_MANIFEST, NAMEDATALEN) == 0);
 			romUrlFound |= (strncmp(optionName, OPTION_NAME_ROM_URL, NAMEDATALEN) == 0);
 			romPathFound |= (strncmp(optionName, OPTION_NAME_ROM_PATH, NAMEDATALEN) == 0);
+
+			if (strncmp(optionName, OPTION_NAME_COLUMNAR_CACHE, NAMEDATALEN) == 0
+				|| strncmp(optionName, OPTION_NAME_SHARED_CACHE, NAMEDATALEN) == 0)
+			{
+				bool bValue = false;
+
+				if (!parse_bool(defGetString(optionDef), &bValue))
+				{
+					ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_ATTRIBUTE_VALUE),
+									errmsg("%s requires a Boolean value", optionName)));
+				}
+			}
 		}
 	}
 
 	if (optionContextId == ForeignTableRelationId)
 	{
-		// make sure either filename or rom_url and rom_path, not both
+		// make sure either filename and/or manifest, or rom_url and rom_path, not both
 		if( !(filenameFound || (romUrlFound && romPathFound)))
 		{
 			ereport(ERROR, (errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
-				errmsg("Either the ``filename'' or the ``rom_url'' and ``rom_path'' options are required for foreign tables")));
+				errmsg("Either the ``filename'' or ``manifest'', or the ``rom_url'' and ``rom_path'' options are required for foreign tables")));
 		}
 		else if(filenameFound && (romUrlFound || romPathFound))
 		{
 			ereport(ERROR, (errcode(ERRCODE_FDW_DYNAMIC_PARAMETER_VALUE_NEEDED),
-				errmsg("Do not mix the ``filename'' option with the ``rom_url'' and ``rom_path'' options for foreign tables")));
+				errmsg("Do not mix the ``filename'' or ``manifest'' options with the ``rom_url'' and ``rom_path'' options for foreign tables")));
 		}
 	}
 
@@ -288,12 +544,35 @@ static void
 JsonGetForeignRelSize(PlannerInfo *root, RelOptInfo *baserel, Oid foreignTableId)
 {
 	JsonFdwOptions *options = JsonGetOptions(foreignTableId);
+	double tupleCount = 0.0;
+	double rowSelectivity = 0.0;
+	double outputRowCount = 0.0;
+
+	/*
+	 * The files of the table, less those whose partition directories can't
+	 * match the where clauses, as the number of files before pruning, and
+	 * the file names that are left, which JsonGetForeignPaths costs. The
+	 * plan has only the clauses, as the files are listed, and pruned, again
+	 * by each scan, see JsonGetForeignPlan.
+	 */
+	if (!(options->pRomUrl != NULL && *options->pRomUrl
+		&& options->pRomPath != NULL && *options->pRomPath))
+	{
+		List *sources = JsonSourceList(options->filename, NULL, false);
+		List *surviving = JsonSourcesPrune(root, NULL, baserel->relid, foreignTableId, JsonPruneClauses(baserel), sources);
+		ListCell *sourceCell = NULL;
+
+		baserel->fdw_private = list_make1(makeInteger(list_length(sources)));
+		foreach(sourceCell, surviving)
+		{
+			baserel->fdw_private = lappend(baserel->fdw_private, makeString((char *) lfirst(sourceCell)));
+		}
+	}
 
-	double tupleCount = TupleCount(baserel, options->filename);
-	double rowSelectivity = clauselist_selectivity(root, baserel->baserestrictinfo,
-					   0, JOIN_INNER, NULL);
+	tupleCount = TupleCount(baserel, options, JsonSourcesFromPrivate(baserel->fdw_private), JsonStatsGet(foreignTableId));
+	rowSelectivity = JsonClauseSelectivity(root, baserel, foreignTableId);
 
-	double outputRowCount = clamp_row_est(tupleCount * rowSelectivity);
+	outputRowCount = clamp_row_est(tupleCount * rowSelectivity);
 	baserel->rows = outputRowCount;
 	//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
 }
@@ -301,33 +580,49 @@ JsonGetForeignRelSize(PlannerInfo *root, RelOptInfo *baserel, Oid foreignTableId
 
 /*
  * JsonGetForeignPaths creates possible access paths for a scan on the foreign
- * table. Currently we only have one possible access path, which simply returns
- * all records in the order they appear in the underlying file.
+ * table. The main access path simply returns all records in the order they
+ * appear in the underlying file. A ROM table may also have parameterized
+ * paths, see JsonParamPathsAdd.
  */
 static void
 JsonGetForeignPaths(PlannerInfo *root, RelOptInfo *baserel, Oid foreignTableId)
 {
 	Path *foreignScanPath = NULL;
 	JsonFdwOptions *options = JsonGetOptions(foreignTableId);
+	List *sources = JsonSourcesFromPrivate(baserel->fdw_private);
+	JsonFdwStats *stats = JsonStatsGet(foreignTableId);
 
-	BlockNumber pageCount = PageCount(options->filename);
-	double tupleCount = TupleCount(baserel, options->filename);
+	BlockNumber pageCount = PageCount(options, sources, stats);
+	double tupleCount = TupleCount(baserel, options, sources, stats);
 
 	/*
 	 * We estimate costs almost the same way as cost_seqscan(), thus assuming
 	 * that I/O costs are equivalent to a regular table file of the same size.
-	 * However, we take per-tuple CPU costs as 10x of a seqscan to account for
-	 * the cost of parsing records.
+	 * However, the per-tuple CPU cost is the time that Analyze measured to
+	 * read, parse and convert a row, as tuples of json_fdw.cpu_tuple_usec,
+	 * or if not analyzed, 10x of a seqscan to account for the cost of parsing
+	 * records. The default of 0.2 usec, roughly the time of a seqscan tuple,
+	 * makes those 10x the same as an analyzed parse of 2 usec a row.
 	 */
-	double tupleParseCost = cpu_tuple_cost * JSON_TUPLE_COST_MULTIPLIER;
+	double tupleParseCost = (stats != NULL && stats->parseUsecPerRow > 0
+		? Max(cpu_tuple_cost, cpu_tuple_cost * stats->parseUsecPerRow / JsonCpuTupleUsec)
+		: cpu_tuple_cost * JSON_TUPLE_COST_MULTIPLIER
+		);
 	double tupleFilterCost = baserel->baserestrictcost.per_tuple;
 	double cpuCostPerTuple = tupleParseCost + tupleFilterCost;
 	double executionCost = (seq_page_cost * pageCount) + (cpuCostPerTuple * tupleCount);
 
 	double startupCost = baserel->baserestrictcost.startup;
-	double totalCost  = startupCost + executionCost;
+	double totalCost  = 0.0;
+
+	// a ROM table is a remote request, that waits on its latency
+	if (options->pRomUrl != NULL && *options->pRomUrl && options->pRomPath != NULL && *options->pRomPath)
+	{
+		startupCost += JSON_REQUEST_COST;
+	}
+	totalCost = startupCost + executionCost;
 
-	// create a foreign path node and add it as the only possible path
+	// create a foreign path node, that reads all of the rows
 	foreignScanPath = (Path *) create_foreignscan_path(root, baserel, baserel->rows,
 								   startupCost, totalCost,
 								   NIL,  // no known ordering
@@ -335,10 +630,116 @@ JsonGetForeignPaths(PlannerInfo *root, RelOptInfo *baserel, Oid foreignTableId)
 								   NIL); // no fdw_private
 
 	add_path(baserel, foreignScanPath);
+
+	// and those that fetch only the rows of the outer row of a nested loop
+	JsonParamPathsAdd(root, baserel, options, cpuCostPerTuple, (tupleCount > 0 ? pageCount / tupleCount : 0.0));
 	//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
 }
 
 
+/*
+ * Indexes of the items in the fdw_private list that JsonGetForeignPlan
+ * passes on to JsonBeginForeignScan.
+ */
+enum FdwScanPrivateIndex
+{
+	FdwScanPrivateColumnList,	// list of referenced columns
+	FdwScanPrivateUrl,		// select url with the where clauses and limit as url parameters, or NULL
+	FdwScanPrivateSources,		// Integer relid of the Vars of the clauses that prune the files, and the clauses, or NIL
+	FdwScanPrivateParamNames,	// url parameters of the fdw_exprs, ie. of outer rows, or NIL
+	FdwScanPrivateConcurrent,	// Integer true if the fetch is started by Begin, and waited for by Iterate
+	FdwScanPrivateAggregates,	// int lists of the kind, attnum, and collation of the output columns of an aggregate, or NIL
+};
+
+/*
+ * If the ROM select action has a "filter", build the select url with the
+ * where clauses that the filter maps, as url parameters. All of the where
+ * clauses are still checked locally, so a server that only roughly
+ * filters, or ignores a parameter, is not a problem.
+ *
+ * If every where clause is sent, the filter is "exact", so the rows that
+ * the server returns are those that the where clauses match, and this table
+ * is all that the query reads, with nothing that needs all of the rows, ie.
+ * aggregates, sorting, grouping, nor set returning functions in the select
+ * list, which return more rows than they read, then a limit is sent too, as
+ * the "limit" parameter of the filter. Postgres still applies any offset,
+ * so the limit sent includes it. The rows of a rough filter, that the local
+ * check removes, would leave fewer rows than the limit.
+ *
+ * Where clauses of the form "column operator expression", whose expression
+ * is only known when the scan begins, ie. a column of the outer row of a
+ * nested loop, are returned as the parameter names, and the expressions, that
+ * the scan evaluates, and adds to the url.
+ *
+ * Returns NULL if nothing could be sent.
+ */
+static char *JsonSelectUrlPlan(PlannerInfo *root, RelOptInfo *baserel, JsonFdwOptions *options, List *scanClauses,
+	List **pParamNames, List **pParamExprs)
+{	Query *parse = root->parse;
+	bool limitable = false;
+	rci_t *pRci = NULL;
+	char *pUrl = NULL;
+
+	if(options->pRomUrl == NULL || !*options->pRomUrl || options->pRomPath == NULL || !*options->pRomPath)
+		return NULL;
+
+	limitable = (root->limit_tuples > 0
+		&& bms_membership(root->all_baserels) == BMS_SINGLETON
+		&& parse->groupClause == NIL && !parse->hasAggs && !parse->hasWindowFuncs
+		&& parse->havingQual == NULL && parse->distinctClause == NIL
+		&& parse->sortClause == NIL && parse->setOperations == NULL
+		&& !expression_returns_set((Node *) parse->targetList)
+		);
+
+	if(scanClauses == NIL && !limitable)
+		return NULL;
+
+	pRci = rciFetch(options->pRomUrl, options->pRomPath, RCI_ACTION_SELECT);
+	if(!rciError(pRci, options->pRomUrl, options->pRomPath)
+		&& rciMethod(pRci, "get", options->pRomUrl, options->pRomPath)
+		&& pRci->pFilterUrl != NULL
+		)
+	{	StringInfoData url;
+		ListCell *lc = NULL;
+		bool sent = false;
+		bool sentAll = true;
+		char const *pLimitParam = rciFilterLimitParam(pRci);
+
+		initStringInfo(&url);
+		appendStringInfoString(&url, pRci->pFilterUrl);
+
+		foreach(lc, scanClauses)
+		{	char const *pParam = NULL;
+			Expr *paramExpr = NULL;
+
+			if(JsonQualToUrlParam(root, baserel->relid, pRci, (Expr *) lfirst(lc), &url))
+				sent = true;
+			else if(JsonQualToParamExpr(root, baserel->relid, pRci, (Expr *) lfirst(lc), &pParam, &paramExpr))
+			{
+				*pParamNames = lappend(*pParamNames, makeString(pstrdup(pParam)));
+				*pParamExprs = lappend(*pParamExprs, paramExpr);
+				sent = true;
+			}
+			else
+				sentAll = false;
+		}
+
+		if(limitable && sentAll && pRci->bFilterExact && pLimitParam != NULL && *pLimitParam)
+		{	char limit[32];
+
+			snprintf(limit, sizeof(limit), "%.0f", root->limit_tuples);
+			JsonUrlParamAppend(&url, pLimitParam, limit);
+			sent = true;
+		}
+
+		if(sent)
+			pUrl = url.data;
+	}
+	rciFree(pRci);
+
+	return pUrl;
+}
+
 /*
  * JsonGetForeignPlan creates a ForeignScan plan node for scanning the foreign
  * table. We also add the query column list to scan nodes private list, because
@@ -351,6 +752,21 @@ JsonGetForeignPlan(PlannerInfo *root, RelOptInfo *baserel, Oid foreignTableId,
 	ForeignScan *foreignScan = NULL;
 	List *columnList = NULL;
 	List *foreignPrivateList = NIL;
+	char *pSelectUrl = NULL;
+	List *paramNames = NIL;
+	List *paramExprs = NIL;
+	JsonFdwOptions *options = NULL;
+	List *sourcesPrivate = NIL;
+
+#if PG_VERSION_NUM >= 90600
+	// the aggregates of the rows, see JsonGetForeignUpperPaths
+	if (baserel->reloptkind == RELOPT_UPPER_REL)
+	{
+		return JsonGetForeignAggPlan(root, bestPath, targetList);
+	}
+#endif
+
+	options = JsonGetOptions(foreignTableId);
 
 	/*
 	 * We have no native ability to evaluate restriction clauses, so we just
@@ -366,12 +782,29 @@ JsonGetForeignPlan(PlannerInfo *root, RelOptInfo *baserel, Oid foreignTableId,
 	 * column list here and put it into foreign scan node's private list.
 	 */
 	columnList = ColumnList(baserel);
-	foreignPrivateList = list_make1(columnList);
+	pSelectUrl = JsonSelectUrlPlan(root, baserel, options, scanClauses, &paramNames, &paramExprs);
+
+	// The files of the table are listed when the scan begins, not now, so a
+	// cached plan sees those added, or removed, since. Only the clauses that
+	// prune them are kept, with the relid of their Vars.
+	if (!(options->pRomUrl != NULL && *options->pRomUrl
+		&& options->pRomPath != NULL && *options->pRomPath))
+	{
+		sourcesPrivate = list_make2(makeInteger(baserel->relid), JsonPruneClauses(baserel));
+	}
+
+	foreignPrivateList = list_make4(columnList, (pSelectUrl != NULL ? makeString(pSelectUrl) : NULL), sourcesPrivate, paramNames);
 
-	// create the foreign scan node
+	// a child of an append, ie. of a union all, or of an inherited table,
+	// starts fetching when the append begins, so they all fetch concurrently
+	foreignPrivateList = lappend(foreignPrivateList, makeInteger(baserel->reloptkind == RELOPT_OTHER_MEMBER_REL));
+	foreignPrivateList = lappend(foreignPrivateList, NIL);
+
+	// create the foreign scan node, the outer columns of the parameters are
+	// replaced by the planner with the params of the nested loop
 	foreignScan = make_foreignscan(
 		targetList, scanClauses, baserel->relid
-		, NIL // no expressions to evaluate
+		, paramExprs
 		, foreignPrivateList
 #if PG_VERSION_NUM >= 90500
 		,NIL // no fdw_scan_tlist
@@ -389,21 +822,67 @@ JsonExplainForeignScan(ForeignScanState *scanState, ExplainState *explainState)
 {
 	Oid foreignTableId = RelationGetRelid(scanState->ss.ss_currentRelation);
 	JsonFdwOptions *options = JsonGetOptions(foreignTableId);
+	List *allSources = NIL;
+	List *sources = NIL;
 
 	ExplainPropertyText("Json File", options->filename, explainState);
+	if (options->pManifest != NULL)
+	{
+		ExplainPropertyText("Json Manifest", options->pManifest, explainState);
+	}
 	ExplainPropertyText("HTTP Post Vars", options->pHttpPostVars, explainState);
 	ExplainPropertyText("Rom URL", options->pRomUrl, explainState);
 	ExplainPropertyText("Rom PATH", options->pRomPath, explainState);
 
+	{	List *foreignPrivateList = (List *) ((ForeignScan *) scanState->ss.ps.plan)->fdw_private;
+		List *sourcesPrivate = (List *) list_nth(foreignPrivateList, FdwScanPrivateSources);
+
+		if(list_nth(foreignPrivateList, FdwScanPrivateUrl) != NULL)
+			ExplainPropertyText("Rom Select URL", strVal(list_nth(foreignPrivateList, FdwScanPrivateUrl)), explainState);
+		if(list_nth(foreignPrivateList, FdwScanPrivateParamNames) != NIL)
+		{	StringInfoData names;
+			ListCell *lc = NULL;
+
+			initStringInfo(&names);
+			foreach(lc, (List *) list_nth(foreignPrivateList, FdwScanPrivateParamNames))
+				appendStringInfo(&names, "%s%s", (names.len > 0 ? ", " : ""), strVal(lfirst(lc)));
+			ExplainPropertyText("Rom Select Params", names.data, explainState);
+		}
+		if(intVal(list_nth(foreignPrivateList, FdwScanPrivateConcurrent)))
+			ExplainPropertyText("Concurrent Fetch", "yes", explainState);
+		if(list_nth(foreignPrivateList, FdwScanPrivateAggregates) != NIL)
+			ExplainPropertyText("Aggregated Scan", "yes", explainState);
+
+		// the files of the table, and those left by pruning, as the scan lists them
+		if(sourcesPrivate != NIL)
+		{
+			allSources = JsonSourceList(options->filename, NULL, false);
+			sources = JsonSourcesPrune(NULL, &scanState->ss.ps, intVal(linitial(sourcesPrivate)), foreignTableId
+				, (List *) lsecond(sourcesPrivate), allSources);
+			if(list_length(allSources) > 1)
+				ExplainPropertyText("Json Files", psprintf("%d of %d", list_length(sources), list_length(allSources)), explainState);
+		}
+	}
+
+	// with Analyze, whether the caches were read, or written
+	if (scanState->fdw_state != NULL)
+	{
+		JsonFdwExecState *execState = (JsonFdwExecState *) scanState->fdw_state;
+
+		if (execState->pJsc != NULL)
+			ExplainPropertyText("Shared Cache", (execState->pJsc->bWriting ? "write" : "read"), explainState);
+		if (execState->pJcc != NULL)
+			ExplainPropertyText("Columnar Cache", (execState->pJcc->bWriting ? "write" : "read"), explainState);
+	}
+
 	// supress file size if we're not showing cost details
 	if (explainState->costs)
 	{
-		struct stat statBuffer;
+		double size = 0.0;
 
-		int statResult = stat(options->filename, &statBuffer);
-		if (statResult == 0)
+		if (SourcesSize(options, sources, &size) > 0)
 		{
-			ExplainPropertyLong("Json File Size", (long) statBuffer.st_size,
+			ExplainPropertyLong("Json File Size", (long) size,
 								explainState);
 		}
 	}
@@ -493,6 +972,13 @@ JsonBeginForeignScan(ForeignScanState *scanState, int executorFlags)
 	const char *filename = NULL;
 	const char *postVars = NULL;
 	cfr_t *pCfr = NULL;
+	jsp_t *pJsp = NULL;
+	jss_t *pJss = NULL;
+	bool bRom = false;
+	bool bConcurrent = false;
+	const char *pSourceName = NULL;
+	int sourceColumnIndex = -1;
+	int natts = RelationGetDescr(scanState->ss.ss_currentRelation)->natts;
 
 	//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
 
@@ -508,8 +994,38 @@ JsonBeginForeignScan(ForeignScanState *scanState, int executorFlags)
 	foreignScan = (ForeignScan *) scanState->ss.ps.plan;
 	foreignPrivateList = (List *) foreignScan->fdw_private;
 
-	columnList = (List *) linitial(foreignPrivateList);
+	columnList = (List *) list_nth(foreignPrivateList, FdwScanPrivateColumnList);
 	columnMappingHash = ColumnMappingHash(foreignTableId, columnList);
+	bConcurrent = intVal(list_nth(foreignPrivateList, FdwScanPrivateConcurrent));
+
+	// the column that has the file name or url of each row, if it is used
+	if (options->pSourceColumn != NULL && *options->pSourceColumn)
+	{
+		AttrNumber attnum = get_attnum(foreignTableId, options->pSourceColumn);
+		Oid atttype = (attnum != InvalidAttrNumber ? get_atttype(foreignTableId, attnum) : InvalidOid);
+		ListCell *columnCell = NULL;
+
+		if (attnum == InvalidAttrNumber)
+		{
+			ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_ATTRIBUTE_VALUE),
+							errmsg("source_column \"%s\" is not a column of the foreign table",
+								   options->pSourceColumn)));
+		}
+		if (atttype != TEXTOID && atttype != VARCHAROID)
+		{
+			ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_DATA_TYPE),
+							errmsg("source_column \"%s\" must be of type text or varchar",
+								   options->pSourceColumn)));
+		}
+
+		foreach(columnCell, columnList)
+		{
+			if (((Var *) lfirst(columnCell))->varattno == attnum)
+			{
+				sourceColumnIndex = attnum - 1;
+			}
+		}
+	}
 
 	filename = options->filename;
 	postVars = options->pHttpPostVars;
@@ -521,20 +1037,84 @@ JsonBeginForeignScan(ForeignScanState *scanState, int executorFlags)
 	{
 		rci_t *pRci = rciFetch(options->pRomUrl, options->pRomPath, RCI_ACTION_SELECT);
 
+		bRom = true;
 		//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
 		if(!rciError(pRci, options->pRomUrl, options->pRomPath)
 			&& rciMethod(pRci, "get", options->pRomUrl, options->pRomPath)
 			)
 		{
-			filename = pstrdup(pRci->pUrl); // dupe the url
+			// fetched as pages ?
+			pJsp = JsonPageInit(pRci);
+
+			// the select url with the where clauses, as planned by JsonSelectUrlPlan ?
+			// and the values of the outer row, or query parameters, if any, which
+			// are only known once the scan is read, and for each rescan, so its
+			// expressions are built once, and the url is fetched by Iterate
+			if(list_nth(foreignPrivateList, FdwScanPrivateUrl) != NULL
+				&& list_nth(foreignPrivateList, FdwScanPrivateParamNames) != NIL)
+			{
+				rciFree(pRci);
+				execState = JsonEmptyScanBegin(scanState, columnMappingHash, options);
+				execState->pJsp = pJsp;
+				execState->sourceColumnIndex = sourceColumnIndex;
+				execState->executorFlags = executorFlags;
+				execState->pParamUrl = strVal(list_nth(foreignPrivateList, FdwScanPrivateUrl));
+				execState->paramNames = (List *) list_nth(foreignPrivateList, FdwScanPrivateParamNames);
+				execState->paramExprStates = (List *) ExecInitExpr((Expr *) foreignScan->fdw_exprs, (PlanState *) scanState);
+				execState->bParamFetch = true;
+				return;
+			}
+			else if(list_nth(foreignPrivateList, FdwScanPrivateUrl) != NULL)
+				filename = pstrdup(strVal(list_nth(foreignPrivateList, FdwScanPrivateUrl)));
+			else
+				filename = pstrdup(pRci->pUrl); // dupe the url
 			postVars = NULL;
+
+			if(pJsp != NULL)
+				JsonPageStart(pJsp, filename);
 		}
 		rciFree(pRci);
 	}
 
+	// A list, glob, or manifest of files and urls ?
+	if(!bRom)
+	{
+		List *sourcesPrivate = (List *) list_nth(foreignPrivateList, FdwScanPrivateSources);
+		List *sources = JsonSourceList(filename, NULL, false);
+
+		// less those that the where clauses, and the values of their params, prune
+		if(sourcesPrivate != NIL)
+		{
+			sources = JsonSourcesPrune(NULL, &scanState->ss.ps, intVal(linitial(sourcesPrivate)), foreignTableId
+				, (List *) lsecond(sourcesPrivate), sources);
+		}
+
+		sources = list_concat(sources, JsonSourceList(NULL, options->pManifest, true));
+
+		if(list_length(sources) == 1 && (options->pManifest == NULL || !*options->pManifest))
+			filename = (const char *) linitial(sources);
+		else
+			pJss = JsonSourceInit(sources, options->readWindow, postVars);
+	}
+
+	// The url of a concurrent scan is fetched as a list of one source, so the
+	// fetch starts now, with those of the other scans of the append, and is
+	// waited for by the first Iterate. Not if its rows are cached, as the
+	// caches are keyed by the ETag of a fetch that is not concurrent.
+	if(bConcurrent && pJss == NULL && pJsp == NULL && filename != NULL && JsonSourceIsUrl(filename)
+		&& (postVars == NULL || !*postVars) && !options->bSharedCache && !options->bColumnarCache)
+	{
+		pJss = JsonSourceInit(list_make1((char *) filename), 1, NULL);
+	}
+	pSourceName = filename;
+
 	// See if this is an off box url, and try to fetch it
 	// and then pass it off to one of the native file handlers
-	if(filename != NULL && *filename)
+	if(pJss != NULL)
+		filename = NULL; // opened below, one source at a time
+	else if(pJsp != NULL)
+		pCfr = JsonPageNext(pJsp);
+	else if(filename != NULL && *filename)
 		pCfr = curlFetchFile(filename, postVars);
 	else
 		openError = 1;
@@ -575,7 +1155,7 @@ JsonBeginForeignScan(ForeignScanState *scanState, int executorFlags)
 		}
 	}
 
-	if(openError || filename == NULL || !*filename)
+	if(pJss == NULL && (openError || filename == NULL || !*filename))
 	{
 		ereport(ERROR, (errcode_for_file_access(),
 						errmsg("could not open file \"%s\" for reading: %m",
@@ -594,21 +1174,152 @@ JsonBeginForeignScan(ForeignScanState *scanState, int executorFlags)
 	execState->currentLineNumber = 0;
 	// we pass this off to EndForeignScan to manage
 	execState->pCfr = pCfr;
+	execState->pJsp = pJsp;
+	execState->pJss = pJss;
+	execState->pSourceName = pSourceName;
+	execState->sourceColumnIndex = sourceColumnIndex;
+	execState->partitionCount = 0;
+	execState->pPartitionIndex = (int *) palloc0(sizeof(int) * (natts + 1));
+	execState->pPartitionValues = (Datum *) palloc0(sizeof(Datum) * (natts + 1));
+	execState->pPartitionNulls = (bool *) palloc0(sizeof(bool) * (natts + 1));
+	execState->scanContext = CurrentMemoryContext;
+	execState->pJks = NULL;
+	execState->pJcc = NULL;
+	execState->pJsc = NULL;
+	execState->executorFlags = executorFlags;
+	execState->pTupleStore = NULL;
+	execState->bTupleStoreComplete = false;
+	execState->bReplaying = false;
+	execState->bytesRead = 0;
+	execState->fileBytes = (filePointer != NULL || gzFilePointer != NULL ? JsonFileBytes(filename) : 0);
+
+	execState->pJas = NULL;
+	execState->pParamUrl = NULL;
+	execState->paramNames = NIL;
+	execState->paramExprStates = NIL;
+	execState->bParamFetch = false;
 
 	scanState->fdw_state = (void *) execState;
+
+	// a scan that aggregates the rows, reads them into a slot of the table's columns
+	if (list_nth(foreignPrivateList, FdwScanPrivateAggregates) != NIL)
+	{
+		execState->pJas = JsonAggInit(scanState, (List *) list_nth(foreignPrivateList, FdwScanPrivateAggregates));
+	}
+
+	// The shared cache of the rows of a small table, and the columnar cache of
+	// a source, of a single source, that are written by the first scan that
+	// reads it through, and read instead of the source by later ones. Not when
+	// analyzing, which has no executor state, as it samples the source itself.
+	if ((options->bSharedCache || options->bColumnarCache) && pJss == NULL && pJsp == NULL
+		&& (postVars == NULL || !*postVars) && scanState->ss.ps.state != NULL)
+	{
+		TupleDesc tupleDescriptor = RelationGetDescr(scanState->ss.ss_currentRelation);
+		char *key = JsonCacheKey(tupleDescriptor, pSourceName, filename, pCfr);
+		bool *pWanted = (bool *) palloc0(sizeof(bool) * (natts + 1));
+		jsc_t *pJsc = NULL;
+		jcc_t *pJcc = NULL;
+		HASH_SEQ_STATUS status;
+		ColumnMapping *columnMapping = NULL;
+		int i;
+
+		// the columns that the scan reads
+		hash_seq_init(&status, columnMappingHash);
+		while ((columnMapping = (ColumnMapping *) hash_seq_search(&status)) != NULL)
+		{
+			pWanted[columnMapping->columnIndex] = true;
+		}
+		if (sourceColumnIndex >= 0)
+		{
+			pWanted[sourceColumnIndex] = true;
+		}
+
+		if (key != NULL && options->bSharedCache)
+			pJsc = JsonSharedCacheOpen(foreignTableId, key, pWanted, natts);
+
+		// the rows of the shared cache being written may be read from the columnar cache
+		if (pJsc != NULL && pJsc->bWriting)
+		{
+			for (i = 0; i < natts; i++)
+				pWanted[i] = ((pJsc->columns[i / BITS_PER_BYTE] & (1 << (i % BITS_PER_BYTE))) != 0);
+		}
+		if (key != NULL && options->bColumnarCache && (pJsc == NULL || pJsc->bWriting))
+			pJcc = JsonCacheOpen(tupleDescriptor, key, pWanted);
+
+		execState->pJsc = pJsc;
+		execState->pJcc = pJcc;
+
+		if ((pJsc != NULL && !pJsc->bWriting) || (pJcc != NULL && !pJcc->bWriting))
+		{
+			JsonFileClose(execState);
+		}
+		else if (pJsc != NULL || pJcc != NULL)
+		{
+			// The caches are written with the columns that this scan reads, and
+			// those that they had, which were converted for every row of the
+			// same source, so a value of another column can't fail the scan
+			if (pJcc != NULL)
+			{
+				memcpy(pWanted, pJcc->pPresent, sizeof(bool) * natts);
+				if (pJsc != NULL)
+				{
+					for (i = 0; i < natts; i++)
+					{
+						if (pWanted[i])
+							pJsc->columns[i / BITS_PER_BYTE] |= (1 << (i % BITS_PER_BYTE));
+					}
+				}
+			}
+
+			hash_destroy(columnMappingHash);
+			execState->columnMappingHash = ColumnMappingHash(foreignTableId, JsonCacheColumnList(tupleDescriptor, pWanted));
+		}
+	}
+
+	// The rows of a small table that is to be rescanned, ie. the inner side of
+	// a nested loop, are kept as they are read, so a rescan replays them,
+	// rather than parse them again. Not if they are read from a cache.
+	if ((executorFlags & EXEC_FLAG_REWIND) && execState->pJas == NULL
+		&& !(execState->pJsc != NULL && !execState->pJsc->bWriting)
+		&& !(execState->pJcc != NULL && !execState->pJcc->bWriting)
+		&& foreignScan->scan.plan.plan_rows * foreignScan->scan.plan.plan_width <= work_mem * 1024.0
+		)
+	{
+		execState->pTupleStore = tuplestore_begin_heap(false, false, work_mem);
+	}
+
+	// open the first source, there may not be one, or
+	// for a concurrent scan, wait for it in Iterate
+	if(pJss != NULL && !bConcurrent)
+		JsonSourceOpenNext(execState);
+	else if(!bRom && pSourceName != NULL)
+		JsonPartitionValuesSet(execState, pSourceName);
 }
 
 
 /*
  * JsonIterateForeignScan reads the next record from the data file, converts it 
  * to PostgreSQL tuple, and stores the converted tuple into the ScanTupleSlot as
- * a virtual tuple.
+ * a virtual tuple. A scan that aggregates the rows returns the next group.
  */
 static TupleTableSlot *
 JsonIterateForeignScan(ForeignScanState *scanState)
 {
 	JsonFdwExecState *execState = (JsonFdwExecState *) scanState->fdw_state;
-	TupleTableSlot *tupleSlot = scanState->ss.ss_ScanTupleSlot;
+
+	if (execState->pJas != NULL)
+	{
+		return JsonAggIterate(scanState);
+	}
+
+	return JsonIterateRow(scanState, scanState->ss.ss_ScanTupleSlot);
+}
+
+
+// JsonIterateRow reads the next row of the table into tupleSlot
+static TupleTableSlot *JsonIterateRow(ForeignScanState *scanState, TupleTableSlot *tupleSlot)
+{
+	JsonFdwExecState *execState = (JsonFdwExecState *) scanState->fdw_state;
 	HTAB *columnMappingHash = execState->columnMappingHash;
 	char errorBuffer[ERROR_BUFFER_SIZE];
 	yajl_val jsonValue = NULL;
@@ -616,6 +1327,9 @@ JsonIterateForeignScan(ForeignScanState *scanState)
 	bool jsonObjectValid = false;
 	bool errorCountExceeded = false;
 
+	// a scan of none of the columns, ie. of count(*), only needs to know that each row is an object
+	bool rowsOnly = (execState->pJks == NULL && columnMappingHash != NULL && hash_get_num_entries(columnMappingHash) == 0);
+
 	TupleDesc tupleDescriptor = tupleSlot->tts_tupleDescriptor;
 	Datum *columnValues = tupleSlot->tts_values;
 	bool *columnNulls = tupleSlot->tts_isnull;
@@ -628,6 +1342,57 @@ JsonIterateForeignScan(ForeignScanState *scanState)
 
 	ExecClearTuple(tupleSlot);
 
+	// a parameterized scan fetches its url, with the values of its parameters now
+	if (execState->bParamFetch)
+	{
+		JsonParamFetch(scanState);
+	}
+
+	// rescanned, so replay the rows that were kept
+	if (execState->bReplaying)
+	{
+		if (!tuplestore_gettupleslot(execState->pTupleStore, true, false, tupleSlot))
+			ExecClearTuple(tupleSlot);
+		return tupleSlot;
+	}
+
+	// read the shared cache, or the columnar cache, rather than parse the source
+	if (execState->pJsc != NULL && !execState->pJsc->bWriting)
+	{
+		JsonSharedCacheReadRow(execState->pJsc, tupleSlot);
+		return tupleSlot;
+	}
+	if (execState->pJcc != NULL && !execState->pJcc->bWriting)
+	{
+		if (JsonCacheReadRow(execState->pJcc, columnValues, columnNulls))
+		{
+			if (execState->pJsc != NULL)
+				JsonSharedCacheWriteRow(execState->pJsc, tupleDescriptor, columnValues, columnNulls);
+			if (execState->pTupleStore != NULL)
+				tuplestore_putvalues(execState->pTupleStore, tupleDescriptor, columnValues, columnNulls);
+			ExecStoreVirtualTuple(tupleSlot);
+		}
+		else
+		{
+			if (execState->pJsc != NULL)
+				execState->pJsc->bComplete = true;
+			execState->bTupleStoreComplete = (execState->pTupleStore != NULL);
+		}
+		return tupleSlot;
+	}
+
+	// the first source of a concurrent scan, that began fetching with the others
+	if (execState->pJss != NULL && execState->pJss->current < 0)
+	{
+		JsonSourceOpenNext(execState);
+	}
+
+	// nothing to scan
+	if (execState->filePointer == NULL && execState->gzFilePointer == NULL)
+	{
+		return tupleSlot;
+	}
+
 	/*
 	 * Loop until we reach the end of file, or we read a line that parses to be
 	 * a valid json object, or we exceed the maximum allowed error count.
@@ -641,14 +1406,32 @@ JsonIterateForeignScan(ForeignScanState *scanState)
 			lineData = ReadLineFromFile(execState->filePointer);
 
 		if (lineData->len == 0)
-			endOfFile = true;
+		{
+			// the end of a page, or source, move on to the next one
+			if (execState->pJsp != NULL)
+				endOfFile = !JsonPageOpenNext(execState);
+			else if (execState->pJss != NULL)
+				endOfFile = !JsonSourceOpenNext(execState);
+			else
+				endOfFile = true;
+		}
 		else
 		{
-			execState->currentLineNumber++;
+			JsonLineCount(execState, lineData->len);
 
-			jsonValue = yajl_tree_parse(lineData->data, errorBuffer, sizeof(errorBuffer));
+			// let the fetches of the other scans progress, while this one is read
+			if (JsonMultiFetch != NULL && execState->currentLineNumber % JSON_FETCH_POLL_LINES == 0)
+				curlMultiFetchPoll(JsonMultiFetch);
 
-			jsonObjectValid = YAJL_IS_OBJECT(jsonValue);
+			if (rowsOnly)
+			{
+				jsonObjectValid = JsonObjectValidate(lineData->data, lineData->len, errorBuffer, sizeof(errorBuffer));
+			}
+			else
+			{
+				jsonValue = yajl_tree_parse(lineData->data, errorBuffer, sizeof(errorBuffer));
+				jsonObjectValid = YAJL_IS_OBJECT(jsonValue);
+			}
 			if (!jsonObjectValid)
 			{
 				yajl_tree_free(jsonValue);
@@ -663,7 +1446,29 @@ JsonIterateForeignScan(ForeignScanState *scanState)
 
 	if (jsonObjectValid)
 	{
-		FillTupleSlot(jsonValue, NULL, columnMappingHash, columnValues, columnNulls);
+		if (execState->pJks != NULL)
+			JsonKeyStatsRow(execState->pJks, jsonValue);
+		if (!rowsOnly)
+			FillTupleSlot(jsonValue, NULL, columnMappingHash, columnValues, columnNulls);
+		if (execState->sourceColumnIndex >= 0)
+		{
+			columnValues[execState->sourceColumnIndex] = CStringGetTextDatum(execState->pSourceName);
+			columnNulls[execState->sourceColumnIndex] = false;
+		}
+		{	int i;
+
+			for (i = 0; i < execState->partitionCount; i++)
+			{
+				columnValues[execState->pPartitionIndex[i]] = execState->pPartitionValues[i];
+				columnNulls[execState->pPartitionIndex[i]] = execState->pPartitionNulls[i];
+			}
+		}
+		if (execState->pJcc != NULL)
+			JsonCacheWriteRow(execState->pJcc, columnValues, columnNulls);
+		if (execState->pJsc != NULL)
+			JsonSharedCacheWriteRow(execState->pJsc, tupleDescriptor, columnValues, columnNulls);
+		if (execState->pTupleStore != NULL)
+			tuplestore_putvalues(execState->pTupleStore, tupleDescriptor, columnValues, columnNulls);
 		ExecStoreVirtualTuple(tupleSlot);
 
 		yajl_tree_free(jsonValue);
@@ -674,1602 +1479,6648 @@ JsonIterateForeignScan(ForeignScanState *scanState)
 						errhint("Last error message at line: %u: %s",
 								execState->currentLineNumber, errorBuffer)));
 	}
+	else if (endOfFile)
+	{
+		// the source was read through, so the caches, and the rows kept, are complete
+		if (execState->pJcc != NULL)
+			execState->pJcc->bComplete = true;
+		if (execState->pJsc != NULL)
+			execState->pJsc->bComplete = true;
+		execState->bTupleStoreComplete = (execState->pTupleStore != NULL);
+	}
 
 	return tupleSlot;
 }
 
 
-// JsonReScanForeignScan rescans the foreign table.
-static void
-JsonReScanForeignScan(ForeignScanState *scanState)
-{
-	//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
-	JsonEndForeignScan(scanState);
-	JsonBeginForeignScan(scanState, 0);
-}
-
-
 /*
- * JsonEndForeignScan finishes scanning the foreign table, and frees the acquired
- * resources.
+ * JsonReScanForeignScan rescans the foreign table. The rows that were kept are
+ * replayed, and otherwise a single source is rewound, that is on disk, even if
+ * it was fetched. Only a scan of several sources, or of pages, begins again.
+ * A parameterized scan fetches its url again, when the values of its
+ * parameters change.
  */
 static void
-JsonEndForeignScan(ForeignScanState *scanState)
+JsonReScanForeignScan(ForeignScanState *scanState)
 {
-	JsonFdwExecState *executionState = (JsonFdwExecState *) scanState->fdw_state;
+	JsonFdwExecState *execState = (JsonFdwExecState *) scanState->fdw_state;
 	//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
-	if (executionState == NULL)
+
+	// the groups of a scan that aggregates the rows are returned again,
+	// as it has no parameters, they are the same
+	if (execState != NULL && execState->pJas != NULL)
 	{
+		execState->pJas->pNext = list_head(execState->pJas->pGroups);
 		return;
 	}
 
-	if (executionState->filePointer != NULL)
+	// the url has the values of the outer row, that changed, so fetch again,
+	// as when the same values are fetched as pages, that can't be rewound
+	if (execState != NULL && execState->pParamUrl != NULL
+		&& (scanState->ss.ps.chgParam != NULL || !JsonScanRewind(execState)))
 	{
-		int closeStatus = FreeFile(executionState->filePointer);
-		if (closeStatus != 0)
-		{
-			ereport(ERROR, (errcode_for_file_access(),
-					 		errmsg("could not close file \"%s\": %m",
-								   executionState->filename)));
-		}
+		JsonParamRescan(execState);
 	}
-
-	if (executionState->gzFilePointer != NULL)
+	else if (execState != NULL && execState->bTupleStoreComplete)
 	{
-		int closeStatus = gzclose(executionState->gzFilePointer);
-		if (closeStatus != Z_OK)
-		{
-			ereport(ERROR, (errcode_for_file_access(),
-					 		errmsg("could not close file \"%s\": %m",
-								   executionState->filename)));
-		}
+		tuplestore_rescan(execState->pTupleStore);
+		execState->bReplaying = true;
 	}
-
-	if (executionState->columnMappingHash != NULL)
+	else if (execState != NULL && JsonScanRewind(execState))
 	{
-		hash_destroy(executionState->columnMappingHash);
+		// the rows are kept again, from the start
+		if (execState->pTupleStore != NULL)
+			tuplestore_clear(execState->pTupleStore);
 	}
+	else
+	{
+		int executorFlags = (execState != NULL ? execState->executorFlags : 0);
 
-	curlCfrFree(executionState->pCfr);
-
-	pfree(executionState);
+		JsonEndForeignScan(scanState);
+		JsonBeginForeignScan(scanState, executorFlags);
+	}
 }
 
 
-/*
- * JsonGetOptions returns the option values to be used when reading and parsing 
- * the json file. To resolve these values, the function checks options for the
- * foreign table, and if not present, falls back to default values.
- */
-static JsonFdwOptions *
-JsonGetOptions(Oid foreignTableId)
-{
-	JsonFdwOptions *jsonFdwOptions = (JsonFdwOptions *) palloc0(sizeof(JsonFdwOptions));
-	//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
+// A scan that has nothing to read
+static JsonFdwExecState *JsonEmptyScanBegin(ForeignScanState *scanState, HTAB *columnMappingHash, JsonFdwOptions *options)
+{	JsonFdwExecState *execState = (JsonFdwExecState *) palloc0(sizeof(JsonFdwExecState));
 
-	if(jsonFdwOptions != NULL)
-	{	char *maxErrorCountString = JsonGetOptionValue(foreignTableId, OPTION_NAME_MAX_ERROR_COUNT);
+	execState->columnMappingHash = columnMappingHash;
+	execState->maxErrorCount = options->maxErrorCount;
+	execState->sourceColumnIndex = -1;
 
-		jsonFdwOptions->maxErrorCount = (maxErrorCountString != NULL
-			? pg_atoi(maxErrorCountString, sizeof(int32), 0)
-			: DEFAULT_MAX_ERROR_COUNT
-			);
-		jsonFdwOptions->filename = JsonGetOptionValue(foreignTableId, OPTION_NAME_FILENAME);
-		jsonFdwOptions->pHttpPostVars = JsonGetOptionValue(foreignTableId, OPTION_NAME_HTTP_POST_VARS);
-		jsonFdwOptions->pRomUrl = JsonGetOptionValue(foreignTableId, OPTION_NAME_ROM_URL);
-		jsonFdwOptions->pRomPath = JsonGetOptionValue(foreignTableId, OPTION_NAME_ROM_PATH);
-	}
+	scanState->fdw_state = (void *) execState;
 
-	return jsonFdwOptions;
+	return execState;
 }
 
-
 /*
- * Json GetOptionValue walks over foreign table and foreign server options, and
- * looks for the option with the given name. If found, the function returns the
- * option's value. This function is unchanged from mongo_fdw.
+ * JsonParamRescan closes the source of a parameterized scan, whose parameters
+ * changed, ie. for the next outer row of a nested loop, so that the next
+ * Iterate fetches the url with their new values.
  */
-static char *
-JsonGetOptionValue(Oid foreignTableId, const char *optionName)
+static void JsonParamRescan(JsonFdwExecState *execState)
 {
-	ForeignTable *foreignTable = NULL;
-	ForeignServer *foreignServer = NULL;
-	List *optionList = NIL;
-	ListCell *optionCell = NULL;
-	char *optionValue = NULL;
+	// the source, and the rows and caches, of the values before
+	JsonFileClose(execState);
+	if (execState->pJss != NULL)
+	{
+		JsonSourceEnd(execState->pJss);
+		execState->pJss = NULL;
+	}
+	if (execState->pJsc != NULL)
+	{
+		JsonSharedCacheClose(execState->pJsc);
+		execState->pJsc = NULL;
+	}
+	if (execState->pJcc != NULL)
+	{
+		JsonCacheClose(execState->pJcc);
+		execState->pJcc = NULL;
+	}
+	if (execState->pTupleStore != NULL)
+	{
+		tuplestore_clear(execState->pTupleStore);
+	}
+	execState->bTupleStoreComplete = false;
+	execState->bReplaying = false;
+	execState->bParamFetch = true;
+}
 
-	//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
-	foreignTable = GetForeignTable(foreignTableId);
-	foreignServer = GetForeignServer(foreignTable->serverid);
+/*
+ * JsonParamFetch fetches the select url of a parameterized scan, with the
+ * values of its parameters. The parameter expressions, and the paging of the
+ * ROM select action, are those of Begin, so only the url is built again. A
+ * null value leaves nothing to read, until the next rescan. It is called by
+ * Iterate, in the per-tuple context, so the url, and the paging of it, are
+ * built in the context of the scan.
+ */
+static void JsonParamFetch(ForeignScanState *scanState)
+{	JsonFdwExecState *execState = (JsonFdwExecState *) scanState->fdw_state;
+	MemoryContext oldContext = MemoryContextSwitchTo(execState->scanContext);
+	const char *filename = NULL;
+	cfr_t *pCfr = NULL;
 
-	optionList = list_concat(optionList, foreignTable->options);
-	optionList = list_concat(optionList, foreignServer->options);
+	execState->bParamFetch = false;
+	execState->errorCount = 0;
+	execState->currentLineNumber = 0;
 
-	foreach(optionCell, optionList)
+	filename = JsonParamUrl(scanState, execState->pParamUrl, execState->paramNames, execState->paramExprStates);
+	execState->pSourceName = filename;
+	if (filename == NULL)
 	{
-		DefElem *optionDef = (DefElem *) lfirst(optionCell);
-		char *optionDefName = optionDef->defname;
+		if (execState->pJsp != NULL)
+			execState->pJsp->bLast = true;
+		MemoryContextSwitchTo(oldContext);
+		return;
+	}
 
-		if (strncmp(optionDefName, optionName, NAMEDATALEN) == 0)
-		{
-			optionValue = defGetString(optionDef);
-			break;
-		}
+	if (execState->pJsp != NULL)
+	{
+		JsonPageStart(execState->pJsp, filename);
+		pCfr = JsonPageNext(execState->pJsp);
 	}
+	else
+		pCfr = curlFetchFile(filename, NULL);
 
-	return optionValue;
+	execState->pCfr = pCfr;
+	if (pCfr == NULL || !pCfr->bFileFetched || pCfr->ccf.pFileName == NULL)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open file \"%s\" for reading: %m",
+							   filename)));
+	}
+
+	JsonFileOpen(execState, pCfr->ccf.pFileName);
+
+	MemoryContextSwitchTo(oldContext);
 }
 
+// The select url, with the url parameters of the values of fdw_exprs,
+// ie. of the outer row of a nested loop, as planned by JsonSelectUrlPlan.
+// Returns NULL if a value is null, as a null matches no row.
+static char *JsonParamUrl(ForeignScanState *scanState, const char *pUrl, List *paramNames, List *exprStates)
+{	ExprContext *econtext = scanState->ss.ps.ps_ExprContext;
+	ListCell *nameCell = NULL;
+	ListCell *exprCell = NULL;
+	StringInfoData url;
 
-// TupleCount estimates the number of base relation tuples in the given file.
-static double
-TupleCount(RelOptInfo *baserel, const char *filename)
-{
-	double tupleCount = 0.0;
+	if(paramNames == NIL)
+		return pstrdup(pUrl);
 
-	BlockNumber pageCountEstimate = baserel->pages;
-	if (pageCountEstimate > 0)
-	{
-		/*
-		 * We have number of pages and number of tuples from pg_class (from a
-		 * previous Analyze), so compute a tuples-per-page estimate and scale
-		 * that by the current file size.
-		 */
-		double density = baserel->tuples / (double) pageCountEstimate;
-		BlockNumber pageCount = PageCount(filename);
+	initStringInfo(&url);
+	appendStringInfoString(&url, pUrl);
 
-		tupleCount = clamp_row_est(density * (double) pageCount);
-	}
-	else
-	{
-		/*
-		 * Otherwise we have to fake it. We back into this estimate using the
-		 * planner's idea of relation width, which may be inaccurate. For better
-		 * estimates, users need to run Analyze.
-		 */
-		struct stat statBuffer;
-		int tupleWidth = 0;
+	forboth(nameCell, paramNames, exprCell, exprStates)
+	{	ExprState *exprState = (ExprState *) lfirst(exprCell);
+		Oid typefnoid = InvalidOid;
+		bool isvarlena = false;
+		bool isNull = false;
+		Datum value = ExecEvalExpr(exprState, econtext, &isNull, NULL);
 
-		int statResult = stat(filename, &statBuffer);
-		if (statResult < 0)
+		if(isNull)
 		{
-			// file may not be there at plan time, so use a default estimate
-			statBuffer.st_size = 10 * BLCKSZ;
+			pfree(url.data);
+			return NULL;
 		}
 
-		tupleWidth = MAXALIGN(baserel->width) + MAXALIGN(sizeof(HeapTupleHeaderData));
-		tupleCount = clamp_row_est((double) statBuffer.st_size / (double) tupleWidth);
+		getTypeOutputInfo(exprType((Node *) exprState->expr), &typefnoid, &isvarlena);
+		JsonUrlParamAppend(&url, strVal(lfirst(nameCell)), OidOutputFunctionCall(typefnoid, value));
 	}
 
-	return tupleCount;
+	return url.data;
 }
 
+// The url of a page, or of the page after a cursor
+static char *JsonPageUrl(jsp_t *pJsp, int page, const char *pCursor)
+{	StringInfoData url;
+	char value[32];
 
-// PageCount calculates and returns the number of pages in a file.
-static BlockNumber
-PageCount(const char *filename)
-{
-	BlockNumber pageCount = 0;
-	struct stat statBuffer;
+	initStringInfo(&url);
+	appendStringInfoString(&url, pJsp->pUrl);
 
-	// if file doesn't exist at plan time, use default estimate for its size
-	int statResult = stat(filename, &statBuffer);
-	if (statResult < 0)
+	switch(pJsp->type)
 	{
-		statBuffer.st_size = 10 * BLCKSZ;
+		case RCI_PAGING_OFFSET:
+		case RCI_PAGING_PAGE:
+			snprintf(value, sizeof(value), "%d", pJsp->first + page * (pJsp->type == RCI_PAGING_OFFSET ? pJsp->size : 1));
+			JsonUrlParamAppend(&url, pJsp->pParam, value);
+			break;
+		case RCI_PAGING_CURSOR:
+			if(pCursor != NULL)
+				JsonUrlParamAppend(&url, pJsp->pParam, pCursor);
+			break;
+		default:
+			break;
 	}
 
-	pageCount = (statBuffer.st_size + (BLCKSZ - 1)) / BLCKSZ;
-	if (pageCount < 1)
+	if(pJsp->pSizeParam != NULL && pJsp->size > 0)
 	{
-		pageCount = 1;
+		snprintf(value, sizeof(value), "%d", pJsp->size);
+		JsonUrlParamAppend(&url, pJsp->pSizeParam, value);
 	}
 
-	return pageCount;
+	return url.data;
 }
 
+static void JsonPageRequest(jsp_t *pJsp, const char *pUrl)
+{
+	if(!curlMultiFetchAdd(pJsp->pCmf, pUrl, pJsp->next, pJsp->pHeader))
+		ereport(ERROR, (errmsg("could not request page %d", pJsp->next), errhint("URL '%s'", pUrl)));
+	pJsp->next++;
+}
 
 /*
- * ColumnList takes in the planner's information about this foreign table. The
- * function then finds all columns needed for query execution, including those
- * used in projections, joins, and filter clauses, de-duplicates these columns,
- * and returns them in a new list. This function is unchanged from mongo_fdw. 
+ * If the ROM select action has "paging", start fetching the pages
+ * of pUrl. Numbered pages, by offset or page number, are fetched
+ * "window" at a time. Pages that are found by the Link header, or a
+ * cursor header of the previous page, can't be, but the next page is
+ * always fetched while the current one is read. The pages of a url are
+ * fetched by JsonPageStart.
+ *
+ * Returns NULL if the source isn't paged.
  */
-static List *
-ColumnList(RelOptInfo *baserel)
-{
-	List *columnList = NIL;
-	List *neededColumnList = NIL;
-	AttrNumber columnIndex = 1;
-	AttrNumber columnCount = baserel->max_attr;
-	List *targetColumnList = baserel->reltargetlist;
-	List *restrictInfoList = baserel->baserestrictinfo;
-	ListCell *restrictInfoCell = NULL;
+static jsp_t *JsonPageInit(rci_t *pRci)
+{	jsp_t *pJsp = NULL;
+
+	if(pRci->pagingType == RCI_PAGING_NONE
+		|| (pRci->pagingType == RCI_PAGING_OFFSET && pRci->pagingSize <= 0)
+		|| ((pRci->pagingType == RCI_PAGING_OFFSET || pRci->pagingType == RCI_PAGING_PAGE || pRci->pagingType == RCI_PAGING_CURSOR)
+			&& (pRci->pPagingParam == NULL || !*pRci->pPagingParam))
+		|| (pRci->pagingType == RCI_PAGING_CURSOR && (pRci->pPagingHeader == NULL || !*pRci->pPagingHeader))
+		)
+		return NULL;
+
+	pJsp = (jsp_t *) palloc0(sizeof(jsp_t));
+	pJsp->type = pRci->pagingType;
+	pJsp->pParam = (pRci->pPagingParam != NULL ? pstrdup(pRci->pPagingParam) : NULL);
+	pJsp->pSizeParam = (pRci->pPagingSizeParam != NULL && *pRci->pPagingSizeParam ? pstrdup(pRci->pPagingSizeParam) : NULL);
+	pJsp->pHeader = (pRci->pPagingHeader != NULL && *pRci->pPagingHeader ? pstrdup(pRci->pPagingHeader) : NULL);
+	pJsp->size = pRci->pagingSize;
+	pJsp->first = pRci->pagingFirst;
+	pJsp->window = (pRci->pagingWindow > 0 ? pRci->pagingWindow : 1);
+	pJsp->current = -1;
+	pJsp->bLast = true; // until started
+
+	return pJsp;
+}
 
-	// first add the columns used in joins and projections
-	neededColumnList = list_copy(targetColumnList);
+// Start fetching the pages of pUrl, from the first, ie. again for a rescan
+static void JsonPageStart(jsp_t *pJsp, const char *pUrl)
+{	int i;
 
-	// then walk over all restriction clauses, and pull up any used columns
-	foreach(restrictInfoCell, restrictInfoList)
+	if(pJsp->pCmf != NULL)
 	{
-		RestrictInfo *restrictInfo = (RestrictInfo *) lfirst(restrictInfoCell);
-		Node *restrictClause = (Node *) restrictInfo->clause;
-		List *clauseColumnList = NIL;
-
-		// recursively pull up any columns used in the restriction clause
-		clauseColumnList = pull_var_clause(restrictClause,
-						   PVC_RECURSE_AGGREGATES,
-						   PVC_RECURSE_PLACEHOLDERS);
-
-		neededColumnList = list_union(neededColumnList, clauseColumnList);
+		JsonMultiFetchUntrack(pJsp->pCmf, 0);
+		curlMultiFetchFree(pJsp->pCmf);
 	}
 
-	// walk over all column definitions, and de-duplicate column list
-	for (columnIndex = 1; columnIndex <= columnCount; columnIndex++)
-	{
-		ListCell *neededColumnCell = NULL;
-		Var *column = NULL;
+	pJsp->pUrl = pstrdup(pUrl);
+	pJsp->next = 0;
+	pJsp->current = -1;
+	pJsp->lines = 0;
+	pJsp->bLast = false;
 
-		// look for this column in the needed column list
-		foreach(neededColumnCell, neededColumnList)
-		{
-			Var *neededColumn = (Var *) lfirst(neededColumnCell);
-			if (neededColumn->varattno == columnIndex)
-			{
-				column = neededColumn;
-				break;
-			}
-		}
+	pJsp->pCmf = curlMultiFetchInit();
+	if(pJsp->pCmf == NULL)
+		ereport(ERROR, (errmsg("could not start fetching pages"), errhint("URL '%s'", pUrl)));
+	JsonMultiFetchTrack(pJsp->pCmf, 0, 0, true);
 
-		if (column != NULL)
-		{
-			columnList = lappend(columnList, column);
-		}
+	if(pJsp->type == RCI_PAGING_OFFSET || pJsp->type == RCI_PAGING_PAGE)
+	{
+		for(i=0; i<pJsp->window; i++)
+			JsonPageRequest(pJsp, JsonPageUrl(pJsp, i, NULL));
 	}
-
-	return columnList;
+	else
+		JsonPageRequest(pJsp, JsonPageUrl(pJsp, 0, NULL));
 }
 
-
 /*
- * ColumnMappingHash creates a hash table that maps column names to column index
- * and types. This table helps us quickly translate JSON document key/values to
- * corresponding PostgreSQL columns. This function is unchanged from mongo_fdw.
+ * Wait for the next page, and keep the pages after it coming.
+ * The caller owns the result, and must curlCfrFree it.
+ *
+ * Returns NULL when there are no more pages. A numbered page
+ * with fewer rows than the page size, or no rows, is the last one,
+ * as is the one before a page that is answered with 404 or 416.
+ * A page that fails otherwise is returned, not fetched.
  */
-static HTAB *
-ColumnMappingHash(Oid foreignTableId, List *columnList)
-{
-	HTAB *columnMappingHash = NULL;
-	ListCell *columnCell = NULL;
-	const long hashTableSize = 2048;
-
-	// create hash table
-	HASHCTL hashInfo;
-	memset(&hashInfo, 0, sizeof(hashInfo));
-	hashInfo.keysize = NAMEDATALEN;
-	hashInfo.entrysize = sizeof(ColumnMapping);
-	hashInfo.hash = string_hash;
-	hashInfo.hcxt = CurrentMemoryContext;
+static cfr_t *JsonPageNext(jsp_t *pJsp)
+{	cfr_t *pCfr = NULL;
 
-	columnMappingHash = hash_create("Column Mapping Hash", hashTableSize, &hashInfo,
-									(HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT));
-	Assert(columnMappingHash != NULL);
+	if(pJsp->current >= 0
+		&& (pJsp->type == RCI_PAGING_OFFSET || pJsp->type == RCI_PAGING_PAGE)
+		&& (pJsp->lines == 0 || (pJsp->size > 0 && pJsp->lines < pJsp->size))
+		)
+		pJsp->bLast = true;
 
-	foreach(columnCell, columnList)
-	{
-		Var *column = (Var *) lfirst(columnCell);
-		AttrNumber columnId = column->varattno;
+	if(pJsp->bLast)
+		return NULL;
 
-		ColumnMapping *columnMapping = NULL;
-		char *columnName = NULL;
-		bool handleFound = false;
-		void *hashKey = NULL;
+	// keep the window full
+	if(pJsp->current >= 0 && (pJsp->type == RCI_PAGING_OFFSET || pJsp->type == RCI_PAGING_PAGE))
+		JsonPageRequest(pJsp, JsonPageUrl(pJsp, pJsp->next, NULL));
 
-		columnName = get_relid_attribute_name(foreignTableId, columnId);
-		hashKey = (void *) columnName;
+	pJsp->current++;
+	pJsp->lines = 0;
+	pCfr = curlMultiFetchWait(pJsp->pCmf, pJsp->current);
 
-		columnMapping = (ColumnMapping *) hash_search(columnMappingHash, hashKey,
-													  HASH_ENTER, &handleFound);
-		Assert(columnMapping != NULL);
+	if(pCfr != NULL && !pCfr->bFileFetched && pJsp->current > 0
+		&& (pCfr->httpResponseCode == 404 || pCfr->httpResponseCode == 416)
+		)
+	{
+		// past the last page of a server that doesn't answer an
+		// empty page, for a page beyond the end, but not found, or
+		// not satisfiable. Any other failure is the caller's error.
+		curlCfrFree(pCfr);
+		pCfr = NULL;
+		pJsp->bLast = true;
+	}
+	else if(pCfr != NULL && pCfr->bFileFetched
+		&& (pJsp->type == RCI_PAGING_LINK || pJsp->type == RCI_PAGING_CURSOR)
+		)
+	{	const char *pNext = (pJsp->type == RCI_PAGING_LINK ? pCfr->pLinkNext : pCfr->pCursor);
 
-		columnMapping->columnIndex = columnId - 1;
-		columnMapping->columnTypeId = column->vartype;
-		columnMapping->columnTypeMod = column->vartypmod;
-		columnMapping->columnArrayTypeId = get_element_type(column->vartype);
+		// fetch the next page while this one is read
+		if(pNext != NULL && *pNext)
+			JsonPageRequest(pJsp, (pJsp->type == RCI_PAGING_LINK ? pNext : JsonPageUrl(pJsp, pJsp->next, pNext)));
+		else
+			pJsp->bLast = true;
 	}
 
-	return columnMappingHash;
+	return pCfr;
 }
 
+// Close the page just read, and open the next one
+// Returns false if there are no more pages
+static bool JsonPageOpenNext(JsonFdwExecState *execState)
+{	cfr_t *pCfr = NULL;
+	const char *filename = NULL;
+
+	JsonFileClose(execState);
 
-// GzipFilename returns true if the filename ends with a gzip file extension.
-static bool
-GzipFilename(const char *filename)
-{
-	bool gzipFile = false;
-	const char *extension = NULL;
+	pCfr = JsonPageNext(execState->pJsp);
+	if (pCfr == NULL)
+	{
+		return false;
+	}
 
-	extension = strrchr(filename, '.');
-	if (extension != NULL)
+	execState->pCfr = pCfr;
+	filename = pCfr->ccf.pFileName;
+	if (!pCfr->bFileFetched || filename == NULL)
 	{
-		if (strncmp(extension, GZIP_FILE_EXTENSION, MAXPGPATH) == 0)
-		{
-			gzipFile = true;
-		}
+		ereport(ERROR, (errmsg("could not fetch page %d", execState->pJsp->current),
+						errhint("URL '%s' http response code %lu", execState->pJsp->pUrl, pCfr->httpResponseCode)));
 	}
 
-	return gzipFile;
-}
+	JsonFileOpen(execState, filename);
 
+	return true;
+}
 
-// HdfsBlockName returns true if filename belongs to a hdfs block.
-static bool
-HdfsBlockName(const char *filename)
+// Open filename, a page or source that is on disk, for reading
+static void JsonFileOpen(JsonFdwExecState *execState, const char *filename)
 {
-	bool hdfsBlock = false;
-	const char *basename = NULL;
-
-	const char *lastDirSeparator = last_dir_separator(filename);
-	if (lastDirSeparator == NULL)
+	execState->filename = filename;
+	if (GzipFilename(filename) || HdfsBlockName(filename))
 	{
-		basename = filename;
+		execState->gzFilePointer = gzopen(filename, PG_BINARY_R);
 	}
 	else
 	{
-		basename = lastDirSeparator + 1;
+		execState->filePointer = AllocateFile(filename, PG_BINARY_R);
 	}
 
-	if (strncmp(basename, HDFS_BLOCK_PREFIX, HDFS_BLOCK_PREFIX_LENGTH) == 0)
+	if (execState->filePointer == NULL && execState->gzFilePointer == NULL)
 	{
-		hdfsBlock = true;
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open file \"%s\" for reading: %m",
+							   filename)));
 	}
 
-	return hdfsBlock;
+	execState->fileBytes += JsonFileBytes(filename);
 }
 
+// The size of a file, as stored, or 0 if it can't be found
+static uint64 JsonFileBytes(const char *filename)
+{
+	struct stat statBuffer;
+
+	return (stat(filename, &statBuffer) == 0 ? (uint64) statBuffer.st_size : 0);
+}
 
 /*
- * ReadLineFromFile reads and returns the next line in the file. If the function
- * reaches the end of file without reading input, it returns an empty string.
+ * JsonSampleBlockNext positions the file at the next line that starts in a
+ * sampled block, moving on to the next sampled block once the lines of the
+ * current one have been read. A block starts at the line after the first
+ * newline in it. It returns false when there are no more blocks to sample.
  */
-static StringInfo
-ReadLineFromFile(FILE *filePointer)
+static bool JsonSampleBlockNext(JsonFdwExecState *execState, jbs_t *pJbs)
 {
-	StringInfo lineData = makeStringInfo();
-	bool endOfFile = false;
-	bool endOfLine = false;
-	char buffer[READ_BUFFER_SIZE];
+	FILE *filePointer = execState->filePointer;
+	off_t position = ftello(filePointer);
 
-	// read from file until either we reach end of file or end of line
-	while (!endOfFile && !endOfLine)
+	while (position >= pJbs->blockEnd)
 	{
-		char *fgetsResult;
-		
-		memset(buffer, 0, sizeof(buffer));
-		fgetsResult = fgets(buffer, sizeof(buffer), filePointer);
-		if (fgetsResult == NULL)
+		off_t blockStart = 0;
+		int64 block = -1;
+
+		// Algorithm S, the next block is selected with the probability of
+		// the blocks still needed, over the blocks left
+		while (block < 0 && pJbs->next < pJbs->blocks && pJbs->selected < pJbs->target)
 		{
-			int errorResult = ferror(filePointer);
-			if (errorResult != 0)
+			if (anl_random_fract() * (pJbs->blocks - pJbs->next) < (pJbs->target - pJbs->selected))
 			{
-				ereport(ERROR, (errcode_for_file_access(),
-								errmsg("could not read from json file: %m")));
+				block = pJbs->next;
+				pJbs->selected++;
 			}
-
-			endOfFile = true;
+			pJbs->next++;
 		}
-		else
+
+		if (block < 0)
+			return false;
+
+		blockStart = (off_t) block * JSON_SAMPLE_BLOCK_SIZE;
+		pJbs->blockEnd = blockStart + JSON_SAMPLE_BLOCK_SIZE;
+
+		// resync to a newline, unless a long line already read reaches into the block
+		if (position < blockStart)
 		{
-			// check if we read a new line
-			endOfLine = (buffer[strlen(buffer) - 1] == '\n');
+			if (fseeko(filePointer, blockStart - 1, SEEK_SET) != 0)
+			{
+				ereport(ERROR, (errcode_for_file_access(),
+								errmsg("could not seek in json file: %m")));
+			}
 
-			appendStringInfoString(lineData, buffer);
+			// the rest of the line that the block starts in, which may be just the newline before it
+			SkipLineFromFile(filePointer, NULL);
+			position = ftello(filePointer);
 		}
 	}
 
-	return lineData;
+	return true;
 }
 
-
 /*
- * ReadLineFromFile reads and returns the next line in the file. If the function
- * reaches the end of file without reading input, it returns an empty string.
+ * JsonSkipLine reads past the next line without parsing it, moving on to the
+ * next page or source at the end of one, as JsonIterateForeignScan does. It
+ * returns false at the end of the last one.
  */
-static StringInfo
-ReadLineFromGzipFile(gzFile gzFilePointer)
+static bool JsonSkipLine(JsonFdwExecState *execState)
 {
-	StringInfo lineData = makeStringInfo();
-	bool endOfFile = false;
-	bool endOfLine = false;
-	char buffer[READ_BUFFER_SIZE];
+	size_t lineLength = 0;
 
-	// read from file until either we reach end of file or end of line
-	while (!endOfFile && !endOfLine)
+	while (lineLength == 0)
 	{
-		char *getsResult = gzgets(gzFilePointer, buffer, sizeof(buffer));
-		if (getsResult == NULL)
+		if (execState->filePointer == NULL && execState->gzFilePointer == NULL)
+			return false;
+
+		lineLength = SkipLineFromFile(execState->filePointer, execState->gzFilePointer);
+		if (lineLength == 0)
 		{
-			int errorResult = 0;
-			const char *message = gzerror(gzFilePointer, &errorResult);
-			if (errorResult != Z_OK && errorResult != Z_STREAM_END)
+			// the end of a page, or source, move on to the next one
+			if (execState->pJsp != NULL)
 			{
-				ereport(ERROR, (errmsg("could not read from json file"), 
-								errhint("%s", message)));
+				if (!JsonPageOpenNext(execState))
+					return false;
 			}
-
-			endOfFile = true;
-		}
-		else
-		{
-			// check if we read a new line
-			endOfLine = (buffer[strlen(buffer) - 1] == '\n');
-
-			appendStringInfoString(lineData, buffer);
+			else if (execState->pJss != NULL)
+			{
+				if (!JsonSourceOpenNext(execState))
+					return false;
+			}
+			else
+				return false;
 		}
 	}
 
-	return lineData;
+	JsonLineCount(execState, lineLength);
+
+	return true;
+}
+
+/*
+ * JsonLineCount counts a line that was read, or skipped, of lineLength bytes,
+ * with its newline, which ReadLineFromFile keeps, and SkipLineFromFile counts,
+ * so that the bytes per row that Analyze measures don't depend on how many of
+ * the rows were skipped.
+ */
+static void JsonLineCount(JsonFdwExecState *execState, size_t lineLength)
+{
+	execState->currentLineNumber++;
+	execState->bytesRead += lineLength;
+	if (execState->pJsp != NULL)
+		execState->pJsp->lines++;
 }
 
+// Close the page or source just read, and free its fetch result
+static void JsonFileClose(JsonFdwExecState *execState)
+{
+	if (execState->filePointer != NULL)
+	{
+		FreeFile(execState->filePointer);
+		execState->filePointer = NULL;
+	}
+	if (execState->gzFilePointer != NULL)
+	{
+		gzclose(execState->gzFilePointer);
+		execState->gzFilePointer = NULL;
+	}
+	curlCfrFree(execState->pCfr);
+	execState->pCfr = NULL;
+}
 
 /*
- * FillTupleSlot walks over all key/value pairs in the given document. For each
- * pair, the function checks if the key appears in the column mapping hash, and
- * if the value type is compatible with the one specified for the column. If so
- * the function converts the value and fills the corresponding tuple position.
- * The jsonObjectKey parameter is used for recursion, and should always be
- * passed as NULL. This function is based on the function with the same name in
- * mongo_fdw.
+ * JsonScanRewind rewinds the scan of a single source, to read it again from
+ * the start, or from the start of the cache it is read from. A cache that is
+ * being written is added if it is complete, or otherwise abandoned, so the
+ * rows aren't written twice. Returns false if the scan can't be rewound.
  */
-static void
-FillTupleSlot(const yajl_val jsonObject, const char *jsonObjectKey,
-			  HTAB *columnMappingHash, Datum *columnValues, bool *columnNulls)
+static bool JsonScanRewind(JsonFdwExecState *execState)
 {
-	uint32 jsonKeyCount = jsonObject->u.object.len;
-	const char **jsonKeyArray = jsonObject->u.object.keys;
-	yajl_val *jsonValueArray = jsonObject->u.object.values;
-	uint32 jsonKeyIndex = 0;
+	if (execState->pJss != NULL || execState->pJsp != NULL)
+	{
+		return false;
+	}
 
-	// loop over key/value pairs of the json object
-	for (jsonKeyIndex = 0; jsonKeyIndex < jsonKeyCount; jsonKeyIndex++)
+	if (execState->pJsc != NULL && !execState->pJsc->bWriting)
 	{
-		const char *jsonKey = jsonKeyArray[jsonKeyIndex];
-		yajl_val jsonValue = jsonValueArray[jsonKeyIndex];
+		execState->pJsc->offset = 0;
+		return true;
+	}
+	if (execState->pJsc != NULL)
+	{
+		JsonSharedCacheClose(execState->pJsc);
+		execState->pJsc = NULL;
+	}
 
-		ColumnMapping *columnMapping = NULL;
-		Oid columnTypeId = InvalidOid;
-		Oid columnArrayTypeId = InvalidOid;
-		Oid columnTypeMod = InvalidOid;
-		bool compatibleTypes = false;
-		bool handleFound = false;
-		const char *jsonFullKey = NULL;
-		void *hashKey = NULL;
+	if (execState->pJcc != NULL && !execState->pJcc->bWriting)
+	{
+		return JsonCacheRewind(execState->pJcc);
+	}
+	if (execState->pJcc != NULL)
+	{
+		JsonCacheClose(execState->pJcc);
+		execState->pJcc = NULL;
+	}
 
-		if (jsonObjectKey != NULL)
-		{
-			/*
-			 * For fields in nested json objects, we use fully qualified field
-			 * name to check the column mapping.
-			 */
-			StringInfo jsonFullKeyString = makeStringInfo();
-			appendStringInfo(jsonFullKeyString, "%s.%s", jsonObjectKey, jsonKey);
-			jsonFullKey = jsonFullKeyString->data;
-		}
-		else
-		{
-			jsonFullKey = jsonKey;
-		}
+	if (execState->filePointer != NULL)
+	{
+		if (fseeko(execState->filePointer, 0, SEEK_SET) != 0)
+			return false;
+	}
+	else if (execState->gzFilePointer != NULL)
+	{
+		if (gzrewind(execState->gzFilePointer) != 0)
+			return false;
+	}
+	else
+	{
+		return false;
+	}
 
-		// recurse into nested objects
-		if (YAJL_IS_OBJECT(jsonValue))
-		{
-			FillTupleSlot(jsonValue, jsonFullKey, columnMappingHash,
-						  columnValues, columnNulls);
-			continue;
-		}
+	execState->currentLineNumber = 0;
+	execState->errorCount = 0;
 
-		// look up the corresponding column for this json key
-		hashKey = (void *) jsonFullKey;
-		columnMapping = (ColumnMapping *) hash_search(columnMappingHash, hashKey,
-													  HASH_FIND, &handleFound);
+	return true;
+}
 
-		// if no corresponding column or null json value, continue
-		if (columnMapping == NULL || YAJL_IS_NULL(jsonValue))
-		{
-			continue;
-		}
+/*
+ * JsonCacheKey returns what identifies the content of a source, and the types
+ * of the columns it is read into, as the key of its caches. A fetched source
+ * is identified by its ETag, and otherwise a file by its device, inode, change
+ * and modification times and size. As the times are in seconds, a file that
+ * was modified in the last second isn't cached, since it could be written
+ * again within that second, without changing any of them. Returns NULL if the
+ * source can't be identified.
+ */
+static char *JsonCacheKey(TupleDesc tupleDescriptor, const char *pSourceName, const char *filename, cfr_t *pCfr)
+{
+	StringInfoData key;
+	struct stat statBuffer;
+	int i;
 
-		// check if columns have compatible types
-		columnTypeId = columnMapping->columnTypeId;
-		columnArrayTypeId = columnMapping->columnArrayTypeId;
-		columnTypeMod = columnMapping->columnTypeMod;
+	initStringInfo(&key);
+	appendStringInfo(&key, "%s\n", pSourceName);
+	if (pCfr != NULL && pCfr->ccf.pHdrs[HDR_IDX_ETAG] != NULL && *pCfr->ccf.pHdrs[HDR_IDX_ETAG])
+	{
+		appendStringInfo(&key, "etag %s\n", pCfr->ccf.pHdrs[HDR_IDX_ETAG]);
+	}
+	else if (filename != NULL && stat(filename, &statBuffer) == 0
+		&& statBuffer.st_mtime < time(NULL) - 1 && statBuffer.st_ctime < time(NULL) - 1)
+	{
+		appendStringInfo(&key, "file %lu %lu %ld %ld %ld\n", (unsigned long) statBuffer.st_dev,
+						 (unsigned long) statBuffer.st_ino, (long) statBuffer.st_ctime,
+						 (long) statBuffer.st_mtime, (long) statBuffer.st_size);
+	}
+	else
+	{
+		pfree(key.data);
+		return NULL;
+	}
 
-		if (OidIsValid(columnArrayTypeId))
-		{
-			compatibleTypes = YAJL_IS_ARRAY(jsonValue);
-		}
+	for (i = 0; i < tupleDescriptor->natts; i++)
+	{
+		Form_pg_attribute attr = tupleDescriptor->attrs[i];
+
+		if (attr->attisdropped)
+			appendStringInfoString(&key, "-\n");
 		else
-		{
-			compatibleTypes = ColumnTypesCompatible(jsonValue, columnTypeId);
-		}
+			appendStringInfo(&key, "%s %u %d\n", NameStr(attr->attname), attr->atttypid, attr->atttypmod);
+	}
 
-		// if types are incompatible, leave this column null
-		if (!compatibleTypes)
-		{
-			continue;
-		}
+	return key.data;
+}
 
-		// fill in corresponding column value and null flag
-		if (OidIsValid(columnArrayTypeId))
-		{
-			uint32 columnIndex = columnMapping->columnIndex;
-			columnValues[columnIndex] = ColumnValueArray(jsonValue, columnArrayTypeId,
-														 columnTypeMod);
-			columnNulls[columnIndex] = false;
-		}
-		else
+// The columns of the table, that the scan that writes a cache reads
+static List *JsonCacheColumnList(TupleDesc tupleDescriptor, bool *pColumns)
+{
+	List *columnList = NIL;
+	int i;
+
+	for (i = 0; i < tupleDescriptor->natts; i++)
+	{
+		Form_pg_attribute attr = tupleDescriptor->attrs[i];
+
+		if (!attr->attisdropped && pColumns[i])
 		{
-			uint32 columnIndex = columnMapping->columnIndex;
-			columnValues[columnIndex] = ColumnValue(jsonValue, columnTypeId,
-													columnTypeMod);
-			columnNulls[columnIndex] = false;
+			columnList = lappend(columnList, makeVar(1, i + 1, attr->atttypid, attr->atttypmod, attr->attcollation, 0));
 		}
 	}
+
+	return columnList;
+}
+
+/*
+ * JsonCacheDirectory creates the directory of the cache files, if it isn't
+ * there, readable only by the server, and checks that one that is there is
+ * the server's, and not readable or writable by anyone else, as the files in
+ * it are read as the datums of the rows they cache.
+ */
+static const char *JsonCacheDirectory(void)
+{
+	const char *pDirectory = (JsonCacheDirectoryPath != NULL && *JsonCacheDirectoryPath ? JsonCacheDirectoryPath : JSON_CACHE_DIR);
+	struct stat statBuffer;
+
+	if (mkdir(pDirectory, S_IRWXU) != 0 && errno != EEXIST)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not create columnar cache directory \"%s\": %m", pDirectory)));
+	}
+
+	if (stat(pDirectory, &statBuffer) != 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not stat columnar cache directory \"%s\": %m", pDirectory)));
+	}
+
+	if (!S_ISDIR(statBuffer.st_mode) || statBuffer.st_uid != geteuid()
+		|| (statBuffer.st_mode & (S_IRWXG | S_IRWXO)) != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+						errmsg("columnar cache directory \"%s\" has invalid ownership or permissions", pDirectory),
+						errhint("It must be a directory owned by the server, with permissions u=rwx (0700).")));
+	}
+
+	return pDirectory;
 }
 
+static int JsonCacheFileCompare(const void *a, const void *b)
+{
+	time_t aTime = ((const JsonCacheFile *) a)->lastUsed;
+	time_t bTime = ((const JsonCacheFile *) b)->lastUsed;
+
+	return (aTime < bTime ? -1 : (aTime > bTime ? 1 : 0));
+}
 
 /*
- * ColumnTypesCompatible checks if the given json value can be converted to the
- * given PostgreSQL type.
+ * JsonCacheEvict removes the least recently used cache files, until they are
+ * no larger than json_fdw.columnar_cache_size, and the files of the scans that
+ * didn't finish writing them, ie. of a backend that crashed, after an hour.
  */
-static bool
-ColumnTypesCompatible(yajl_val jsonValue, Oid columnTypeId)
+static void JsonCacheEvict(const char *pDirectory)
 {
-	bool compatibleTypes = false;
+	DIR *dir = AllocateDir(pDirectory);
+	struct dirent *entry = NULL;
+	JsonCacheFile *pFiles = NULL;
+	int fileCount = 0;
+	int fileAlloc = 16;
+	double totalSize = 0.0;
+	time_t now = time(NULL);
+	int i;
 
-	// we consider the PostgreSQL column type as authoritative
-	switch(columnTypeId)
+	if (dir == NULL)
 	{
-		case INT2OID: case INT4OID:
-		case INT8OID: case FLOAT4OID:
-		case FLOAT8OID: case NUMERICOID:
-		{
-			if (YAJL_IS_NUMBER(jsonValue))
-			{
-				compatibleTypes = true;
-			}
-			break;
-		}
-		case BOOLOID:
+		return;
+	}
+
+	pFiles = (JsonCacheFile *) palloc(sizeof(JsonCacheFile) * fileAlloc);
+	while ((entry = ReadDir(dir, pDirectory)) != NULL)
+	{
+		char *pPath = NULL;
+		char *pExtension = strstr(entry->d_name, ".jfc");
+		struct stat statBuffer;
+
+		if (pExtension == NULL)
+			continue;
+
+		pPath = psprintf("%s/%s", pDirectory, entry->d_name);
+		if (stat(pPath, &statBuffer) != 0 || !S_ISREG(statBuffer.st_mode))
 		{
-			if (YAJL_IS_TRUE(jsonValue) || YAJL_IS_FALSE(jsonValue))
-			{
-				compatibleTypes = true;
-			}
-			break;
+			pfree(pPath);
 		}
-		case BPCHAROID:
-		case VARCHAROID:
-		case TEXTOID:
+		else if (pExtension[4] != '\0')
 		{
-			if (YAJL_IS_STRING(jsonValue))
-			{
-				compatibleTypes = true;
-			}
-			break;
+			// the temporary file of a scan that is writing it
+			if (statBuffer.st_mtime < now - JSON_CACHE_TMP_SECS)
+				unlink(pPath);
+			pfree(pPath);
 		}
-		case DATEOID:
-		case TIMESTAMPOID:
-		case TIMESTAMPTZOID:
+		else
 		{
-			if (YAJL_IS_STRING(jsonValue))
+			if (fileCount == fileAlloc)
 			{
-				const char *stringValue = (char *) YAJL_GET_STRING(jsonValue);
-
-				bool validDateTimeFormat = ValidDateTimeFormat(stringValue);
-				if (validDateTimeFormat)
-				{
-					compatibleTypes = true;
-				}
+				fileAlloc *= 2;
+				pFiles = (JsonCacheFile *) repalloc(pFiles, sizeof(JsonCacheFile) * fileAlloc);
 			}
-			break;
+			pFiles[fileCount].pPath = pPath;
+			pFiles[fileCount].size = statBuffer.st_size;
+			pFiles[fileCount].lastUsed = statBuffer.st_mtime;
+			totalSize += statBuffer.st_size;
+			fileCount++;
 		}
-		default:
+	}
+	FreeDir(dir);
+
+	qsort(pFiles, fileCount, sizeof(JsonCacheFile), JsonCacheFileCompare);
+	for (i = 0; i < fileCount && totalSize > JsonCacheSize * 1024.0; i++)
+	{
+		if (unlink(pFiles[i].pPath) == 0)
+			totalSize -= pFiles[i].size;
+	}
+
+	for (i = 0; i < fileCount; i++)
+		pfree(pFiles[i].pPath);
+	pfree(pFiles);
+}
+
+/*
+ * JsonCacheHeaderRead reads the header of a cache file, and the columns that
+ * it has. Returns false if it isn't the file of the key, but one that it
+ * collides with, or of a previous version, or if it is truncated.
+ */
+static bool JsonCacheHeaderRead(FILE *filePointer, const char *key, int columnCount, bool *pPresent)
+{
+	char magic[sizeof(JSON_CACHE_MAGIC) - 1];
+	uint32 keyLen = strlen(key);
+	uint32 fileKeyLen = 0;
+	uint32 fileColumnCount = 0;
+	char *fileKey = NULL;
+	bits8 *pColumns = NULL;
+	bool bMatch = false;
+	int i;
+
+	if (fread(magic, sizeof(magic), 1, filePointer) == 1
+		&& memcmp(magic, JSON_CACHE_MAGIC, sizeof(magic)) == 0
+		&& fread(&fileKeyLen, sizeof(fileKeyLen), 1, filePointer) == 1
+		&& fileKeyLen == keyLen
+		)
+	{
+		fileKey = (char *) palloc(keyLen + 1);
+		pColumns = (bits8 *) palloc0(BITMAPLEN(columnCount));
+		bMatch = (fread(fileKey, 1, keyLen, filePointer) == keyLen && memcmp(fileKey, key, keyLen) == 0
+			&& fread(&fileColumnCount, sizeof(fileColumnCount), 1, filePointer) == 1
+			&& fileColumnCount == columnCount
+			&& fread(pColumns, 1, BITMAPLEN(columnCount), filePointer) == BITMAPLEN(columnCount)
+			);
+		for (i = 0; bMatch && i < columnCount; i++)
 		{
-			/*
-			 * We currently error out on other data types. Some types such as
-			 * byte arrays are easy to add, but they need testing. Other types
-			 * such as money or inet, do not have equivalents in JSON.
-			 */
-			ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_DATA_TYPE),
-							errmsg("cannot convert json type to column type"),
-							errhint("column type: %u", (uint32) columnTypeId)));
-			break;
+			pPresent[i] = ((pColumns[i / BITS_PER_BYTE] & (1 << (i % BITS_PER_BYTE))) != 0);
 		}
+		pfree(pColumns);
+		pfree(fileKey);
 	}
 
-	return compatibleTypes;
+	return bMatch;
 }
 
+/*
+ * JsonCacheVerify walks the stripe headers of a cache file, seeking past the
+ * columns, and checks that each stripe is whole, so a file that is truncated
+ * is a cache miss, rather than read. The crc of a column is checked when it
+ * is read, by JsonCacheStripeRead, so opening the cache reads only the
+ * headers. Leaves the file at its end.
+ */
+static bool JsonCacheVerify(FILE *filePointer, int columnCount)
+{
+	uint32 *pLens = (uint32 *) palloc(sizeof(uint32) * 3 * columnCount);
+	struct stat fileStat;
+	bool bValid = (fstat(fileno(filePointer), &fileStat) == 0);
+	bool bEnd = false;
+
+	while (bValid && !bEnd)
+	{
+		uint32 rows = 0;
+		off_t storedLen = 0;
+		int i;
+
+		if (fread(&rows, sizeof(rows), 1, filePointer) != 1)
+		{
+			bEnd = true;
+			bValid = (feof(filePointer) && !ferror(filePointer));
+			continue;
+		}
+
+		bValid = (rows > 0 && rows <= JSON_CACHE_STRIPE_ROWS
+			&& fread(pLens, sizeof(uint32), 3 * columnCount, filePointer) == 3 * columnCount
+			);
+		for (i = 0; bValid && i < columnCount; i++)
+		{
+			bValid = (pLens[i * 3] >= BITMAPLEN(rows));
+			storedLen += pLens[i * 3 + 1];
+		}
+
+		// seeking past the end of the file succeeds, so it is checked against its size
+		bValid = (bValid && ftello(filePointer) + storedLen <= fileStat.st_size
+			&& fseeko(filePointer, storedLen, SEEK_CUR) == 0
+			);
+	}
+	pfree(pLens);
+
+	return bValid;
+}
 
 /*
- * ValidDateTimeFormat checks if the given dateTimeString can be parsed and decoded
- * as a date/timestamp. The algorithm used here is based on date_in, timestamp_in,
- * and timestamptz_in functions.
+ * JsonCacheOpen opens the columnar cache of the key for reading the wanted
+ * columns, if there is one that has them, and otherwise starts writing it, to
+ * a temporary file that is renamed once complete, with the wanted columns, and
+ * those of the cache that was there. A file that isn't whole is a miss.
+ * Returns NULL if the cache can't be written.
  */
-static bool
-ValidDateTimeFormat(const char *dateTimeString)
+static jcc_t *JsonCacheOpen(TupleDesc tupleDescriptor, const char *key, bool *pWanted)
 {
-	bool validDateTimeFormat = false;
-	char workBuffer[MAXDATELEN + 1];
-	char *fieldArray[MAXDATEFIELDS];
-	int fieldTypeArray[MAXDATEFIELDS];
-	int fieldCount = 0;
+	jcc_t *pJcc = NULL;
+	char keyHash[33];
+	const char *pDirectory = NULL;
+	int columnCount = tupleDescriptor->natts;
+	MemoryContext oldContext = NULL;
+	int i;
 
-	int parseError = ParseDateTime(dateTimeString, workBuffer, sizeof(workBuffer),
-								   fieldArray, fieldTypeArray, MAXDATEFIELDS, 
-								   &fieldCount);
+	if (!pg_md5_hash(key, strlen(key), keyHash))
+	{
+		return NULL;
+	}
 
-	if (parseError == 0)
+	pDirectory = JsonCacheDirectory();
+	pJcc = (jcc_t *) palloc0(sizeof(jcc_t));
+	pJcc->pFileName = psprintf("%s/%s.jfc", pDirectory, keyHash);
+	pJcc->columnCount = columnCount;
+	pJcc->pTypLen = (int16 *) palloc0(sizeof(int16) * (columnCount + 1));
+	pJcc->pTypByVal = (bool *) palloc0(sizeof(bool) * (columnCount + 1));
+	pJcc->pNeeded = (bool *) palloc0(sizeof(bool) * (columnCount + 1));
+	pJcc->pPresent = (bool *) palloc0(sizeof(bool) * (columnCount + 1));
+	pJcc->pValues = (StringInfoData *) palloc0(sizeof(StringInfoData) * (columnCount + 1));
+	pJcc->ppNulls = (bits8 **) palloc0(sizeof(bits8 *) * (columnCount + 1));
+	pJcc->ppCursor = (char **) palloc0(sizeof(char *) * (columnCount + 1));
+	pJcc->ppEnd = (char **) palloc0(sizeof(char *) * (columnCount + 1));
+	pJcc->context = AllocSetContextCreate(CurrentMemoryContext,
+					 "json_fdw columnar cache context",
+					 ALLOCSET_DEFAULT_MINSIZE,
+					 ALLOCSET_DEFAULT_INITSIZE,
+					 ALLOCSET_DEFAULT_MAXSIZE);
+
+	for (i = 0; i < columnCount; i++)
 	{
-		int dateType = 0;
-		struct pg_tm dateTime;
-		fsec_t fractionalSecond = 0;
-		int timezone = 0;
+		pJcc->pTypLen[i] = tupleDescriptor->attrs[i]->attlen;
+		pJcc->pTypByVal[i] = tupleDescriptor->attrs[i]->attbyval;
+	}
+	memcpy(pJcc->pNeeded, pWanted, sizeof(bool) * columnCount);
 
-		int decodeError = DecodeDateTime(fieldArray, fieldTypeArray, fieldCount,
-										 &dateType, &dateTime, &fractionalSecond,
-										 &timezone);
-		if (decodeError == 0)
+	pJcc->pFile = AllocateFile(pJcc->pFileName, PG_BINARY_R);
+	if (pJcc->pFile != NULL)
+	{
+		bool bHit = JsonCacheHeaderRead(pJcc->pFile, key, columnCount, pJcc->pPresent);
+
+		for (i = 0; bHit && i < columnCount; i++)
 		{
-			/* 
-			 * We only accept DTK_DATE, DTK_EPOCH, DTK_LATE, and DTK_EARLY date
-			 * types. For other date types, input functions raise an error.
-			 */
-			if (dateType == DTK_DATE || dateType == DTK_EPOCH ||
-				dateType == DTK_LATE || dateType == DTK_EARLY)
+			bHit = (pJcc->pPresent[i] || !pWanted[i]);
+		}
+
+		if (bHit)
+		{
+			pJcc->dataStart = ftello(pJcc->pFile);
+			if (JsonCacheVerify(pJcc->pFile, columnCount) && fseeko(pJcc->pFile, pJcc->dataStart, SEEK_SET) == 0)
 			{
-				validDateTimeFormat = true;
+				// a cache that is read, is recently used
+				(void) utime(pJcc->pFileName, NULL);
+				return pJcc;
 			}
-#ifdef DEBUG
-			else
-				ereport(DEBUG1, (errmsg("%s:%s:%u invlalid format", __FILE__, __func__, __LINE__)));
-#endif
+
+			ereport(DEBUG1, (errmsg("columnar cache file \"%s\" is damaged, so it is written again", pJcc->pFileName)));
+			memset(pJcc->pPresent, 0, sizeof(bool) * columnCount);
 		}
-#ifdef DEBUG
-		else
-			ereport(DEBUG1, (errmsg("%s:%s:%u decode error", __FILE__, __func__, __LINE__)));
-#endif
+
+		FreeFile(pJcc->pFile);
+		pJcc->pFile = NULL;
 	}
-#ifdef DEBUG
-	else
-		ereport(DEBUG1, (errmsg("%s:%s:%u parse error", __FILE__, __func__, __LINE__)));
-#endif
 
-	return validDateTimeFormat;
-}
+	// the columns of the cache that was there were converted for every row, so they still are
+	for (i = 0; i < columnCount; i++)
+	{
+		pJcc->pPresent[i] = (pJcc->pPresent[i] || pWanted[i]);
+	}
 
+	pJcc->bWriting = true;
+	pJcc->pFileNameTmp = psprintf("%s.%d", pJcc->pFileName, MyProcPid);
+	pJcc->pFile = AllocateFile(pJcc->pFileNameTmp, PG_BINARY_W);
+	if (pJcc->pFile == NULL)
+	{
+		ereport(DEBUG1, (errcode_for_file_access(),
+						 errmsg("could not create columnar cache file \"%s\": %m",
+								pJcc->pFileNameTmp)));
+		MemoryContextDelete(pJcc->context);
+		pfree(pJcc);
 
-/*
- * ColumnValueArray uses array element type id to read the current array pointed
- * to by the jsonArray, and converts each array element with matching type to 
- * the corresponding PostgreSQL datum. Then, the function constructs an array
- * datum from element datums, and returns the array datum. This function ignores
- * values that aren't type compatible with valueTypeId.
- */
-static Datum
-ColumnValueArray(yajl_val jsonArray, Oid valueTypeId, Oid valueTypeMod)
+		return NULL;
+	}
+
+	{	uint32 keyLen = strlen(key);
+		uint32 fileColumnCount = columnCount;
+		bits8 *pColumns = (bits8 *) palloc0(BITMAPLEN(columnCount));
+
+		for (i = 0; i < columnCount; i++)
+		{
+			if (pJcc->pPresent[i])
+				pColumns[i / BITS_PER_BYTE] |= (1 << (i % BITS_PER_BYTE));
+		}
+
+		pJcc->bFailed = (fwrite(JSON_CACHE_MAGIC, sizeof(JSON_CACHE_MAGIC) - 1, 1, pJcc->pFile) != 1
+			|| fwrite(&keyLen, sizeof(keyLen), 1, pJcc->pFile) != 1
+			|| fwrite(key, 1, keyLen, pJcc->pFile) != keyLen
+			|| fwrite(&fileColumnCount, sizeof(fileColumnCount), 1, pJcc->pFile) != 1
+			|| fwrite(pColumns, 1, BITMAPLEN(columnCount), pJcc->pFile) != BITMAPLEN(columnCount)
+			);
+		pfree(pColumns);
+	}
+
+	oldContext = MemoryContextSwitchTo(pJcc->context);
+	for (i = 0; i < columnCount; i++)
+	{
+		initStringInfo(&pJcc->pValues[i]);
+		pJcc->ppNulls[i] = (bits8 *) palloc0(BITMAPLEN(JSON_CACHE_STRIPE_ROWS));
+	}
+	MemoryContextSwitchTo(oldContext);
+
+	return pJcc;
+}
+
+// Append a value to the values of its column, as the bytes of the datum
+static void JsonCacheValueAppend(StringInfo str, Datum value, int16 typLen, bool typByVal)
 {
-	Datum columnValueDatum = 0;
-	ArrayType *columnValueObject = NULL;
-	bool typeByValue = false;
-	char typeAlignment = 0;
-	int16 typeLength = 0;
+	if (typByVal)
+	{
+		Datum buffer = 0;
 
-	uint32 jsonValueCount = jsonArray->u.array.len;
-	yajl_val *jsonValueArray = jsonArray->u.array.values;
+		store_att_byval(&buffer, value, typLen);
+		appendBinaryStringInfo(str, (char *) &buffer, typLen);
+	}
+	else if (typLen > 0)
+	{
+		appendBinaryStringInfo(str, DatumGetPointer(value), typLen);
+	}
+	else
+	{
+		// a varlena, or a cstring, is prefixed by its length
+		char *pValue = (typLen == -1 ? (char *) PG_DETOAST_DATUM_PACKED(value) : DatumGetCString(value));
+		uint32 len = (typLen == -1 ? VARSIZE_ANY(pValue) : strlen(pValue) + 1);
 
-	// allocate enough room for datum array's maximum possible size
-	Datum *datumArray = palloc0(jsonValueCount * sizeof(Datum));
-	uint32 datumArraySize = 0;
+		appendBinaryStringInfo(str, (char *) &len, sizeof(len));
+		appendBinaryStringInfo(str, pValue, len);
+	}
+}
 
-	uint32 jsonValueIndex = 0;
-	for (jsonValueIndex = 0; jsonValueIndex < jsonValueCount; jsonValueIndex++)
+// Compress the columns of the rows buffered, and write them as a stripe
+static void JsonCacheStripeWrite(jcc_t *pJcc)
+{
+	int columnCount = pJcc->columnCount;
+	uint32 bitmapLen = BITMAPLEN(pJcc->rows);
+	uint32 *pLens = (uint32 *) palloc0(sizeof(uint32) * 3 * columnCount);
+	Bytef **ppStored = (Bytef **) palloc0(sizeof(Bytef *) * columnCount);
+	StringInfoData raw;
+	int i;
+
+	initStringInfo(&raw);
+	for (i = 0; i < columnCount && !pJcc->bFailed; i++)
 	{
-		yajl_val jsonValue = jsonValueArray[jsonValueIndex];
+		uLongf storedLen = 0;
 
-		bool compatibleTypes = ColumnTypesCompatible(jsonValue, valueTypeId);
-		if (compatibleTypes)
+		resetStringInfo(&raw);
+		appendBinaryStringInfo(&raw, (char *) pJcc->ppNulls[i], bitmapLen);
+		appendBinaryStringInfo(&raw, pJcc->pValues[i].data, pJcc->pValues[i].len);
+
+		storedLen = compressBound(raw.len);
+		ppStored[i] = (Bytef *) palloc(storedLen);
+		pJcc->bFailed = (compress2(ppStored[i], &storedLen, (Bytef *) raw.data, raw.len, Z_BEST_SPEED) != Z_OK);
+		pLens[i * 3] = raw.len;
+		pLens[i * 3 + 1] = storedLen;
+		pLens[i * 3 + 2] = (uint32) crc32(crc32(0L, Z_NULL, 0), ppStored[i], storedLen);
+
+		resetStringInfo(&pJcc->pValues[i]);
+		memset(pJcc->ppNulls[i], 0, bitmapLen);
+	}
+
+	if (!pJcc->bFailed)
+	{
+		pJcc->bFailed = (fwrite(&pJcc->rows, sizeof(pJcc->rows), 1, pJcc->pFile) != 1
+			|| fwrite(pLens, sizeof(uint32), 3 * columnCount, pJcc->pFile) != 3 * columnCount
+			);
+		for (i = 0; i < columnCount && !pJcc->bFailed; i++)
 		{
-			datumArray[datumArraySize] = ColumnValue(jsonValue, valueTypeId,
-													 valueTypeMod);
-			datumArraySize++;
+			pJcc->bFailed = (fwrite(ppStored[i], 1, pLens[i * 3 + 1], pJcc->pFile) != pLens[i * 3 + 1]);
 		}
 	}
 
-	get_typlenbyvalalign(valueTypeId, &typeLength, &typeByValue, &typeAlignment);
-	columnValueObject = construct_array(datumArray, datumArraySize, valueTypeId,
-										typeLength, typeByValue, typeAlignment);
+	for (i = 0; i < columnCount; i++)
+	{
+		if (ppStored[i] != NULL)
+			pfree(ppStored[i]);
+	}
+	pfree(ppStored);
+	pfree(pLens);
+	pfree(raw.data);
+	pJcc->rows = 0;
+}
 
-	columnValueDatum = PointerGetDatum(columnValueObject);
-	return columnValueDatum;
+// Buffer the values of a row, and write the stripe once it is full
+static void JsonCacheWriteRow(jcc_t *pJcc, Datum *columnValues, bool *columnNulls)
+{
+	MemoryContext oldContext = NULL;
+	int i;
+
+	if (pJcc->bFailed)
+	{
+		return;
+	}
+
+	oldContext = MemoryContextSwitchTo(pJcc->context);
+	for (i = 0; i < pJcc->columnCount; i++)
+	{
+		if (!columnNulls[i])
+		{
+			pJcc->ppNulls[i][pJcc->rows / BITS_PER_BYTE] |= (1 << (pJcc->rows % BITS_PER_BYTE));
+			JsonCacheValueAppend(&pJcc->pValues[i], columnValues[i], pJcc->pTypLen[i], pJcc->pTypByVal[i]);
+		}
+	}
+	MemoryContextSwitchTo(oldContext);
+
+	pJcc->rows++;
+	if (pJcc->rows >= JSON_CACHE_STRIPE_ROWS)
+	{
+		JsonCacheStripeWrite(pJcc);
+	}
 }
 
+// A cache file that can't be read is removed, so the next scan writes it again
+static void JsonCacheCorrupt(jcc_t *pJcc)
+{
+	unlink(pJcc->pFileName);
+	ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+					errmsg("columnar cache file \"%s\" is corrupt", pJcc->pFileName),
+					errhint("The file has been removed, and is written again by the next scan.")));
+}
 
 /*
- * ColumnValue uses column type information to read the current value pointed to
- * by jsonValue, and converts this value to the corresponding PostgreSQL datum.
- * The function then returns this datum.
+ * JsonCacheStripeRead reads the next stripe, checking the crc of the columns
+ * that the scan reads and decompressing them, and seeking past the others.
+ * The values of the previous stripe are freed. Returns false at the end of
+ * the cache.
  */
-static Datum
-ColumnValue(yajl_val jsonValue, Oid columnTypeId, int32 columnTypeMod)
+static bool JsonCacheStripeRead(jcc_t *pJcc)
 {
-	Datum columnValue = 0;
+	int columnCount = pJcc->columnCount;
+	uint32 rows = 0;
+	uint32 *pLens = NULL;
+	int i;
 
-	switch(columnTypeId)
+	MemoryContextReset(pJcc->context);
+	pJcc->rows = 0;
+	pJcc->row = 0;
+
+	if (fread(&rows, sizeof(rows), 1, pJcc->pFile) != 1)
 	{
-		case INT2OID:
+		return false;
+	}
+
+	pLens = (uint32 *) MemoryContextAlloc(pJcc->context, sizeof(uint32) * 3 * columnCount);
+	if (rows == 0 || rows > JSON_CACHE_STRIPE_ROWS
+		|| fread(pLens, sizeof(uint32), 3 * columnCount, pJcc->pFile) != 3 * columnCount)
+	{
+		JsonCacheCorrupt(pJcc);
+	}
+
+	for (i = 0; i < columnCount; i++)
+	{
+		uint32 rawLen = pLens[i * 3];
+		uint32 storedLen = pLens[i * 3 + 1];
+		uint32 crc = pLens[i * 3 + 2];
+		uLongf len = rawLen;
+		Bytef *pStored = NULL;
+		char *pRaw = NULL;
+
+		if (!pJcc->pNeeded[i])
 		{
-			const char *value = YAJL_GET_NUMBER(jsonValue);
-			columnValue = DirectFunctionCall1(int2in, CStringGetDatum(value));
-			break;
+			if (fseeko(pJcc->pFile, storedLen, SEEK_CUR) != 0)
+				JsonCacheCorrupt(pJcc);
+			continue;
 		}
-		case INT4OID:
+
+		pStored = (Bytef *) MemoryContextAlloc(pJcc->context, storedLen + 1);
+		pRaw = (char *) MemoryContextAlloc(pJcc->context, rawLen + 1);
+		if (fread(pStored, 1, storedLen, pJcc->pFile) != storedLen
+			|| (uint32) crc32(crc32(0L, Z_NULL, 0), pStored, storedLen) != crc
+			|| uncompress((Bytef *) pRaw, &len, pStored, storedLen) != Z_OK
+			|| len != rawLen || rawLen < BITMAPLEN(rows)
+			)
 		{
-			const char *value = YAJL_GET_NUMBER(jsonValue);
-			columnValue = DirectFunctionCall1(int4in, CStringGetDatum(value));
-			break;
+			JsonCacheCorrupt(pJcc);
 		}
-		case INT8OID:
-		{
-			const char *value = YAJL_GET_NUMBER(jsonValue);
-			columnValue = DirectFunctionCall1(int8in, CStringGetDatum(value));
-			break;
+		pfree(pStored);
+
+		pJcc->ppNulls[i] = (bits8 *) pRaw;
+		pJcc->ppCursor[i] = pRaw + BITMAPLEN(rows);
+		pJcc->ppEnd[i] = pRaw + rawLen;
+	}
+
+	pJcc->rows = rows;
+
+	return true;
+}
+
+// The next value of a column, as appended by JsonCacheValueAppend
+static Datum JsonCacheValueGet(jcc_t *pJcc, int column)
+{
+	int16 typLen = pJcc->pTypLen[column];
+	char *pCursor = pJcc->ppCursor[column];
+	uint32 len = (typLen > 0 ? typLen : sizeof(uint32));
+	Datum value = 0;
+
+	if (pCursor + len > pJcc->ppEnd[column])
+	{
+		JsonCacheCorrupt(pJcc);
+	}
+
+	if (pJcc->pTypByVal[column])
+	{
+		Datum buffer = 0;
+
+		memcpy(&buffer, pCursor, typLen);
+		value = fetch_att(&buffer, true, typLen);
+	}
+	else
+	{
+		char *pValue = NULL;
+
+		if (typLen < 0)
+		{
+			memcpy(&len, pCursor, sizeof(len));
+			pCursor += sizeof(len);
+			if (len == 0 || len > (uint32) (pJcc->ppEnd[column] - pCursor))
+			{
+				JsonCacheCorrupt(pJcc);
+			}
+		}
+
+		// copied, for the alignment of the datum
+		pValue = (char *) palloc(len);
+		memcpy(pValue, pCursor, len);
+
+		// a varlena must be as long as its header says, and a cstring end with its terminator
+		if ((typLen == -1 && (VARATT_IS_EXTERNAL(pValue) || (VARATT_IS_1B(pValue) ? VARHDRSZ_SHORT : VARHDRSZ) > len
+				|| VARSIZE_ANY(pValue) != len))
+			|| (typLen == -2 && strnlen(pValue, len) != len - 1))
+		{
+			JsonCacheCorrupt(pJcc);
+		}
+		value = PointerGetDatum(pValue);
+	}
+	pJcc->ppCursor[column] = pCursor + len;
+
+	return value;
+}
+
+// Read the values of the next row of the cache, of the columns the scan reads
+static bool JsonCacheReadRow(jcc_t *pJcc, Datum *columnValues, bool *columnNulls)
+{
+	MemoryContext oldContext = NULL;
+	int i;
+
+	if (pJcc->row >= pJcc->rows && !JsonCacheStripeRead(pJcc))
+	{
+		return false;
+	}
+
+	oldContext = MemoryContextSwitchTo(pJcc->context);
+	for (i = 0; i < pJcc->columnCount; i++)
+	{
+		if (pJcc->pNeeded[i] && (pJcc->ppNulls[i][pJcc->row / BITS_PER_BYTE] & (1 << (pJcc->row % BITS_PER_BYTE))))
+		{
+			columnValues[i] = JsonCacheValueGet(pJcc, i);
+			columnNulls[i] = false;
+		}
+	}
+	MemoryContextSwitchTo(oldContext);
+
+	pJcc->row++;
+
+	return true;
+}
+
+// Read the cache again, from its first stripe
+static bool JsonCacheRewind(jcc_t *pJcc)
+{
+	MemoryContextReset(pJcc->context);
+	pJcc->rows = 0;
+	pJcc->row = 0;
+
+	return (fseeko(pJcc->pFile, pJcc->dataStart, SEEK_SET) == 0);
+}
+
+/*
+ * JsonCacheClose closes the cache. One being written is kept only if the scan
+ * read the source through, and all of it was written, otherwise it is removed.
+ */
+static void JsonCacheClose(jcc_t *pJcc)
+{
+	if (pJcc->bWriting && pJcc->bComplete && !pJcc->bFailed && pJcc->rows > 0)
+	{
+		JsonCacheStripeWrite(pJcc);
+	}
+
+	if (pJcc->pFile != NULL && FreeFile(pJcc->pFile) != 0)
+	{
+		pJcc->bFailed = true;
+	}
+
+	if (pJcc->bWriting)
+	{
+		if (!pJcc->bComplete || pJcc->bFailed || rename(pJcc->pFileNameTmp, pJcc->pFileName) != 0)
+		{
+			unlink(pJcc->pFileNameTmp);
+		}
+		else
+		{
+			// the files are kept within their size, by removing the least recently used
+			JsonCacheEvict(JsonCacheDirectory());
+		}
+	}
+
+	MemoryContextDelete(pJcc->context);
+	pfree(pJcc);
+}
+
+
+// The shared memory of the shared cache, its header and its rows
+static Size JsonSharedCacheShmemSize(void)
+{
+	return add_size(MAXALIGN(sizeof(JsonSharedCache)), mul_size((Size) JsonSharedCacheSize, 1024));
+}
+
+// Allocate, or attach to, the shared cache, at startup
+static void JsonSharedCacheStartup(void)
+{
+	bool found = false;
+
+	if (prevShmemStartupHook != NULL)
+	{
+		prevShmemStartupHook();
+	}
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	JsonSharedCachePtr = (JsonSharedCache *) ShmemInitStruct(JSON_SHARED_CACHE_NAME, JsonSharedCacheShmemSize(), &found);
+	if (!found)
+	{
+		memset(JsonSharedCachePtr, 0, sizeof(JsonSharedCache));
+#if PG_VERSION_NUM >= 90600
+		JsonSharedCachePtr->lock = &(GetNamedLWLockTranche(JSON_SHARED_CACHE_NAME))->lock;
+#else
+		JsonSharedCachePtr->lock = LWLockAssign();
+#endif
+		JsonSharedCachePtr->arenaSize = mul_size((Size) JsonSharedCacheSize, 1024);
+#if PG_VERSION_NUM >= 90500
+		pg_atomic_init_u64(&JsonSharedCachePtr->clock, 0);
+#endif
+	}
+	LWLockRelease(AddinShmemInitLock);
+}
+
+/*
+ * Mark an entry as just read. Its rows are read under the shared lock, so with
+ * 9.5 or later, the clock and the entry are atomics, and otherwise the lock
+ * is held exclusively, see JsonSharedCacheOpen.
+ */
+static void JsonSharedCacheTouch(JsonSharedCache *pCache, JsonSharedCacheEntry *pEntry)
+{
+#if PG_VERSION_NUM >= 90500
+	pg_atomic_write_u64(&pEntry->lastUsed, pg_atomic_fetch_add_u64(&pCache->clock, 1) + 1);
+#else
+	pEntry->lastUsed = ++pCache->clock;
+#endif
+}
+
+// When an entry was last read, by the clock of the cache
+static uint64 JsonSharedCacheLastUsed(JsonSharedCacheEntry *pEntry)
+{
+#if PG_VERSION_NUM >= 90500
+	return pg_atomic_read_u64(&pEntry->lastUsed);
+#else
+	return pEntry->lastUsed;
+#endif
+}
+
+// Does the bitmap of the columns of a shared cache entry have all of the wanted columns
+static bool JsonSharedCacheHas(bits8 *pColumns, bool *pWanted, int columnCount)
+{
+	int i;
+
+	for (i = 0; i < columnCount; i++)
+	{
+		if (pWanted[i] && !(pColumns[i / BITS_PER_BYTE] & (1 << (i % BITS_PER_BYTE))))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * JsonSharedCacheOpen copies the rows of the key from the shared cache, if it
+ * has them, with the wanted columns, so the lock is only held while they are
+ * copied. Otherwise the scan collects its rows, to add them, with the wanted
+ * columns, and those of the entry of the key that didn't have them. Returns
+ * NULL if there is no shared cache.
+ */
+static jsc_t *JsonSharedCacheOpen(Oid foreignTableId, const char *key, bool *pWanted, int columnCount)
+{
+	JsonSharedCache *pCache = JsonSharedCachePtr;
+	jsc_t *pJsc = NULL;
+	bool found = false;
+	int i;
+
+	if (pCache == NULL)
+	{
+		return NULL;
+	}
+
+	pJsc = (jsc_t *) palloc0(sizeof(jsc_t));
+	if (!pg_md5_hash(key, strlen(key), pJsc->keyHash))
+	{
+		pfree(pJsc);
+		return NULL;
+	}
+	pJsc->relid = foreignTableId;
+	pJsc->maxSize = pCache->arenaSize / 4;
+	pJsc->context = CurrentMemoryContext;
+	initStringInfo(&pJsc->tuples);
+
+	for (i = 0; i < columnCount && i < MaxTupleAttributeNumber; i++)
+	{
+		if (pWanted[i])
+			pJsc->columns[i / BITS_PER_BYTE] |= (1 << (i % BITS_PER_BYTE));
+	}
+
+#if PG_VERSION_NUM >= 90500
+	LWLockAcquire(pCache->lock, LW_SHARED);
+#else
+	LWLockAcquire(pCache->lock, LW_EXCLUSIVE);
+#endif
+	for (i = 0; i < pCache->entryCount && !found; i++)
+	{
+		JsonSharedCacheEntry *pEntry = &pCache->entries[i];
+
+		if (strcmp(pEntry->keyHash, pJsc->keyHash) == 0 && !JsonSharedCacheHas(pEntry->columns, pWanted, columnCount))
+		{
+			int j;
+
+			// the columns of the entry were converted for every row, so they still are
+			for (j = 0; j < sizeof(pJsc->columns); j++)
+				pJsc->columns[j] |= pEntry->columns[j];
+		}
+		else if (strcmp(pEntry->keyHash, pJsc->keyHash) == 0)
+		{
+			enlargeStringInfo(&pJsc->tuples, pEntry->size);
+			memcpy(pJsc->tuples.data, JsonSharedCacheArena(pCache) + pEntry->offset, pEntry->size);
+			pJsc->tuples.len = pEntry->size;
+
+			JsonSharedCacheTouch(pCache, pEntry);
+			found = true;
+		}
+	}
+	LWLockRelease(pCache->lock);
+
+	pJsc->bWriting = !found;
+
+	return pJsc;
+}
+
+// Collect a row, unless the rows are too many for a small table
+static void JsonSharedCacheWriteRow(jsc_t *pJsc, TupleDesc tupleDescriptor, Datum *columnValues, bool *columnNulls)
+{
+	MinimalTuple tuple = NULL;
+	MemoryContext oldContext = NULL;
+	int len = 0;
+
+	if (pJsc->bFailed)
+	{
+		return;
+	}
+
+	tuple = heap_form_minimal_tuple(tupleDescriptor, columnValues, columnNulls);
+	len = MAXALIGN(tuple->t_len);
+	if (pJsc->tuples.len + len > pJsc->maxSize)
+	{
+		pJsc->bFailed = true;
+		resetStringInfo(&pJsc->tuples);
+	}
+	else
+	{
+		// each row is maxaligned, as they are read where they are
+		oldContext = MemoryContextSwitchTo(pJsc->context);
+		enlargeStringInfo(&pJsc->tuples, len);
+		memset(pJsc->tuples.data + pJsc->tuples.len, 0, len);
+		memcpy(pJsc->tuples.data + pJsc->tuples.len, tuple, tuple->t_len);
+		pJsc->tuples.len += len;
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	heap_free_minimal_tuple(tuple);
+}
+
+// Store the next row in the slot, or leave it empty after the last one
+static void JsonSharedCacheReadRow(jsc_t *pJsc, TupleTableSlot *tupleSlot)
+{
+	MinimalTuple tuple = NULL;
+
+	if (pJsc->offset < pJsc->tuples.len)
+	{
+		tuple = (MinimalTuple) (pJsc->tuples.data + pJsc->offset);
+		pJsc->offset += MAXALIGN(tuple->t_len);
+		ExecStoreMinimalTuple(tuple, tupleSlot, false);
+	}
+}
+
+// Remove an entry, moving the rows of the entries after it down over its rows
+static void JsonSharedCacheEvict(JsonSharedCache *pCache, int index)
+{
+	char *pArena = JsonSharedCacheArena(pCache);
+	Size offset = pCache->entries[index].offset;
+	Size size = pCache->entries[index].size;
+	int i;
+
+	memmove(pArena + offset, pArena + offset + size, pCache->used - offset - size);
+	pCache->used -= size;
+	for (i = index + 1; i < pCache->entryCount; i++)
+	{
+		pCache->entries[i - 1] = pCache->entries[i];
+		pCache->entries[i - 1].offset -= size;
+	}
+	pCache->entryCount--;
+}
+
+/*
+ * JsonSharedCachePut adds the rows that a scan collected to the shared cache,
+ * unless another backend just did, with the same columns. The rows of the
+ * table that are there, of a source that has since changed, or with fewer
+ * columns, are removed, and then the least recently used, until the rows fit.
+ */
+static void JsonSharedCachePut(jsc_t *pJsc)
+{
+	JsonSharedCache *pCache = JsonSharedCachePtr;
+	Size size = pJsc->tuples.len;
+	int i;
+
+	LWLockAcquire(pCache->lock, LW_EXCLUSIVE);
+
+	for (i = 0; i < pCache->entryCount; i++)
+	{
+		JsonSharedCacheEntry *pEntry = &pCache->entries[i];
+		int j;
+		bool bHas = (strcmp(pEntry->keyHash, pJsc->keyHash) == 0);
+
+		for (j = 0; bHas && j < sizeof(pJsc->columns); j++)
+			bHas = ((pJsc->columns[j] & ~pEntry->columns[j]) == 0);
+
+		if (bHas)
+		{
+			LWLockRelease(pCache->lock);
+			return;
+		}
+	}
+
+	i = 0;
+	while (i < pCache->entryCount)
+	{
+		if (pCache->entries[i].relid == pJsc->relid || strcmp(pCache->entries[i].keyHash, pJsc->keyHash) == 0)
+			JsonSharedCacheEvict(pCache, i);
+		else
+			i++;
+	}
+
+	while (pCache->entryCount > 0
+		&& (pCache->entryCount >= JSON_SHARED_CACHE_ENTRIES || pCache->arenaSize - pCache->used < size))
+	{
+		int leastRecent = 0;
+
+		for (i = 1; i < pCache->entryCount; i++)
+		{
+			if (JsonSharedCacheLastUsed(&pCache->entries[i]) < JsonSharedCacheLastUsed(&pCache->entries[leastRecent]))
+				leastRecent = i;
+		}
+		JsonSharedCacheEvict(pCache, leastRecent);
+	}
+
+	if (pCache->arenaSize - pCache->used >= size)
+	{
+		JsonSharedCacheEntry *pEntry = &pCache->entries[pCache->entryCount++];
+
+		strlcpy(pEntry->keyHash, pJsc->keyHash, sizeof(pEntry->keyHash));
+		pEntry->relid = pJsc->relid;
+		pEntry->offset = pCache->used;
+		pEntry->size = size;
+#if PG_VERSION_NUM >= 90500
+		pg_atomic_init_u64(&pEntry->lastUsed, 0);
+#endif
+		JsonSharedCacheTouch(pCache, pEntry);
+		memcpy(pEntry->columns, pJsc->columns, sizeof(pEntry->columns));
+		memcpy(JsonSharedCacheArena(pCache) + pEntry->offset, pJsc->tuples.data, size);
+		pCache->used += size;
+	}
+
+	LWLockRelease(pCache->lock);
+}
+
+// Add the rows collected, if the scan read the source through, and free them
+static void JsonSharedCacheClose(jsc_t *pJsc)
+{
+	if (pJsc->bWriting && pJsc->bComplete && !pJsc->bFailed)
+	{
+		JsonSharedCachePut(pJsc);
+	}
+
+	pfree(pJsc->tuples.data);
+	pfree(pJsc);
+}
+
+
+// GLOB_BRACE, ie. "feed-{00,01,02}.json", is an extension
+#ifdef GLOB_BRACE
+#define JSON_GLOB_FLAGS GLOB_BRACE
+#else
+#define JSON_GLOB_FLAGS 0
+#endif
+
+// Is the source a url, or a local file
+static bool JsonSourceIsUrl(const char *source)
+{	urlparts_t parts;
+
+	return urlParse(source, &parts);
+}
+
+// Does a file path or url start at p
+static bool JsonSourceStart(const char *p)
+{
+	while (*p == ' ' || *p == '\t')
+		p++;
+
+	return (*p == '/' || pg_strncasecmp(p, "http://", 7) == 0 || pg_strncasecmp(p, "https://", 8) == 0);
+}
+
+static int JsonSourceNameCompare(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/*
+ * Append a local file to the list, or if it is a directory, the files in it,
+ * and in the directories under it, in sorted order. Hidden files, and those
+ * that start with '_', ie. _SUCCESS markers, are skipped.
+ */
+static List *JsonSourceDirectory(List *sources, char *path)
+{	struct stat statBuffer;
+	DIR *dir = NULL;
+	struct dirent *entry = NULL;
+	char **ppNames = NULL;
+	int nameCount = 0;
+	int nameAlloc = 16;
+	int i;
+
+	// a file, or not there, which is reported when it is opened
+	if (stat(path, &statBuffer) < 0 || !S_ISDIR(statBuffer.st_mode))
+		return lappend(sources, path);
+
+	dir = AllocateDir(path);
+	if (dir == NULL)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open directory \"%s\": %m", path)));
+	}
+
+	ppNames = (char **) palloc(sizeof(char *) * nameAlloc);
+	while ((entry = ReadDir(dir, path)) != NULL)
+	{
+		if (entry->d_name[0] == '.' || entry->d_name[0] == '_')
+			continue;
+
+		if (nameCount == nameAlloc)
+		{
+			nameAlloc *= 2;
+			ppNames = (char **) repalloc(ppNames, sizeof(char *) * nameAlloc);
+		}
+		ppNames[nameCount++] = pstrdup(entry->d_name);
+	}
+	FreeDir(dir);
+
+	qsort(ppNames, nameCount, sizeof(char *), JsonSourceNameCompare);
+	for (i = 0; i < nameCount; i++)
+		sources = JsonSourceDirectory(sources, psprintf("%s/%s", path, ppNames[i]));
+
+	pfree(ppNames);
+
+	return sources;
+}
+
+/*
+ * Append a source, of len characters, to the list. Blank sources, and those
+ * that start with '#', are skipped, a local file with wildcards is replaced
+ * with the files that it matches, in sorted order, and a directory with the
+ * files in it.
+ */
+static List *JsonSourceAppend(List *sources, const char *source, int len)
+{	char *pSource = NULL;
+
+	while (len > 0 && isspace((unsigned char) *source))
+	{
+		source++;
+		len--;
+	}
+	while (len > 0 && isspace((unsigned char) source[len - 1]))
+		len--;
+
+	if (len == 0 || *source == '#')
+		return sources;
+
+	pSource = pnstrdup(source, len);
+	if (!JsonSourceIsUrl(pSource) && strpbrk(pSource, "*?[{") != NULL)
+	{	glob_t globbed;
+		size_t i;
+
+		memset(&globbed, 0, sizeof(globbed));
+		if (glob(pSource, JSON_GLOB_FLAGS, NULL, &globbed) == 0)
+		{
+			for (i = 0; i < globbed.gl_pathc; i++)
+				sources = JsonSourceDirectory(sources, pstrdup(globbed.gl_pathv[i]));
+		}
+		globfree(&globbed);
+		pfree(pSource);
+	}
+	else if (!JsonSourceIsUrl(pSource))
+		sources = JsonSourceDirectory(sources, pSource);
+	else
+		sources = lappend(sources, pSource);
+
+	return sources;
+}
+
+// Append the sources listed in a manifest, a file or url, with one source per line
+static List *JsonManifestSources(List *sources, const char *manifest)
+{	cfr_t *pCfr = curlFetchFile(manifest, NULL);
+	const char *filename = manifest;
+	FILE *filePointer = NULL;
+	gzFile gzFilePointer = NULL;
+	StringInfo lineData = NULL;
+
+	if (pCfr != NULL)
+	{
+		if (!pCfr->bFileFetched || pCfr->ccf.pFileName == NULL)
+		{	unsigned long httpResponseCode = pCfr->httpResponseCode;
+
+			curlCfrFree(pCfr);
+			ereport(ERROR, (errmsg("could not fetch manifest"),
+							errhint("URL '%s' http response code %lu", manifest, httpResponseCode)));
+		}
+		filename = pCfr->ccf.pFileName;
+	}
+
+	if (GzipFilename(filename))
+		gzFilePointer = gzopen(filename, PG_BINARY_R);
+	else
+		filePointer = AllocateFile(filename, PG_BINARY_R);
+
+	if (filePointer == NULL && gzFilePointer == NULL)
+	{
+		curlCfrFree(pCfr);
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open manifest \"%s\" for reading: %m",
+							   manifest)));
+	}
+
+	do
+	{
+		lineData = (gzFilePointer != NULL ? ReadLineFromGzipFile(gzFilePointer) : ReadLineFromFile(filePointer));
+		sources = JsonSourceAppend(sources, lineData->data, lineData->len);
+	} while (lineData->len > 0);
+
+	if (gzFilePointer != NULL)
+		gzclose(gzFilePointer);
+	if (filePointer != NULL)
+		FreeFile(filePointer);
+	curlCfrFree(pCfr);
+
+	return sources;
+}
+
+/*
+ * JsonSourceList returns the files and urls of a table, in scan order. The
+ * filename option is a file or url, or a comma separated list of them, and
+ * local files may be globs. The manifest is a file or url that lists more of
+ * them, one per line, and is only read if bManifest, ie. not at plan time.
+ *
+ * A comma only separates sources if a path or url follows it, so that urls
+ * with commas in their query still work as they always have.
+ */
+static List *JsonSourceList(const char *filename, const char *manifest, bool bManifest)
+{	List *sources = NIL;
+	const char *p = filename;
+
+	while (p != NULL && *p)
+	{	const char *pComma = strchr(p, ',');
+
+		while (pComma != NULL && !JsonSourceStart(pComma + 1))
+			pComma = strchr(pComma + 1, ',');
+
+		sources = JsonSourceAppend(sources, p, (pComma != NULL ? pComma - p : strlen(p)));
+		p = (pComma != NULL ? pComma + 1 : NULL);
+	}
+
+	if (bManifest && manifest != NULL && *manifest)
+		sources = JsonManifestSources(sources, manifest);
+
+	return sources;
+}
+
+// Keep window remote sources in flight, ahead of the one being read
+static void JsonSourceRequest(jss_t *pJss)
+{
+	while (pJss->pCmf != NULL && pJss->inFlight < pJss->window && pJss->next < pJss->count)
+	{
+		if (pJss->pRemote[pJss->next])
+		{
+			if (!curlMultiFetchAdd(pJss->pCmf, pJss->ppSources[pJss->next], pJss->idBase + pJss->next, NULL))
+				ereport(ERROR, (errmsg("could not request source %d", pJss->next), errhint("URL '%s'", pJss->ppSources[pJss->next])));
+			pJss->inFlight++;
+		}
+		pJss->next++;
+	}
+}
+
+/*
+ * Start reading a list of sources. Remote sources are fetched "window" at a
+ * time, unless they are posted to, which is done one at a time, as each is
+ * read. Sources are read in order, so the rows of a source are together.
+ */
+static jss_t *JsonSourceInit(List *sources, int window, const char *pPostVars)
+{	jss_t *pJss = (jss_t *) palloc0(sizeof(jss_t));
+	ListCell *sourceCell = NULL;
+	bool bRemote = false;
+	int i = 0;
+
+	pJss->count = list_length(sources);
+	pJss->ppSources = (char **) palloc0(sizeof(char *) * (pJss->count + 1));
+	pJss->pRemote = (bool *) palloc0(sizeof(bool) * (pJss->count + 1));
+	foreach(sourceCell, sources)
+	{
+		pJss->ppSources[i] = (char *) lfirst(sourceCell);
+		pJss->pRemote[i] = JsonSourceIsUrl(pJss->ppSources[i]);
+		bRemote |= pJss->pRemote[i];
+		i++;
+	}
+	pJss->current = -1;
+	pJss->window = (window > 0 ? window : 1);
+	pJss->pPostVars = pPostVars;
+
+	if (bRemote && (pPostVars == NULL || !*pPostVars))
+	{
+		pJss->pCmf = JsonMultiFetchGet();
+		pJss->idBase = JsonMultiFetchNextId;
+		JsonMultiFetchNextId += pJss->count;
+		JsonMultiFetchTrack(pJss->pCmf, pJss->idBase, pJss->count, false);
+		JsonSourceRequest(pJss);
+	}
+
+	return pJss;
+}
+
+// Abandon the fetches of the sources that weren't read
+static void JsonSourceEnd(jss_t *pJss)
+{	int i;
+
+	for (i = Max(pJss->current, 0); pJss->pCmf != NULL && i < pJss->next; i++)
+	{
+		if (pJss->pRemote[i])
+			curlMultiFetchCancel(pJss->pCmf, pJss->idBase + i);
+	}
+	if (pJss->pCmf != NULL)
+	{
+		JsonMultiFetchUntrack(pJss->pCmf, pJss->idBase);
+	}
+	pJss->pCmf = NULL;
+}
+
+// The fetches of every scan of the backend share one curl multi handle
+static cmf_t *JsonMultiFetchGet(void)
+{
+	if (JsonMultiFetch == NULL)
+	{
+		JsonMultiFetch = curlMultiFetchInit();
+		if (JsonMultiFetch == NULL)
+			ereport(ERROR, (errmsg("could not start fetching sources")));
+	}
+
+	return JsonMultiFetch;
+}
+
+/*
+ * JsonMultiFetchTrack records the fetches of a scan, with the subtransaction
+ * that began it, until the scan ends, so that they end with the transaction,
+ * or subtransaction, if the scan ends with an error. The fetches of a scan
+ * are the ids from idBase, of the shared multi handle, or those of a handle
+ * of its own, that is freed.
+ */
+static void JsonMultiFetchTrack(cmf_t *pCmf, int idBase, int count, bool bOwned)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+	JsonMultiFetchScan *pScan = (JsonMultiFetchScan *) palloc(sizeof(JsonMultiFetchScan));
+
+	pScan->pCmf = pCmf;
+	pScan->idBase = idBase;
+	pScan->count = count;
+	pScan->bOwned = bOwned;
+	pScan->subid = GetCurrentSubTransactionId();
+	JsonMultiFetchScans = lappend(JsonMultiFetchScans, pScan);
+	MemoryContextSwitchTo(oldContext);
+}
+
+static void JsonMultiFetchUntrack(cmf_t *pCmf, int idBase)
+{
+	ListCell *lc = NULL;
+
+	foreach(lc, JsonMultiFetchScans)
+	{
+		JsonMultiFetchScan *pScan = (JsonMultiFetchScan *) lfirst(lc);
+
+		if (pScan->pCmf == pCmf && pScan->idBase == idBase)
+		{
+			JsonMultiFetchScans = list_delete_ptr(JsonMultiFetchScans, pScan);
+			pfree(pScan);
+			break;
+		}
+	}
+}
+
+// A scan that ends with an error, doesn't end its fetches, so they all end with the transaction
+static void JsonMultiFetchXactCallback(XactEvent event, void *arg)
+{
+	ListCell *lc = NULL;
+
+	if (event != XACT_EVENT_ABORT)
+	{
+		return;
+	}
+
+	foreach(lc, JsonMultiFetchScans)
+	{
+		JsonMultiFetchScan *pScan = (JsonMultiFetchScan *) lfirst(lc);
+
+		if (pScan->bOwned)
+			curlMultiFetchFree(pScan->pCmf);
+	}
+	list_free_deep(JsonMultiFetchScans);
+	JsonMultiFetchScans = NIL;
+
+	if (JsonMultiFetch != NULL)
+	{
+		curlMultiFetchFree(JsonMultiFetch);
+		JsonMultiFetch = NULL;
+	}
+}
+
+/*
+ * or with the subtransaction, ie. a savepoint, or a PL/pgSQL exception block,
+ * as the scans of the rest of the transaction would otherwise drive them
+ */
+static void JsonMultiFetchSubXactCallback(SubXactEvent event, SubTransactionId mySubid, SubTransactionId parentSubid, void *arg)
+{
+	ListCell *lc = NULL;
+	bool bFreed = true;
+	int i;
+
+	if (event == SUBXACT_EVENT_COMMIT_SUB)
+	{
+		foreach(lc, JsonMultiFetchScans)
+		{
+			JsonMultiFetchScan *pScan = (JsonMultiFetchScan *) lfirst(lc);
+
+			if (pScan->subid == mySubid)
+				pScan->subid = parentSubid;
+		}
+	}
+	else if (event == SUBXACT_EVENT_ABORT_SUB)
+	{
+		while (bFreed)
+		{
+			bFreed = false;
+			foreach(lc, JsonMultiFetchScans)
+			{
+				JsonMultiFetchScan *pScan = (JsonMultiFetchScan *) lfirst(lc);
+
+				if (pScan->subid == mySubid)
+				{
+					if (pScan->bOwned)
+						curlMultiFetchFree(pScan->pCmf);
+					else
+					{
+						for (i = 0; i < pScan->count; i++)
+							curlMultiFetchCancel(pScan->pCmf, pScan->idBase + i);
+					}
+					JsonMultiFetchScans = list_delete_ptr(JsonMultiFetchScans, pScan);
+					pfree(pScan);
+					bFreed = true;
+					break;
+				}
+			}
+		}
+	}
+}
+
+// Have the os start reading the next source, if it is a local file
+static void JsonSourcePrefetch(jss_t *pJss)
+{
+#ifdef USE_POSIX_FADVISE
+	int next = pJss->current + 1;
+
+	if (next < pJss->count && !pJss->pRemote[next])
+	{
+		int fd = open(pJss->ppSources[next], O_RDONLY);
+
+		if (fd >= 0)
+		{
+			(void) posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+			close(fd);
+		}
+	}
+#endif
+}
+
+// Close the source just read, and open the next one
+// Returns false if there are no more sources
+static bool JsonSourceOpenNext(JsonFdwExecState *execState)
+{	jss_t *pJss = execState->pJss;
+	const char *source = NULL;
+	const char *filename = NULL;
+
+	JsonFileClose(execState);
+
+	if (pJss->current + 1 >= pJss->count)
+	{
+		return false;
+	}
+
+	pJss->current++;
+	source = pJss->ppSources[pJss->current];
+	filename = source;
+	if (pJss->pRemote[pJss->current])
+	{
+		cfr_t *pCfr = NULL;
+
+		if (pJss->pCmf != NULL)
+		{
+			pCfr = curlMultiFetchWait(pJss->pCmf, pJss->idBase + pJss->current);
+			pJss->inFlight--;
+			JsonSourceRequest(pJss);
+		}
+		else
+			pCfr = curlFetchFile(source, pJss->pPostVars);
+
+		execState->pCfr = pCfr;
+		if (pCfr == NULL || !pCfr->bFileFetched || pCfr->ccf.pFileName == NULL)
+		{
+			ereport(ERROR, (errmsg("could not fetch source %d", pJss->current),
+							errhint("URL '%s' http response code %lu", source, (pCfr != NULL ? pCfr->httpResponseCode : 0))));
+		}
+		filename = pCfr->ccf.pFileName;
+	}
+
+	execState->pSourceName = source;
+	JsonPartitionValuesSet(execState, source);
+	JsonFileOpen(execState, filename);
+	JsonSourcePrefetch(pJss);
+
+	return true;
+}
+
+
+// The file names of the fdw_private list that JsonGetForeignRelSize leaves in baserel, or NIL
+static List *JsonSourcesFromPrivate(List *sourcesPrivate)
+{	List *sources = NIL;
+	ListCell *sourceCell = NULL;
+
+	if (sourcesPrivate != NIL)
+	{
+		for_each_cell(sourceCell, lnext(list_head(sourcesPrivate)))
+		{
+			sources = lappend(sources, strVal(lfirst(sourceCell)));
+		}
+	}
+
+	return sources;
+}
+
+// Decode the %xx escapes of a partition value, of len characters
+static char *JsonPartitionDecode(const char *p, int len)
+{	char *value = (char *) palloc(len + 1);
+	int i;
+	int j = 0;
+
+	for (i = 0; i < len; i++)
+	{
+		if (p[i] == '%' && i + 2 < len && isxdigit((unsigned char) p[i + 1]) && isxdigit((unsigned char) p[i + 2]))
+		{	char hex[3] = { p[i + 1], p[i + 2], 0 };
+
+			value[j++] = (char) strtol(hex, NULL, 16);
+			i += 2;
+		}
+		else
+			value[j++] = p[i];
+	}
+	value[j] = 0;
+
+	return value;
+}
+
+static DefElem *JsonPartitionFind(List *partitions, const char *name)
+{	ListCell *partitionCell = NULL;
+
+	foreach(partitionCell, partitions)
+	{
+		DefElem *partition = (DefElem *) lfirst(partitionCell);
+
+		if (strcmp(partition->defname, name) == 0)
+			return partition;
+	}
+
+	return NULL;
+}
+
+/*
+ * JsonSourcePartitions returns the key=value directories of the path of a
+ * file or url, ie. hive style partitions, as a list of DefElems. If a key is
+ * repeated, the last value wins.
+ */
+static List *JsonSourcePartitions(const char *source)
+{	List *partitions = NIL;
+	urlparts_t parts;
+	const char *p = source;
+	const char *pEnd = NULL;
+
+	if (urlParse(source, &parts))
+	{
+		p = parts.path.p;
+		pEnd = p + parts.path.len;
+	}
+	else
+		pEnd = p + strlen(p);
+
+	// only the directories, not the file name
+	while (pEnd > p && pEnd[-1] != '/')
+		pEnd--;
+
+	while (p < pEnd)
+	{	const char *pSlash = memchr(p, '/', pEnd - p);
+		const char *pEquals = memchr(p, '=', pSlash - p);
+
+		if (pEquals != NULL && pEquals > p)
+		{	char *key = pnstrdup(p, pEquals - p);
+			Node *value = (Node *) makeString(JsonPartitionDecode(pEquals + 1, pSlash - pEquals - 1));
+			DefElem *partition = JsonPartitionFind(partitions, key);
+
+			if (partition != NULL)
+				partition->arg = value;
+			else
+				partitions = lappend(partitions, makeDefElem(key, value));
+		}
+		p = pSlash + 1;
+	}
+
+	return partitions;
+}
+
+// Convert a partition value to the type of its column, returns true if it is null
+static bool JsonPartitionValue(const char *value, Oid typeId, int32 typeMod, Datum *pValue)
+{	Oid typeInput = InvalidOid;
+	Oid typeIoParam = InvalidOid;
+
+	if (strcmp(value, HIVE_DEFAULT_PARTITION) == 0)
+	{
+		*pValue = (Datum) 0;
+		return true;
+	}
+
+	getTypeInputInfo(typeId, &typeInput, &typeIoParam);
+	*pValue = OidInputFunctionCall(typeInput, (char *) value, typeIoParam, typeMod);
+
+	return false;
+}
+
+// Set the partition column values of the rows of a source
+static void JsonPartitionValuesSet(JsonFdwExecState *execState, const char *source)
+{	MemoryContext oldContext = MemoryContextSwitchTo(execState->scanContext);
+	List *partitions = JsonSourcePartitions(source);
+	ListCell *partitionCell = NULL;
+
+	execState->partitionCount = 0;
+	foreach(partitionCell, partitions)
+	{
+		DefElem *partition = (DefElem *) lfirst(partitionCell);
+		ColumnMapping *columnMapping = (ColumnMapping *) hash_search(execState->columnMappingHash, partition->defname, HASH_FIND, NULL);
+
+		if (columnMapping != NULL)
+		{	int i = execState->partitionCount++;
+
+			execState->pPartitionIndex[i] = columnMapping->columnIndex;
+			execState->pPartitionNulls[i] = JsonPartitionValue(strVal(partition->arg)
+				, columnMapping->columnTypeId, columnMapping->columnTypeMod, &execState->pPartitionValues[i]);
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+typedef struct JsonPartitionContext
+{
+	Index relid;
+	Oid foreignTableId;
+	List *partitions;		// of the source being pruned
+	bool bMissing;			// a column that isn't a partition of the source was found
+} JsonPartitionContext;
+
+// Replace the partition columns of a clause with their values, as constants
+static Node *JsonPartitionMutator(Node *node, JsonPartitionContext *context)
+{
+	if (node == NULL)
+		return NULL;
+
+	if (IsA(node, Var))
+	{
+		Var *var = (Var *) node;
+		DefElem *partition = NULL;
+
+		if (var->varno == context->relid && var->varlevelsup == 0 && var->varattno > 0)
+			partition = JsonPartitionFind(context->partitions, get_relid_attribute_name(context->foreignTableId, var->varattno));
+
+		if (partition == NULL)
+			context->bMissing = true;
+		else
+		{	Datum value = (Datum) 0;
+			bool isNull = JsonPartitionValue(strVal(partition->arg), var->vartype, var->vartypmod, &value);
+			int16 typeLen = 0;
+			bool typeByVal = false;
+
+			get_typlenbyval(var->vartype, &typeLen, &typeByVal);
+			return (Node *) makeConst(var->vartype, var->vartypmod, var->varcollid, typeLen, value, isNull, typeByVal);
+		}
+
+		return node;
+	}
+
+	return expression_tree_mutator(node, JsonPartitionMutator, (void *) context);
+}
+
+// Does the clause have a param of the executor, ie. of an init plan, which isn't set when the scan begins
+static bool JsonExecParamWalker(Node *node, void *context)
+{
+	if (node == NULL)
+		return false;
+
+	if (IsA(node, Param) && ((Param *) node)->paramkind == PARAM_EXEC)
+		return true;
+
+	return expression_tree_walker(node, JsonExecParamWalker, context);
+}
+
+// The where clauses that may prune the sources, those without volatile functions, sub plans, or executor params
+static List *JsonPruneClauses(RelOptInfo *baserel)
+{	List *clauses = NIL;
+	ListCell *restrictInfoCell = NULL;
+
+	foreach(restrictInfoCell, baserel->baserestrictinfo)
+	{
+		Node *clause = (Node *) ((RestrictInfo *) lfirst(restrictInfoCell))->clause;
+
+		if (!contain_volatile_functions(clause) && !contain_subplans(clause) && !JsonExecParamWalker(clause, NULL))
+			clauses = lappend(clauses, clause);
+	}
+
+	return clauses;
+}
+
+// Is a clause, with the partition values of a source as constants, false or null
+static bool JsonPruneClauseFalse(PlannerInfo *root, PlanState *planState, Node *folded)
+{	bool bFalse = false;
+
+	if (planState == NULL)
+	{
+		folded = eval_const_expressions(root, folded);
+		bFalse = (IsA(folded, Const) && (((Const *) folded)->constisnull || !DatumGetBool(((Const *) folded)->constvalue)));
+	}
+	else
+	{	// by the executor, with the values of the params of the query
+		ExprContext *econtext = planState->ps_ExprContext;
+		MemoryContext oldContext = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+		ExprState *exprState = ExecInitExpr((Expr *) eval_const_expressions(NULL, folded), NULL);
+		bool isNull = false;
+		Datum value = ExecEvalExpr(exprState, econtext, &isNull, NULL);
+
+		bFalse = (isNull || !DatumGetBool(value));
+		MemoryContextSwitchTo(oldContext);
+		ResetExprContext(econtext);
+	}
+
+	return bFalse;
+}
+
+/*
+ * JsonSourcesPrune returns the sources whose partitions, ie. the key=value
+ * directories of their path, could match the where clauses. A where clause
+ * that uses only partition columns of a source, is folded to a constant with
+ * the partition values, and if it is false or null, the source is dropped.
+ * Other clauses don't prune. The planner prunes for its estimates, with root,
+ * and each scan again, with its plan state, for the sources it reads.
+ */
+static List *JsonSourcesPrune(PlannerInfo *root, PlanState *planState, Index relid, Oid foreignTableId, List *clauses, List *sources)
+{	List *surviving = NIL;
+	ListCell *sourceCell = NULL;
+
+	foreach(sourceCell, sources)
+	{
+		char *source = (char *) lfirst(sourceCell);
+		JsonPartitionContext context;
+		ListCell *clauseCell = NULL;
+		bool bKeep = true;
+
+		context.relid = relid;
+		context.foreignTableId = foreignTableId;
+		context.partitions = JsonSourcePartitions(source);
+
+		foreach(clauseCell, clauses)
+		{
+			Node *folded = NULL;
+
+			if (context.partitions == NIL || !bKeep)
+				break;
+
+			context.bMissing = false;
+			folded = JsonPartitionMutator((Node *) lfirst(clauseCell), &context);
+			if (!context.bMissing)
+				bKeep = !JsonPruneClauseFalse(root, planState, folded);
+		}
+
+		if (bKeep)
+			surviving = lappend(surviving, source);
+	}
+
+	return surviving;
+}
+
+
+/*
+ * JsonEndForeignScan finishes scanning the foreign table, and frees the acquired
+ * resources.
+ */
+static void
+JsonEndForeignScan(ForeignScanState *scanState)
+{
+	JsonFdwExecState *executionState = (JsonFdwExecState *) scanState->fdw_state;
+	//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
+	if (executionState == NULL)
+	{
+		return;
+	}
+
+	if (executionState->pJcc != NULL)
+	{
+		JsonCacheClose(executionState->pJcc);
+	}
+
+	if (executionState->pJsc != NULL)
+	{
+		JsonSharedCacheClose(executionState->pJsc);
+	}
+
+	if (executionState->pTupleStore != NULL)
+	{
+		tuplestore_end(executionState->pTupleStore);
+	}
+
+	if (executionState->pJas != NULL)
+	{
+		JsonAggEnd(executionState->pJas);
+	}
+
+	if (executionState->filePointer != NULL)
+	{
+		int closeStatus = FreeFile(executionState->filePointer);
+		if (closeStatus != 0)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+					 		errmsg("could not close file \"%s\": %m",
+								   executionState->filename)));
+		}
+	}
+
+	if (executionState->gzFilePointer != NULL)
+	{
+		int closeStatus = gzclose(executionState->gzFilePointer);
+		if (closeStatus != Z_OK)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+					 		errmsg("could not close file \"%s\": %m",
+								   executionState->filename)));
+		}
+	}
+
+	if (executionState->columnMappingHash != NULL)
+	{
+		hash_destroy(executionState->columnMappingHash);
+	}
+
+	curlCfrFree(executionState->pCfr);
+
+	if (executionState->pJsp != NULL && executionState->pJsp->pCmf != NULL)
+	{
+		JsonMultiFetchUntrack(executionState->pJsp->pCmf, 0);
+		curlMultiFetchFree(executionState->pJsp->pCmf);
+	}
+
+	if (executionState->pJss != NULL)
+	{
+		JsonSourceEnd(executionState->pJss);
+	}
+
+	pfree(executionState);
+}
+
+
+/*
+ * JsonGetOptions returns the option values to be used when reading and parsing 
+ * the json file. To resolve these values, the function checks options for the
+ * foreign table, and if not present, falls back to default values.
+ */
+static JsonFdwOptions *
+JsonGetOptions(Oid foreignTableId)
+{
+	JsonFdwOptions *jsonFdwOptions = (JsonFdwOptions *) palloc0(sizeof(JsonFdwOptions));
+	//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
+
+	if(jsonFdwOptions != NULL)
+	{	char *maxErrorCountString = JsonGetOptionValue(foreignTableId, OPTION_NAME_MAX_ERROR_COUNT);
+
+		jsonFdwOptions->maxErrorCount = (maxErrorCountString != NULL
+			? pg_atoi(maxErrorCountString, sizeof(int32), 0)
+			: DEFAULT_MAX_ERROR_COUNT
+			);
+		jsonFdwOptions->filename = JsonGetOptionValue(foreignTableId, OPTION_NAME_FILENAME);
+		jsonFdwOptions->pHttpPostVars = JsonGetOptionValue(foreignTableId, OPTION_NAME_HTTP_POST_VARS);
+		jsonFdwOptions->pRomUrl = JsonGetOptionValue(foreignTableId, OPTION_NAME_ROM_URL);
+		jsonFdwOptions->pRomPath = JsonGetOptionValue(foreignTableId, OPTION_NAME_ROM_PATH);
+
+		{	char *batchSizeString = JsonGetOptionValue(foreignTableId, OPTION_NAME_BATCH_SIZE);
+			char *batchBytesString = JsonGetOptionValue(foreignTableId, OPTION_NAME_BATCH_BYTES);
+
+			// zero means not specified, so the ROM action decides
+			jsonFdwOptions->batchSize = (batchSizeString != NULL ? pg_atoi(batchSizeString, sizeof(int32), 0) : 0);
+			jsonFdwOptions->batchBytes = (batchBytesString != NULL ? pg_atoi(batchBytesString, sizeof(int32), 0) : 0);
+			jsonFdwOptions->pBatchFormat = JsonGetOptionValue(foreignTableId, OPTION_NAME_BATCH_FORMAT);
+		}
+
+		{	char *writeWindowString = JsonGetOptionValue(foreignTableId, OPTION_NAME_WRITE_WINDOW);
+
+			jsonFdwOptions->writeWindow = (writeWindowString != NULL ? pg_atoi(writeWindowString, sizeof(int32), 0) : 0);
+		}
+		jsonFdwOptions->pContentEncoding = JsonGetOptionValue(foreignTableId, OPTION_NAME_CONTENT_ENCODING);
+		jsonFdwOptions->pManifest = JsonGetOptionValue(foreignTableId, OPTION_NAME_MANIFEST);
+		jsonFdwOptions->pSourceColumn = JsonGetOptionValue(foreignTableId, OPTION_NAME_SOURCE_COLUMN);
+
+		{	char *readWindowString = JsonGetOptionValue(foreignTableId, OPTION_NAME_READ_WINDOW);
+
+			jsonFdwOptions->readWindow = (readWindowString != NULL ? pg_atoi(readWindowString, sizeof(int32), 0) : DEFAULT_READ_WINDOW);
+		}
+
+		{	char *columnarCacheString = JsonGetOptionValue(foreignTableId, OPTION_NAME_COLUMNAR_CACHE);
+			char *sharedCacheString = JsonGetOptionValue(foreignTableId, OPTION_NAME_SHARED_CACHE);
+
+			// checked by the validator, so off if not specified
+			jsonFdwOptions->bColumnarCache = false;
+			if (columnarCacheString != NULL)
+				(void) parse_bool(columnarCacheString, &jsonFdwOptions->bColumnarCache);
+			jsonFdwOptions->bSharedCache = false;
+			if (sharedCacheString != NULL)
+				(void) parse_bool(sharedCacheString, &jsonFdwOptions->bSharedCache);
+		}
+	}
+
+	return jsonFdwOptions;
+}
+
+
+/*
+ * Json GetOptionValue walks over foreign table and foreign server options, and
+ * looks for the option with the given name. If found, the function returns the
+ * option's value. This function is unchanged from mongo_fdw.
+ */
+static char *
+JsonGetOptionValue(Oid foreignTableId, const char *optionName)
+{
+	ForeignTable *foreignTable = NULL;
+	ForeignServer *foreignServer = NULL;
+	List *optionList = NIL;
+	ListCell *optionCell = NULL;
+	char *optionValue = NULL;
+
+	//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
+	foreignTable = GetForeignTable(foreignTableId);
+	foreignServer = GetForeignServer(foreignTable->serverid);
+
+	optionList = list_concat(optionList, foreignTable->options);
+	optionList = list_concat(optionList, foreignServer->options);
+
+	foreach(optionCell, optionList)
+	{
+		DefElem *optionDef = (DefElem *) lfirst(optionCell);
+		char *optionDefName = optionDef->defname;
+
+		if (strncmp(optionDefName, optionName, NAMEDATALEN) == 0)
+		{
+			optionValue = defGetString(optionDef);
+			break;
+		}
+	}
+
+	return optionValue;
+}
+
+
+// TupleCount estimates the number of base relation tuples in the given sources.
+static double
+TupleCount(RelOptInfo *baserel, JsonFdwOptions *options, List *sources, JsonFdwStats *stats)
+{
+	double tupleCount = 0.0;
+	double size = 0.0;
+	bool localSources = (SourcesSize(options, sources, &size) == list_length(sources)
+		&& sources != NIL && (options->pManifest == NULL || !*options->pManifest));
+
+	BlockNumber pageCountEstimate = baserel->pages;
+	if (stats != NULL && localSources && stats->bytesPerRow > 0)
+	{
+		/*
+		 * The files are all on disk, so scale their current size by what
+		 * Analyze measured, the uncompressed bytes of a stored byte, and the
+		 * uncompressed bytes of a row.
+		 */
+		tupleCount = clamp_row_est(size * stats->compressionRatio / stats->bytesPerRow);
+	}
+	else if (stats != NULL)
+	{
+		/*
+		 * The size of a remote source isn't known until it is fetched, so use
+		 * the rows that Analyze read, less those of the files that are pruned.
+		 */
+		tupleCount = clamp_row_est(stats->rows * JsonStatsScale(sources, stats));
+	}
+	else if (pageCountEstimate > 0)
+	{
+		/*
+		 * We have number of pages and number of tuples from pg_class (from a
+		 * previous Analyze), so compute a tuples-per-page estimate and scale
+		 * that by the current file size.
+		 */
+		double density = baserel->tuples / (double) pageCountEstimate;
+		BlockNumber pageCount = PageCount(options, sources, stats);
+
+		tupleCount = clamp_row_est(density * (double) pageCount);
+	}
+	else
+	{
+		/*
+		 * Otherwise we have to fake it. We back into this estimate using the
+		 * planner's idea of relation width, which may be inaccurate. For better
+		 * estimates, users need to run Analyze. Files may not be there at plan
+		 * time, so they have a default estimate.
+		 */
+		int tupleWidth = MAXALIGN(baserel->width) + MAXALIGN(sizeof(HeapTupleHeaderData));
+
+		tupleCount = clamp_row_est(size / (double) tupleWidth);
+	}
+
+	return tupleCount;
+}
+
+
+/*
+ * PageCount calculates and returns the number of pages in the sources. Remote
+ * sources count as the bytes that Analyze fetched, if the table was analyzed.
+ */
+static BlockNumber
+PageCount(JsonFdwOptions *options, List *sources, JsonFdwStats *stats)
+{
+	BlockNumber pageCount = 0;
+	double size = 0.0;
+
+	// if files don't exist at plan time, use default estimate for their size
+	int found = SourcesSize(options, sources, &size);
+	if (stats != NULL && (found < list_length(sources) || sources == NIL
+		|| (options->pManifest != NULL && *options->pManifest)))
+	{
+		size = stats->fileBytes * JsonStatsScale(sources, stats);
+	}
+
+	pageCount = (BlockNumber) ((size + (BLCKSZ - 1)) / BLCKSZ);
+	if (pageCount < 1)
+	{
+		pageCount = 1;
+	}
+
+	return pageCount;
+}
+
+
+/*
+ * SourcesSize sums the sizes of the files of the filename option. Urls, files
+ * that don't exist at plan time, a ROM url, and the manifest, which isn't read
+ * at plan time, count as a default estimate. Returns the number of files found.
+ */
+static int
+SourcesSize(JsonFdwOptions *options, List *sources, double *pSize)
+{
+	ListCell *sourceCell = NULL;
+	int found = 0;
+
+	*pSize = 0.0;
+	foreach(sourceCell, sources)
+	{
+		struct stat statBuffer;
+
+		int statResult = stat((const char *) lfirst(sourceCell), &statBuffer);
+		if (statResult < 0)
+		{
+			statBuffer.st_size = 10 * BLCKSZ;
+		}
+		else
+		{
+			found++;
+		}
+
+		*pSize += (double) statBuffer.st_size;
+	}
+
+	if (options->filename == NULL || (options->pManifest != NULL && *options->pManifest))
+	{
+		*pSize += 10 * BLCKSZ;
+	}
+
+	return found;
+}
+
+
+/*
+ * ColumnList takes in the planner's information about this foreign table. The
+ * function then finds all columns needed for query execution, including those
+ * used in projections, joins, and filter clauses, de-duplicates these columns,
+ * and returns them in a new list. This function is unchanged from mongo_fdw. 
+ */
+static List *
+ColumnList(RelOptInfo *baserel)
+{
+	List *columnList = NIL;
+	List *neededColumnList = NIL;
+	AttrNumber columnIndex = 1;
+	AttrNumber columnCount = baserel->max_attr;
+	List *targetColumnList = baserel->reltargetlist;
+	List *restrictInfoList = baserel->baserestrictinfo;
+	ListCell *restrictInfoCell = NULL;
+
+	// first add the columns used in joins and projections
+	neededColumnList = list_copy(targetColumnList);
+
+	// then walk over all restriction clauses, and pull up any used columns
+	foreach(restrictInfoCell, restrictInfoList)
+	{
+		RestrictInfo *restrictInfo = (RestrictInfo *) lfirst(restrictInfoCell);
+		Node *restrictClause = (Node *) restrictInfo->clause;
+		List *clauseColumnList = NIL;
+
+		// recursively pull up any columns used in the restriction clause
+		clauseColumnList = pull_var_clause(restrictClause,
+						   PVC_RECURSE_AGGREGATES,
+						   PVC_RECURSE_PLACEHOLDERS);
+
+		neededColumnList = list_union(neededColumnList, clauseColumnList);
+	}
+
+	// walk over all column definitions, and de-duplicate column list
+	for (columnIndex = 1; columnIndex <= columnCount; columnIndex++)
+	{
+		ListCell *neededColumnCell = NULL;
+		Var *column = NULL;
+
+		// look for this column in the needed column list
+		foreach(neededColumnCell, neededColumnList)
+		{
+			Var *neededColumn = (Var *) lfirst(neededColumnCell);
+			if (neededColumn->varattno == columnIndex)
+			{
+				column = neededColumn;
+				break;
+			}
+		}
+
+		if (column != NULL)
+		{
+			columnList = lappend(columnList, column);
+		}
+	}
+
+	return columnList;
+}
+
+
+/*
+ * ColumnMappingHash creates a hash table that maps column names to column index
+ * and types. This table helps us quickly translate JSON document key/values to
+ * corresponding PostgreSQL columns. This function is unchanged from mongo_fdw.
+ */
+static HTAB *
+ColumnMappingHash(Oid foreignTableId, List *columnList)
+{
+	HTAB *columnMappingHash = NULL;
+	ListCell *columnCell = NULL;
+	const long hashTableSize = 2048;
+
+	// create hash table
+	HASHCTL hashInfo;
+	memset(&hashInfo, 0, sizeof(hashInfo));
+	hashInfo.keysize = NAMEDATALEN;
+	hashInfo.entrysize = sizeof(ColumnMapping);
+	hashInfo.hash = string_hash;
+	hashInfo.hcxt = CurrentMemoryContext;
+
+	columnMappingHash = hash_create("Column Mapping Hash", hashTableSize, &hashInfo,
+									(HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT));
+	Assert(columnMappingHash != NULL);
+
+	foreach(columnCell, columnList)
+	{
+		Var *column = (Var *) lfirst(columnCell);
+		AttrNumber columnId = column->varattno;
+
+		ColumnMapping *columnMapping = NULL;
+		char *columnName = NULL;
+		bool handleFound = false;
+		void *hashKey = NULL;
+
+		columnName = get_relid_attribute_name(foreignTableId, columnId);
+		hashKey = (void *) columnName;
+
+		columnMapping = (ColumnMapping *) hash_search(columnMappingHash, hashKey,
+													  HASH_ENTER, &handleFound);
+		Assert(columnMapping != NULL);
+
+		columnMapping->columnIndex = columnId - 1;
+		columnMapping->columnTypeId = column->vartype;
+		columnMapping->columnTypeMod = column->vartypmod;
+		columnMapping->columnArrayTypeId = get_element_type(column->vartype);
+	}
+
+	return columnMappingHash;
+}
+
+
+// GzipFilename returns true if the filename ends with a gzip file extension.
+static bool
+GzipFilename(const char *filename)
+{
+	bool gzipFile = false;
+	const char *extension = NULL;
+
+	extension = strrchr(filename, '.');
+	if (extension != NULL)
+	{
+		if (strncmp(extension, GZIP_FILE_EXTENSION, MAXPGPATH) == 0)
+		{
+			gzipFile = true;
+		}
+	}
+
+	return gzipFile;
+}
+
+
+// HdfsBlockName returns true if filename belongs to a hdfs block.
+static bool
+HdfsBlockName(const char *filename)
+{
+	bool hdfsBlock = false;
+	const char *basename = NULL;
+
+	const char *lastDirSeparator = last_dir_separator(filename);
+	if (lastDirSeparator == NULL)
+	{
+		basename = filename;
+	}
+	else
+	{
+		basename = lastDirSeparator + 1;
+	}
+
+	if (strncmp(basename, HDFS_BLOCK_PREFIX, HDFS_BLOCK_PREFIX_LENGTH) == 0)
+	{
+		hdfsBlock = true;
+	}
+
+	return hdfsBlock;
+}
+
+
+/*
+ * ReadLineFromFile reads and returns the next line in the file. If the function
+ * reaches the end of file without reading input, it returns an empty string.
+ */
+static StringInfo
+ReadLineFromFile(FILE *filePointer)
+{
+	StringInfo lineData = makeStringInfo();
+	bool endOfFile = false;
+	bool endOfLine = false;
+	char buffer[READ_BUFFER_SIZE];
+
+	// read from file until either we reach end of file or end of line
+	while (!endOfFile && !endOfLine)
+	{
+		char *fgetsResult;
+		
+		memset(buffer, 0, sizeof(buffer));
+		fgetsResult = fgets(buffer, sizeof(buffer), filePointer);
+		if (fgetsResult == NULL)
+		{
+			int errorResult = ferror(filePointer);
+			if (errorResult != 0)
+			{
+				ereport(ERROR, (errcode_for_file_access(),
+								errmsg("could not read from json file: %m")));
+			}
+
+			endOfFile = true;
+		}
+		else
+		{
+			// check if we read a new line
+			endOfLine = (buffer[strlen(buffer) - 1] == '\n');
+
+			appendStringInfoString(lineData, buffer);
+		}
+	}
+
+	return lineData;
+}
+
+
+/*
+ * ReadLineFromFile reads and returns the next line in the file. If the function
+ * reaches the end of file without reading input, it returns an empty string.
+ */
+static StringInfo
+ReadLineFromGzipFile(gzFile gzFilePointer)
+{
+	StringInfo lineData = makeStringInfo();
+	bool endOfFile = false;
+	bool endOfLine = false;
+	char buffer[READ_BUFFER_SIZE];
+
+	// read from file until either we reach end of file or end of line
+	while (!endOfFile && !endOfLine)
+	{
+		char *getsResult = gzgets(gzFilePointer, buffer, sizeof(buffer));
+		if (getsResult == NULL)
+		{
+			int errorResult = 0;
+			const char *message = gzerror(gzFilePointer, &errorResult);
+			if (errorResult != Z_OK && errorResult != Z_STREAM_END)
+			{
+				ereport(ERROR, (errmsg("could not read from json file"), 
+								errhint("%s", message)));
+			}
+
+			endOfFile = true;
+		}
+		else
+		{
+			// check if we read a new line
+			endOfLine = (buffer[strlen(buffer) - 1] == '\n');
+
+			appendStringInfoString(lineData, buffer);
+		}
+	}
+
+	return lineData;
+}
+
+
+/*
+ * SkipLineFromFile reads past the next line of a file, or gzip file, without
+ * keeping it, and returns its length, with its newline, as that of the line
+ * that ReadLineFromFile, or ReadLineFromGzipFile, returns. At the end of file
+ * it returns 0.
+ */
+static size_t
+SkipLineFromFile(FILE *filePointer, void *gzFilePointer)
+{
+	size_t lineLength = 0;
+	bool endOfFile = false;
+	bool endOfLine = false;
+	char buffer[READ_BUFFER_SIZE];
+
+	// read from file until either we reach end of file or end of line
+	while (!endOfFile && !endOfLine)
+	{
+		char *getsResult = (gzFilePointer != NULL
+			? gzgets((gzFile) gzFilePointer, buffer, sizeof(buffer))
+			: fgets(buffer, sizeof(buffer), filePointer)
+			);
+		if (getsResult == NULL)
+		{
+			int errorResult = 0;
+
+			if (gzFilePointer == NULL && ferror(filePointer) != 0)
+			{
+				ereport(ERROR, (errcode_for_file_access(),
+								errmsg("could not read from json file: %m")));
+			}
+			else if (gzFilePointer != NULL)
+			{
+				const char *message = gzerror((gzFile) gzFilePointer, &errorResult);
+				if (errorResult != Z_OK && errorResult != Z_STREAM_END)
+				{
+					ereport(ERROR, (errmsg("could not read from json file"),
+									errhint("%s", message)));
+				}
+			}
+
+			endOfFile = true;
+		}
+		else
+		{
+			size_t length = strlen(buffer);
+
+			// check if we read a new line
+			endOfLine = (buffer[length - 1] == '\n');
+			lineLength += length;
+		}
+	}
+
+	return lineLength;
+}
+
+
+/*
+ * JsonObjectValidate checks that a line is a json object, as yajl_tree_parse
+ * would, with the same error message if it isn't, but without building the
+ * tree of its values, for a scan that reads none of its columns.
+ */
+static bool
+JsonObjectValidate(const char *pLine, size_t lineLength, char *pErrorBuffer, size_t errorBufferSize)
+{
+	const char *p = pLine;
+	yajl_handle handle = NULL;
+	yajl_status status = yajl_status_ok;
+
+	while (p < pLine + lineLength && isspace((unsigned char) *p))
+	{
+		p++;
+	}
+	if (p == pLine + lineLength || *p != '{')
+	{
+		snprintf(pErrorBuffer, errorBufferSize, "not a json object");
+		return false;
+	}
+
+	handle = yajl_alloc(NULL, NULL, NULL);
+	yajl_config(handle, yajl_allow_comments, 1);
+
+	status = yajl_parse(handle, (const unsigned char *) pLine, lineLength);
+	if (status == yajl_status_ok)
+	{
+		status = yajl_complete_parse(handle);
+	}
+	if (status != yajl_status_ok)
+	{
+		unsigned char *pError = yajl_get_error(handle, 1, (const unsigned char *) pLine, lineLength);
+
+		snprintf(pErrorBuffer, errorBufferSize, "%s", (char *) pError);
+		yajl_free_error(handle, pError);
+	}
+	yajl_free(handle);
+
+	return (status == yajl_status_ok);
+}
+
+
+/*
+ * FillTupleSlot walks over all key/value pairs in the given document. For each
+ * pair, the function checks if the key appears in the column mapping hash, and
+ * if the value type is compatible with the one specified for the column. If so
+ * the function converts the value and fills the corresponding tuple position.
+ * The jsonObjectKey parameter is used for recursion, and should always be
+ * passed as NULL. This function is based on the function with the same name in
+ * mongo_fdw.
+ */
+static void
+FillTupleSlot(const yajl_val jsonObject, const char *jsonObjectKey,
+			  HTAB *columnMappingHash, Datum *columnValues, bool *columnNulls)
+{
+	uint32 jsonKeyCount = jsonObject->u.object.len;
+	const char **jsonKeyArray = jsonObject->u.object.keys;
+	yajl_val *jsonValueArray = jsonObject->u.object.values;
+	uint32 jsonKeyIndex = 0;
+
+	// loop over key/value pairs of the json object
+	for (jsonKeyIndex = 0; jsonKeyIndex < jsonKeyCount; jsonKeyIndex++)
+	{
+		const char *jsonKey = jsonKeyArray[jsonKeyIndex];
+		yajl_val jsonValue = jsonValueArray[jsonKeyIndex];
+
+		ColumnMapping *columnMapping = NULL;
+		Oid columnTypeId = InvalidOid;
+		Oid columnArrayTypeId = InvalidOid;
+		Oid columnTypeMod = InvalidOid;
+		bool compatibleTypes = false;
+		bool handleFound = false;
+		const char *jsonFullKey = NULL;
+		void *hashKey = NULL;
+
+		if (jsonObjectKey != NULL)
+		{
+			/*
+			 * For fields in nested json objects, we use fully qualified field
+			 * name to check the column mapping.
+			 */
+			StringInfo jsonFullKeyString = makeStringInfo();
+			appendStringInfo(jsonFullKeyString, "%s.%s", jsonObjectKey, jsonKey);
+			jsonFullKey = jsonFullKeyString->data;
+		}
+		else
+		{
+			jsonFullKey = jsonKey;
+		}
+
+		// recurse into nested objects
+		if (YAJL_IS_OBJECT(jsonValue))
+		{
+			FillTupleSlot(jsonValue, jsonFullKey, columnMappingHash,
+						  columnValues, columnNulls);
+			continue;
+		}
+
+		// look up the corresponding column for this json key
+		hashKey = (void *) jsonFullKey;
+		columnMapping = (ColumnMapping *) hash_search(columnMappingHash, hashKey,
+													  HASH_FIND, &handleFound);
+
+		// if no corresponding column or null json value, continue
+		if (columnMapping == NULL || YAJL_IS_NULL(jsonValue))
+		{
+			continue;
+		}
+
+		// check if columns have compatible types
+		columnTypeId = columnMapping->columnTypeId;
+		columnArrayTypeId = columnMapping->columnArrayTypeId;
+		columnTypeMod = columnMapping->columnTypeMod;
+
+		if (OidIsValid(columnArrayTypeId))
+		{
+			compatibleTypes = YAJL_IS_ARRAY(jsonValue);
+		}
+		else
+		{
+			compatibleTypes = ColumnTypesCompatible(jsonValue, columnTypeId);
+		}
+
+		// if types are incompatible, leave this column null
+		if (!compatibleTypes)
+		{
+			continue;
+		}
+
+		// fill in corresponding column value and null flag
+		if (OidIsValid(columnArrayTypeId))
+		{
+			uint32 columnIndex = columnMapping->columnIndex;
+			columnValues[columnIndex] = ColumnValueArray(jsonValue, columnArrayTypeId,
+														 columnTypeMod);
+			columnNulls[columnIndex] = false;
+		}
+		else
+		{
+			uint32 columnIndex = columnMapping->columnIndex;
+			columnValues[columnIndex] = ColumnValue(jsonValue, columnTypeId,
+													columnTypeMod);
+			columnNulls[columnIndex] = false;
+		}
+	}
+}
+
+
+/*
+ * ColumnTypesCompatible checks if the given json value can be converted to the
+ * given PostgreSQL type.
+ */
+static bool
+ColumnTypesCompatible(yajl_val jsonValue, Oid columnTypeId)
+{
+	bool compatibleTypes = false;
+
+	// we consider the PostgreSQL column type as authoritative
+	switch(columnTypeId)
+	{
+		case INT2OID: case INT4OID:
+		case INT8OID: case FLOAT4OID:
+		case FLOAT8OID: case NUMERICOID:
+		{
+			if (YAJL_IS_NUMBER(jsonValue))
+			{
+				compatibleTypes = true;
+			}
+			break;
+		}
+		case BOOLOID:
+		{
+			if (YAJL_IS_TRUE(jsonValue) || YAJL_IS_FALSE(jsonValue))
+			{
+				compatibleTypes = true;
+			}
+			break;
+		}
+		case BPCHAROID:
+		case VARCHAROID:
+		case TEXTOID:
+		{
+			if (YAJL_IS_STRING(jsonValue))
+			{
+				compatibleTypes = true;
+			}
+			break;
+		}
+		case DATEOID:
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+		{
+			if (YAJL_IS_STRING(jsonValue))
+			{
+				const char *stringValue = (char *) YAJL_GET_STRING(jsonValue);
+
+				bool validDateTimeFormat = ValidDateTimeFormat(stringValue);
+				if (validDateTimeFormat)
+				{
+					compatibleTypes = true;
+				}
+			}
+			break;
+		}
+		default:
+		{
+			/*
+			 * We currently error out on other data types. Some types such as
+			 * byte arrays are easy to add, but they need testing. Other types
+			 * such as money or inet, do not have equivalents in JSON.
+			 */
+			ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_DATA_TYPE),
+							errmsg("cannot convert json type to column type"),
+							errhint("column type: %u", (uint32) columnTypeId)));
+			break;
+		}
+	}
+
+	return compatibleTypes;
+}
+
+
+/*
+ * ValidDateTimeFormat checks if the given dateTimeString can be parsed and decoded
+ * as a date/timestamp. The algorithm used here is based on date_in, timestamp_in,
+ * and timestamptz_in functions.
+ */
+static bool
+ValidDateTimeFormat(const char *dateTimeString)
+{
+	bool validDateTimeFormat = false;
+	char workBuffer[MAXDATELEN + 1];
+	char *fieldArray[MAXDATEFIELDS];
+	int fieldTypeArray[MAXDATEFIELDS];
+	int fieldCount = 0;
+
+	int parseError = ParseDateTime(dateTimeString, workBuffer, sizeof(workBuffer),
+								   fieldArray, fieldTypeArray, MAXDATEFIELDS, 
+								   &fieldCount);
+
+	if (parseError == 0)
+	{
+		int dateType = 0;
+		struct pg_tm dateTime;
+		fsec_t fractionalSecond = 0;
+		int timezone = 0;
+
+		int decodeError = DecodeDateTime(fieldArray, fieldTypeArray, fieldCount,
+										 &dateType, &dateTime, &fractionalSecond,
+										 &timezone);
+		if (decodeError == 0)
+		{
+			/* 
+			 * We only accept DTK_DATE, DTK_EPOCH, DTK_LATE, and DTK_EARLY date
+			 * types. For other date types, input functions raise an error.
+			 */
+			if (dateType == DTK_DATE || dateType == DTK_EPOCH ||
+				dateType == DTK_LATE || dateType == DTK_EARLY)
+			{
+				validDateTimeFormat = true;
+			}
+#ifdef DEBUG
+			else
+				ereport(DEBUG1, (errmsg("%s:%s:%u invlalid format", __FILE__, __func__, __LINE__)));
+#endif
+		}
+#ifdef DEBUG
+		else
+			ereport(DEBUG1, (errmsg("%s:%s:%u decode error", __FILE__, __func__, __LINE__)));
+#endif
+	}
+#ifdef DEBUG
+	else
+		ereport(DEBUG1, (errmsg("%s:%s:%u parse error", __FILE__, __func__, __LINE__)));
+#endif
+
+	return validDateTimeFormat;
+}
+
+
+/*
+ * ColumnValueArray uses array element type id to read the current array pointed
+ * to by the jsonArray, and converts each array element with matching type to 
+ * the corresponding PostgreSQL datum. Then, the function constructs an array
+ * datum from element datums, and returns the array datum. This function ignores
+ * values that aren't type compatible with valueTypeId.
+ */
+static Datum
+ColumnValueArray(yajl_val jsonArray, Oid valueTypeId, Oid valueTypeMod)
+{
+	Datum columnValueDatum = 0;
+	ArrayType *columnValueObject = NULL;
+	bool typeByValue = false;
+	char typeAlignment = 0;
+	int16 typeLength = 0;
+
+	uint32 jsonValueCount = jsonArray->u.array.len;
+	yajl_val *jsonValueArray = jsonArray->u.array.values;
+
+	// allocate enough room for datum array's maximum possible size
+	Datum *datumArray = palloc0(jsonValueCount * sizeof(Datum));
+	uint32 datumArraySize = 0;
+
+	uint32 jsonValueIndex = 0;
+	for (jsonValueIndex = 0; jsonValueIndex < jsonValueCount; jsonValueIndex++)
+	{
+		yajl_val jsonValue = jsonValueArray[jsonValueIndex];
+
+		bool compatibleTypes = ColumnTypesCompatible(jsonValue, valueTypeId);
+		if (compatibleTypes)
+		{
+			datumArray[datumArraySize] = ColumnValue(jsonValue, valueTypeId,
+													 valueTypeMod);
+			datumArraySize++;
+		}
+	}
+
+	get_typlenbyvalalign(valueTypeId, &typeLength, &typeByValue, &typeAlignment);
+	columnValueObject = construct_array(datumArray, datumArraySize, valueTypeId,
+										typeLength, typeByValue, typeAlignment);
+
+	columnValueDatum = PointerGetDatum(columnValueObject);
+	return columnValueDatum;
+}
+
+
+/*
+ * ColumnValue uses column type information to read the current value pointed to
+ * by jsonValue, and converts this value to the corresponding PostgreSQL datum.
+ * The function then returns this datum.
+ */
+static Datum
+ColumnValue(yajl_val jsonValue, Oid columnTypeId, int32 columnTypeMod)
+{
+	Datum columnValue = 0;
+
+	switch(columnTypeId)
+	{
+		case INT2OID:
+		{
+			const char *value = YAJL_GET_NUMBER(jsonValue);
+			columnValue = DirectFunctionCall1(int2in, CStringGetDatum(value));
+			break;
+		}
+		case INT4OID:
+		{
+			const char *value = YAJL_GET_NUMBER(jsonValue);
+			columnValue = DirectFunctionCall1(int4in, CStringGetDatum(value));
+			break;
+		}
+		case INT8OID:
+		{
+			const char *value = YAJL_GET_NUMBER(jsonValue);
+			columnValue = DirectFunctionCall1(int8in, CStringGetDatum(value));
+			break;
+		}
+		case FLOAT4OID:
+		{
+			const char *value = YAJL_GET_NUMBER(jsonValue);
+			columnValue = DirectFunctionCall1(float4in, CStringGetDatum(value));
+			break;
+		}
+		case FLOAT8OID:
+		{
+			const char *value = YAJL_GET_NUMBER(jsonValue);
+			columnValue = DirectFunctionCall1(float8in, CStringGetDatum(value));
+			break;
+		}
+		case NUMERICOID:
+		{
+			const char *value = YAJL_GET_NUMBER(jsonValue);
+			columnValue = DirectFunctionCall3(numeric_in, CStringGetDatum(value),
+											  ObjectIdGetDatum(InvalidOid),
+											  Int32GetDatum(columnTypeMod));
+			break;
+		}
+		case BOOLOID:
+		{
+			bool value = YAJL_IS_TRUE(jsonValue);
+			columnValue = BoolGetDatum(value);
+			break;
+		}
+		case BPCHAROID:
+		{
+			const char *value = YAJL_GET_STRING(jsonValue);
+			columnValue = DirectFunctionCall3(bpcharin, CStringGetDatum(value),
+											  ObjectIdGetDatum(InvalidOid),
+											  Int32GetDatum(columnTypeMod));
+			break;
+		}
+		case VARCHAROID:
+		{
+			const char *value = YAJL_GET_STRING(jsonValue);
+			columnValue = DirectFunctionCall3(varcharin, CStringGetDatum(value),
+											  ObjectIdGetDatum(InvalidOid),
+											  Int32GetDatum(columnTypeMod));
+			break;
+		}
+		case TEXTOID:
+		{
+			const char *value = YAJL_GET_STRING(jsonValue);
+			columnValue = CStringGetTextDatum(value);
+			break;
+		}
+		case DATEOID:
+		{
+			const char *value = YAJL_GET_STRING(jsonValue);
+			columnValue = DirectFunctionCall1(date_in, CStringGetDatum(value));
+			break;
+		}
+		case TIMESTAMPOID:
+		{
+			const char *value = YAJL_GET_STRING(jsonValue);
+			columnValue = DirectFunctionCall3(timestamp_in, CStringGetDatum(value),
+											  ObjectIdGetDatum(InvalidOid),
+											  Int32GetDatum(columnTypeMod));
+			break;
+		}
+		case TIMESTAMPTZOID:
+		{
+			const char *value = YAJL_GET_STRING(jsonValue);
+			columnValue = DirectFunctionCall3(timestamptz_in, CStringGetDatum(value),
+											  ObjectIdGetDatum(InvalidOid),
+											  Int32GetDatum(columnTypeMod));
+			break;
+		}
+		default:
+		{
+			ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_DATA_TYPE),
+							errmsg("cannot convert json type to column type"),
+							errhint("column type: %u", (uint32) columnTypeId)));
+			break;
+		}
+	}
+
+	return columnValue;
+}
+
+
+/*
+ * JsonAnalyzeForeignTable sets the total page count and the function pointer
+ * used to acquire a random sample of rows from the foreign file.
+ */
+static bool
+JsonAnalyzeForeignTable(Relation relation,
+						AcquireSampleRowsFunc *acquireSampleRowsFunc,
+						BlockNumber *totalPageCount)
+{
+	Oid foreignTableId = RelationGetRelid(relation);
+	JsonFdwOptions *options = JsonGetOptions(foreignTableId);
+	BlockNumber pageCount = 0;
+	double size = 0.0;
+
+	//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
+	if (SourcesSize(options, JsonSourceList(options->filename, NULL, false), &size) == 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+				 		errmsg("could not stat file \"%s\": %m",
+							   (options->filename != NULL ? options->filename : options->pManifest))));
+	}
+
+	/*
+	 * Our estimate should return at least 1 so that we can tell later on that
+	 * pg_class.relpages is not default.
+	 */
+	pageCount = (BlockNumber) ((size + (BLCKSZ - 1)) / BLCKSZ);
+	if (pageCount < 1)
+	{
+		pageCount = 1;
+	}
+
+	(*totalPageCount) = pageCount;
+	(*acquireSampleRowsFunc) = JsonAcquireSampleRows;
+
+	return true;
+}
+
+
+/*
+ * JsonAcquireSampleRows acquires a random sample of rows from the foreign
+ * table. Selected rows are returned in the caller allocated sampleRows array,
+ * which must have at least target row count entries. The actual number of rows
+ * selected is returned as the function result. We also count the number of rows
+ * in the collection and return it in total row count. We also always set dead
+ * row count to zero.
+ *
+ * Note that the returned list of rows does not always follow their actual order
+ * in the JSON file. Therefore, correlation estimates derived later could be
+ * inaccurate, but that's OK. We currently don't use correlation estimates (the
+ * planner only pays attention to correlation for index scans).
+ */
+static int
+JsonAcquireSampleRows(Relation relation, int logLevel,
+					  HeapTuple *sampleRows, int targetRowCount,
+					  double *totalRowCount, double *totalDeadRowCount)
+{
+	int sampleRowCount = 0;
+	double rowCount = 0.0;
+	double rowCountToSkip = -1;	// -1 means not set yet
+	double parsedRowCount = 0.0;
+	double selectionState = 0;
+	MemoryContext oldContext = CurrentMemoryContext;
+	MemoryContext tupleContext = NULL;
+	Datum *columnValues = NULL;
+	bool *columnNulls = NULL;
+	TupleTableSlot *scanTupleSlot = NULL;
+	List *columnList = NIL;
+	List *foreignPrivateList = NULL;
+	ForeignScanState *scanState = NULL;
+	ForeignScan *foreignScan = NULL;
+	char *relationName = NULL;
+	int executorFlags = 0;
+	JsonFdwExecState *execState = NULL;
+	JsonFdwStats stats;
+	instr_time startTime;
+	instr_time endTime;
+	instr_time parseTime;
+	instr_time analyzeTime;
+	jbs_t blockSampler;
+	jbs_t *pJbs = NULL;
+	jks_t *pJks = NULL;
+	bool timeBounded = false;
+	bool timeLimitReached = false;
+	double sampledFraction = 1.0;	// of the stored bytes
+	double totalRows = 0.0;
+
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	int columnCount = tupleDescriptor->natts;
+	Form_pg_attribute *attributes = tupleDescriptor->attrs;
+
+	// create list of columns of the relation
+	int columnIndex = 0;
+	//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
+	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Var *column = (Var *) palloc0(sizeof(Var));
+
+		// only assign required fields for column mapping hash
+		column->varattno = columnIndex + 1;
+		column->vartype = attributes[columnIndex]->atttypid;
+		column->vartypmod = attributes[columnIndex]->atttypmod;
+
+		columnList = lappend(columnList, column);
+	}
+
+	// setup foreign scan plan node
+	foreignPrivateList = list_make4(columnList, NULL, NIL, NIL);
+	foreignPrivateList = lappend(foreignPrivateList, makeInteger(false));
+	foreignPrivateList = lappend(foreignPrivateList, NIL);
+	foreignScan = makeNode(ForeignScan);
+	foreignScan->fdw_private = foreignPrivateList;
+
+	// setup tuple slot
+	columnValues = (Datum *) palloc0(columnCount * sizeof(Datum));
+	columnNulls = (bool *) palloc0(columnCount * sizeof(bool));	
+	scanTupleSlot = MakeTupleTableSlot();
+	scanTupleSlot->tts_tupleDescriptor = tupleDescriptor;
+	scanTupleSlot->tts_values = columnValues;
+	scanTupleSlot->tts_isnull = columnNulls;
+
+	// setup scan state
+	scanState = makeNode(ForeignScanState);
+	scanState->ss.ss_currentRelation = relation;
+	scanState->ss.ps.plan = (Plan *) foreignScan;
+	scanState->ss.ss_ScanTupleSlot = scanTupleSlot;
+
+	JsonBeginForeignScan(scanState, executorFlags);
+	execState = (JsonFdwExecState *) scanState->fdw_state;
+	execState->pJks = JsonKeyStatsInit(targetRowCount);
+	INSTR_TIME_SET_ZERO(parseTime);
+	INSTR_TIME_SET_CURRENT(analyzeTime);
+
+	/*
+	 * A large uncompressed file is sampled by blocks, at random offsets, rather
+	 * than read through. A gzip file can't be seeked, so it is read for a
+	 * bounded time instead, json_fdw.analyze_gzip_time, and the row count
+	 * extrapolated from how much of it was read. That sample is of the head
+	 * of the file, so it is biased when the rows change along the file, ie.
+	 * when it is in time order. Several sources, and pages, are read through.
+	 */
+	if (execState->pJss == NULL && execState->pJsp == NULL)
+	{
+		if (execState->filePointer != NULL && execState->fileBytes / JSON_SAMPLE_BLOCK_SIZE > (uint64) targetRowCount)
+		{
+			memset(&blockSampler, 0, sizeof(blockSampler));
+			blockSampler.blocks = (execState->fileBytes + JSON_SAMPLE_BLOCK_SIZE - 1) / JSON_SAMPLE_BLOCK_SIZE;
+			blockSampler.target = targetRowCount;
+			pJbs = &blockSampler;
+		}
+		else if (execState->gzFilePointer != NULL && JsonSampleGzipMsec >= 0)
+			timeBounded = true;
+	}
+
+	/*
+	 * Use per-tuple memory context to prevent leak of memory used to read and
+	 * parse rows from the file using ReadLineFromFile and FillTupleSlot.
+	 */
+	tupleContext = AllocSetContextCreate(CurrentMemoryContext,
+					 "json_fdw temporary context",
+					 ALLOCSET_DEFAULT_MINSIZE,
+					 ALLOCSET_DEFAULT_INITSIZE,
+					 ALLOCSET_DEFAULT_MAXSIZE);
+
+	// prepare for sampling rows
+	selectionState = anl_init_selection_state(targetRowCount);
+
+	for (;;)
+	{
+		// check for user-requested abort or sleep
+		vacuum_delay_point();
+
+		/*
+		 * Once the reservoir is full, the rows that Vitter's algorithm skips
+		 * are only counted, by their newlines, rather than parsed. t in
+		 * Vitter's paper is the number of records already processed. If we
+		 * need to compute a new S value, we must use the "not yet incremented"
+		 * value of rowCount as t.
+		 */
+		if (sampleRowCount >= targetRowCount)
+		{
+			bool endOfRows = false;
+
+			if (rowCountToSkip < 0)
+			{
+				rowCountToSkip = anl_get_next_S(rowCount, targetRowCount, &selectionState);
+			}
+
+			while (rowCountToSkip > 0 && !endOfRows && !timeLimitReached)
+			{
+				endOfRows = ((pJbs != NULL && !JsonSampleBlockNext(execState, pJbs)) || !JsonSkipLine(execState));
+				if (!endOfRows)
+				{
+					rowCount += 1;
+					rowCountToSkip -= 1;
+
+					if (((uint64) rowCount % JSON_SAMPLE_CHECK_ROWS) == 0)
+					{
+						vacuum_delay_point();
+						if (timeBounded)
+						{
+							INSTR_TIME_SET_CURRENT(endTime);
+							INSTR_TIME_SUBTRACT(endTime, analyzeTime);
+							timeLimitReached = (INSTR_TIME_GET_MILLISEC(endTime) > JsonSampleGzipMsec);
+						}
+					}
+				}
+			}
+
+			if (endOfRows || timeLimitReached)
+			{
+				break;
+			}
+		}
+
+		memset(columnValues, 0, columnCount * sizeof(Datum));
+		memset(columnNulls, true, columnCount * sizeof(bool));
+
+		MemoryContextReset(tupleContext);
+		MemoryContextSwitchTo(tupleContext);
+
+		// when sampling blocks, move on to the next line of a sampled block
+		if (pJbs != NULL && !JsonSampleBlockNext(execState, pJbs))
+		{
+			MemoryContextSwitchTo(oldContext);
+			break;
+		}
+
+		// read the next record, timing the read, parse and convert of it
+		INSTR_TIME_SET_CURRENT(startTime);
+		JsonIterateForeignScan(scanState);
+		INSTR_TIME_SET_CURRENT(endTime);
+		INSTR_TIME_ACCUM_DIFF(parseTime, endTime, startTime);
+
+		MemoryContextSwitchTo(oldContext);
+
+		// if there are no more records to read, break
+		if (scanTupleSlot->tts_isempty)
+		{
+			break;
+		}
+		parsedRowCount += 1;
+
+		if (timeBounded)
+		{
+			INSTR_TIME_SUBTRACT(endTime, analyzeTime);
+			timeLimitReached = (INSTR_TIME_GET_MILLISEC(endTime) > JsonSampleGzipMsec);
+		}
+
+		/*
+		 * The first targetRowCount sample rows are simply copied into the
+		 * reservoir. Then we start replacing tuples in the sample until we
+		 * reach the end of the relation. This algorithm is from Jeff Vitter's
+		 * paper (see more info in commands/analyze.c).
+		 */
+		if (sampleRowCount < targetRowCount)
+		{
+			JsonKeyStatsKeep(execState->pJks, sampleRowCount);
+			sampleRows[sampleRowCount++] = heap_form_tuple(tupleDescriptor, 
+								   columnValues,
+								   columnNulls);
+		}
+		else
+		{
+			/*
+			 * The rows before it were skipped, so this is a suitable tuple,
+			 * save it, replacing one old tuple at random.
+			 */
+			int rowIndex = (int) (targetRowCount * anl_random_fract());
+			Assert(rowIndex >= 0);
+			Assert(rowIndex < targetRowCount);
+
+			heap_freetuple(sampleRows[rowIndex]);
+			sampleRows[rowIndex] = heap_form_tuple(tupleDescriptor, columnValues, columnNulls);
+			JsonKeyStatsKeep(execState->pJks, rowIndex);
+
+			rowCountToSkip = -1;
+		}
+
+		rowCount += 1;
+
+		if (timeLimitReached)
+		{
+			break;
+		}
+	}
+
+	// the share of the file that was read, to extrapolate the rows of all of it from
+	if (pJbs != NULL && pJbs->selected > 0)
+	{
+		sampledFraction = (double) pJbs->selected / (double) pJbs->blocks;
+	}
+	else if (timeLimitReached && execState->fileBytes > 0)
+	{
+		sampledFraction = (double) gzoffset((gzFile) execState->gzFilePointer) / (double) execState->fileBytes;
+		sampledFraction = Min(Max(sampledFraction, DBL_MIN), 1.0);
+	}
+	totalRows = (sampledFraction < 1.0 ? clamp_row_est(rowCount / sampledFraction) : rowCount);
+
+	// clean up
+	MemoryContextDelete(tupleContext);
+	pfree(columnValues);
+	pfree(columnNulls);
+
+	// keep what was measured, for costing scans
+	memset(&stats, 0, sizeof(stats));
+	stats.relid = RelationGetRelid(relation);
+	stats.rows = totalRows;
+	stats.sources = (execState->pJss != NULL ? execState->pJss->count : 1);
+	stats.fileBytes = (double) execState->fileBytes;
+	if (rowCount > 0)
+	{
+		stats.bytesPerRow = (double) execState->bytesRead / rowCount;
+		stats.parseUsecPerRow = (double) INSTR_TIME_GET_MICROSEC(parseTime) / Max(parsedRowCount, 1.0);
+	}
+	stats.compressionRatio = (execState->fileBytes > 0
+		? (double) execState->bytesRead / ((double) execState->fileBytes * sampledFraction)
+		: 1.0
+		);
+	pJks = execState->pJks;
+	JsonKeyStatsCount(pJks, sampleRowCount, execState->columnMappingHash);
+
+	JsonEndForeignScan(scanState);
+
+	// emit some interesting relation info
+	relationName = RelationGetRelationName(relation);
+	if (sampledFraction < 1.0)
+	{
+		ereport(logLevel, (errmsg("\"%s\": scanned %.1f%% of the file, containing %.0f rows; %d rows in sample, %.0f estimated total rows",
+					  relationName, sampledFraction * 100.0, rowCount, sampleRowCount, totalRows)));
+	}
+	else
+	{
+		ereport(logLevel, (errmsg("\"%s\": file contains %.0f rows; %d rows in sample",
+					  relationName, rowCount, sampleRowCount)));
+	}
+
+	(*totalRowCount) = totalRows;
+	(*totalDeadRowCount) = 0;
+
+	JsonStatsPut(&stats, pJks, logLevel);
+	MemoryContextDelete(pJks->context);
+
+	return sampleRowCount;
+}
+
+
+/*
+ * The stats that Analyze measured are cached per backend, including those of
+ * tables that have not been analyzed. Writing the stats of a table sends a
+ * relcache invalidation for it, which drops the cached entry in every backend.
+ */
+static HTAB *JsonStatsHash = NULL;
+
+static void JsonStatsInvalidate(Datum arg, Oid relid)
+{
+	if (JsonStatsHash == NULL)
+		return;
+
+	if (OidIsValid(relid))
+	{	JsonFdwStats *pStats = (JsonFdwStats *) hash_search(JsonStatsHash, &relid, HASH_FIND, NULL);
+
+		if (pStats != NULL && pStats->pKeyHash != NULL)
+			hash_destroy(pStats->pKeyHash);
+		hash_search(JsonStatsHash, &relid, HASH_REMOVE, NULL);
+	}
+	else
+	{	HASH_SEQ_STATUS status;
+		JsonFdwStats *pStats = NULL;
+
+		// all of the relcache is being reset
+		hash_seq_init(&status, JsonStatsHash);
+		while ((pStats = (JsonFdwStats *) hash_seq_search(&status)) != NULL)
+		{
+			if (pStats->pKeyHash != NULL)
+				hash_destroy(pStats->pKeyHash);
+			hash_search(JsonStatsHash, &pStats->relid, HASH_REMOVE, NULL);
+		}
+	}
+}
+
+/*
+ * Find a stats table of the extension, returning its qualified name and oid,
+ * or NULL if the extension has not been updated to a version with it yet.
+ * It is the member of the extension of that name, wherever that is, not any
+ * table of that name that may be in its schema. This must be called with SPI
+ * connected.
+ */
+static char *JsonStatsTableName(const char *relname, Oid *pTableId)
+{
+	char *tableName = NULL;
+	Oid argTypes[1] = { TEXTOID };
+	Datum args[1] = { CStringGetTextDatum(relname) };
+	int rc = SPI_execute_with_args(
+		"SELECT c.oid, quote_ident(n.nspname) || '.' || quote_ident(c.relname)"
+		" FROM pg_catalog.pg_extension e"
+		" JOIN pg_catalog.pg_depend d ON d.refclassid = 'pg_catalog.pg_extension'::pg_catalog.regclass"
+		"  AND d.refobjid = e.oid AND d.deptype = 'e'"
+		"  AND d.classid = 'pg_catalog.pg_class'::pg_catalog.regclass"
+		" JOIN pg_catalog.pg_class c ON c.oid = d.objid AND c.relname = $1"
+		" JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace"
+		" WHERE e.extname = 'json_fdw'"
+		, 1, argTypes, args, NULL, true, 1);
+
+	if (rc == SPI_OK_SELECT && SPI_processed == 1)
+	{	bool isNull = false;
+
+		*pTableId = DatumGetObjectId(SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &isNull));
+		tableName = SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 2);
+	}
+
+	return tableName;
+}
+
+// JsonStatsEntry returns the cached stats of a foreign table, reading them if they aren't cached
+static JsonFdwStats *JsonStatsEntry(Oid foreignTableId)
+{
+	JsonFdwStats *pStats = NULL;
+	JsonFdwStats stats;
+	bool found = false;
+
+	if (JsonStatsHash == NULL)
+	{	HASHCTL hashInfo;
+
+		memset(&hashInfo, 0, sizeof(hashInfo));
+		hashInfo.keysize = sizeof(Oid);
+		hashInfo.entrysize = sizeof(JsonFdwStats);
+		hashInfo.hash = tag_hash;
+		hashInfo.hcxt = CacheMemoryContext;
+
+		JsonStatsHash = hash_create("json_fdw stats", 32, &hashInfo, (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT));
+		CacheRegisterRelcacheCallback(JsonStatsInvalidate, (Datum) 0);
+	}
+
+	pStats = (JsonFdwStats *) hash_search(JsonStatsHash, &foreignTableId, HASH_FIND, &found);
+	if (pStats == NULL)
+	{	Oid tableId = InvalidOid;
+		char *tableName = NULL;
+
+		memset(&stats, 0, sizeof(stats));
+		stats.relid = foreignTableId;
+
+		// read into a local first, so that an error doesn't leave a partial entry behind
+		SPI_connect();
+		tableName = JsonStatsTableName(JSON_STATS_TABLE, &tableId);
+		if (tableName != NULL)
+		{	Oid argTypes[1] = { OIDOID };
+			Datum args[1] = { ObjectIdGetDatum(foreignTableId) };
+			char *query = psprintf(
+				"SELECT rows, sources, file_bytes, bytes_per_row, compression_ratio, parse_usec_per_row"
+				" FROM %s WHERE relid = $1", tableName);
+			int rc = SPI_execute_with_args(query, 1, argTypes, args, NULL, true, 1);
+
+			if (rc == SPI_OK_SELECT && SPI_processed == 1)
+			{	HeapTuple tuple = SPI_tuptable->vals[0];
+				TupleDesc tupleDesc = SPI_tuptable->tupdesc;
+				bool isNull = false;
+
+				stats.bFound = true;
+				stats.rows = DatumGetFloat8(SPI_getbinval(tuple, tupleDesc, 1, &isNull));
+				stats.sources = DatumGetInt32(SPI_getbinval(tuple, tupleDesc, 2, &isNull));
+				stats.fileBytes = DatumGetFloat8(SPI_getbinval(tuple, tupleDesc, 3, &isNull));
+				stats.bytesPerRow = DatumGetFloat8(SPI_getbinval(tuple, tupleDesc, 4, &isNull));
+				stats.compressionRatio = DatumGetFloat8(SPI_getbinval(tuple, tupleDesc, 5, &isNull));
+				stats.parseUsecPerRow = DatumGetFloat8(SPI_getbinval(tuple, tupleDesc, 6, &isNull));
+			}
+		}
+		SPI_finish();
+
+		pStats = (JsonFdwStats *) hash_search(JsonStatsHash, &foreignTableId, HASH_ENTER, &found);
+		*pStats = stats;
+	}
+
+	return pStats;
+}
+
+// JsonStatsGet returns the stats of a foreign table, or NULL if it has not been analyzed
+static JsonFdwStats *JsonStatsGet(Oid foreignTableId)
+{
+	JsonFdwStats *pStats = JsonStatsEntry(foreignTableId);
+
+	return (pStats->bFound ? pStats : NULL);
+}
+
+/*
+ * Find the function of the extension that writes the stats tables, returning
+ * its qualified name, or NULL, logged, if the extension has not been updated
+ * to a version with it yet. This must be called with SPI connected.
+ */
+static char *JsonStatsPutFunctionName(int logLevel)
+{
+	char *functionName = NULL;
+	Oid argTypes[1] = { TEXTOID };
+	Datum args[1] = { CStringGetTextDatum(JSON_STATS_PUT_FUNCTION) };
+	int rc = SPI_execute_with_args(
+		"SELECT quote_ident(n.nspname) || '.' || quote_ident(p.proname)"
+		" FROM pg_catalog.pg_extension e"
+		" JOIN pg_catalog.pg_depend d ON d.refclassid = 'pg_catalog.pg_extension'::pg_catalog.regclass"
+		"  AND d.refobjid = e.oid AND d.deptype = 'e'"
+		"  AND d.classid = 'pg_catalog.pg_proc'::pg_catalog.regclass"
+		" JOIN pg_catalog.pg_proc p ON p.oid = d.objid AND p.proname = $1"
+		" JOIN pg_catalog.pg_namespace n ON n.oid = p.pronamespace"
+		" WHERE e.extname = 'json_fdw'"
+		, 1, argTypes, args, NULL, true, 1);
+
+	if (rc == SPI_OK_SELECT && SPI_processed == 1)
+	{
+		functionName = SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1);
+	}
+	else
+	{
+		ereport(logLevel, (errmsg("json_fdw stats not saved, there is no %s function", JSON_STATS_PUT_FUNCTION),
+				   errhint("Update the extension with ALTER EXTENSION json_fdw UPDATE.")));
+	}
+
+	return functionName;
+}
+
+// A float8[] of one of the fractions of the keys, of type, or of their presence if type is -1
+static Datum JsonKeyStatsFracArray(jks_t *pJks, int type)
+{
+	Datum *pFracs = (Datum *) palloc(sizeof(Datum) * (pJks->keyCount + 1));
+	int count = 0;
+	int i;
+
+	for (i = 0; i < pJks->keyCount; i++)
+	{	JsonKeyStats *pKey = pJks->ppKeys[i];
+
+		if (pKey->present == 0)
+			continue;
+		pFracs[count++] = Float8GetDatum((type < 0 ? pKey->present : pKey->types[type]) / pJks->sampleRows);
+	}
+
+	return PointerGetDatum(construct_array(pFracs, count, FLOAT8OID, sizeof(float8), FLOAT8PASSBYVAL, 'd'));
+}
+
+/*
+ * JsonStatsPut replaces the stats of a foreign table, and of its keys. They
+ * are written by a security definer function of the extension, for the owner
+ * of the table, as Analyze is run by roles that may not write the stats
+ * tables. A table that isn't the session user's, or an extension that hasn't
+ * been updated, is logged rather than raised.
+ */
+static void JsonStatsPut(JsonFdwStats *pStats, jks_t *pJks, int logLevel)
+{
+	char *functionName = NULL;
+
+	if (!pg_class_ownercheck(pStats->relid, GetSessionUserId()))
+	{
+		ereport(logLevel, (errmsg("json_fdw stats not saved, must be owner of relation %s", get_rel_name(pStats->relid))));
+		return;
+	}
+
+	SPI_connect();
+	functionName = JsonStatsPutFunctionName(logLevel);
+	if (functionName != NULL)
+	{	Oid argTypes[16] = { OIDOID, FLOAT8OID, INT4OID, FLOAT8OID, FLOAT8OID, FLOAT8OID, FLOAT8OID,
+			TEXTARRAYOID, BOOLARRAYOID, FLOAT8ARRAYOID, FLOAT8ARRAYOID, FLOAT8ARRAYOID,
+			FLOAT8ARRAYOID, FLOAT8ARRAYOID, FLOAT8ARRAYOID, FLOAT8ARRAYOID };
+		Datum args[16];
+		char nulls[16];
+		int i;
+
+		memset(nulls, ' ', sizeof(nulls));
+		args[0] = ObjectIdGetDatum(pStats->relid);
+		args[1] = Float8GetDatum(pStats->rows);
+		args[2] = Int32GetDatum(pStats->sources);
+		args[3] = Float8GetDatum(pStats->fileBytes);
+		args[4] = Float8GetDatum(pStats->bytesPerRow);
+		args[5] = Float8GetDatum(pStats->compressionRatio);
+		args[6] = Float8GetDatum(pStats->parseUsecPerRow);
+
+		// the keys, and their fractions of the rows in the sample, if the keys
+		// were analyzed, otherwise their stats are left as they are
+		if (pJks != NULL)
+		{	Datum *pKeys = (Datum *) palloc(sizeof(Datum) * (pJks->keyCount + 1));
+			Datum *pMapped = (Datum *) palloc(sizeof(Datum) * (pJks->keyCount + 1));
+			int count = 0;
+			int type;
+
+			for (i = 0; i < pJks->keyCount; i++)
+			{	JsonKeyStats *pKey = pJks->ppKeys[i];
+
+				if (pKey->present == 0)
+					continue;
+				pKeys[count] = CStringGetTextDatum(pKey->key);
+				pMapped[count] = BoolGetDatum(pKey->bMapped);
+				count++;
+			}
+			args[7] = PointerGetDatum(construct_array(pKeys, count, TEXTOID, -1, false, 'i'));
+			args[8] = PointerGetDatum(construct_array(pMapped, count, BOOLOID, 1, true, 'c'));
+			args[9] = JsonKeyStatsFracArray(pJks, -1);
+			for (type = 0; type < JSON_KEY_TYPE_COUNT; type++)
+				args[10 + type] = JsonKeyStatsFracArray(pJks, type);
+		}
+		else
+		{
+			for (i = 7; i < 16; i++)
+			{
+				args[i] = (Datum) 0;
+				nulls[i] = 'n';
+			}
+		}
+
+		SPI_execute_with_args(psprintf("SELECT %s($1, $2, $3, $4, $5, $6, $7, $8, $9, $10, $11, $12, $13, $14, $15, $16)", functionName)
+			, 16, argTypes, args, nulls, false, 0);
+	}
+
+	// drop the cached stats of the table, in every backend
+	CacheInvalidateRelcacheByRelid(pStats->relid);
+	JsonStatsInvalidate((Datum) 0, pStats->relid);
+	SPI_finish();
+}
+
+// JsonKeyStatsInit starts collecting the keys of the rows of a sample of the given size
+static jks_t *JsonKeyStatsInit(int slotCount)
+{
+	jks_t *pJks = (jks_t *) palloc0(sizeof(jks_t));
+	HASHCTL hashInfo;
+
+	pJks->context = AllocSetContextCreate(CurrentMemoryContext,
+					 "json_fdw key stats context",
+					 ALLOCSET_DEFAULT_MINSIZE,
+					 ALLOCSET_DEFAULT_INITSIZE,
+					 ALLOCSET_DEFAULT_MAXSIZE);
+
+	memset(&hashInfo, 0, sizeof(hashInfo));
+	hashInfo.keysize = NAMEDATALEN;
+	hashInfo.entrysize = sizeof(JsonKeyStats);
+	hashInfo.hash = string_hash;
+	hashInfo.hcxt = pJks->context;
+
+	pJks->pKeys = hash_create("json_fdw key stats", 256, &hashInfo, (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT));
+	pJks->ppKeys = (JsonKeyStats **) MemoryContextAlloc(pJks->context, sizeof(JsonKeyStats *) * JSON_KEY_STATS_MAX);
+	pJks->rowAlloc = 64;
+	pJks->pRow = (int *) MemoryContextAlloc(pJks->context, sizeof(int) * pJks->rowAlloc);
+	pJks->slotCount = slotCount;
+	pJks->ppSlots = (int **) MemoryContextAllocZero(pJks->context, sizeof(int *) * slotCount);
+
+	return pJks;
+}
+
+// The json type of a value, as kept by Analyze
+static int JsonKeyType(yajl_val jsonValue)
+{
+	int type = JSON_KEY_TYPE_NULL;
+
+	if (YAJL_IS_STRING(jsonValue))
+		type = JSON_KEY_TYPE_STRING;
+	else if (YAJL_IS_NUMBER(jsonValue))
+		type = JSON_KEY_TYPE_NUMBER;
+	else if (YAJL_IS_TRUE(jsonValue) || YAJL_IS_FALSE(jsonValue))
+		type = JSON_KEY_TYPE_BOOLEAN;
+	else if (YAJL_IS_OBJECT(jsonValue))
+		type = JSON_KEY_TYPE_OBJECT;
+	else if (YAJL_IS_ARRAY(jsonValue))
+		type = JSON_KEY_TYPE_ARRAY;
+
+	return type;
+}
+
+// Add the keys of a json object, and of the objects nested in it, by their dotted paths as FillTupleSlot does
+static void JsonKeyStatsWalk(jks_t *pJks, yajl_val jsonObject, const char *jsonObjectKey)
+{
+	uint32 jsonKeyIndex = 0;
+
+	for (jsonKeyIndex = 0; jsonKeyIndex < jsonObject->u.object.len; jsonKeyIndex++)
+	{
+		const char *jsonKey = jsonObject->u.object.keys[jsonKeyIndex];
+		yajl_val jsonValue = jsonObject->u.object.values[jsonKeyIndex];
+		const char *jsonFullKey = (jsonObjectKey != NULL ? psprintf("%s.%s", jsonObjectKey, jsonKey) : jsonKey);
+		JsonKeyStats *pKey = NULL;
+		bool found = false;
+
+		// a key longer than a column name can't be read by one, nor can the keys in it
+		if (strlen(jsonFullKey) >= NAMEDATALEN)
+			continue;
+
+		pKey = (JsonKeyStats *) hash_search(pJks->pKeys, jsonFullKey, HASH_FIND, &found);
+		if (pKey == NULL && pJks->keyCount < JSON_KEY_STATS_MAX)
+		{
+			pKey = (JsonKeyStats *) hash_search(pJks->pKeys, jsonFullKey, HASH_ENTER, &found);
+			pKey->index = pJks->keyCount;
+			pKey->present = 0;
+			memset(pKey->types, 0, sizeof(pKey->types));
+			pKey->bMapped = false;
+			pJks->ppKeys[pJks->keyCount++] = pKey;
+		}
+
+		if (pKey != NULL)
+		{
+			if (pJks->rowCount == pJks->rowAlloc)
+			{
+				pJks->rowAlloc *= 2;
+				pJks->pRow = (int *) repalloc(pJks->pRow, sizeof(int) * pJks->rowAlloc);
+			}
+			pJks->pRow[pJks->rowCount++] = pKey->index * JSON_KEY_TYPE_COUNT + JsonKeyType(jsonValue);
+		}
+
+		if (YAJL_IS_OBJECT(jsonValue))
+			JsonKeyStatsWalk(pJks, jsonValue, jsonFullKey);
+	}
+}
+
+// JsonKeyStatsRow collects the keys of the row just read
+static void JsonKeyStatsRow(jks_t *pJks, yajl_val jsonObject)
+{
+	pJks->rowCount = 0;
+	JsonKeyStatsWalk(pJks, jsonObject, NULL);
+}
+
+// JsonKeyStatsKeep keeps the keys of the row just read, with the reservoir slot it was sampled into
+static void JsonKeyStatsKeep(jks_t *pJks, int slot)
+{
+	int *pSlot = (int *) MemoryContextAlloc(pJks->context, sizeof(int) * (pJks->rowCount + 1));
+
+	pSlot[0] = pJks->rowCount;
+	memcpy(pSlot + 1, pJks->pRow, sizeof(int) * pJks->rowCount);
+
+	if (pJks->ppSlots[slot] != NULL)
+		pfree(pJks->ppSlots[slot]);
+	pJks->ppSlots[slot] = pSlot;
+}
+
+// JsonKeyStatsCount counts the keys of the rows in the sample, and notes those that a column reads
+static void JsonKeyStatsCount(jks_t *pJks, int sampleRowCount, HTAB *columnMappingHash)
+{
+	int slot;
+	int i;
+
+	for (slot = 0; slot < sampleRowCount && slot < pJks->slotCount; slot++)
+	{	int *pSlot = pJks->ppSlots[slot];
+
+		for (i = 1; pSlot != NULL && i <= pSlot[0]; i++)
+		{	JsonKeyStats *pKey = pJks->ppKeys[pSlot[i] / JSON_KEY_TYPE_COUNT];
+
+			pKey->present += 1;
+			pKey->types[pSlot[i] % JSON_KEY_TYPE_COUNT] += 1;
+		}
+	}
+
+	for (i = 0; i < pJks->keyCount; i++)
+	{	bool found = false;
+
+		hash_search(columnMappingHash, pJks->ppKeys[i]->key, HASH_FIND, &found);
+		pJks->ppKeys[i]->bMapped = found;
+	}
+
+	pJks->sampleRows = sampleRowCount;
+}
+
+/*
+ * The share of the sampled rows whose value of a key a column of the given type
+ * converts, as ColumnTypesCompatible decides, or -1 for a type that it doesn't.
+ * Strings count for dates and timestamps, so that is an upper bound for them.
+ */
+static double JsonKeyColumnFrac(double *pTypes, Oid columnTypeId)
+{
+	double frac = -1.0;
+
+	if (OidIsValid(get_element_type(columnTypeId)))
+		frac = pTypes[JSON_KEY_TYPE_ARRAY];
+	else
+	{
+		switch (columnTypeId)
+		{
+			case INT2OID: case INT4OID:
+			case INT8OID: case FLOAT4OID:
+			case FLOAT8OID: case NUMERICOID:
+				frac = pTypes[JSON_KEY_TYPE_NUMBER];
+				break;
+			case BOOLOID:
+				frac = pTypes[JSON_KEY_TYPE_BOOLEAN];
+				break;
+			case BPCHAROID: case VARCHAROID:
+			case TEXTOID: case DATEOID:
+			case TIMESTAMPOID: case TIMESTAMPTZOID:
+				frac = pTypes[JSON_KEY_TYPE_STRING];
+				break;
+		}
+	}
+
+	return frac;
+}
+
+/*
+ * JsonKeyStatsHash returns the stats of the keys of a foreign table, that are
+ * read all at once, when a plan first needs them, and cached with the stats
+ * of the table, until Analyze replaces them. It is empty if the keys haven't
+ * been analyzed.
+ */
+static HTAB *JsonKeyStatsHash(Oid foreignTableId)
+{
+	JsonFdwStats *pStats = JsonStatsEntry(foreignTableId);
+	HTAB *pKeyHash = NULL;
+	HASHCTL hashInfo;
+	Oid tableId = InvalidOid;
+	char *tableName = NULL;
+
+	if (pStats->pKeyHash != NULL)
+	{
+		return pStats->pKeyHash;
+	}
+
+	memset(&hashInfo, 0, sizeof(hashInfo));
+	hashInfo.keysize = NAMEDATALEN;
+	hashInfo.entrysize = sizeof(JsonKeyStats);
+	hashInfo.hash = string_hash;
+	hashInfo.hcxt = CacheMemoryContext;
+	pKeyHash = hash_create("json_fdw key stats", 64, &hashInfo, (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT));
+
+	SPI_connect();
+	tableName = JsonStatsTableName(JSON_KEY_STATS_TABLE, &tableId);
+	if (tableName != NULL)
+	{	Oid argTypes[1] = { OIDOID };
+		Datum args[1] = { ObjectIdGetDatum(foreignTableId) };
+		char *query = psprintf(
+			"SELECT key, present_frac, null_frac, string_frac, number_frac, boolean_frac, object_frac, array_frac"
+			" FROM %s WHERE relid = $1", tableName);
+		int rc = SPI_execute_with_args(query, 1, argTypes, args, NULL, true, 0);
+		uint64 row;
+
+		for (row = 0; rc == SPI_OK_SELECT && row < SPI_processed; row++)
+		{	HeapTuple tuple = SPI_tuptable->vals[row];
+			TupleDesc tupleDesc = SPI_tuptable->tupdesc;
+			char key[NAMEDATALEN];
+			JsonKeyStats *pKey = NULL;
+			bool isNull = false;
+			int type;
+
+			strlcpy(key, SPI_getvalue(tuple, tupleDesc, 1), sizeof(key));
+			pKey = (JsonKeyStats *) hash_search(pKeyHash, key, HASH_ENTER, NULL);
+			pKey->present = DatumGetFloat8(SPI_getbinval(tuple, tupleDesc, 2, &isNull));
+			for (type = 0; type < JSON_KEY_TYPE_COUNT; type++)
+				pKey->types[type] = DatumGetFloat8(SPI_getbinval(tuple, tupleDesc, type + 3, &isNull));
+		}
+	}
+	SPI_finish();
+
+	// the stats of the table may have been invalidated by the query
+	pStats = JsonStatsEntry(foreignTableId);
+	if (pStats->pKeyHash != NULL)
+		hash_destroy(pStats->pKeyHash);
+	pStats->pKeyHash = pKeyHash;
+
+	return pKeyHash;
+}
+
+/*
+ * JsonKeyStatsFrac returns the share of rows that a column of a key has a
+ * value in, or -1 if the keys weren't analyzed. A key that wasn't in the
+ * sample is taken to be in half a row of it, as it may be in rows that
+ * weren't sampled, rather than in none.
+ */
+static double JsonKeyStatsFrac(Oid foreignTableId, const char *key, Oid columnTypeId)
+{
+	HTAB *pKeyHash = JsonKeyStatsHash(foreignTableId);
+	JsonFdwStats *pStats = NULL;
+	JsonKeyStats *pKey = NULL;
+	char keyName[NAMEDATALEN];
+	double sampleRows = 0.0;
+
+	if (hash_get_num_entries(pKeyHash) == 0)
+	{
+		return -1.0;
+	}
+
+	strlcpy(keyName, key, sizeof(keyName));
+	pKey = (JsonKeyStats *) hash_search(pKeyHash, keyName, HASH_FIND, NULL);
+	if (pKey != NULL)
+	{
+		return JsonKeyColumnFrac(pKey->types, columnTypeId);
+	}
+
+	// Analyze samples at most 300 rows per unit of the statistics target
+	pStats = JsonStatsGet(foreignTableId);
+	sampleRows = 300.0 * default_statistics_target;
+	if (pStats != NULL && pStats->rows > 0 && pStats->rows < sampleRows)
+		sampleRows = pStats->rows;
+
+	return 0.5 / sampleRows;
+}
+
+/*
+ * JsonClauseSelectivity is the selectivity of the restriction clauses of a
+ * scan. A null test, or a strict operator, on a column without statistics,
+ * ie. one added since the table was analyzed, uses the share of the sampled
+ * rows with a value of the column's key that the column can convert, as the
+ * keys are analyzed whether a column reads them or not. The key is named as
+ * the column is elsewhere in the plan, by JsonAttributeNameGet.
+ */
+static Selectivity JsonClauseSelectivity(PlannerInfo *root, RelOptInfo *baserel, Oid foreignTableId)
+{
+	Selectivity selectivity = 1.0;
+	List *otherClauses = NIL;
+	ListCell *clauseCell = NULL;
+
+	foreach(clauseCell, baserel->baserestrictinfo)
+	{
+		RestrictInfo *restrictInfo = (RestrictInfo *) lfirst(clauseCell);
+		Node *clause = (Node *) restrictInfo->clause;
+		Var *column = NULL;
+		double frac = -1.0;
+
+		if (IsA(clause, NullTest) && !((NullTest *) clause)->argisrow && IsA(((NullTest *) clause)->arg, Var))
+		{
+			column = (Var *) ((NullTest *) clause)->arg;
+		}
+		else if (IsA(clause, OpExpr) && op_strict(((OpExpr *) clause)->opno))
+		{
+			List *columnList = pull_var_clause(clause, PVC_RECURSE_AGGREGATES, PVC_RECURSE_PLACEHOLDERS);
+
+			if (list_length(columnList) == 1)
+				column = (Var *) linitial(columnList);
+		}
+
+		if (column != NULL && column->varno == baserel->relid && column->varlevelsup == 0 && column->varattno > 0
+			&& !SearchSysCacheExists3(STATRELATTINH, ObjectIdGetDatum(foreignTableId), Int16GetDatum(column->varattno), BoolGetDatum(false)))
+		{
+			frac = JsonKeyStatsFrac(foreignTableId, JsonAttributeNameGet(column->varno, column->varattno, root), column->vartype);
+		}
+
+		if (frac < 0)
+			otherClauses = lappend(otherClauses, restrictInfo);
+		else if (IsA(clause, NullTest))
+			selectivity *= (((NullTest *) clause)->nulltesttype == IS_NULL ? 1.0 - frac : frac);
+		else
+			selectivity *= frac * clause_selectivity(root, clause, 0, JOIN_INNER, NULL);
+	}
+
+	return selectivity * clauselist_selectivity(root, otherClauses, 0, JOIN_INNER, NULL);
+}
+
+/*
+ * JsonStatsScale is the share of the sources that Analyze read, that a scan
+ * reads, as some may have been pruned, or added since.
+ */
+static double JsonStatsScale(List *sources, JsonFdwStats *stats)
+{
+	return (sources != NIL && stats->sources > 0 ? (double) list_length(sources) / (double) stats->sources : 1.0);
+}
+
+// *** All the stuff below here, was broken by Neal Horman ;)
+static char *JsonAttributeNameGet(int varno, int varattno, PlannerInfo *root)
+{
+	RangeTblEntry *rte = planner_rt_fetch(varno, root);
+	List *options = GetForeignColumnOptions(rte->relid, varattno);
+	char *colname = NULL;
+	ListCell *lc;
+
+	foreach(lc, options)
+	{
+		DefElem *def = (DefElem *) lfirst(lc);
+
+		if (strcmp(def->defname, "column_name") == 0)
+		{
+			colname = defGetString(def);
+			break;
+		}
+	}
+
+	if(colname == NULL)
+		colname = get_relid_attribute_name(rte->relid, varattno);
+
+	return colname;
+}
+
+/*
+ * Indexes of the items in the fdw_private list that JsonPlanForeignModify
+ * passes on to JsonBeginForeignModify.
+ */
+enum FdwModifyPrivateIndex
+{
+	FdwModifyPrivateTargetNames,	// list of attribute names
+	FdwModifyPrivateTargetAttrs,	// integer list of attribute numbers
+	FdwModifyPrivateUrl,		// remote url of the operation
+	FdwModifyPrivateBatchSize,	// Integer rows per request
+	FdwModifyPrivateBatchBytes,	// Integer request body size cap
+	FdwModifyPrivateBatchFormat,	// Integer RCI_BATCH_FORMAT_xxx
+	FdwModifyPrivateWriteWindow,	// Integer number of requests in flight
+	FdwModifyPrivateContentEncoding,	// request body content encoding, or NULL
+};
+
+/*
+ * Indexes of the items in the fdw_private list that JsonPlanDirectModify
+ * leaves in the ForeignScan, for JsonBeginDirectModify.
+ */
+enum FdwDirectModifyPrivateIndex
+{
+	FdwDirectModifyPrivateUrl,	// filter url of the operation
+	FdwDirectModifyPrivateBody,	// request body, empty for a delete
+	FdwDirectModifyPrivateContentEncoding,	// request body content encoding, or NULL
+	FdwDirectModifyPrivateCountHeader,	// response header with the number of rows changed
+};
+
+static void JsonColumnEmitterInit(jce_t *pJce, int attnum, Oid type, const char *name, FmgrInfo *pOutputFn);
+static void JsonModifyRowBuild(jfmes_t *pJfmes, TupleTableSlot *slot, StringInfo str);
+
+// Append a url named parameter, with the value percent encoded
+static void JsonUrlParamAppend(StringInfo url, const char *name, const char *value)
+{	static const char hex[] = "0123456789ABCDEF";
+	const unsigned char *p;
+
+	appendStringInfoChar(url, (strchr(url->data, '?') != NULL ? '&' : '?'));
+	appendStringInfoString(url, name);
+	appendStringInfoChar(url, '=');
+
+	for(p = (const unsigned char *)value; *p; p++)
+	{
+		if((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9')
+			|| *p == '-' || *p == '_' || *p == '.' || *p == '~')
+			appendStringInfoChar(url, *p);
+		else
+		{
+			appendStringInfoChar(url, '%');
+			appendStringInfoChar(url, hex[*p >> 4]);
+			appendStringInfoChar(url, hex[*p & 0x0f]);
+		}
+	}
+}
+
+static Node *JsonStripRelabel(Node *node)
+{
+	while(node != NULL && IsA(node, RelabelType))
+		node = (Node *) ((RelabelType *) node)->arg;
+
+	return node;
+}
+
+// Translate a "column = any(constant array)", ie. "column in (constants)",
+// where clause into a url parameter of the ROM action filter, if the filter
+// maps the column with the "in" operator, as a comma separated list of values
+static bool JsonQualInToUrlParam(PlannerInfo *root, Index relid, rci_t *pRci, ScalarArrayOpExpr *saop, StringInfo url)
+{	Node *left = NULL;
+	Node *right = NULL;
+	Var *var = NULL;
+	Const *constant = NULL;
+	char *opname = NULL;
+	char const *pParam = NULL;
+	ArrayType *array = NULL;
+	Oid elemType = InvalidOid;
+	int16 elemLength = 0;
+	bool elemByVal = false;
+	char elemAlign = 0;
+	Datum *elems = NULL;
+	bool *nulls = NULL;
+	int elemCount = 0;
+	int i;
+	Oid typefnoid = InvalidOid;
+	bool isvarlena = false;
+	StringInfoData values;
+
+	if(!saop->useOr || list_length(saop->args) != 2)
+		return false;
+
+	left = JsonStripRelabel((Node *) linitial(saop->args));
+	right = JsonStripRelabel((Node *) lsecond(saop->args));
+	if(!IsA(left, Var) || !IsA(right, Const))
+		return false;
+
+	var = (Var *) left;
+	constant = (Const *) right;
+	if(var->varno != relid || var->varlevelsup != 0 || var->varattno <= 0 || constant->constisnull)
+		return false;
+
+	opname = get_opname(saop->opno);
+	if(opname == NULL || strcmp(opname, "=") != 0)
+		return false;
+
+	pParam = rciFilterParam(pRci, JsonAttributeNameGet(relid, var->varattno, root), "in");
+	if(pParam == NULL || !*pParam)
+		return false;
+
+	array = DatumGetArrayTypeP(constant->constvalue);
+	elemType = ARR_ELEMTYPE(array);
+	get_typlenbyvalalign(elemType, &elemLength, &elemByVal, &elemAlign);
+	deconstruct_array(array, elemType, elemLength, elemByVal, elemAlign, &elems, &nulls, &elemCount);
+	getTypeOutputInfo(elemType, &typefnoid, &isvarlena);
+
+	// a null matches no row, so it is left out
+	initStringInfo(&values);
+	for(i=0; i<elemCount; i++)
+	{
+		if(!nulls[i])
+			appendStringInfo(&values, "%s%s", (values.len > 0 ? "," : ""), OidOutputFunctionCall(typefnoid, elems[i]));
+	}
+
+	if(values.len == 0)
+		return false;
+
+	JsonUrlParamAppend(url, pParam, values.data);
+
+	return true;
+}
+
+// Translate a "column operator constant" where clause into a url
+// parameter of the ROM action filter, if the filter maps it
+static bool JsonQualToUrlParam(PlannerInfo *root, Index relid, rci_t *pRci, Expr *qual, StringInfo url)
+{	OpExpr *op = (OpExpr *) qual;
+	Node *left = NULL;
+	Node *right = NULL;
+	Var *var = NULL;
+	Const *constant = NULL;
+	Oid opno = InvalidOid;
+	char *opname = NULL;
+	char const *pParam = NULL;
+	Oid typefnoid = InvalidOid;
+	bool isvarlena = false;
+
+	if(IsA(qual, ScalarArrayOpExpr))
+		return JsonQualInToUrlParam(root, relid, pRci, (ScalarArrayOpExpr *) qual, url);
+
+	if(!IsA(qual, OpExpr) || list_length(op->args) != 2)
+		return false;
+
+	left = JsonStripRelabel((Node *) linitial(op->args));
+	right = JsonStripRelabel((Node *) lsecond(op->args));
+
+	if(IsA(left, Var) && IsA(right, Const))
+	{
+		var = (Var *) left;
+		constant = (Const *) right;
+		opno = op->opno;
+	}
+	else if(IsA(left, Const) && IsA(right, Var))
+	{
+		// "constant < column" is "column > constant"
+		var = (Var *) right;
+		constant = (Const *) left;
+		opno = get_commutator(op->opno);
+	}
+	else
+		return false;
+
+	if(var->varno != relid || var->varlevelsup != 0 || var->varattno <= 0 || constant->constisnull || opno == InvalidOid)
+		return false;
+
+	opname = get_opname(opno);
+	if(opname == NULL)
+		return false;
+
+	pParam = rciFilterParam(pRci, JsonAttributeNameGet(relid, var->varattno, root), opname);
+	if(pParam == NULL || !*pParam)
+		return false;
+
+	getTypeOutputInfo(constant->consttype, &typefnoid, &isvarlena);
+	JsonUrlParamAppend(url, pParam, OidOutputFunctionCall(typefnoid, constant->constvalue));
+
+	return true;
+}
+
+// Find a "column operator expression" where clause, whose expression is not a
+// constant, and doesn't read this table, ie. a column of another table that
+// is the outer side of a nested loop, or a query parameter, and whose column
+// and operator the ROM action filter maps to a url parameter. The expression
+// is evaluated when the scan begins, see JsonParamUrl.
+static bool JsonQualToParamExpr(PlannerInfo *root, Index relid, rci_t *pRci, Expr *qual, char const **ppParam, Expr **ppExpr)
+{	OpExpr *op = (OpExpr *) qual;
+	Node *left = NULL;
+	Node *right = NULL;
+	Var *var = NULL;
+	Expr *expr = NULL;
+	Oid opno = InvalidOid;
+	char *opname = NULL;
+	char const *pParam = NULL;
+
+	if(!IsA(qual, OpExpr) || list_length(op->args) != 2)
+		return false;
+
+	left = JsonStripRelabel((Node *) linitial(op->args));
+	right = JsonStripRelabel((Node *) lsecond(op->args));
+
+	if(IsA(left, Var) && ((Var *) left)->varno == relid)
+	{
+		var = (Var *) left;
+		expr = (Expr *) lsecond(op->args);
+		opno = op->opno;
+	}
+	else if(IsA(right, Var) && ((Var *) right)->varno == relid)
+	{
+		var = (Var *) right;
+		expr = (Expr *) linitial(op->args);
+		opno = get_commutator(op->opno);
+	}
+	else
+		return false;
+
+	if(var->varlevelsup != 0 || var->varattno <= 0 || opno == InvalidOid
+		|| IsA(JsonStripRelabel((Node *) expr), Const)
+		|| bms_is_member(relid, pull_varnos((Node *) expr))
+		|| contain_volatile_functions((Node *) expr)
+		|| contain_subplans((Node *) expr)
+		)
+		return false;
+
+	opname = get_opname(opno);
+	if(opname == NULL)
+		return false;
+
+	pParam = rciFilterParam(pRci, JsonAttributeNameGet(relid, var->varattno, root), opname);
+	if(pParam == NULL || !*pParam)
+		return false;
+
+	*ppParam = pParam;
+	*ppExpr = expr;
+
+	return true;
+}
+
+typedef struct _jecm_t
+{
+	rci_t *pRci;
+	Index relid;
+} jecm_t; // JsonEquivalenceClassMatch_Type
+
+// An equivalence class member that is a column of this table,
+// that the ROM action filter maps with the "=" operator
+static bool JsonEcMemberMatch(PlannerInfo *root, RelOptInfo *rel, EquivalenceClass *ec, EquivalenceMember *em, void *arg)
+{	jecm_t *pJecm = (jecm_t *) arg;
+	Var *var = (Var *) JsonStripRelabel((Node *) em->em_expr);
+	char const *pParam = NULL;
+
+	if(var == NULL || !IsA(var, Var) || var->varno != pJecm->relid || var->varlevelsup != 0 || var->varattno <= 0)
+		return false;
+
+	pParam = rciFilterParam(pJecm->pRci, JsonAttributeNameGet(pJecm->relid, var->varattno, root), "=");
+
+	return (pParam != NULL && *pParam);
+}
+
+/*
+ * A ROM table, whose select action "filter" maps a column, that is joined to
+ * a column of another table, can be the inner side of a nested loop, that
+ * fetches only the rows of each outer row, with the value of the outer row
+ * as a url parameter. This is much cheaper than fetching all of the rows of a
+ * large remote table, when there are few outer rows, so a parameterized path
+ * is added for each set of outer tables of the join clauses that are mapped.
+ * The remote request of each outer row is costed as JSON_REQUEST_COST.
+ */
+static void JsonParamPathsAdd(PlannerInfo *root, RelOptInfo *baserel, JsonFdwOptions *options, double cpuCostPerTuple, double pagesPerTuple)
+{	rci_t *pRci = NULL;
+	List *clauses = NIL;
+	List *ppiList = NIL;
+	ListCell *lc = NULL;
+
+	if(options->pRomUrl == NULL || !*options->pRomUrl || options->pRomPath == NULL || !*options->pRomPath)
+		return;
+
+	pRci = rciFetch(options->pRomUrl, options->pRomPath, RCI_ACTION_SELECT);
+	if(rciError(pRci, options->pRomUrl, options->pRomPath)
+		|| !rciMethod(pRci, "get", options->pRomUrl, options->pRomPath)
+		|| pRci->pFilterUrl == NULL
+		)
+	{
+		rciFree(pRci);
+		return;
+	}
+
+	// the join clauses, that could be moved into this scan
+	foreach(lc, baserel->joininfo)
+	{	RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+		char const *pParam = NULL;
+		Expr *expr = NULL;
+
+#if PG_VERSION_NUM >= 90500
+		if(!join_clause_is_movable_to(rinfo, baserel))
+#else
+		if(!join_clause_is_movable_to(rinfo, baserel->relid))
+#endif
+			continue;
+
+		if(JsonQualToParamExpr(root, baserel->relid, pRci, rinfo->clause, &pParam, &expr))
+			clauses = lappend(clauses, rinfo);
+	}
+
+	// and the equalities of the equivalence classes, ie. of "a.x = b.x", that aren't in joininfo
+	if(baserel->has_eclass_joins)
+	{	jecm_t jecm;
+
+		jecm.pRci = pRci;
+		jecm.relid = baserel->relid;
+		foreach(lc, generate_implied_equalities_for_column(root, baserel, JsonEcMemberMatch, (void *) &jecm, baserel->lateral_referencers))
+		{	RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+			char const *pParam = NULL;
+			Expr *expr = NULL;
+
+			if(JsonQualToParamExpr(root, baserel->relid, pRci, rinfo->clause, &pParam, &expr))
+				clauses = lappend(clauses, rinfo);
+		}
+	}
+	rciFree(pRci);
+
+	// the parameterizations, ie. the sets of outer tables, of the clauses
+	foreach(lc, clauses)
+	{	RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+		Relids requiredOuter = bms_union(rinfo->clause_relids, baserel->lateral_relids);
+
+		requiredOuter = bms_del_member(requiredOuter, baserel->relid);
+		if(!bms_is_empty(requiredOuter))
+			ppiList = list_append_unique_ptr(ppiList, get_baserel_parampathinfo(root, baserel, requiredOuter));
+	}
+
+	foreach(lc, ppiList)
+	{	ParamPathInfo *ppi = (ParamPathInfo *) lfirst(lc);
+		double rows = ppi->ppi_rows;
+		double startupCost = baserel->baserestrictcost.startup + JSON_REQUEST_COST;
+		double totalCost = startupCost + (seq_page_cost * pagesPerTuple * rows) + (cpuCostPerTuple * rows);
+
+		add_path(baserel, (Path *) create_foreignscan_path(root, baserel, rows,
+								   startupCost, totalCost,
+								   NIL,  // no known ordering
+								   ppi->ppi_req_outer,
+								   NIL)); // no fdw_private
+	}
+}
+
+#if PG_VERSION_NUM >= 90600
+// The type of the sum of a column of typeId, that the scan computes, or InvalidOid
+static Oid JsonAggSumType(Oid typeId)
+{
+	switch (typeId)
+	{
+		case INT2OID:
+		case INT4OID:
+			return INT8OID;
+		case INT8OID:
+		case NUMERICOID:
+			return NUMERICOID;
+		case FLOAT4OID:
+		case FLOAT8OID:
+			return typeId;
+		default:
+			return InvalidOid;
+	}
+}
+
+/*
+ * JsonAggColumnsPlan returns the output columns of a scan of baserel that
+ * aggregates its rows, for the expressions of the grouped target, as the int
+ * lists of their kind, the attnum of the column they read, and their
+ * collation. Returns NIL if any of them isn't a group by column, or count,
+ * min, max, or sum of a column, with no distinct, order by, or filter.
+ */
+static List *JsonAggColumnsPlan(PlannerInfo *root, RelOptInfo *baserel, List *exprs)
+{
+	Query *parse = root->parse;
+	List *aggColumns = NIL;
+	ListCell *lc = NULL;
+
+	foreach(lc, exprs)
+	{
+		Node *expr = (Node *) lfirst(lc);
+		Var *column = NULL;
+		Oid collation = InvalidOid;
+		int kind = -1;
+
+		if (IsA(expr, Var))
+		{
+			TypeCacheEntry *typentry = NULL;
+			ListCell *groupCell = NULL;
+
+			// grouped by the equality of its type, that can be hashed
+			column = (Var *) expr;
+			collation = column->varcollid;
+			typentry = lookup_type_cache(column->vartype, TYPECACHE_EQ_OPR | TYPECACHE_HASH_PROC);
+			foreach(groupCell, parse->groupClause)
+			{
+				SortGroupClause *groupClause = (SortGroupClause *) lfirst(groupCell);
+
+				if (equal(get_sortgroupclause_expr(groupClause, parse->targetList), expr)
+					&& groupClause->eqop == typentry->eq_opr && OidIsValid(typentry->hash_proc))
+				{
+					kind = JSON_AGG_GROUP;
+				}
+			}
+		}
+		else if (IsA(expr, Aggref))
+		{
+			Aggref *aggref = (Aggref *) expr;
+			char *pName = get_func_name(aggref->aggfnoid);
+
+			if (pName == NULL || get_func_namespace(aggref->aggfnoid) != PG_CATALOG_NAMESPACE
+				|| aggref->aggdistinct != NIL || aggref->aggorder != NIL || aggref->aggfilter != NULL
+				|| aggref->aggkind != AGGKIND_NORMAL || aggref->aggsplit != AGGSPLIT_SIMPLE
+				|| aggref->agglevelsup != 0)
+			{
+				return NIL;
+			}
+
+			collation = aggref->inputcollid;
+			if (aggref->aggstar)
+			{
+				kind = (strcmp(pName, "count") == 0 ? JSON_AGG_COUNT_STAR : -1);
+			}
+			else if (list_length(aggref->args) == 1 && IsA(((TargetEntry *) linitial(aggref->args))->expr, Var))
+			{
+				column = (Var *) ((TargetEntry *) linitial(aggref->args))->expr;
+
+				if (strcmp(pName, "count") == 0)
+					kind = JSON_AGG_COUNT;
+				else if ((strcmp(pName, "min") == 0 || strcmp(pName, "max") == 0)
+					&& aggref->aggtype == column->vartype
+					&& OidIsValid(lookup_type_cache(column->vartype, TYPECACHE_CMP_PROC)->cmp_proc))
+					kind = (strcmp(pName, "min") == 0 ? JSON_AGG_MIN : JSON_AGG_MAX);
+				else if (strcmp(pName, "sum") == 0 && OidIsValid(JsonAggSumType(column->vartype))
+					&& aggref->aggtype == JsonAggSumType(column->vartype))
+					kind = JSON_AGG_SUM;
+			}
+		}
+
+		if (kind < 0 || (column != NULL
+			&& (column->varno != baserel->relid || column->varlevelsup != 0 || column->varattno <= 0)))
+		{
+			return NIL;
+		}
+
+		aggColumns = lappend(aggColumns, list_make3_int(kind, (column != NULL ? column->varattno : 0), collation));
+	}
+
+	return aggColumns;
+}
+
+/*
+ * JsonGetForeignUpperPaths adds a path that computes the aggregates of a
+ * query of just this table, ie. count, min, max, and sum of its columns,
+ * with or without group by, as the rows are read, so they aren't returned
+ * to an Agg node. Not if there are where clauses, as they would need to be
+ * checked first, nor with grouping sets, or having.
+ */
+static void JsonGetForeignUpperPaths(PlannerInfo *root, UpperRelationKind stage, RelOptInfo *input_rel, RelOptInfo *output_rel)
+{
+	Query *parse = root->parse;
+	PathTarget *target = root->upper_targets[UPPERREL_GROUP_AGG];
+	List *groupExprs = NIL;
+	double rows = 1.0;
+	Cost startupCost = 0.0;
+	Cost totalCost = 0.0;
+
+	if (stage != UPPERREL_GROUP_AGG || input_rel->reloptkind != RELOPT_BASEREL
+		|| input_rel->baserestrictinfo != NIL || planner_rt_fetch(input_rel->relid, root)->inh
+		|| input_rel->cheapest_total_path == NULL || target == NULL
+		|| parse->groupingSets != NIL || parse->havingQual != NULL
+		|| JsonAggColumnsPlan(root, input_rel, target->exprs) == NIL)
+	{
+		return;
+	}
+
+	groupExprs = get_sortgrouplist_exprs(parse->groupClause, parse->targetList);
+	if (groupExprs != NIL)
+	{
+		rows = estimate_num_groups(root, groupExprs, input_rel->rows, NULL);
+	}
+
+	// the rows are read as by the scan, and the cost of the aggregates is
+	// less than that of an Agg node, as the rows aren't returned to it
+	startupCost = input_rel->cheapest_total_path->total_cost;
+	totalCost = startupCost + cpu_tuple_cost * rows;
+
+	add_path(output_rel, (Path *) create_foreignscan_path(root, output_rel, target, rows,
+								   startupCost, totalCost,
+								   NIL,  // no known ordering
+								   NULL, // not parameterized
+								   NULL, // no outer path
+								   list_make1(makeInteger(input_rel->relid))));
+}
+
+/*
+ * JsonGetForeignAggPlan creates the plan of a path of JsonGetForeignUpperPaths.
+ * It is a scan of the table, of the columns that the aggregates read, whose
+ * output is the group by columns, and aggregates, of the target list.
+ */
+static ForeignScan *JsonGetForeignAggPlan(PlannerInfo *root, ForeignPath *bestPath, List *targetList)
+{
+	Index relid = intVal(linitial(bestPath->fdw_private));
+	RelOptInfo *baserel = find_base_rel(root, relid);
+	JsonFdwOptions *options = JsonGetOptions(planner_rt_fetch(relid, root)->relid);
+	List *foreignPrivateList = NIL;
+	List *sourcesPrivate = NIL;
+	List *exprs = NIL;
+	ListCell *lc = NULL;
+
+	foreach(lc, targetList)
+	{
+		exprs = lappend(exprs, ((TargetEntry *) lfirst(lc))->expr);
+	}
+
+	if (!(options->pRomUrl != NULL && *options->pRomUrl
+		&& options->pRomPath != NULL && *options->pRomPath))
+	{
+		sourcesPrivate = list_make2(makeInteger(relid), NIL);
+	}
+
+	foreignPrivateList = list_make4(ColumnList(baserel), NULL, sourcesPrivate, NIL);
+	foreignPrivateList = lappend(foreignPrivateList, makeInteger(false));
+	foreignPrivateList = lappend(foreignPrivateList, JsonAggColumnsPlan(root, baserel, exprs));
+
+	// a scan of the table, whose tuples are those of the target list
+	return make_foreignscan(targetList, NIL, relid
+		, NIL // no fdw_exprs
+		, foreignPrivateList
+		, (List *) copyObject(targetList) // fdw_scan_tlist
+		, NIL // no fdw_recheck_quals
+		, NULL // no outer plan
+		);
+}
+#endif
+
+// JsonAggInit begins the aggregates of a scan, of the output columns of aggColumns
+static jas_t *JsonAggInit(ForeignScanState *scanState, List *aggColumns)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(scanState->ss.ss_currentRelation);
+	jas_t *pJas = (jas_t *) palloc0(sizeof(jas_t));
+	ListCell *lc = NULL;
+	HASHCTL hashInfo;
+	int i = 0;
+
+	pJas->columnCount = list_length(aggColumns);
+	pJas->pColumns = (JsonAggColumn *) palloc0(sizeof(JsonAggColumn) * pJas->columnCount);
+	foreach(lc, aggColumns)
+	{
+		List *aggColumn = (List *) lfirst(lc);
+		JsonAggColumn *pColumn = &pJas->pColumns[i++];
+		int attnum = lsecond_int(aggColumn);
+
+		pColumn->kind = linitial_int(aggColumn);
+		pColumn->columnIndex = attnum - 1;
+		pColumn->collation = (Oid) lthird_int(aggColumn);
+		if (attnum > 0)
+		{
+			TypeCacheEntry *typentry = NULL;
+
+			pColumn->typeId = tupleDescriptor->attrs[attnum - 1]->atttypid;
+			pColumn->typLen = tupleDescriptor->attrs[attnum - 1]->attlen;
+			pColumn->typByVal = tupleDescriptor->attrs[attnum - 1]->attbyval;
+			if (pColumn->kind == JSON_AGG_GROUP)
+			{
+				typentry = lookup_type_cache(pColumn->typeId, TYPECACHE_EQ_OPR_FINFO | TYPECACHE_HASH_PROC_FINFO);
+				fmgr_info_copy(&pColumn->eq, &typentry->eq_opr_finfo, CurrentMemoryContext);
+				fmgr_info_copy(&pColumn->hash, &typentry->hash_proc_finfo, CurrentMemoryContext);
+			}
+			else if (pColumn->kind == JSON_AGG_MIN || pColumn->kind == JSON_AGG_MAX)
+			{
+				typentry = lookup_type_cache(pColumn->typeId, TYPECACHE_CMP_PROC_FINFO);
+				fmgr_info_copy(&pColumn->cmp, &typentry->cmp_proc_finfo, CurrentMemoryContext);
+			}
+		}
+	}
+
+	memset(&hashInfo, 0, sizeof(hashInfo));
+	hashInfo.keysize = sizeof(uint32);
+	hashInfo.entrysize = sizeof(JsonAggGroupList);
+	hashInfo.hash = tag_hash;
+	hashInfo.hcxt = CurrentMemoryContext;
+	pJas->pGroupHash = hash_create("Json Aggregate Groups", 256, &hashInfo,
+					(HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT));
+
+	pJas->pRowSlot = MakeSingleTupleTableSlot(tupleDescriptor);
+	pJas->groupContext = AllocSetContextCreate(CurrentMemoryContext,
+					 "json_fdw aggregate context",
+					 ALLOCSET_DEFAULT_MINSIZE,
+					 ALLOCSET_DEFAULT_INITSIZE,
+					 ALLOCSET_DEFAULT_MAXSIZE);
+	pJas->rowContext = AllocSetContextCreate(CurrentMemoryContext,
+					 "json_fdw aggregate row context",
+					 ALLOCSET_DEFAULT_MINSIZE,
+					 ALLOCSET_DEFAULT_INITSIZE,
+					 ALLOCSET_DEFAULT_MAXSIZE);
+
+	return pJas;
+}
+
+// A new group, of the group by values of a row, or of none
+static JsonAggGroup *JsonAggGroupNew(jas_t *pJas, uint32 hash, Datum *values, bool *nulls)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(pJas->groupContext);
+	JsonAggGroup *pGroup = (JsonAggGroup *) palloc0(sizeof(JsonAggGroup));
+	int i;
+
+	pGroup->hash = hash;
+	pGroup->pValues = (Datum *) palloc0(sizeof(Datum) * pJas->columnCount);
+	pGroup->pNulls = (bool *) palloc(sizeof(bool) * pJas->columnCount);
+	pGroup->pCounts = (int64 *) palloc0(sizeof(int64) * pJas->columnCount);
+	pGroup->pSums = (double *) palloc0(sizeof(double) * pJas->columnCount);
+	for (i = 0; i < pJas->columnCount; i++)
+	{
+		JsonAggColumn *pColumn = &pJas->pColumns[i];
+
+		pGroup->pNulls[i] = true;
+		if (pColumn->kind == JSON_AGG_GROUP && values != NULL && !nulls[pColumn->columnIndex])
+		{
+			pGroup->pValues[i] = datumCopy(values[pColumn->columnIndex], pColumn->typByVal, pColumn->typLen);
+			pGroup->pNulls[i] = false;
+		}
+	}
+	pJas->pGroups = lappend(pJas->pGroups, pGroup);
+	MemoryContextSwitchTo(oldContext);
+
+	return pGroup;
+}
+
+// The group of the group by values of a row, which is added if it is new
+static JsonAggGroup *JsonAggGroupFind(jas_t *pJas, Datum *values, bool *nulls)
+{
+	JsonAggGroupList *pList = NULL;
+	JsonAggGroup *pGroup = NULL;
+	ListCell *lc = NULL;
+	bool found = false;
+	uint32 hash = 0;
+	int i;
+
+	for (i = 0; i < pJas->columnCount; i++)
+	{
+		JsonAggColumn *pColumn = &pJas->pColumns[i];
+
+		if (pColumn->kind == JSON_AGG_GROUP)
+		{
+			hash = (hash << 1) | (hash >> 31);
+			if (!nulls[pColumn->columnIndex])
+				hash ^= DatumGetUInt32(FunctionCall1Coll(&pColumn->hash, pColumn->collation, values[pColumn->columnIndex]));
+		}
+	}
+
+	pList = (JsonAggGroupList *) hash_search(pJas->pGroupHash, &hash, HASH_ENTER, &found);
+	if (!found)
+	{
+		pList->pGroups = NIL;
+	}
+
+	foreach(lc, pList->pGroups)
+	{
+		bool bEqual = true;
+
+		pGroup = (JsonAggGroup *) lfirst(lc);
+		for (i = 0; bEqual && i < pJas->columnCount; i++)
+		{
+			JsonAggColumn *pColumn = &pJas->pColumns[i];
+
+			if (pColumn->kind != JSON_AGG_GROUP)
+				continue;
+			if (pGroup->pNulls[i] || nulls[pColumn->columnIndex])
+				bEqual = (pGroup->pNulls[i] && nulls[pColumn->columnIndex]);
+			else
+				bEqual = DatumGetBool(FunctionCall2Coll(&pColumn->eq, pColumn->collation,
+					pGroup->pValues[i], values[pColumn->columnIndex]));
 		}
-		case FLOAT4OID:
+		if (bEqual)
 		{
-			const char *value = YAJL_GET_NUMBER(jsonValue);
-			columnValue = DirectFunctionCall1(float4in, CStringGetDatum(value));
-			break;
+			return pGroup;
 		}
-		case FLOAT8OID:
+	}
+
+	pGroup = JsonAggGroupNew(pJas, hash, values, nulls);
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(pJas->groupContext);
+
+		pList->pGroups = lappend(pList->pGroups, pGroup);
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	return pGroup;
+}
+
+// Adds the values of a row to the aggregates of its group
+static void JsonAggRow(jas_t *pJas, TupleTableSlot *rowSlot)
+{
+	Datum *values = NULL;
+	bool *nulls = NULL;
+	JsonAggGroup *pGroup = NULL;
+	MemoryContext oldContext = NULL;
+	int i;
+
+	// the rows read from the shared cache are stored as tuples
+	slot_getallattrs(rowSlot);
+	values = rowSlot->tts_values;
+	nulls = rowSlot->tts_isnull;
+
+	pGroup = JsonAggGroupFind(pJas, values, nulls);
+	oldContext = MemoryContextSwitchTo(pJas->groupContext);
+	for (i = 0; i < pJas->columnCount; i++)
+	{
+		JsonAggColumn *pColumn = &pJas->pColumns[i];
+		Datum value = (Datum) 0;
+
+		if (pColumn->kind == JSON_AGG_COUNT_STAR)
 		{
-			const char *value = YAJL_GET_NUMBER(jsonValue);
-			columnValue = DirectFunctionCall1(float8in, CStringGetDatum(value));
-			break;
+			pGroup->pCounts[i]++;
+			continue;
 		}
-		case NUMERICOID:
+		if (pColumn->kind == JSON_AGG_GROUP || nulls[pColumn->columnIndex])
 		{
-			const char *value = YAJL_GET_NUMBER(jsonValue);
-			columnValue = DirectFunctionCall3(numeric_in, CStringGetDatum(value),
-											  ObjectIdGetDatum(InvalidOid),
-											  Int32GetDatum(columnTypeMod));
-			break;
+			continue;
 		}
-		case BOOLOID:
+
+		value = values[pColumn->columnIndex];
+		switch (pColumn->kind)
 		{
-			bool value = YAJL_IS_TRUE(jsonValue);
-			columnValue = BoolGetDatum(value);
+			case JSON_AGG_COUNT:
+				pGroup->pCounts[i]++;
+				break;
+
+			case JSON_AGG_MIN:
+			case JSON_AGG_MAX:
+			{
+				int32 compare = (pGroup->pNulls[i] ? 0
+					: DatumGetInt32(FunctionCall2Coll(&pColumn->cmp, pColumn->collation, value, pGroup->pValues[i])));
+
+				if (pGroup->pNulls[i] || (pColumn->kind == JSON_AGG_MIN ? compare < 0 : compare > 0))
+				{
+					if (!pGroup->pNulls[i] && !pColumn->typByVal)
+						pfree(DatumGetPointer(pGroup->pValues[i]));
+					pGroup->pValues[i] = datumCopy(value, pColumn->typByVal, pColumn->typLen);
+				}
+				break;
+			}
+
+			case JSON_AGG_SUM:
+				switch (pColumn->typeId)
+				{
+					case INT2OID:
+						pGroup->pCounts[i] += DatumGetInt16(value);
+						break;
+					case INT4OID:
+						pGroup->pCounts[i] += DatumGetInt32(value);
+						break;
+					case FLOAT4OID:
+						pGroup->pSums[i] = DatumGetFloat4(DirectFunctionCall2(float4pl, Float4GetDatum((float4) pGroup->pSums[i]), value));
+						break;
+					case FLOAT8OID:
+						pGroup->pSums[i] = DatumGetFloat8(DirectFunctionCall2(float8pl, Float8GetDatum(pGroup->pSums[i]), value));
+						break;
+					default:
+					{
+						// numeric, and int8 as numeric
+						Datum sum = (pColumn->typeId == INT8OID ? DirectFunctionCall1(int8_numeric, value) : value);
+
+						if (!pGroup->pNulls[i])
+						{
+							sum = DirectFunctionCall2(numeric_add, pGroup->pValues[i], sum);
+							pfree(DatumGetPointer(pGroup->pValues[i]));
+						}
+						pGroup->pValues[i] = (sum == value ? datumCopy(sum, false, -1) : sum);
+						break;
+					}
+				}
+				break;
+		}
+		pGroup->pNulls[i] = false;
+	}
+	MemoryContextSwitchTo(oldContext);
+}
+
+// Stores the group by values, and aggregates, of a group into tupleSlot
+static void JsonAggGroupStore(jas_t *pJas, JsonAggGroup *pGroup, TupleTableSlot *tupleSlot)
+{
+	int i;
+
+	for (i = 0; i < pJas->columnCount; i++)
+	{
+		JsonAggColumn *pColumn = &pJas->pColumns[i];
+		Datum value = pGroup->pValues[i];
+		bool isNull = pGroup->pNulls[i];
+
+		if (pColumn->kind == JSON_AGG_COUNT_STAR || pColumn->kind == JSON_AGG_COUNT)
+		{
+			value = Int64GetDatum(pGroup->pCounts[i]);
+			isNull = false;
+		}
+		else if (pColumn->kind == JSON_AGG_SUM && !isNull)
+		{
+			if (pColumn->typeId == INT2OID || pColumn->typeId == INT4OID)
+				value = Int64GetDatum(pGroup->pCounts[i]);
+			else if (pColumn->typeId == FLOAT4OID)
+				value = Float4GetDatum((float4) pGroup->pSums[i]);
+			else if (pColumn->typeId == FLOAT8OID)
+				value = Float8GetDatum(pGroup->pSums[i]);
+		}
+
+		tupleSlot->tts_values[i] = value;
+		tupleSlot->tts_isnull[i] = isNull;
+	}
+	ExecStoreVirtualTuple(tupleSlot);
+}
+
+/*
+ * JsonAggIterate reads every row of the table, on the first call, into the
+ * aggregates of its group, and then returns the groups, one per call.
+ */
+static TupleTableSlot *JsonAggIterate(ForeignScanState *scanState)
+{
+	JsonFdwExecState *execState = (JsonFdwExecState *) scanState->fdw_state;
+	jas_t *pJas = execState->pJas;
+	TupleTableSlot *tupleSlot = scanState->ss.ss_ScanTupleSlot;
+
+	ExecClearTuple(tupleSlot);
+
+	if (!pJas->bAggregated)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(pJas->rowContext);
+		bool grouped = false;
+		int i;
+
+		while (!TupIsNull(JsonIterateRow(scanState, pJas->pRowSlot)))
+		{
+			JsonAggRow(pJas, pJas->pRowSlot);
+			MemoryContextReset(pJas->rowContext);
+		}
+		MemoryContextSwitchTo(oldContext);
+
+		// with no group by, there is a row, even if the table has none
+		for (i = 0; i < pJas->columnCount; i++)
+		{
+			grouped |= (pJas->pColumns[i].kind == JSON_AGG_GROUP);
+		}
+		if (!grouped && pJas->pGroups == NIL)
+		{
+			JsonAggGroupNew(pJas, 0, NULL, NULL);
+		}
+
+		pJas->pNext = list_head(pJas->pGroups);
+		pJas->bAggregated = true;
+	}
+
+	if (pJas->pNext != NULL)
+	{
+		JsonAggGroupStore(pJas, (JsonAggGroup *) lfirst(pJas->pNext), tupleSlot);
+		pJas->pNext = lnext(pJas->pNext);
+	}
+
+	return tupleSlot;
+}
+
+static void JsonAggEnd(jas_t *pJas)
+{
+	ExecDropSingleTupleTableSlot(pJas->pRowSlot);
+	hash_destroy(pJas->pGroupHash);
+	MemoryContextDelete(pJas->rowContext);
+	MemoryContextDelete(pJas->groupContext);
+}
+
+#if PG_VERSION_NUM >= 90600
+/*
+ * If the ROM action has a "filter" with a "countHeader", that is "exact",
+ * and the update or delete is a scan of just this table, where every where
+ * clause is "column operator constant" that the filter maps to a url
+ * parameter, and an update only sets columns to constants, then the whole
+ * operation is done by one remote request, whose response has the number
+ * of rows it changed. Not if the table has row triggers, which would need
+ * the rows. A filter that isn't exact may match rows that the where clauses
+ * don't, which only the rows of a scan can be checked for.
+ *
+ * Returns the request body, and replaces url, or returns NULL if the
+ * operation can't be done this way.
+ */
+static char *JsonDirectModifyBody(PlannerInfo *root, ModifyTable *plan, Index resultRelation, int subplan_index,
+	Relation rel, rci_t *pRci, StringInfo url)
+{	Plan *subplan = NULL;
+	ForeignScan *foreignScan = NULL;
+	TriggerDesc *trigdesc = rel->trigdesc;
+	StringInfoData filterUrl;
+	StringInfoData body;
+	ListCell *lc = NULL;
+
+	if(pRci->pFilterUrl == NULL || pRci->pFilterCountHeader == NULL || !*pRci->pFilterCountHeader
+		|| !pRci->bFilterExact
+		|| (plan->operation != CMD_UPDATE && plan->operation != CMD_DELETE)
+		|| plan->returningLists != NIL
+		|| plan->withCheckOptionLists != NIL
+		)
+		return NULL;
+
+	if(trigdesc != NULL
+		&& (plan->operation == CMD_UPDATE
+			? (trigdesc->trig_update_before_row || trigdesc->trig_update_after_row)
+			: (trigdesc->trig_delete_before_row || trigdesc->trig_delete_after_row)
+			)
+		)
+		return NULL;
+
+	subplan = (Plan *) list_nth(plan->plans, subplan_index);
+	if(!IsA(subplan, ForeignScan))
+		return NULL;
+
+	foreignScan = (ForeignScan *) subplan;
+	if(foreignScan->scan.scanrelid != resultRelation || subplan->qual == NIL)
+		return NULL;
+
+	initStringInfo(&filterUrl);
+	appendStringInfoString(&filterUrl, pRci->pFilterUrl);
+	foreach(lc, subplan->qual)
+	{
+		if(!JsonQualToUrlParam(root, resultRelation, pRci, (Expr *) lfirst(lc), &filterUrl))
+			return NULL;
+	}
+
+	initStringInfo(&body);
+	if(plan->operation == CMD_UPDATE)
+	{	TupleDesc tupdesc = RelationGetDescr(rel);
+		bool first = true;
+
+		// the json object of the changed columns
+		appendStringInfoChar(&body, '{');
+		foreach(lc, subplan->targetlist)
+		{	TargetEntry *tle = (TargetEntry *) lfirst(lc);
+			Node *expr = JsonStripRelabel((Node *) tle->expr);
+			Form_pg_attribute attr = NULL;
+			Const *constant = NULL;
+			FmgrInfo outputFn;
+			Oid typefnoid = InvalidOid;
+			bool isvarlena = false;
+			jce_t jce;
+
+			if(tle->resjunk || tle->resno <= 0 || tle->resno > tupdesc->natts)
+				continue;
+
+			attr = tupdesc->attrs[tle->resno - 1];
+			if(attr->attisdropped)
+				continue;
+
+			// unchanged ?
+			if(IsA(expr, Var) && ((Var *) expr)->varno == resultRelation && ((Var *) expr)->varattno == tle->resno)
+				continue;
+
+			if(!IsA(expr, Const))
+				return NULL;
+
+			constant = (Const *) expr;
+			getTypeOutputInfo(attr->atttypid, &typefnoid, &isvarlena);
+			fmgr_info(typefnoid, &outputFn);
+			JsonColumnEmitterInit(&jce, tle->resno, attr->atttypid, JsonAttributeNameGet(resultRelation, tle->resno, root), &outputFn);
+
+			if(!first)
+				appendStringInfoChar(&body, ',');
+			first = false;
+
+			appendBinaryStringInfo(&body, jce.pKey, jce.keyLen);
+			if(constant->constisnull)
+				appendStringInfoString(&body, "null");
+			else
+				jce.emit(&body, &jce, constant->constvalue);
+		}
+		appendStringInfoChar(&body, '}');
+
+		// nothing changed
+		if(first)
+			return NULL;
+	}
+
+	resetStringInfo(url);
+	appendStringInfoString(url, filterUrl.data);
+
+	return body.data;
+}
+
+/*
+ * JsonPlanDirectModify makes the scan of an update or delete do the whole
+ * operation by one remote request, when JsonDirectModifyBody can build it.
+ * The core has already checked that the table has no row triggers, and no
+ * check options of views. Returns false if the operation is done row by row.
+ */
+static bool JsonPlanDirectModify(PlannerInfo *root, ModifyTable *plan, Index resultRelation, int subplan_index)
+{	RangeTblEntry *rte = planner_rt_fetch(resultRelation, root);
+	Relation rel = NULL;
+	JsonFdwOptions *options = JsonGetOptions(rte->relid);
+	rci_t *pRci = NULL;
+	ForeignScan *foreignScan = NULL;
+	StringInfoData strUrl;
+	char *pBody = NULL;
+	char const *pEncoding = NULL;
+	List *fdwPrivate = NIL;
+
+	if(options->pRomUrl == NULL || !*options->pRomUrl || options->pRomPath == NULL || !*options->pRomPath
+		|| (plan->operation != CMD_UPDATE && plan->operation != CMD_DELETE)
+		)
+		return false;
+
+	pRci = rciFetch(options->pRomUrl, options->pRomPath, (plan->operation == CMD_UPDATE ? RCI_ACTION_UPDATE : RCI_ACTION_DELETE));
+	if(rciError(pRci, options->pRomUrl, options->pRomPath)
+		|| !rciMethod(pRci, (plan->operation == CMD_DELETE ? "delete" : "put"), options->pRomUrl, options->pRomPath)
+		)
+	{
+		rciFree(pRci);
+		return false;
+	}
+
+	// an unsupported encoding is reported by JsonPlanForeignModify
+	pEncoding = (options->pContentEncoding != NULL ? options->pContentEncoding : pRci->pEncoding);
+	if(pEncoding != NULL && *pEncoding && !curlContentEncodingSupported(pEncoding))
+	{
+		rciFree(pRci);
+		return false;
+	}
+
+	initStringInfo(&strUrl);
+	rel = heap_open(rte->relid, NoLock);
+	pBody = JsonDirectModifyBody(root, plan, resultRelation, subplan_index, rel, pRci, &strUrl);
+	heap_close(rel, NoLock);
+
+	if(pBody != NULL)
+	{
+		// in FdwDirectModifyPrivateIndex order
+		fdwPrivate = list_make4(makeString(strUrl.data), makeString(pBody)
+			, (pEncoding != NULL && *pEncoding ? makeString(pstrdup(pEncoding)) : NULL)
+			, makeString(pstrdup(pRci->pFilterCountHeader))
+			);
+
+		foreignScan = (ForeignScan *) list_nth(plan->plans, subplan_index);
+		foreignScan->operation = plan->operation;
+		foreignScan->fdw_private = fdwPrivate;
+		foreignScan->fdw_exprs = NIL;
+	}
+	rciFree(pRci);
+
+	return (pBody != NULL);
+}
+
+static void JsonBeginDirectModify(ForeignScanState *node, int eflags)
+{	List *fdwPrivate = ((ForeignScan *) node->ss.ps.plan)->fdw_private;
+	Value *pContentEncoding = NULL;
+	jdmes_t *pJdmes = NULL;
+
+	// if Explain with no Analyze, do nothing
+	if(eflags & EXEC_FLAG_EXPLAIN_ONLY)
+		return;
+
+	pJdmes = (jdmes_t *) palloc0(sizeof(jdmes_t));
+	pJdmes->pUrl = strVal(list_nth(fdwPrivate, FdwDirectModifyPrivateUrl));
+	pJdmes->pMethod = (((ForeignScan *) node->ss.ps.plan)->operation == CMD_DELETE ? "DELETE" : NULL);
+	pJdmes->pBody = strVal(list_nth(fdwPrivate, FdwDirectModifyPrivateBody));
+	pContentEncoding = (Value *) list_nth(fdwPrivate, FdwDirectModifyPrivateContentEncoding);
+	pJdmes->pContentEncoding = (pContentEncoding != NULL ? strVal(pContentEncoding) : NULL);
+	pJdmes->pCountHeader = strVal(list_nth(fdwPrivate, FdwDirectModifyPrivateCountHeader));
+
+	node->fdw_state = pJdmes;
+}
+
+// Send the request, and count the rows that the server changed
+static TupleTableSlot *JsonIterateDirectModify(ForeignScanState *node)
+{	jdmes_t *pJdmes = (jdmes_t *) node->fdw_state;
+
+	if(!pJdmes->bDone)
+	{	char *pCount = NULL;
+		char *pEnd = NULL;
+		unsigned long httpResponseCode = curlPutHeader(pJdmes->pUrl, pJdmes->pMethod
+			, pJdmes->pBody, strlen(pJdmes->pBody), "application/json", pJdmes->pContentEncoding
+			, pJdmes->pCountHeader, &pCount);
+		long count = (pCount != NULL ? strtol(pCount, &pEnd, 10) : -1);
+
+		pJdmes->bDone = true;
+		if(pCount != NULL && (pEnd == pCount || *pEnd != '\0'))
+			count = -1;
+		free(pCount);
+
+		if(!CURL_HTTP_OK(httpResponseCode))
+		{
+			ereport(ERROR, (errmsg("remote server did not accept the direct modify"),
+				errhint("URL '%s' http response code %lu", pJdmes->pUrl, httpResponseCode)));
+		}
+
+		if(count < 0)
+		{
+			ereport(WARNING, (errmsg("remote server did not report the number of rows changed"),
+				errhint("URL '%s' response header \"%s\"", pJdmes->pUrl, pJdmes->pCountHeader)));
+		}
+		else
+			node->ss.ps.state->es_processed += count;
+	}
+
+	return ExecClearTuple(node->ss.ss_ScanTupleSlot);
+}
+
+static void JsonEndDirectModify(ForeignScanState *node)
+{
+	// nothing to release, the request is done by Iterate
+}
+
+static void JsonExplainDirectModify(ForeignScanState *node, ExplainState *explainState)
+{	List *fdwPrivate = ((ForeignScan *) node->ss.ps.plan)->fdw_private;
+
+	ExplainPropertyText("Direct Modify", "yes", explainState);
+	ExplainPropertyText("Rom Modify URL", strVal(list_nth(fdwPrivate, FdwDirectModifyPrivateUrl)), explainState);
+}
+#endif
+
+/*
+ * An insert operation consists of
+ *	PlanForeignModify
+ *	BeginForeignModify
+ *	ExecForeignInsert
+ *	EndForeignModify
+ */
+
+static List *JsonPlanForeignModify(PlannerInfo *root, ModifyTable *plan, Index resultRelation, int subplan_index)
+{
+	CmdType		operation = plan->operation;
+	RangeTblEntry	*rte = planner_rt_fetch(resultRelation, root);
+	Relation	rel = heap_open(rte->relid, NoLock);
+	JsonFdwOptions	*options = JsonGetOptions(RelationGetRelid(rel));
+	List		*targetAttrs = NULL;
+	List		*targetNames = NULL;
+	char const	*pRomUrl = options->pRomUrl;
+	char const	*pRomPath = options->pRomPath;
+	rci_t		*pRci = NULL;
+	List		*fdwPrivate = NIL;
+	StringInfoData	strUrl;
+	int		batchSize = 1;
+	int		batchBytes = DEFAULT_BATCH_BYTES;
+	int		batchFormat = RCI_BATCH_FORMAT_ARRAY;
+	int		writeWindow = 1;
+	char		*pContentEncoding = NULL;
+
+	initStringInfo(&strUrl);
+
+	// fetch the ROM
+	pRci = rciFetch(pRomUrl, pRomPath, 
+			(
+			operation == CMD_INSERT ? RCI_ACTION_INSERT :
+			operation == CMD_UPDATE ? RCI_ACTION_UPDATE :
+			operation == CMD_DELETE ? RCI_ACTION_DELETE :
+			RCI_ACTION_NONE
+			)
+		);
+
+	if(!rciError(pRci, pRomUrl, pRomPath)
+		&& rciMethod(pRci, (operation == CMD_DELETE ? "delete" : "put"), pRomUrl, pRomPath)
+		)
+	{
+		appendStringInfoString(&strUrl, pRci->pUrl);
+		//ELog(DEBUG1, "%s:%d url '%s'", __func__, __LINE__, strUrl.data);
+
+		// Inserts and deletes may be batched, the table options override the ROM action
+		if(operation == CMD_INSERT || operation == CMD_DELETE)
+		{
+			batchSize = (options->batchSize > 0 ? options->batchSize
+				: pRci->batchSize > 0 ? pRci->batchSize
+				: batchSize
+				);
+			batchBytes = (options->batchBytes > 0 ? options->batchBytes
+				: pRci->batchBytes > 0 ? pRci->batchBytes
+				: batchBytes
+				);
+			batchFormat = (options->pBatchFormat != NULL ? rciBatchFormat(options->pBatchFormat)
+				: pRci->batchFormat
+				);
+		}
+
+		writeWindow = (options->writeWindow > 0 ? options->writeWindow
+			: pRci->window > 0 ? pRci->window
+			: writeWindow
+			);
+
+		// compress the request bodies ?
+		{	char const *pEncoding = (options->pContentEncoding != NULL ? options->pContentEncoding : pRci->pEncoding);
+
+			if(pEncoding != NULL && *pEncoding)
+			{
+				if(!curlContentEncodingSupported(pEncoding))
+				{
+					rciFree(pRci);
+					heap_close(rel, NoLock);
+					ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_ATTRIBUTE_VALUE),
+						errmsg("unsupported content encoding \"%s\"", pEncoding),
+						errhint("Supported content encodings are gzip and deflate")));
+				}
+				pContentEncoding = pstrdup(pEncoding);
+			}
+		}
+	}
+	rciFree(pRci);
+
+	switch (operation)
+	{
+		case CMD_INSERT:
+		case CMD_UPDATE:
+			{
+				TupleDesc tupdesc = RelationGetDescr(rel);
+				int attnum;
+
+				// collect relation information
+				for (attnum = 1; attnum <= tupdesc->natts; attnum++)
+				{
+					Form_pg_attribute attr = tupdesc->attrs[attnum - 1];
+
+					if (!attr->attisdropped)
+					{
+						// collect the name of the attribute
+						char *colname = JsonAttributeNameGet(resultRelation, attnum, root);
+						targetNames = lappend(targetNames, colname);
+
+						// collect the index of the attribute
+						targetAttrs = lappend_int(targetAttrs, attnum);
+
+						//ELog(DEBUG1, "%s:%d %s", __func__, __LINE__, colname);
+					}
+				}
+			}
+			break;
+		case CMD_DELETE:
+			{
+				// the row key, as added by JsonAddForeignUpdateTargets
+				targetNames = lappend(targetNames, JsonAttributeNameGet(resultRelation, 1, root));
+				targetAttrs = lappend_int(targetAttrs, 1);
+			}
+			break;
+		default:
 			break;
-		}
-		case BPCHAROID:
+	}
+
+	heap_close(rel, NoLock);
+
+	// in FdwModifyPrivateIndex order
+	fdwPrivate = list_make3(targetNames, targetAttrs, strUrl.data);
+	fdwPrivate = lappend(fdwPrivate, makeInteger(batchSize));
+	fdwPrivate = lappend(fdwPrivate, makeInteger(batchBytes));
+	fdwPrivate = lappend(fdwPrivate, makeInteger(batchFormat));
+	fdwPrivate = lappend(fdwPrivate, makeInteger(writeWindow));
+	fdwPrivate = lappend(fdwPrivate, (pContentEncoding != NULL ? makeString(pContentEncoding) : NULL));
+
+	return fdwPrivate;
+}
+
+// A wait on requests in flight can be cancelled
+static void JsonCurlWait(void)
+{
+	CHECK_FOR_INTERRUPTS();
+}
+
+// Close the pooled connections, as the backend exits
+static void JsonCurlCleanup(int code, Datum arg)
+{
+	curlCleanup();
+}
+
+/*
+ * The cleanup is registered once curl is first used, rather than by _PG_init,
+ * as a backend forked by a postmaster that preloaded json_fdw doesn't inherit
+ * the exit callbacks that _PG_init registered there.
+ */
+static void JsonCurlInit(void)
+{
+	on_proc_exit(JsonCurlCleanup, (Datum) 0);
+}
+
+// Start pipelining the puts of a modify, which are freed by an abort of its transaction, or subtransaction
+static cpm_t *JsonPutMultiInit(int window)
+{	cpm_t *pCpm = curlPutMultiInit(window);
+
+	if(pCpm != NULL)
+	{	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+		JsonPutMulti *pJpm = (JsonPutMulti *) palloc(sizeof(JsonPutMulti));
+
+		pJpm->pCpm = pCpm;
+		pJpm->subid = GetCurrentSubTransactionId();
+		JsonPutMultiList = lappend(JsonPutMultiList, pJpm);
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	return pCpm;
+}
+
+static void JsonPutMultiFree(cpm_t *pCpm)
+{	ListCell *lc = NULL;
+
+	foreach(lc, JsonPutMultiList)
+	{	JsonPutMulti *pJpm = (JsonPutMulti *) lfirst(lc);
+
+		if(pJpm->pCpm == pCpm)
 		{
-			const char *value = YAJL_GET_STRING(jsonValue);
-			columnValue = DirectFunctionCall3(bpcharin, CStringGetDatum(value),
-											  ObjectIdGetDatum(InvalidOid),
-											  Int32GetDatum(columnTypeMod));
+			JsonPutMultiList = list_delete_ptr(JsonPutMultiList, pJpm);
+			pfree(pJpm);
 			break;
 		}
-		case VARCHAROID:
+	}
+
+	curlPutMultiFree(pCpm);
+}
+
+// A modify that ends with an error doesn't end its pipelined puts, so they end with the transaction
+static void JsonPutMultiXactCallback(XactEvent event, void *arg)
+{
+	if(event == XACT_EVENT_ABORT)
+	{
+		while(JsonPutMultiList != NIL)
+			JsonPutMultiFree(((JsonPutMulti *) linitial(JsonPutMultiList))->pCpm);
+	}
+}
+
+// or with the subtransaction, ie. a savepoint, or a PL/pgSQL exception block
+static void JsonPutMultiSubXactCallback(SubXactEvent event, SubTransactionId mySubid, SubTransactionId parentSubid, void *arg)
+{	ListCell *lc = NULL;
+	bool bFreed = true;
+
+	if(event == SUBXACT_EVENT_COMMIT_SUB)
+	{
+		foreach(lc, JsonPutMultiList)
+		{	JsonPutMulti *pJpm = (JsonPutMulti *) lfirst(lc);
+
+			if(pJpm->subid == mySubid)
+				pJpm->subid = parentSubid;
+		}
+	}
+	else if(event == SUBXACT_EVENT_ABORT_SUB)
+	{
+		while(bFreed)
 		{
-			const char *value = YAJL_GET_STRING(jsonValue);
-			columnValue = DirectFunctionCall3(varcharin, CStringGetDatum(value),
-											  ObjectIdGetDatum(InvalidOid),
-											  Int32GetDatum(columnTypeMod));
-			break;
+			bFreed = false;
+			foreach(lc, JsonPutMultiList)
+			{	JsonPutMulti *pJpm = (JsonPutMulti *) lfirst(lc);
+
+				if(pJpm->subid == mySubid)
+				{
+					JsonPutMultiFree(pJpm->pCpm);
+					bFreed = true;
+					break;
+				}
+			}
 		}
-		case TEXTOID:
+	}
+}
+
+static void JsonBeginForeignModify(
+	ModifyTableState *mtstate,
+	ResultRelInfo *resultRelInfo,
+	List *fdw_private,
+	int subplan_index,
+	int eflags
+	)
+{
+	//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
+
+	if(!(eflags & EXEC_FLAG_EXPLAIN_ONLY))
+	{
+		AttrNumber n_params = 0;
+		Oid typefnoid = InvalidOid;
+		bool isvarlena = false;
+		ListCell *lc = NULL;
+		ListCell *lcNames = NULL;
+		EState *estate = mtstate->ps.state;
+		Relation rel = resultRelInfo->ri_RelationDesc;
+		Oid foreignTableId = RelationGetRelid(rel);
+		ForeignTable *table = GetForeignTable(foreignTableId);
+		jfmes_t *pJfmes = (jfmes_t *) palloc0(sizeof(jfmes_t));
+
+		//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
+		if(pJfmes != NULL)
 		{
-			const char *value = YAJL_GET_STRING(jsonValue);
-			columnValue = CStringGetTextDatum(value);
-			break;
+			pJfmes->rel = rel;
+
+			pJfmes->retrieved_names = (List *) list_nth(fdw_private, FdwModifyPrivateTargetNames);
+			pJfmes->retrieved_attrs = (List *) list_nth(fdw_private, FdwModifyPrivateTargetAttrs);
+			pJfmes->pUrl = (char const *) list_nth(fdw_private, FdwModifyPrivateUrl);
+			pJfmes->table_options = table->options;
+
+			// deletes send the row keys, found in the junk attribute of the subplan
+			if(mtstate->operation == CMD_DELETE)
+			{	Plan *subplan = mtstate->mt_plans[subplan_index]->plan;
+				char *pKeyName = NameStr(RelationGetDescr(rel)->attrs[0]->attname);
+
+				pJfmes->pMethod = "DELETE";
+				pJfmes->keyAttno = ExecFindJunkAttributeInTlist(subplan->targetlist, pKeyName);
+				if(!AttributeNumberIsValid(pJfmes->keyAttno))
+					ereport(ERROR, (errmsg("could not find junk row key column \"%s\"", pKeyName)));
+			}
+
+			pJfmes->batchSize = intVal(list_nth(fdw_private, FdwModifyPrivateBatchSize));
+			pJfmes->batchBytes = intVal(list_nth(fdw_private, FdwModifyPrivateBatchBytes));
+			pJfmes->batchFormat = intVal(list_nth(fdw_private, FdwModifyPrivateBatchFormat));
+			initStringInfo(&pJfmes->batch);
+			pJfmes->batchRows = 0;
+			pJfmes->rowCount = 0;
+
+			// pipeline the requests ?
+			{	int writeWindow = intVal(list_nth(fdw_private, FdwModifyPrivateWriteWindow));
+
+				pJfmes->pCpm = (writeWindow > 1 ? JsonPutMultiInit(writeWindow) : NULL);
+			}
+
+			{	Value *pContentEncoding = (Value *) list_nth(fdw_private, FdwModifyPrivateContentEncoding);
+
+				pJfmes->pContentEncoding = (pContentEncoding != NULL ? strVal(pContentEncoding) : NULL);
+			}
+
+			n_params = list_length(pJfmes->retrieved_attrs) + 1;
+			pJfmes->p_flinfo = (FmgrInfo *) palloc0(sizeof(FmgrInfo) * n_params);
+			pJfmes->p_nums = 0;
+
+			pJfmes->temp_cxt = AllocSetContextCreate(
+				estate->es_query_cxt,
+				"json_fdw temporary data",
+				ALLOCSET_SMALL_MINSIZE,
+				ALLOCSET_SMALL_INITSIZE,
+				ALLOCSET_SMALL_MAXSIZE
+				);
+
+			//ELog(DEBUG1, "%s:%d put url '%s'", __func__, __LINE__, pJfmes->pUrl);
+			// collect accessor functions, and a json emitter for each attribute
+			pJfmes->pJce = (jce_t *) palloc0(sizeof(jce_t) * n_params);
+			lcNames = list_head(pJfmes->retrieved_names);
+			foreach(lc, pJfmes->retrieved_attrs)
+			{
+				int attnum = lfirst_int(lc);
+				Form_pg_attribute attr = RelationGetDescr(rel)->attrs[attnum - 1];
+				jce_t *pJce = &pJfmes->pJce[pJfmes->p_nums];
+
+				Assert(!attr->attisdropped);
+
+				getTypeOutputInfo(attr->atttypid, &typefnoid, &isvarlena);
+				fmgr_info(typefnoid, &pJfmes->p_flinfo[pJfmes->p_nums]);
+
+				JsonColumnEmitterInit(pJce, attnum, attr->atttypid, lfirst(lcNames), &pJfmes->p_flinfo[pJfmes->p_nums]);
+
+				pJfmes->p_nums++;
+				lcNames = lnext(lcNames);
+				//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
+			}
+			Assert(pJfmes->p_nums <= n_params);
+
+			initStringInfo(&pJfmes->row);
 		}
-		case DATEOID:
+
+		resultRelInfo->ri_FdwState = pJfmes;
+	}
+}
+
+// Error out if any of the pipelined requests has failed
+static void JsonModifyPipelineCheck(jfmes_t *pJfmes)
+{	unsigned long firstRow = 0;
+	unsigned long rows = 0;
+	unsigned long httpResponseCode = 0;
+
+	if(curlPutMultiFailed(pJfmes->pCpm, &firstRow, &rows, &httpResponseCode))
+	{
+		// abandon the requests still in flight, without waiting on them
+		JsonPutMultiFree(pJfmes->pCpm);
+		pJfmes->pCpm = NULL;
+
+		ereport(ERROR, (errmsg("remote server did not accept rows %lu to %lu", firstRow, firstRow + rows - 1),
+			errhint("URL '%s' http response code %lu", pJfmes->pUrl, httpResponseCode)));
+	}
+}
+
+// Send a request body of one or more rows to the remote
+// server, and error out if the server did not accept it
+// If pipelined, the request is only queued, and failures
+// are reported by a later call, or by JsonEndForeignModify
+static void JsonModifySend(jfmes_t *pJfmes, char const *pBody, size_t bodyLen, char const *pContentType, int rows)
+{	uint64 firstRow = pJfmes->rowCount - rows + 1;
+
+	if(pJfmes->pCpm != NULL)
+	{
+		curlPutMultiAdd(pJfmes->pCpm, pJfmes->pUrl, pJfmes->pMethod, pBody, bodyLen, pContentType, pJfmes->pContentEncoding, firstRow, rows);
+		JsonModifyPipelineCheck(pJfmes);
+	}
+	else
+	{	unsigned long httpResponseCode = curlPut(pJfmes->pUrl, pJfmes->pMethod, pBody, bodyLen, pContentType, pJfmes->pContentEncoding);
+
+		if(!CURL_HTTP_OK(httpResponseCode))
 		{
-			const char *value = YAJL_GET_STRING(jsonValue);
-			columnValue = DirectFunctionCall1(date_in, CStringGetDatum(value));
-			break;
+			ereport(ERROR, (errmsg("remote server did not accept rows " UINT64_FORMAT " to " UINT64_FORMAT, firstRow, pJfmes->rowCount),
+				errhint("URL '%s' http response code %lu", pJfmes->pUrl, httpResponseCode)));
 		}
-		case TIMESTAMPOID:
+	}
+}
+
+// Send the rows buffered in the batch as one request
+static void JsonModifyBatchFlush(jfmes_t *pJfmes)
+{
+	if(pJfmes->batchRows > 0)
+	{
+		if(pJfmes->batchFormat == RCI_BATCH_FORMAT_NDJSON)
 		{
-			const char *value = YAJL_GET_STRING(jsonValue);
-			columnValue = DirectFunctionCall3(timestamp_in, CStringGetDatum(value),
-											  ObjectIdGetDatum(InvalidOid),
-											  Int32GetDatum(columnTypeMod));
-			break;
+			appendStringInfoChar(&pJfmes->batch, '\n');
+			JsonModifySend(pJfmes, pJfmes->batch.data, pJfmes->batch.len, "application/x-ndjson", pJfmes->batchRows);
 		}
-		case TIMESTAMPTZOID:
+		else
 		{
-			const char *value = YAJL_GET_STRING(jsonValue);
-			columnValue = DirectFunctionCall3(timestamptz_in, CStringGetDatum(value),
-											  ObjectIdGetDatum(InvalidOid),
-											  Int32GetDatum(columnTypeMod));
-			break;
+			appendStringInfoChar(&pJfmes->batch, ']');
+			JsonModifySend(pJfmes, pJfmes->batch.data, pJfmes->batch.len, "application/json", pJfmes->batchRows);
 		}
-		default:
+
+		resetStringInfo(&pJfmes->batch);
+		pJfmes->batchRows = 0;
+	}
+}
+
+// Send a json object row to the remote server, either now, or as part of a batch
+static void JsonModifyRowAdd(jfmes_t *pJfmes, StringInfo row)
+{
+	// let pipelined requests progress, and collect their completions
+	if(pJfmes->pCpm != NULL)
+	{
+		curlPutMultiReap(pJfmes->pCpm, false);
+		JsonModifyPipelineCheck(pJfmes);
+	}
+
+	if(pJfmes->batchSize <= 1)
+	{
+		pJfmes->rowCount++;
+		JsonModifySend(pJfmes, row->data, row->len, "application/json", 1);
+	}
+	else
+	{
+		// flush first, if adding this row would exceed the byte cap
+		if(pJfmes->batchRows > 0 && pJfmes->batch.len + row->len + 2 > pJfmes->batchBytes)
+			JsonModifyBatchFlush(pJfmes);
+
+		if(pJfmes->batchFormat == RCI_BATCH_FORMAT_NDJSON)
 		{
-			ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_DATA_TYPE),
-							errmsg("cannot convert json type to column type"),
-							errhint("column type: %u", (uint32) columnTypeId)));
-			break;
+			if(pJfmes->batchRows > 0)
+				appendStringInfoChar(&pJfmes->batch, '\n');
 		}
+		else
+			appendStringInfoChar(&pJfmes->batch, (pJfmes->batchRows > 0 ? ',' : '['));
+
+		// the batch buffer is not in the per-tuple context, so it survives
+		appendBinaryStringInfo(&pJfmes->batch, row->data, row->len);
+		pJfmes->batchRows++;
+		pJfmes->rowCount++;
+
+		if(pJfmes->batchRows >= pJfmes->batchSize || pJfmes->batch.len >= pJfmes->batchBytes)
+			JsonModifyBatchFlush(pJfmes);
 	}
+}
 
-	return columnValue;
+static TupleTableSlot *JsonExecForeignInsert(
+	EState *estate,
+	ResultRelInfo *resultRelInfo,
+	TupleTableSlot *slot,
+	TupleTableSlot *planSlot
+	)
+{
+	jfmes_t *pJfmes = (jfmes_t *) resultRelInfo->ri_FdwState;
+	MemoryContext oldContext = MemoryContextSwitchTo(pJfmes->temp_cxt);
+
+	// build the json object document, and send it to the remote server
+	JsonModifyRowBuild(pJfmes, slot, &pJfmes->row);
+	JsonModifyRowAdd(pJfmes, &pJfmes->row);
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextReset(pJfmes->temp_cxt);
+
+	return slot;
 }
 
 
 /*
- * JsonAnalyzeForeignTable sets the total page count and the function pointer
- * used to acquire a random sample of rows from the foreign file.
+ *
+ * An update operation consists of
+ *	AddForeignUpdateTargets
+ *
+ *	GetForeignRelSize
+ *	GetForeignPaths
+ *	GetForeignPlan
+ *
+ *	PlanForeignModify
+ *	BeginForeignScan
+ *	BeginForeignModify
+ *	EndForeignModify
+ *
+ *	EndForeignScan
  */
-static bool
-JsonAnalyzeForeignTable(Relation relation,
-						AcquireSampleRowsFunc *acquireSampleRowsFunc,
-						BlockNumber *totalPageCount)
+
+static void JsonAddForeignUpdateTargets(Query *parsetree, RangeTblEntry *target_rte, Relation target_relation)
 {
-	Oid foreignTableId = RelationGetRelid(relation);
-	JsonFdwOptions *options = JsonGetOptions(foreignTableId);
-	BlockNumber pageCount = 0;
-	struct stat statBuffer;
+	// What we need is the rowid which is the first column
+	Form_pg_attribute attr = RelationGetDescr(target_relation)->attrs[0];
+	// Make a Var representing the desired value
+	Var *var = makeVar(parsetree->resultRelation, 1, attr->atttypid, attr->atttypmod, InvalidOid, 0);
+	// Wrap it in a TLE with the right name ...
+	const char *attrname = NameStr(attr->attname);
+
+	TargetEntry *tle = makeTargetEntry((Expr *) var,
+		list_length(parsetree->targetList) + 1,
+		pstrdup(attrname),
+		true
+		);
 
-	int statResult = stat(options->filename, &statBuffer);
 	//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
-	if (statResult < 0)
-	{
-		ereport(ERROR, (errcode_for_file_access(),
-				 		errmsg("could not stat file \"%s\": %m",
-							   options->filename)));
-	}
+	// ... and add it to the query's targetlist
+	parsetree->targetList = lappend(parsetree->targetList, tle);
+}
+
+static TupleTableSlot * JsonExecForeignUpdate(
+	EState *estate,
+	ResultRelInfo *resultRelInfo,
+	TupleTableSlot *slot,
+	TupleTableSlot *planSlot
+	)
+{
+	jfmes_t *pJfmes = (jfmes_t *) resultRelInfo->ri_FdwState;
+	MemoryContext oldContext = MemoryContextSwitchTo(pJfmes->temp_cxt);
 
-	/*
-	 * Our estimate should return at least 1 so that we can tell later on that
-	 * pg_class.relpages is not default.
-	 */
-	pageCount = (statBuffer.st_size + (BLCKSZ - 1)) / BLCKSZ;
-	if (pageCount < 1)
-	{
-		pageCount = 1;
-	}
+	// build the json object document, and send it to the remote server
+	JsonModifyRowBuild(pJfmes, slot, &pJfmes->row);
+	JsonModifyRowAdd(pJfmes, &pJfmes->row);
 
-	(*totalPageCount) = pageCount;
-	(*acquireSampleRowsFunc) = JsonAcquireSampleRows;
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextReset(pJfmes->temp_cxt);
 
-	return true;
+	return slot;
 }
 
-
 /*
- * JsonAcquireSampleRows acquires a random sample of rows from the foreign
- * table. Selected rows are returned in the caller allocated sampleRows array,
- * which must have at least target row count entries. The actual number of rows
- * selected is returned as the function result. We also count the number of rows
- * in the collection and return it in total row count. We also always set dead
- * row count to zero.
- *
- * Note that the returned list of rows does not always follow their actual order
- * in the JSON file. Therefore, correlation estimates derived later could be
- * inaccurate, but that's OK. We currently don't use correlation estimates (the
- * planner only pays attention to correlation for index scans).
+ * A delete operation consists of the same callbacks as an update,
+ * but with ExecForeignDelete. The row key is sent, rather than the
+ * row, so batched deletes send a json array of keys per request
  */
-static int
-JsonAcquireSampleRows(Relation relation, int logLevel,
-					  HeapTuple *sampleRows, int targetRowCount,
-					  double *totalRowCount, double *totalDeadRowCount)
+static TupleTableSlot * JsonExecForeignDelete(
+	EState *estate,
+	ResultRelInfo *resultRelInfo,
+	TupleTableSlot *slot,
+	TupleTableSlot *planSlot
+	)
 {
-	int sampleRowCount = 0;
-	double rowCount = 0.0;
-	double rowCountToSkip = -1;	// -1 means not set yet
-	double selectionState = 0;
-	MemoryContext oldContext = CurrentMemoryContext;
-	MemoryContext tupleContext = NULL;
-	Datum *columnValues = NULL;
-	bool *columnNulls = NULL;
-	TupleTableSlot *scanTupleSlot = NULL;
-	List *columnList = NIL;
-	List *foreignPrivateList = NULL;
-	ForeignScanState *scanState = NULL;
-	ForeignScan *foreignScan = NULL;
-	char *relationName = NULL;
-	int executorFlags = 0;
-
-	TupleDesc tupleDescriptor = RelationGetDescr(relation);
-	int columnCount = tupleDescriptor->natts;
-	Form_pg_attribute *attributes = tupleDescriptor->attrs;
+	jfmes_t *pJfmes = (jfmes_t *) resultRelInfo->ri_FdwState;
+	jce_t *pJce = &pJfmes->pJce[0];
+	bool isnull = true;
+	Datum value = ExecGetJunkAttribute(planSlot, pJfmes->keyAttno, &isnull);
 
-	// create list of columns of the relation
-	int columnIndex = 0;
-	//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
-	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
-	{
-		Var *column = (Var *) palloc0(sizeof(Var));
+	if(isnull)
+		ereport(ERROR, (errmsg("row key column \"%s\" is NULL", (char *) linitial(pJfmes->retrieved_names))));
+	else
+	{	MemoryContext oldContext = MemoryContextSwitchTo(pJfmes->temp_cxt);
 
-		// only assign required fields for column mapping hash
-		column->varattno = columnIndex + 1;
-		column->vartype = attributes[columnIndex]->atttypid;
-		column->vartypmod = attributes[columnIndex]->atttypmod;
+		// send the json value of the key to the remote server
+		resetStringInfo(&pJfmes->row);
+		pJce->emit(&pJfmes->row, pJce, value);
+		JsonModifyRowAdd(pJfmes, &pJfmes->row);
 
-		columnList = lappend(columnList, column);
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextReset(pJfmes->temp_cxt);
 	}
 
-	// setup foreign scan plan node
-	foreignPrivateList = list_make1(columnList);
-	foreignScan = makeNode(ForeignScan);
-	foreignScan->fdw_private = foreignPrivateList;
-
-	// setup tuple slot
-	columnValues = (Datum *) palloc0(columnCount * sizeof(Datum));
-	columnNulls = (bool *) palloc0(columnCount * sizeof(bool));	
-	scanTupleSlot = MakeTupleTableSlot();
-	scanTupleSlot->tts_tupleDescriptor = tupleDescriptor;
-	scanTupleSlot->tts_values = columnValues;
-	scanTupleSlot->tts_isnull = columnNulls;
-
-	// setup scan state
-	scanState = makeNode(ForeignScanState);
-	scanState->ss.ss_currentRelation = relation;
-	scanState->ss.ps.plan = (Plan *) foreignScan;
-	scanState->ss.ss_ScanTupleSlot = scanTupleSlot;
-
-	JsonBeginForeignScan(scanState, executorFlags);
-
-	/*
-	 * Use per-tuple memory context to prevent leak of memory used to read and
-	 * parse rows from the file using ReadLineFromFile and FillTupleSlot.
-	 */
-	tupleContext = AllocSetContextCreate(CurrentMemoryContext,
-					 "json_fdw temporary context",
-					 ALLOCSET_DEFAULT_MINSIZE,
-					 ALLOCSET_DEFAULT_INITSIZE,
-					 ALLOCSET_DEFAULT_MAXSIZE);
+	return slot;
+}
 
-	// prepare for sampling rows
-	selectionState = anl_init_selection_state(targetRowCount);
+static void JsonEndForeignModify(EState *estate, ResultRelInfo *resultRelInfo)
+{
+	jfmes_t *pJfmes = (jfmes_t *) resultRelInfo->ri_FdwState;
 
-	for (;;)
+	//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
+	// send any rows still waiting in a partial batch
+	if(pJfmes != NULL)
 	{
-		// check for user-requested abort or sleep
-		vacuum_delay_point();
+		JsonModifyBatchFlush(pJfmes);
 
-		memset(columnValues, 0, columnCount * sizeof(Datum));
-		memset(columnNulls, true, columnCount * sizeof(bool));
-
-		MemoryContextReset(tupleContext);
-		MemoryContextSwitchTo(tupleContext);
+		// wait for the pipelined requests to complete
+		if(pJfmes->pCpm != NULL)
+		{
+			curlPutMultiFinish(pJfmes->pCpm);
+			JsonModifyPipelineCheck(pJfmes);
+			JsonPutMultiFree(pJfmes->pCpm);
+			pJfmes->pCpm = NULL;
+		}
+	}
+}
 
-		// read the next record
-		JsonIterateForeignScan(scanState);
+// Characters that must be escaped inside of a json string
+static const char JsonEscapeChars[256] =
+{
+	// control characters
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	// '"' and '\\'
+	['"'] = 1, ['\\'] = 1,
+};
 
-		MemoryContextSwitchTo(oldContext);
+// Append a quoted and escaped json string
+// Runs of characters that need no escaping are copied in one go
+static void JsonAppendString(StringInfo str, const char *pSrc, int len)
+{	const char *pEnd = pSrc + len;
+	const char *pRun = pSrc;
 
-		// if there are no more records to read, break
-		if (scanTupleSlot->tts_isempty)
-		{
-			break;
-		}
+	appendStringInfoCharMacro(str, '"');
+	for(; pSrc < pEnd; pSrc++)
+	{	unsigned char c = (unsigned char)*pSrc;
 
-		/*
-		 * The first targetRowCount sample rows are simply copied into the
-		 * reservoir. Then we start replacing tuples in the sample until we
-		 * reach the end of the relation. This algorithm is from Jeff Vitter's
-		 * paper (see more info in commands/analyze.c).
-		 */
-		if (sampleRowCount < targetRowCount)
-		{
-			sampleRows[sampleRowCount++] = heap_form_tuple(tupleDescriptor, 
-								   columnValues,
-								   columnNulls);
-		}
-		else
+		if(JsonEscapeChars[c])
 		{
-			/*
-			 * t in Vitter's paper is the number of records already processed.
-			 * If we need to compute a new S value, we must use the "not yet
-			 * incremented" value of rowCount as t.
-			 */
-			if (rowCountToSkip < 0)
-			{
-				rowCountToSkip = anl_get_next_S(rowCount, targetRowCount, &selectionState);
-			}
+			if(pSrc > pRun)
+				appendBinaryStringInfo(str, pRun, pSrc - pRun);
+			pRun = pSrc + 1;
 
-			if (rowCountToSkip <= 0)
+			switch(c)
 			{
-				/*
-				 * Found a suitable tuple, so save it, replacing one old tuple
-				 * at random.
-				 */
-				int rowIndex = (int) (targetRowCount * anl_random_fract());
-				Assert(rowIndex >= 0);
-				Assert(rowIndex < targetRowCount);
-
-				heap_freetuple(sampleRows[rowIndex]);
-				sampleRows[rowIndex] = heap_form_tuple(tupleDescriptor, columnValues, columnNulls);
+				case '"': appendBinaryStringInfo(str, "\\\"", 2); break;
+				case '\\': appendBinaryStringInfo(str, "\\\\", 2); break;
+				case '\n': appendBinaryStringInfo(str, "\\n", 2); break;
+				case '\r': appendBinaryStringInfo(str, "\\r", 2); break;
+				case '\t': appendBinaryStringInfo(str, "\\t", 2); break;
+				case '\b': appendBinaryStringInfo(str, "\\b", 2); break;
+				case '\f': appendBinaryStringInfo(str, "\\f", 2); break;
+				default: appendStringInfo(str, "\\u%04x", c); break;
 			}
-
-			rowCountToSkip -= 1;
 		}
-
-		rowCount += 1;
 	}
+	if(pSrc > pRun)
+		appendBinaryStringInfo(str, pRun, pSrc - pRun);
+	appendStringInfoCharMacro(str, '"');
+}
 
-	// clean up
-	MemoryContextDelete(tupleContext);
-	pfree(columnValues);
-	pfree(columnNulls);
-
-	JsonEndForeignScan(scanState);
+// Append a signed integer, without going through printf
+static void JsonAppendInt64(StringInfo str, int64 value)
+{	char buffer[24];
+	char *p = buffer + sizeof(buffer);
+	uint64 uvalue = (value < 0 ? -((uint64) value) : (uint64) value);
 
-	// emit some interesting relation info
-	relationName = RelationGetRelationName(relation);
-	ereport(logLevel, (errmsg("\"%s\": file contains %.0f rows; %d rows in sample",
-				  relationName, rowCount, sampleRowCount)));
+	do
+	{
+		*--p = '0' + (uvalue % 10);
+		uvalue /= 10;
+	} while(uvalue != 0);
 
-	(*totalRowCount) = rowCount;
-	(*totalDeadRowCount) = 0;
+	if(value < 0)
+		*--p = '-';
 
-	return sampleRowCount;
+	appendBinaryStringInfo(str, p, buffer + sizeof(buffer) - p);
 }
 
-// *** All the stuff below here, was broken by Neal Horman ;)
-static char *JsonAttributeNameGet(int varno, int varattno, PlannerInfo *root)
+// Append the shortest decimal representation of a float that reads back as
+// the same value. Json has no representation of NaN or Infinity, so use null.
+static void JsonAppendFloat(StringInfo str, double value, bool isFloat4)
 {
-	RangeTblEntry *rte = planner_rt_fetch(varno, root);
-	List *options = GetForeignColumnOptions(rte->relid, varattno);
-	char *colname = NULL;
-	ListCell *lc;
+	if(isnan(value) || isinf(value))
+		appendBinaryStringInfo(str, "null", 4);
+	else
+	{	char buffer[32];
+		int digits = (isFloat4 ? FLT_DIG : DBL_DIG);
+		int maxDigits = (isFloat4 ? FLT_DIG + 3 : DBL_DIG + 2);
+		int len = 0;
 
-	foreach(lc, options)
-	{
-		DefElem *def = (DefElem *) lfirst(lc);
+		for(; digits <= maxDigits; digits++)
+		{	double readBack = 0;
 
-		if (strcmp(def->defname, "column_name") == 0)
-		{
-			colname = defGetString(def);
-			break;
+			len = snprintf(buffer, sizeof(buffer), "%.*g", digits, value);
+			readBack = strtod(buffer, NULL);
+			if(isFloat4 ? ((float4) readBack == (float4) value) : (readBack == value))
+				break;
 		}
-	}
 
-	if(colname == NULL)
-		colname = get_relid_attribute_name(rte->relid, varattno);
-
-	return colname;
+		appendBinaryStringInfo(str, buffer, len);
+	}
 }
 
-/*
- * An insert operation consists of
- *	PlanForeignModify
- *	BeginForeignModify
- *	ExecForeignInsert
- *	EndForeignModify
- */
+static void JsonEmitInt2(StringInfo str, jce_t *pJce, Datum value)
+{
+	JsonAppendInt64(str, DatumGetInt16(value));
+}
 
-static List *JsonPlanForeignModify(PlannerInfo *root, ModifyTable *plan, Index resultRelation, int subplan_index)
+static void JsonEmitInt4(StringInfo str, jce_t *pJce, Datum value)
 {
-	CmdType		operation = plan->operation;
-	RangeTblEntry	*rte = planner_rt_fetch(resultRelation, root);
-	Relation	rel = heap_open(rte->relid, NoLock);
-	ForeignTable	*table = GetForeignTable(RelationGetRelid(rel));
-	char		*tableName = RelationGetRelationName(rel);
-	List		*targetAttrs = NULL;
-	List		*targetNames = NULL;
-	ListCell	*lc;
-	char const	*pRomUrl = NULL;
-	char const	*pRomPath = NULL;
-	rci_t		*pRci = NULL;
-	StringInfoData	strUrl;
+	JsonAppendInt64(str, DatumGetInt32(value));
+}
 
-	initStringInfo(&strUrl);
+static void JsonEmitInt8(StringInfo str, jce_t *pJce, Datum value)
+{
+	JsonAppendInt64(str, DatumGetInt64(value));
+}
 
-	// find the ROM url and path options
-	foreach(lc, table->options)
-	{
-		DefElem *def = (DefElem *) lfirst(lc);
-		const char *str = defGetString(def);
+static void JsonEmitFloat4(StringInfo str, jce_t *pJce, Datum value)
+{
+	JsonAppendFloat(str, DatumGetFloat4(value), true);
+}
 
-		//ELog(DEBUG1, "%s:%d '%s' --> '%s'", __func__, __LINE__, def->defname, str);
-		if(strcasecmp(def->defname, OPTION_NAME_ROM_URL) == 0)
-			pRomUrl = str;
-		else if(strcasecmp(def->defname, OPTION_NAME_ROM_PATH) == 0)
-			pRomPath = str;
-	}
+static void JsonEmitFloat8(StringInfo str, jce_t *pJce, Datum value)
+{
+	JsonAppendFloat(str, DatumGetFloat8(value), false);
+}
 
-	//ELog(DEBUG1, "%s:%d table name '%s'", __func__, __LINE__, tableName);
+// Numeric text output is already a valid json number, and is exact
+static void JsonEmitNumeric(StringInfo str, jce_t *pJce, Datum value)
+{	char *outputString = OutputFunctionCall(pJce->pOutputFn, value);
 
-	// fetch the ROM
-	pRci = rciFetch(pRomUrl, pRomPath, 
-			(
-			operation == CMD_INSERT ? RCI_ACTION_INSERT :
-			operation == CMD_UPDATE ? RCI_ACTION_UPDATE :
-			//operation == CMD_DELETE ? RCI_ACTION_DELETE :
-			RCI_ACTION_NONE
-			)
-		);
+	if(strcmp(outputString, "NaN") == 0)
+		appendBinaryStringInfo(str, "null", 4);
+	else
+		appendStringInfoString(str, outputString);
+}
 
-	if(!rciError(pRci, pRomUrl, pRomPath)
-		&& rciMethod(pRci, "put", pRomUrl, pRomPath)
-		)
-	{
-		appendStringInfoString(&strUrl, pRci->pUrl);
-		//ELog(DEBUG1, "%s:%d url '%s'", __func__, __LINE__, strUrl.data);
-	}
-	rciFree(pRci);
+static void JsonEmitBool(StringInfo str, jce_t *pJce, Datum value)
+{
+	if(DatumGetBool(value))
+		appendBinaryStringInfo(str, "true", 4);
+	else
+		appendBinaryStringInfo(str, "false", 5);
+}
 
-	switch (operation)
-	{
-		case CMD_INSERT:
-		case CMD_UPDATE:
-			{
-				TupleDesc tupdesc = RelationGetDescr(rel);
-				int attnum;
+// text, varchar, and bpchar are all text varlenas, so use the bytes directly
+static void JsonEmitText(StringInfo str, jce_t *pJce, Datum value)
+{	text *pText = DatumGetTextPP(value);
 
-				// collect relation information
-				for (attnum = 1; attnum <= tupdesc->natts; attnum++)
-				{
-					Form_pg_attribute attr = tupdesc->attrs[attnum - 1];
+	JsonAppendString(str, VARDATA_ANY(pText), VARSIZE_ANY_EXHDR(pText));
+}
 
-					if (!attr->attisdropped)
-					{
-						// collect the name of the attribute
-						char *colname = JsonAttributeNameGet(resultRelation, attnum, root);
-						targetNames = lappend(targetNames, colname);
+static void JsonEmitName(StringInfo str, jce_t *pJce, Datum value)
+{	const char *pName = NameStr(*DatumGetName(value));
 
-						// collect the index of the attribute
-						targetAttrs = lappend_int(targetAttrs, attnum);
+	JsonAppendString(str, pName, strlen(pName));
+}
 
-						//ELog(DEBUG1, "%s:%d %s", __func__, __LINE__, colname);
-					}
-				}
-			}
-			break;
-		default:
-			break;
-	}
+// Types without a native json representation are emitted
+// as a json string of their postgres text output
+static void JsonEmitOutputString(StringInfo str, jce_t *pJce, Datum value)
+{	char *outputString = OutputFunctionCall(pJce->pOutputFn, value);
 
-	heap_close(rel, NoLock);
-	return list_make3(targetNames, targetAttrs, strUrl.data);
+	JsonAppendString(str, outputString, strlen(outputString));
 }
 
-static void JsonBeginForeignModify(
-	ModifyTableState *mtstate,
-	ResultRelInfo *resultRelInfo,
-	List *fdw_private,
-	int subplan_index,
-	int eflags
-	)
+static void JsonEmitDateTime(StringInfo str, jce_t *pJce, Datum value)
 {
-	//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
+	int pgtz;
+	struct pg_tm pgtm;
+	fsec_t fsec;
+	const char *pgtzn;
+	struct tm tm;
+	char buffer [128];
+	Timestamp valueTimestamp;
+
+	// get pg time
+	if(pJce->type == DATEOID)
+	{	Datum valueDatum = DirectFunctionCall1(date_timestamp, value);
+
+		valueTimestamp = DatumGetTimestamp(valueDatum);
+	}
+	else
+		valueTimestamp = DatumGetTimestamp(value);
+
+	// extract pg time
+	timestamp2tm(valueTimestamp, &pgtz, &pgtm, &fsec, &pgtzn, pg_tzset("UTC"));
+
+	// map to unix time
+	tm.tm_sec = pgtm.tm_sec;
+	tm.tm_min = pgtm.tm_min;
+	tm.tm_hour = pgtm.tm_hour;
+	tm.tm_mday = pgtm.tm_mday;
+	tm.tm_mon = pgtm.tm_mon - 1;
+	tm.tm_year = pgtm.tm_year - 1900;
+	tm.tm_wday = pgtm.tm_wday;
+	tm.tm_yday = pgtm.tm_yday;
+	tm.tm_isdst = pgtm.tm_isdst;
+	tm.tm_gmtoff = pgtm.tm_gmtoff;
+	tm.tm_zone = (char *)pgtm.tm_zone;
+
+	memset(buffer, 0, sizeof(buffer));
+	// convert to string in ISO format
+	strftime(buffer, sizeof(buffer)-1, "%Y-%m-%d %H:%M:%S %Z", &tm);
+
+	JsonAppendString(str, buffer, strlen(buffer));
+}
 
-	if(!(eflags & EXEC_FLAG_EXPLAIN_ONLY))
+// Append the elements of one dimension of an array, as a json array, and those
+// of the dimensions below it as nested arrays. NULL elements are json nulls.
+static void JsonAppendArrayDim(StringInfo str, jce_t *pElement, int dim, int ndim, int *dims, Datum *elements, bool *nulls, int *pIndex)
+{	int i;
+
+	appendStringInfoCharMacro(str, '[');
+	for(i=0; i<dims[dim]; i++)
 	{
-		AttrNumber n_params = 0;
-		Oid typefnoid = InvalidOid;
-		bool isvarlena = false;
-		ListCell *lc = NULL;
-		EState *estate = mtstate->ps.state;
-		Relation rel = resultRelInfo->ri_RelationDesc;
-		Oid foreignTableId = RelationGetRelid(rel);
-		ForeignTable *table = GetForeignTable(foreignTableId);
-		jfmes_t *pJfmes = (jfmes_t *) palloc0(sizeof(jfmes_t));
+		if(i > 0)
+			appendStringInfoCharMacro(str, ',');
 
-		//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
-		if(pJfmes != NULL)
+		if(dim + 1 < ndim)
+			JsonAppendArrayDim(str, pElement, dim + 1, ndim, dims, elements, nulls, pIndex);
+		else
 		{
-			pJfmes->rel = rel;
+			if(nulls[*pIndex])
+				appendBinaryStringInfo(str, "null", 4);
+			else
+				pElement->emit(str, pElement, elements[*pIndex]);
+			(*pIndex)++;
+		}
+	}
+	appendStringInfoCharMacro(str, ']');
+}
 
-			pJfmes->retrieved_names = (List *) list_nth(fdw_private, 0);
-			pJfmes->retrieved_attrs = (List *) list_nth(fdw_private, 1);
-			pJfmes->pUrl = (char const *) list_nth(fdw_private, 2);
-			pJfmes->table_options = table->options;
+// Arrays are emitted element by element, with the emitter of their element type
+static void JsonEmitArray(StringInfo str, jce_t *pJce, Datum value)
+{	ArrayType *pArray = DatumGetArrayTypeP(value);
+	jce_t *pElement = pJce->pElement;
+	Datum *elements = NULL;
+	bool *nulls = NULL;
+	int count = 0;
+	int index = 0;
 
-			n_params = list_length(pJfmes->retrieved_attrs) + 1;
-			pJfmes->p_flinfo = (FmgrInfo *) palloc0(sizeof(FmgrInfo) * n_params);
-			pJfmes->p_nums = 0;
+	deconstruct_array(pArray, pElement->type, pJce->elementLen, pJce->elementByVal, pJce->elementAlign, &elements, &nulls, &count);
 
-			pJfmes->temp_cxt = AllocSetContextCreate(
-				estate->es_query_cxt,
-				"json_fdw temporary data",
-				ALLOCSET_SMALL_MINSIZE,
-				ALLOCSET_SMALL_INITSIZE,
-				ALLOCSET_SMALL_MAXSIZE
-				);
+	if(ARR_NDIM(pArray) == 0)
+		appendBinaryStringInfo(str, "[]", 2);
+	else
+		JsonAppendArrayDim(str, pElement, 0, ARR_NDIM(pArray), ARR_DIMS(pArray), elements, nulls, &index);
+}
 
-			//ELog(DEBUG1, "%s:%d put url '%s'", __func__, __LINE__, pJfmes->pUrl);
-			// collect accessor functions for each attribute
-			foreach(lc, pJfmes->retrieved_attrs)
-			{
-				int attnum = lfirst_int(lc);
-				Form_pg_attribute attr = RelationGetDescr(rel)->attrs[attnum - 1];
+// Resolve how to emit an attribute as a json name and value pair, once per
+// statement, so that rows are built without any per value type lookups
+static void JsonColumnEmitterInit(jce_t *pJce, int attnum, Oid type, const char *name, FmgrInfo *pOutputFn)
+{	StringInfoData key;
 
-				Assert(!attr->attisdropped);
+	pJce->attnum = attnum;
+	pJce->type = type;
+	pJce->pOutputFn = pOutputFn;
 
-				getTypeOutputInfo(attr->atttypid, &typefnoid, &isvarlena);
-				fmgr_info(typefnoid, &pJfmes->p_flinfo[pJfmes->p_nums]);
-				pJfmes->p_nums++;
-				//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
-			}
-			Assert(pJfmes->p_nums <= n_params);
+	// the quoted and escaped name, with the separator
+	initStringInfo(&key);
+	JsonAppendString(&key, name, strlen(name));
+	appendStringInfoChar(&key, ':');
+	pJce->pKey = key.data;
+	pJce->keyLen = key.len;
+
+	switch(type)
+	{
+		case INT2OID: pJce->emit = JsonEmitInt2; break;
+		case INT4OID: pJce->emit = JsonEmitInt4; break;
+		case INT8OID: pJce->emit = JsonEmitInt8; break;
+		case FLOAT4OID: pJce->emit = JsonEmitFloat4; break;
+		case FLOAT8OID: pJce->emit = JsonEmitFloat8; break;
+		case NUMERICOID: pJce->emit = JsonEmitNumeric; break;
+		case BOOLOID: pJce->emit = JsonEmitBool; break;
+
+		case BPCHAROID:
+		case VARCHAROID:
+		case TEXTOID:
+			pJce->emit = JsonEmitText;
+			break;
+		case NAMEOID: pJce->emit = JsonEmitName; break;
+
+		case DATEOID:
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+			pJce->emit = JsonEmitDateTime;
+			break;
+		case TIMEOID: pJce->emit = JsonEmitOutputString; break;
+
+		case INT4ARRAYOID:
+		case INT2ARRAYOID:
+		case FLOAT4ARRAYOID:
+		case TEXTARRAYOID:
+		{
+			Oid elementType = get_element_type(type);
+			Oid elementOutputFn = InvalidOid;
+			bool isvarlena = false;
+			FmgrInfo *pElementOutputFn = (FmgrInfo *) palloc0(sizeof(FmgrInfo));
+
+			getTypeOutputInfo(elementType, &elementOutputFn, &isvarlena);
+			fmgr_info(elementOutputFn, pElementOutputFn);
+			get_typlenbyvalalign(elementType, &pJce->elementLen, &pJce->elementByVal, &pJce->elementAlign);
+
+			pJce->pElement = (jce_t *) palloc0(sizeof(jce_t));
+			JsonColumnEmitterInit(pJce->pElement, attnum, elementType, name, pElementOutputFn);
+			pJce->emit = JsonEmitArray;
+			break;
 		}
 
-		resultRelInfo->ri_FdwState = pJfmes;
+		//case OIDARRAYOID:
+		default:
+		{
+			ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_DATA_TYPE),
+							errmsg("cannot convert constant value to JSON value"),
+							errhint("Constant value data type: %u", type)));
+			break;
+		}
 	}
 }
 
-static int JsonPg2Json(StringInfo Str, Oid type, Datum value, const char *name, bool *isnull);
+// Build a json object document of the non-null attributes of the slot into str
+static void JsonModifyRowBuild(jfmes_t *pJfmes, TupleTableSlot *slot, StringInfo str)
+{	bool first = true;
+	int i;
 
-static TupleTableSlot *JsonExecForeignInsert(
-	EState *estate,
-	ResultRelInfo *resultRelInfo,
-	TupleTableSlot *slot,
-	TupleTableSlot *planSlot
-	)
-{
-	jfmes_t *pJfmes = (jfmes_t *) resultRelInfo->ri_FdwState;
-	MemoryContext oldContext = MemoryContextSwitchTo(pJfmes->temp_cxt);
-	int nParams = list_length(pJfmes->retrieved_attrs);
+	resetStringInfo(str);
+	appendStringInfoCharMacro(str, '{');
 
-	if(nParams == list_length(pJfmes->retrieved_names))
-	{
-		bool *isnull = (bool*) palloc0(sizeof(bool) * nParams);
-		ListCell *lcAttrs = NULL;
-		ListCell *lcNames = list_head(pJfmes->retrieved_names);
-		StringInfoData str;
-		int paramNum = 0;
-		int paramCount = 0;
-		int ok = 0;
+	for(i=0; i<pJfmes->p_nums; i++)
+	{	jce_t *pJce = &pJfmes->pJce[i];
+		bool isnull = true;
+		Datum value = slot_getattr(slot, pJce->attnum, &isnull);
 
-		// count the number of non-null attributes
-		foreach(lcAttrs, pJfmes->retrieved_attrs)
+		if(!isnull)
 		{
-			bool bIsNull = true;
-			slot_getattr(slot, lfirst_int(lcAttrs), &bIsNull);
-			paramCount += (!bIsNull);
+			if(!first)
+				appendStringInfoCharMacro(str, ',');
+			first = false;
+
+			appendBinaryStringInfo(str, pJce->pKey, pJce->keyLen);
+			pJce->emit(str, pJce, value);
 		}
+	}
 
-		// build json object document string
-		initStringInfo(&str);
-		appendStringInfoString(&str, "{ ");
-		foreach(lcAttrs, pJfmes->retrieved_attrs)
-		{
-			int attnum = lfirst_int(lcAttrs) - 1;
-			Datum value = slot_getattr(slot, attnum + 1, &isnull[attnum]);
-			Oid type = slot->tts_tupleDescriptor->attrs[attnum]->atttypid;
+	appendStringInfoCharMacro(str, '}');
+}
 
-			//ELog(DEBUG1, "%s:%d %u/%u %s %u", __func__, __LINE__, attnum, nParams, lfirst(lcNames), isnull[attnum]);
-			if(JsonPg2Json(&str, type, value, lfirst(lcNames), &isnull[attnum])
-				// if not last attribute
-				&& paramNum < paramCount - 1
-				&& !isnull[attnum]
-			)
-			{
-				appendStringInfoString(&str, ", ");
-				paramNum++;
-			}
 
-			lcNames = lnext(lcNames);
-		}
-		appendStringInfoString(&str, " }");
+// The narrowest column type of a json scalar, as ColumnTypesCompatible and ColumnValue convert them
+static int JsonInferScalar(yajl_val jsonValue)
+{
+	int type = JSON_INFER_NULL;
 
-		// send the json object to the remote server
-		ok = curlPut(pJfmes->pUrl, str.data, strlen(str.data), "application/json");
+	if (YAJL_IS_TRUE(jsonValue) || YAJL_IS_FALSE(jsonValue))
+		type = JSON_INFER_BOOLEAN;
+	else if (YAJL_IS_INTEGER(jsonValue))
+	{
+		long long value = YAJL_GET_INTEGER(jsonValue);
 
-		//ELog(DEBUG1, "%s:%d '%s' --> %s %s", __func__, __LINE__, str.data, pJfmes->pUrl, ok ? "OK" : "FAIL");
+		type = (value >= INT_MIN && value <= INT_MAX ? JSON_INFER_INTEGER : JSON_INFER_BIGINT);
 	}
+	else if (YAJL_IS_NUMBER(jsonValue))
+	{
+		// the smallest bigint, an integer too large for one, or a fraction or exponent
+		const char *number = YAJL_GET_NUMBER(jsonValue);
+		int64 value = 0;
 
-	MemoryContextSwitchTo(oldContext);
-	MemoryContextReset(pJfmes->temp_cxt);
-
-	return slot;
-}
+		if (strspn(number, "-0123456789") != strlen(number))
+			type = JSON_INFER_DOUBLE;
+		else
+			type = (scanint8(number, true, &value) ? JSON_INFER_BIGINT : JSON_INFER_NUMERIC);
+	}
+	else if (YAJL_IS_STRING(jsonValue))
+	{
+		const char *string = YAJL_GET_STRING(jsonValue);
 
+		if (!ValidDateTimeFormat(string))
+			type = JSON_INFER_TEXT;
+		else
+			type = (strchr(string, ':') != NULL ? JSON_INFER_TIMESTAMP : JSON_INFER_DATE);
+	}
+	else if (YAJL_IS_ARRAY(jsonValue))
+		type = JSON_INFER_ARRAY;
+	else if (YAJL_IS_OBJECT(jsonValue))
+		type = JSON_INFER_OBJECT;
 
-/*
- *
- * An update operation consists of
- *	AddForeignUpdateTargets
- *
- *	GetForeignRelSize
- *	GetForeignPaths
- *	GetForeignPlan
- *
- *	PlanForeignModify
- *	BeginForeignScan
- *	BeginForeignModify
- *	EndForeignModify
- *
- *	EndForeignScan
- */
+	return type;
+}
 
-static void JsonAddForeignUpdateTargets(Query *parsetree, RangeTblEntry *target_rte, Relation target_relation)
+// Find, or add, a key of the inferred schema
+static JsonInferKey *JsonInferKeyGet(HTAB *keysHash, List **pKeys, const char *key)
 {
-	// What we need is the rowid which is the first column
-	Form_pg_attribute attr = RelationGetDescr(target_relation)->attrs[0];
-	// Make a Var representing the desired value
-	Var *var = makeVar(parsetree->resultRelation, 1, attr->atttypid, attr->atttypmod, InvalidOid, 0);
-	// Wrap it in a TLE with the right name ...
-	const char *attrname = NameStr(attr->attname);
+	bool found = false;
+	JsonInferKey *pKey = (JsonInferKey *) hash_search(keysHash, key, HASH_ENTER, &found);
 
-	TargetEntry *tle = makeTargetEntry((Expr *) var,
-		list_length(parsetree->targetList) + 1,
-		pstrdup(attrname),
-		true
-		);
+	if (!found)
+	{
+		pKey->index = list_length(*pKeys);
+		memset(pKey->counts, 0, sizeof(pKey->counts));
+		memset(pKey->elementCounts, 0, sizeof(pKey->elementCounts));
+		*pKeys = lappend(*pKeys, pKey);
+	}
 
-	//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
-	// ... and add it to the query's targetlist
-	parsetree->targetList = lappend(parsetree->targetList, tle);
+	return pKey;
 }
 
-static TupleTableSlot * JsonExecForeignUpdate(
-	EState *estate,
-	ResultRelInfo *resultRelInfo,
-	TupleTableSlot *slot,
-	TupleTableSlot *planSlot
-	)
+// Add the keys of a json object, and of the objects nested in it, by their dotted paths as FillTupleSlot does
+static void JsonInferObject(HTAB *keysHash, List **pKeys, yajl_val jsonObject, const char *jsonObjectKey)
 {
-	jfmes_t *pJfmes = (jfmes_t *) resultRelInfo->ri_FdwState;
-	int nParams = list_length(pJfmes->retrieved_attrs);
+	uint32 jsonKeyIndex = 0;
 
-	if(nParams == list_length(pJfmes->retrieved_names))
+	for (jsonKeyIndex = 0; jsonKeyIndex < jsonObject->u.object.len; jsonKeyIndex++)
 	{
-		bool *isnull = palloc0(sizeof(bool) * nParams);
-		ListCell *lcAttrs = NULL;
-		ListCell *lcNames = list_head(pJfmes->retrieved_names);
-		StringInfoData str;
-		int paramNum = 0;
-		int ok = 0;
+		const char *jsonKey = jsonObject->u.object.keys[jsonKeyIndex];
+		yajl_val jsonValue = jsonObject->u.object.values[jsonKeyIndex];
+		const char *jsonFullKey = (jsonObjectKey != NULL ? psprintf("%s.%s", jsonObjectKey, jsonKey) : jsonKey);
+		JsonInferKey *pKey = NULL;
+		int type = JSON_INFER_NULL;
+
+		// a key longer than a column name can't be read by one, nor can the keys in it
+		if (strlen(jsonFullKey) >= NAMEDATALEN)
+			continue;
 
-		//ELog(DEBUG1, "%s:%d nparams %u", __func__, __LINE__, nParams);
+		pKey = JsonInferKeyGet(keysHash, pKeys, jsonFullKey);
+		type = JsonInferScalar(jsonValue);
+		pKey->counts[type]++;
 
-		// build json object document string
-		initStringInfo(&str);
-		appendStringInfoString(&str, "{ ");
-		foreach(lcAttrs, pJfmes->retrieved_attrs)
+		if (type == JSON_INFER_ARRAY)
 		{
-			Datum value = 0;
-			int attnum = lfirst_int(lcAttrs) - 1;
-			Oid type;
-
-			type = slot->tts_tupleDescriptor->attrs[attnum]->atttypid;
-			value = slot_getattr(slot, attnum + 1, (bool*)(&isnull[attnum]));
+			uint32 i;
 
-			if(JsonPg2Json(&str, type, value, lfirst(lcNames), &isnull[attnum])
-				// if not last attribute
-				&& paramNum < nParams -1
-				&& !isnull[attnum]
-			)
-			{
-				appendStringInfoString(&str, ", ");
-			}
-			lcNames = lnext(lcNames);
-			paramNum ++;
+			for (i = 0; i < jsonValue->u.array.len; i++)
+				pKey->elementCounts[JsonInferScalar(jsonValue->u.array.values[i])]++;
 		}
-		appendStringInfoString(&str, " }");
-
-		// send the json object to the remote server
-		ok = curlPut(pJfmes->pUrl, str.data, strlen(str.data), "application/json");
-		//ELog(DEBUG1, "%s:%d '%s' --> %s %s", __func__, __LINE__, str.data, pJfmes->pUrl, ok ? "OK" : "FAIL");
+		else if (type == JSON_INFER_OBJECT)
+			JsonInferObject(keysHash, pKeys, jsonValue, jsonFullKey);
 	}
-
-	return slot;
 }
 
-static void JsonEndForeignModify(EState *estate, ResultRelInfo *resultRelInfo)
+// The narrowest type of the partition columns of a source, that JsonPartitionValue converts
+static void JsonInferPartitions(HTAB *keysHash, List **pKeys, const char *source)
 {
-	jfmes_t *pJfmes = (jfmes_t *) resultRelInfo->ri_FdwState;
+	ListCell *partitionCell = NULL;
 
-	//ELog(DEBUG1, "%s:%d", __func__, __LINE__);
+	foreach(partitionCell, JsonSourcePartitions(source))
+	{
+		DefElem *partition = (DefElem *) lfirst(partitionCell);
+		const char *value = strVal(partition->arg);
+		JsonInferKey *pKey = NULL;
+		int type = JSON_INFER_TEXT;
+		const char *digits = value + (*value == '-' ? 1 : 0);
+
+		if (strlen(partition->defname) >= NAMEDATALEN)
+			continue;
+
+		if (strcmp(value, HIVE_DEFAULT_PARTITION) == 0)
+			type = JSON_INFER_NULL;
+		else if (*digits && strspn(digits, "0123456789") == strlen(digits))
+			type = (strlen(digits) < 10 ? JSON_INFER_INTEGER : JSON_INFER_NUMERIC);
+		else if (ValidDateTimeFormat(value))
+			type = (strchr(value, ':') != NULL ? JSON_INFER_TIMESTAMP : JSON_INFER_DATE);
+
+		pKey = JsonInferKeyGet(keysHash, pKeys, partition->defname);
+		pKey->counts[type]++;
+	}
 }
 
-// Transmute a postgres text array into a json text array
-enum
+/*
+ * The narrowest column type that reads most of the values of a key, or NULL if
+ * it only ever held objects. A column only converts one kind of json value, ie.
+ * a text column doesn't read numbers, so the kind that most of the values are
+ * decides, and then the widest type of that kind.
+ */
+static const char *JsonInferTypeName(uint32 *counts)
 {
-	SM_UNQUOTED,
-	SM_QUOTED,
-	SM_NEEDQUOTE,
-};
+	const char *typeName = NULL;
+	uint32 booleans = counts[JSON_INFER_BOOLEAN];
+	uint32 numbers = counts[JSON_INFER_INTEGER] + counts[JSON_INFER_BIGINT] + counts[JSON_INFER_NUMERIC] + counts[JSON_INFER_DOUBLE];
+	uint32 strings = counts[JSON_INFER_DATE] + counts[JSON_INFER_TIMESTAMP] + counts[JSON_INFER_TEXT];
+
+	if (booleans + numbers + strings == 0)
+		typeName = (counts[JSON_INFER_NULL] > 0 ? "text" : NULL);
+	else if (strings >= numbers && strings >= booleans)
+	{
+		if (counts[JSON_INFER_TEXT] > 0)
+			typeName = "text";
+		else if (counts[JSON_INFER_TIMESTAMP] > 0)
+			typeName = "timestamp";
+		else
+			typeName = "date";
+	}
+	else if (numbers >= booleans)
+	{
+		if (counts[JSON_INFER_DOUBLE] > 0)
+			typeName = "double precision";
+		else if (counts[JSON_INFER_NUMERIC] > 0)
+			typeName = "numeric";
+		else if (counts[JSON_INFER_BIGINT] > 0)
+			typeName = "bigint";
+		else
+			typeName = "integer";
+	}
+	else
+		typeName = "boolean";
 
-// Append to the "outStr" string, an array of data that is Text,
-// while dealing with quoting conversion from sql to json
-static void JsonPgTextArray2Json(StringInfo outStr, const char *inStr, int len)
-{	int state = SM_UNQUOTED;
-	int i;
+	return typeName;
+}
 
-	if(len)
-		appendStringInfoCharMacro(outStr, '[');
+/*
+ * json_fdw_infer_schema reads the first rows of a json source, a file, url,
+ * list, glob or directory, as a foreign table would, and returns the CREATE
+ * FOREIGN TABLE of the dotted key paths found, with the narrowest type that
+ * reads most of the values of each. The rows are sampled evenly across the
+ * sources, and remote sources are fetched concurrently, as a scan does.
+ */
+Datum
+json_fdw_infer_schema(PG_FUNCTION_ARGS)
+{
+	char *source = NULL;
+	int sampleRowCount = (PG_ARGISNULL(1) ? JSON_INFER_SAMPLE_ROWS : PG_GETARG_INT32(1));
+	char *tableName = NULL;
+	char *serverName = (PG_ARGISNULL(3) ? "json_server" : text_to_cstring(PG_GETARG_TEXT_PP(3)));
+	List *sources = NIL;
+	int sourceRowCount = 0;
+	int rowCount = 0;
+	JsonFdwExecState *execState = NULL;
+	HTAB *keysHash = NULL;
+	List *keys = NIL;
+	ListCell *keyCell = NULL;
+	StringInfoData ddl;
+	HASHCTL hashInfo;
+	MemoryContext rowContext = NULL;
+	MemoryContext oldContext = NULL;
+	bool firstColumn = true;
 
-	for(i=0; i<len; i++)
+	if (!superuser())
 	{
-		switch(state)
-		{
-			case SM_UNQUOTED:
-				if(inStr[i] == '\\' && i+1 < len)
-					appendStringInfoCharMacro(outStr, inStr[i++]);
-				else if(inStr[i] == '"')
-					state = SM_QUOTED;
-				else if(inStr[i] != ',')
-				{
-					appendStringInfoCharMacro(outStr, '"');
-					state = SM_NEEDQUOTE;
-				}
-				appendStringInfoCharMacro(outStr, inStr[i]);
-				break;
+		ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+						errmsg("only superuser can infer the schema of a json source")));
+	}
 
-			case SM_NEEDQUOTE:
-				if(inStr[i] == '\\' && i+1 < len)
-					appendStringInfoCharMacro(outStr, inStr[i++]);
-				else if(inStr[i] == ',')
-				{
-					appendStringInfoCharMacro(outStr, '"');
-					state = SM_UNQUOTED;
-				}
-				appendStringInfoCharMacro(outStr, inStr[i]);
-				break;
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
 
-			case SM_QUOTED:
-				if(inStr[i] == '\\' && i+1 < len)
-					appendStringInfoCharMacro(outStr, inStr[i++]);
-				else if(inStr[i] == '"')
-					state = SM_UNQUOTED;
-				appendStringInfoCharMacro(outStr, inStr[i]);
-				break;
-		}
+	source = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	if (sampleRowCount <= 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("sample_rows must be greater than zero")));
 	}
 
-	if(state == SM_NEEDQUOTE)
-		appendStringInfoCharMacro(outStr, '"');
-	if(i)
-		appendStringInfoCharMacro(outStr, ']');
-}
+	if (!PG_ARGISNULL(2))
+		tableName = text_to_cstring(PG_GETARG_TEXT_PP(2));
+	else
+	{
+		// the base name of the first source, without its extensions or query
+		const char *baseName = strrchr(source, '/');
 
-// Convert a postgres attribute value into a json name and value pair
-// and append it to the json object string "str"
-// On return, tell the consumer if we did that for this attribute.
-static int JsonPg2Json(StringInfo str, Oid type, Datum value, const char *name, bool *isnull)
-{	int oldLen = str->len;
+		baseName = (baseName != NULL ? baseName + 1 : source);
+		tableName = pnstrdup(baseName, strcspn(baseName, ".?,"));
+		if (!*tableName)
+			tableName = "json_table";
+	}
 
-	if(!*isnull)
+	sources = JsonSourceList(source, NULL, false);
+	if (sources == NIL)
 	{
-		switch(type)
-		{
-			case INT2OID: appendStringInfo(str, "\"%s\": %u", name, (int16)DatumGetInt16(value)); break;
-			case INT4OID: appendStringInfo(str, "\"%s\": %u", name, (int32)DatumGetInt32(value)); break;
-			case INT8OID: appendStringInfo(str, "\"%s\": %lu", name, (int64)DatumGetInt64(value)); break;
-			case FLOAT4OID: appendStringInfo(str, "\"%s\": %f", name, (float4)DatumGetFloat4(value)); break;
-			case FLOAT8OID: appendStringInfo(str, "\"%s\": %f", name, (float8)DatumGetFloat8(value)); break;
+		ereport(ERROR, (errmsg("json source \"%s\" has no files", source)));
+	}
+	sourceRowCount = Max(sampleRowCount / list_length(sources), 1);
 
-			case NUMERICOID:
-				{	Datum valueDatum = DirectFunctionCall1(numeric_float8, value);
+	memset(&hashInfo, 0, sizeof(hashInfo));
+	hashInfo.keysize = NAMEDATALEN;
+	hashInfo.entrysize = sizeof(JsonInferKey);
+	hashInfo.hash = string_hash;
+	hashInfo.hcxt = CurrentMemoryContext;
+	keysHash = hash_create("json_fdw infer schema", 256, &hashInfo, (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT));
 
-					appendStringInfo(str, "\"%s\": %f", name, (float8)DatumGetFloat8(valueDatum));
-				}
-				break;
+	// read the sources as a scan of several sources does
+	execState = (JsonFdwExecState *) palloc0(sizeof(JsonFdwExecState));
+	execState->columnMappingHash = ColumnMappingHash(InvalidOid, NIL);
+	execState->scanContext = CurrentMemoryContext;
+	execState->pJss = JsonSourceInit(sources, DEFAULT_READ_WINDOW, NULL);
 
-			//case BOOLOID: appendStringInfo(str, "\"%s\": %s", name, (((int32)DatumGetInt32(value))) ? "true", "false"); break;
-			case BOOLOID: appendStringInfo(str, "\"%s\": %u", name, (int32)DatumGetInt32(value)); break;
+	rowContext = AllocSetContextCreate(CurrentMemoryContext,
+					 "json_fdw infer schema context",
+					 ALLOCSET_DEFAULT_MINSIZE,
+					 ALLOCSET_DEFAULT_INITSIZE,
+					 ALLOCSET_DEFAULT_MAXSIZE);
 
-			case BPCHAROID:
-			case VARCHAROID:
-			case TEXTOID:
-			case NAMEOID:
-				{	char *outputString = NULL;
-					Oid outputFunctionId = InvalidOid;
-					bool typeVarLength = false;
+	while (rowCount < sampleRowCount && JsonSourceOpenNext(execState))
+	{
+		int readCount = 0;
+		bool endOfFile = false;
 
-					getTypeOutputInfo(type, &outputFunctionId, &typeVarLength);
-					outputString = OidOutputFunctionCall(outputFunctionId, value);
+		JsonInferPartitions(keysHash, &keys, execState->pSourceName);
 
-					appendStringInfo(str, "\"%s\": \"%s\"", name, outputString);
-				}
-				break;
+		while (!endOfFile && readCount < sourceRowCount && rowCount < sampleRowCount)
+		{
+			StringInfo lineData = NULL;
+
+			CHECK_FOR_INTERRUPTS();
+			MemoryContextReset(rowContext);
+			oldContext = MemoryContextSwitchTo(rowContext);
+
+			lineData = (execState->gzFilePointer != NULL
+				? ReadLineFromGzipFile(execState->gzFilePointer)
+				: ReadLineFromFile(execState->filePointer)
+				);
+			endOfFile = (lineData->len == 0);
+			if (!endOfFile)
+			{
+				char errorBuffer[ERROR_BUFFER_SIZE];
+				yajl_val jsonValue = yajl_tree_parse(lineData->data, errorBuffer, sizeof(errorBuffer));
 
-			case DATEOID:
-			case TIMEOID:
-			case TIMESTAMPOID:
-			case TIMESTAMPTZOID:
+				// the keys are kept in the function's context, their paths are copied by the hash
+				if (YAJL_IS_OBJECT(jsonValue))
 				{
-					int pgtz;
-					struct pg_tm pgtm;
-					fsec_t fsec;
-					const char *pgtzn;
-					struct tm tm;
-					char buffer [128];
-					Timestamp valueTimestamp;
-
-					// get pg time
-					if(type == DATEOID)
-					{	Datum valueDatum = DirectFunctionCall1(date_timestamp, value);
-
-						valueTimestamp = DatumGetTimestamp(valueDatum);
-					}
-					else
-						valueTimestamp = DatumGetTimestamp(value);
-
-					// extract pg time
-					timestamp2tm(valueTimestamp, &pgtz, &pgtm, &fsec, &pgtzn, pg_tzset("UTC"));
-
-					// map to unix time
-					tm.tm_sec = pgtm.tm_sec;
-					tm.tm_min = pgtm.tm_min;
-					tm.tm_hour = pgtm.tm_hour;
-					tm.tm_mday = pgtm.tm_mday;
-					tm.tm_mon = pgtm.tm_mon - 1;
-					tm.tm_year = pgtm.tm_year - 1900;
-					tm.tm_wday = pgtm.tm_wday;
-					tm.tm_yday = pgtm.tm_yday;
-					tm.tm_isdst = pgtm.tm_isdst;
-					tm.tm_gmtoff = pgtm.tm_gmtoff;
-					tm.tm_zone = (char *)pgtm.tm_zone;
-
-					memset(buffer, 0, sizeof(buffer));
-					// convert to string in ISO format
-					strftime(buffer, sizeof(buffer)-1, "%Y-%m-%d %H:%M:%S %Z", &tm);
-
-					appendStringInfo(str, "\"%s\": \"%s\"", name, buffer);
+					MemoryContextSwitchTo(oldContext);
+					JsonInferObject(keysHash, &keys, jsonValue, NULL);
+					readCount++;
+					rowCount++;
 				}
-				break;
-		/*
-			case BITOID:
-			{
-				int32 dat;
-				int32 *bufptr = palloc0(sizeof(int32));
-				char *outputString = NULL;
-				Oid outputFunctionId = InvalidOid;
-				bool typeVarLength = false;
-				getTypeOutputInfo(type, &outputFunctionId, &typeVarLength);
-				outputString = OidOutputFunctionCall(outputFunctionId, value);
-
-				dat = bin_dec(atoi(outputString));
-				memcpy(bufptr, (char*)&dat, sizeof(int32));
-				binds[attnum].buffer = bufptr;
-				break;
+				yajl_tree_free(jsonValue);
 			}
-		*/
-			case INT4ARRAYOID:
-			case INT2ARRAYOID:
-			case FLOAT4ARRAYOID:
-			case TEXTARRAYOID:
-				{	Oid outputFunctionId;
-					bool typeVarLength = false;
-					char *outputString = NULL;
-					int l;
-
-					getTypeOutputInfo(type, &outputFunctionId, &typeVarLength);
-					outputString = OidOutputFunctionCall(outputFunctionId, value);
-
-					// trim left and right curly braces
-					outputString++;
-					l = strlen(outputString) - 1;
-
-					if(type != TEXTARRAYOID)
-						appendStringInfo(str, "\"%s\": [%*.*s]", name, l, l, outputString);
-					else
-					{
-						appendStringInfo(str, "\"%s\": ", name);
-						JsonPgTextArray2Json(str, outputString, l);
-					}
-				}
-				break;
 
-			//case OIDARRAYOID:
-			default:
-			{
-				ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_DATA_TYPE),
-								errmsg("cannot convert constant value to JSON value"),
-								errhint("Constant value data type: %u", type)));
-				break;
-			}
+			MemoryContextSwitchTo(oldContext);
+		}
+	}
+
+	JsonFileClose(execState);
+	JsonSourceEnd(execState->pJss);
+	MemoryContextDelete(rowContext);
+
+	initStringInfo(&ddl);
+	appendStringInfo(&ddl, "CREATE FOREIGN TABLE %s\n(\n", quote_identifier(tableName));
+	foreach(keyCell, keys)
+	{
+		JsonInferKey *pKey = (JsonInferKey *) lfirst(keyCell);
+		const char *typeName = JsonInferTypeName(pKey->counts);
+		uint32 scalars = 0;
+		int type;
+
+		for (type = JSON_INFER_BOOLEAN; type <= JSON_INFER_TEXT; type++)
+			scalars += pKey->counts[type];
+
+		// an array of the elements' type, as ColumnValueArray converts the elements one by one
+		if (pKey->counts[JSON_INFER_ARRAY] > scalars)
+		{
+			const char *elementTypeName = JsonInferTypeName(pKey->elementCounts);
+
+			typeName = psprintf("%s[]", (elementTypeName != NULL ? elementTypeName : "text"));
+		}
+
+		if (typeName != NULL)
+		{
+			appendStringInfo(&ddl, "%s    %s %s", (firstColumn ? "" : ",\n"), quote_identifier(pKey->key), typeName);
+			firstColumn = false;
 		}
 	}
+	appendStringInfo(&ddl, "\n)\nSERVER %s\nOPTIONS (filename %s);", quote_identifier(serverName), quote_literal_cstr(source));
 
-	return (str->len > oldLen); // we appended new characters
+	PG_RETURN_TEXT_P(cstring_to_text(ddl.data));
 }
@@ -15,11 +15,19 @@
 #define JSON_FDW_H
 
 #include "fmgr.h"
+#include "access/htup_details.h"
 #include "catalog/pg_foreign_server.h"
 #include "catalog/pg_foreign_table.h"
 #include "utils/hsearch.h"
 #include "nodes/pg_list.h"
 #include "utils/rel.h"
+#include "lib/stringinfo.h"
+#include "storage/lwlock.h"
+#include "utils/tuplestore.h"
+#include "executor/tuptable.h"
+#if PG_VERSION_NUM >= 90500
+#include "port/atomics.h"
+#endif
 
 #include "curlapi.h"
 
@@ -32,13 +40,52 @@
 #define OPTION_NAME_HTTP_POST_VARS "http_post_vars"
 #define OPTION_NAME_ROM_URL "rom_url"
 #define OPTION_NAME_ROM_PATH "rom_path"
+#define OPTION_NAME_BATCH_SIZE "batch_size"
+#define OPTION_NAME_BATCH_BYTES "batch_bytes"
+#define OPTION_NAME_BATCH_FORMAT "batch_format"
+#define DEFAULT_BATCH_BYTES (1024 * 1024)
+#define OPTION_NAME_WRITE_WINDOW "write_window"
+#define OPTION_NAME_CONTENT_ENCODING "content_encoding"
+#define OPTION_NAME_MANIFEST "manifest"
+#define OPTION_NAME_SOURCE_COLUMN "source_column"
+#define OPTION_NAME_READ_WINDOW "read_window"
+#define DEFAULT_READ_WINDOW 4
+#define OPTION_NAME_COLUMNAR_CACHE "columnar_cache"
+#define OPTION_NAME_SHARED_CACHE "shared_cache"
 
 #define JSON_TUPLE_COST_MULTIPLIER 10
+#define JSON_CPU_TUPLE_USEC 0.2
+#define JSON_REQUEST_COST 100.0
+#define JSON_FETCH_POLL_LINES 1024
+#define JSON_STATS_TABLE "json_fdw_stats"
+#define JSON_KEY_STATS_TABLE "json_fdw_key_stats"
+#define JSON_STATS_PUT_FUNCTION "json_fdw_stats_put"
+
+// Array types that pg_type.h does not name before 9.6
+#ifndef BOOLARRAYOID
+#define BOOLARRAYOID 1000
+#endif
+#ifndef FLOAT8ARRAYOID
+#define FLOAT8ARRAYOID 1022
+#endif
+#define JSON_KEY_STATS_MAX 1000
+#define JSON_INFER_SAMPLE_ROWS 1000
+#define JSON_SAMPLE_BLOCK_SIZE BLCKSZ
+#define JSON_SAMPLE_GZIP_MSEC 30000
+#define JSON_SAMPLE_CHECK_ROWS 1024
+#define JSON_CACHE_DIR "pg_stat_tmp/json_fdw"
+#define JSON_CACHE_SIZE (1024 * 1024)
+#define JSON_CACHE_MAGIC "JFC3"
+#define JSON_CACHE_TMP_SECS 3600
+#define JSON_CACHE_STRIPE_ROWS 10000
+#define JSON_SHARED_CACHE_NAME "json_fdw shared cache"
+#define JSON_SHARED_CACHE_ENTRIES 64
 #define ERROR_BUFFER_SIZE 1024
 #define READ_BUFFER_SIZE 4096
 #define GZIP_FILE_EXTENSION ".gz"
 #define HDFS_BLOCK_PREFIX "blk_"
 #define HDFS_BLOCK_PREFIX_LENGTH 4
+#define HIVE_DEFAULT_PARTITION "__HIVE_DEFAULT_PARTITION__"
 
 
 /*
@@ -67,9 +114,230 @@ typedef struct JsonFdwOptions
 	char const *pHttpPostVars;
 	char const *pRomUrl;
 	char const *pRomPath;
+	int32 batchSize;
+	int32 batchBytes;
+	char const *pBatchFormat;
+	int32 writeWindow;
+	char const *pContentEncoding;
+	char const *pManifest;
+	char const *pSourceColumn;
+	int32 readWindow;
+	bool bColumnarCache;
+	bool bSharedCache;
 } JsonFdwOptions;
 
 
+/*
+ * jsp_t keeps the state of a source that is fetched as pages. Pages are
+ * fetched concurrently, and read in order, as each completes.
+ */
+typedef struct _jsp_t
+{
+	cmf_t *pCmf;			// the page fetches in flight
+	int type;			// RCI_PAGING_xxx
+	char *pUrl;			// url of the pages, without the paging parameters
+	char *pParam;			// url parameter of the offset, page number, or cursor
+	char *pSizeParam;		// url parameter of the page size, or NULL
+	char *pHeader;			// response header with the next cursor, or NULL
+	int size;			// rows per page, 0 if not known
+	int first;			// offset or page number of the first page
+	int window;			// number of pages fetched concurrently
+	int next;			// the next page to request
+	int current;			// the page being read, -1 before the first
+	uint32 lines;			// lines read from the current page
+	bool bLast;			// the current page is the last one
+} jsp_t; // Json Scan Paging Type
+
+/*
+ * jss_t keeps the state of a table with several sources, ie. a list, a glob,
+ * or a manifest of files and urls. Remote sources are fetched concurrently,
+ * ahead of the one being read, and the next local file is prefetched. The
+ * fetches of every scan share the one curl multi handle of the backend, so
+ * the sources of the other scans of a query download while one is read.
+ */
+typedef struct _jss_t
+{
+	char **ppSources;		// the files and urls, in scan order
+	bool *pRemote;			// the source is a url
+	int count;			// number of sources
+	int current;			// the source being read, -1 before the first
+	int next;			// the next source to consider fetching
+	int inFlight;			// number of remote sources being fetched
+	int window;			// number of remote sources fetched concurrently
+	cmf_t *pCmf;			// the remote fetches in flight, or NULL to fetch each when read
+	int idBase;			// fetch id of the first source, in the fetches of the backend
+	char const *pPostVars;		// http post vars of the remote sources
+} jss_t; // Json Scan Sources Type
+
+// The fetches of a scan, that are ended by an abort of the subtransaction that began it
+typedef struct JsonMultiFetchScan
+{
+	cmf_t *pCmf;			// the shared multi handle, or the scan's own
+	int idBase;			// fetch id of the first source, of the shared multi handle
+	int count;			// number of sources
+	bool bOwned;			// the multi handle is the scan's own, ie. of its pages
+	SubTransactionId subid;
+} JsonMultiFetchScan;
+
+/*
+ * jcc_t is the columnar cache of a source, being written by the first scan
+ * that reads it through, or read by later ones instead of parsing the json.
+ * The cache file is a header, with the key of the source and the column
+ * types, and the columns that it has, then stripes of rows. A stripe is the
+ * row count, the raw and stored size and the crc of each column, and the
+ * columns, each zlib compressed null bitmap and values, so a scan checks and
+ * decompresses only the columns it reads. The columns that it has are
+ * those that the scans that wrote it read, so they are all that it converted.
+ */
+typedef struct _jcc_t
+{
+	char *pFileName;		// the cache file
+	char *pFileNameTmp;		// the file being written, renamed once complete
+	FILE *pFile;
+	bool bWriting;			// writing the cache, else reading it
+	bool bComplete;			// the scan being cached read through the source
+	bool bFailed;			// could not write the cache, so it is abandoned
+	int columnCount;		// attributes of the table
+	int16 *pTypLen;			// their type lengths
+	bool *pTypByVal;
+	bool *pNeeded;			// the columns the scan reads, when reading
+	bool *pPresent;			// the columns of the cache
+	uint32 rows;			// rows in the stripe
+	uint32 row;			// the next row of the stripe, when reading
+	StringInfoData *pValues;	// values of each column of the stripe
+	bits8 **ppNulls;		// and their null bitmaps, set for a value
+	char **ppCursor;		// the next value of each column, when reading
+	char **ppEnd;			// and the end of them
+	off_t dataStart;		// of the first stripe, when reading
+	MemoryContext context;		// of the stripe
+} jcc_t; // Json Columnar Cache Type
+
+// A file of the columnar cache, as its least recently used are evicted
+typedef struct JsonCacheFile
+{
+	char *pPath;
+	off_t size;
+	time_t lastUsed;		// its modification time, which is set as it is read
+} JsonCacheFile;
+
+/*
+ * JsonSharedCacheEntry is a table in the shared cache. Its rows are minimal
+ * tuples, each maxaligned, in the arena that follows the entries.
+ */
+typedef struct JsonSharedCacheEntry
+{
+	char keyHash[33];		// md5 of the key of the source, see JsonCacheKey
+	Oid relid;			// the table that cached it
+	Size offset;			// of the rows, in the arena
+	Size size;
+#if PG_VERSION_NUM >= 90500
+	pg_atomic_uint64 lastUsed;	// the clock of the cache, when last read, set under the shared lock
+#else
+	uint64 lastUsed;		// the clock of the cache, when last read
+#endif
+	bits8 columns[BITMAPLEN(MaxTupleAttributeNumber)];	// that the rows have
+} JsonSharedCacheEntry;
+
+/*
+ * JsonSharedCache is the header of the shared memory of the cache, that is
+ * allocated at startup when json_fdw is in shared_preload_libraries. The
+ * entries are in the order of their rows in the arena, which is compacted as
+ * entries are evicted, so the free space is at its end.
+ */
+typedef struct JsonSharedCache
+{
+	LWLock *lock;			// of all of it
+	Size arenaSize;
+	Size used;			// bytes of the arena in use, from its start
+#if PG_VERSION_NUM >= 90500
+	pg_atomic_uint64 clock;		// counts the reads, for evicting the least recently used
+#else
+	uint64 clock;			// counts the reads, for evicting the least recently used
+#endif
+	int entryCount;
+	JsonSharedCacheEntry entries[JSON_SHARED_CACHE_ENTRIES];
+} JsonSharedCache;
+
+/*
+ * jsc_t is a scan's copy of the rows of a table in the shared cache, or the
+ * rows being collected by the scan, that are added to the shared cache if the
+ * scan reads the source through.
+ */
+typedef struct _jsc_t
+{
+	char keyHash[33];		// md5 of the key of the source
+	Oid relid;
+	bool bWriting;			// collecting the rows, else reading them
+	bool bComplete;			// the scan read the source through
+	bool bFailed;			// too many rows to cache, so they are abandoned
+	Size maxSize;			// of the rows of an entry
+	StringInfoData tuples;		// the rows, as maxaligned minimal tuples
+	int offset;			// of the next row, when reading
+	MemoryContext context;		// of the rows, as they are collected per tuple
+	bits8 columns[BITMAPLEN(MaxTupleAttributeNumber)];	// that the rows have, or are collected with
+} jsc_t; // Json Shared Cache Type
+
+// The kinds of the output columns of a scan that aggregates its rows
+enum
+{
+JSON_AGG_GROUP,			// a group by column
+JSON_AGG_COUNT_STAR,
+JSON_AGG_COUNT,
+JSON_AGG_MIN,
+JSON_AGG_MAX,
+JSON_AGG_SUM,
+};
+
+// An output column of a scan that aggregates its rows
+typedef struct JsonAggColumn
+{
+	int kind;			// JSON_AGG_xxx
+	int columnIndex;		// zero based index of the column of the table it reads, -1 for count(*)
+	Oid typeId;			// of the column of the table
+	Oid collation;			// of the group by column, or the input of min and max
+	int16 typLen;
+	bool typByVal;
+	FmgrInfo cmp;			// order, of the values of min and max
+	FmgrInfo eq;			// equality, and hash, of the values of a group by column
+	FmgrInfo hash;
+} JsonAggColumn;
+
+// A group of the rows of a scan that aggregates them
+typedef struct JsonAggGroup
+{
+	uint32 hash;			// of the values of its group by columns
+	Datum *pValues;			// of the group by columns, and min, max, and numeric sum
+	bool *pNulls;			// no value yet, ie. a null group by value, or no rows
+	int64 *pCounts;			// of count, and the integer sums
+	double *pSums;			// of the float sums
+} JsonAggGroup;
+
+/*
+ * jas_t keeps the state of a scan that computes simple aggregates, with or
+ * without group by, of the rows of the table as they are read, see
+ * JsonGetForeignUpperPaths. It returns a row per group, once every row of
+ * the table was read.
+ */
+typedef struct _jas_t
+{
+	int columnCount;		// output columns
+	JsonAggColumn *pColumns;
+	TupleTableSlot *pRowSlot;	// the rows of the table, as read
+	HTAB *pGroupHash;		// the lists of groups, by the hash of their group by values
+	List *pGroups;			// in the order they were found
+	ListCell *pNext;		// the next group to return
+	bool bAggregated;		// every row was read
+	MemoryContext groupContext;	// of the groups
+	MemoryContext rowContext;	// of a row, as it is read
+} jas_t; // Json Aggregate Scan Type
+
+// The groups of a scan that aggregates its rows, with the same hash
+typedef struct JsonAggGroupList
+{
+	uint32 hash;			// hash key
+	List *pGroups;
+} JsonAggGroupList;
+
 /*
  * JsonFdwExecState keeps foreign data wrapper specific execution state that we
  * create and hold onto when executing the query.
@@ -86,23 +354,201 @@ typedef struct JsonFdwExecState
 	HTAB *columnMappingHash;
 
 	cfr_t *pCfr;			// curl fetch result
+	jsp_t *pJsp;			// paged source, or NULL
+	jss_t *pJss;			// several sources, or NULL
+	char const *pSourceName;	// file name or url of the source being read
+	int sourceColumnIndex;		// zero based index of the source column, -1 if none
+
+	int partitionCount;		// number of partition columns of the source being read
+	int *pPartitionIndex;		// their zero based column indexes
+	Datum *pPartitionValues;	// and values, from the key=value directories of the source
+	bool *pPartitionNulls;
+	MemoryContext scanContext;	// context of the scan, for the partition values
+
+	uint64 bytesRead;		// uncompressed bytes of the lines read
+	uint64 fileBytes;		// bytes of the files opened, as stored or fetched
+	struct _jks_t *pJks;		// key stats of the rows read, when analyzing, or NULL
+	jcc_t *pJcc;			// columnar cache of the source, or NULL
+	jsc_t *pJsc;			// shared cache of the table, or NULL
+	int executorFlags;		// as the scan began, to begin it again
+	Tuplestorestate *pTupleStore;	// the rows, kept to be replayed by a rescan, or NULL
+	bool bTupleStoreComplete;	// the scan was read through into it
+	bool bReplaying;		// rescanned, so the rows are read from it
+	jas_t *pJas;			// the aggregates of the rows, or NULL
+	char const *pParamUrl;		// select url of a parameterized scan, less its parameters, or NULL
+	List *paramNames;		// its url parameters
+	List *paramExprStates;		// and the states of their fdw_exprs, built once for every rescan
+	bool bParamFetch;		// the url is fetched by the next Iterate, with the values then
 } JsonFdwExecState;
 
+// The json types of the values of a key, as kept by ANALYZE
+enum
+{
+JSON_KEY_TYPE_NULL,
+JSON_KEY_TYPE_STRING,
+JSON_KEY_TYPE_NUMBER,
+JSON_KEY_TYPE_BOOLEAN,
+JSON_KEY_TYPE_OBJECT,
+JSON_KEY_TYPE_ARRAY,
+
+JSON_KEY_TYPE_COUNT // must always be last
+};
+
+/*
+ * JsonKeyStats is what ANALYZE found of one dotted key path, over the rows in
+ * the sample, as kept in the json_fdw_key_stats table.
+ */
+typedef struct JsonKeyStats
+{
+	char key[NAMEDATALEN];		// hash key, the dotted path
+	int index;			// order the key was first seen in
+	double present;			// rows the key is in
+	double types[JSON_KEY_TYPE_COUNT];	// and by the json type of its value
+	bool bMapped;			// a column of the table reads the key
+} JsonKeyStats;
+
+/*
+ * jks_t collects the keys of the rows that ANALYZE reads. The keys of each
+ * row in the sample are kept with its reservoir slot, as a row may be
+ * replaced by a later one, and counted once the sample is complete.
+ */
+typedef struct _jks_t
+{
+	HTAB *pKeys;			// JsonKeyStats, by key
+	JsonKeyStats **ppKeys;		// and by index
+	int keyCount;
+	int *pRow;			// keys of the row just read, as index * JSON_KEY_TYPE_COUNT + type
+	int rowCount;
+	int rowAlloc;
+	int **ppSlots;			// keys of the rows in the sample, by slot, with the count first
+	int slotCount;
+	double sampleRows;		// rows in the sample, once counted
+	MemoryContext context;		// of the keys and slots
+} jks_t; // Json Key Stats Type
+
+// The narrowest column types that json_fdw_infer_schema tells apart
+enum
+{
+JSON_INFER_NULL,
+JSON_INFER_BOOLEAN,
+JSON_INFER_INTEGER,
+JSON_INFER_BIGINT,
+JSON_INFER_NUMERIC,
+JSON_INFER_DOUBLE,
+JSON_INFER_DATE,
+JSON_INFER_TIMESTAMP,
+JSON_INFER_TEXT,
+JSON_INFER_ARRAY,
+JSON_INFER_OBJECT,
+
+JSON_INFER_COUNT // must always be last
+};
+
+// JsonInferKey is what json_fdw_infer_schema found of one dotted key path
+typedef struct JsonInferKey
+{
+	char key[NAMEDATALEN];		// hash key, the dotted path
+	int index;			// order the key was first seen in
+	uint32 counts[JSON_INFER_COUNT];	// values, by their narrowest type
+	uint32 elementCounts[JSON_INFER_COUNT];	// and the elements of array values
+} JsonInferKey;
+
+/*
+ * jbs_t picks the blocks of an uncompressed file that ANALYZE samples, in file
+ * order, with Knuth's selection sampling, ie. Algorithm S.
+ */
+typedef struct _jbs_t
+{
+	int64 blocks;			// blocks in the file
+	int64 next;			// the next block to consider
+	int64 target;			// number of blocks to sample
+	int64 selected;			// number of blocks sampled so far
+	off_t blockEnd;			// end of the block being read
+} jbs_t; // Json Block Sampler Type
+
+/*
+ * JsonFdwStats is what ANALYZE measured of a foreign table, as kept in the
+ * json_fdw_stats table, and cached per backend.
+ */
+typedef struct JsonFdwStats
+{
+	Oid relid;			// hash key
+	bool bFound;			// the table has been analyzed
+	double rows;			// rows read
+	int sources;			// files and urls read
+	double fileBytes;		// bytes of the files, as stored or fetched, ie. compressed
+	double bytesPerRow;		// uncompressed bytes per row
+	double compressionRatio;	// uncompressed bytes per stored byte
+	double parseUsecPerRow;		// time to read, parse and convert a row
+	HTAB *pKeyHash;			// the stats of its keys, of JsonKeyStats, once loaded, see JsonKeyStatsFrac
+} JsonFdwStats;
+
+/*
+ * jce_t describes how one attribute of a modified row is written as a json
+ * name and value pair. The emitter is resolved once per statement.
+ */
+typedef struct _jce_t jce_t;
+typedef void (*JsonEmitFn)(StringInfo str, jce_t *pJce, Datum value);
+
+struct _jce_t
+{
+	int attnum;			// 1 based attribute number
+	Oid type;			// attribute type
+	char *pKey;			// quoted and escaped name, and the ':' separator
+	int keyLen;
+	JsonEmitFn emit;		// appends the json value
+	FmgrInfo *pOutputFn;		// type output function, for emitters that need it
+	jce_t *pElement;		// emitter of the elements of an array type
+	int16 elementLen;		// and their storage, for deconstruct_array
+	bool elementByVal;
+	char elementAlign;
+}; // Json Column Emitter Type
+
 typedef struct _jfmes_t
 {
 	Relation rel;			// relcache entry for the foriegn table
 	int p_nums;			// number of parameters to transmit
 	FmgrInfo *p_flinfo;		// output conversion functions for them
+	jce_t *pJce;			// json emitters for them
+	StringInfoData row;		// the json object document of the current row
 
 	List *retrieved_attrs;		// list of target attribute members
 	List *retrieved_names;		// list of target attribute names
 	List *table_options;
 	char const *pUrl;		// put url
+	char const *pMethod;		// request method, NULL for put
+	AttrNumber keyAttno;		// junk attribute of the row key, for delete
+
+	int batchSize;			// rows per remote request
+	int batchBytes;			// request body size cap of a batch
+	int batchFormat;		// RCI_BATCH_FORMAT_xxx
+	StringInfoData batch;		// rows buffered, but not yet sent
+	int batchRows;			// number of rows in batch
+	uint64 rowCount;		// number of rows sent or buffered
+	cpm_t *pCpm;			// pipelined requests, if the write window is more than one
+	char const *pContentEncoding;	// request body content encoding, or NULL
 
 	MemoryContext temp_cxt;		// context for per-tuple temp data
 
 } jfmes_t; // Json Fdw Modify Exec State Type
 
+// The pipelined puts of a modify, that are freed by an abort of the subtransaction that began them
+typedef struct JsonPutMulti
+{
+	cpm_t *pCpm;
+	SubTransactionId subid;
+} JsonPutMulti;
+
+typedef struct _jdmes_t
+{
+	char const *pUrl;		// filter url of the operation
+	char const *pMethod;		// request method, NULL for put
+	char const *pBody;		// request body, empty for a delete
+	char const *pContentEncoding;	// request body content encoding, or NULL
+	char const *pCountHeader;	// response header with the number of rows changed
+	bool bDone;			// the request has been sent
+} jdmes_t; // Json Direct Modify Exec State Type
+
 
 /*
  * ColumnMapping reprents a hash table entry that maps a column name to column
@@ -124,6 +570,7 @@ typedef struct ColumnMapping
 /* Function declarations for foreign data wrapper */
 extern Datum json_fdw_handler(PG_FUNCTION_ARGS);
 extern Datum json_fdw_validator(PG_FUNCTION_ARGS);
+extern Datum json_fdw_infer_schema(PG_FUNCTION_ARGS);
 
 
 #endif   /* JSON_FDW_H */
@@ -25,6 +25,8 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
 
 #include <yajl/yajl_tree.h>
 #include <yajl/yajl_tree_path.h>
@@ -38,52 +40,199 @@
 #include "regexapi_helper.h"
 #include "rciapi.h"
 
-static yajl_val romRootFetch(char const *pRomUrl, char const *pRomPath)
+// Parse a fetched ROM file
+static yajl_val romRootParse(char const *pFileName)
 {	yajl_val root = NULL;
+	FILE *fin = fopen(pFileName, "r");
 
-	if(pRomUrl != NULL && pRomPath != NULL && *pRomUrl && *pRomPath)
-	{	cfr_t *pCfr = curlFetchFile(pRomUrl, NULL);
+	if(fin != NULL)
+	{	char errorBuffer[ERROR_BUFFER_SIZE];
 
-		if(pCfr != NULL && pCfr->bFileFetched)
-		{	FILE *fin = fopen(pCfr->ccf.pFileName, "r");
+		root = yajl_tree_parse_file(fin, READ_BUFFER_SIZE, NULL, errorBuffer, sizeof(errorBuffer));
+		fclose(fin);
+	}
+
+	// must be an object with schema 2,
+	// else, not the rom we are looking for
+	if(
+		!YAJL_IS_OBJECT(root)
+		 || atoi( ytp_get(root, "romschema", NULL)) != 2
+		)
+	{
+		// free and null, if failure
+		yajl_tree_free(root);
+		root = NULL;
+	}
+
+	return root;
+}
+
+// A compiled rom_path action, the rci_t that rciFetch hands out copies of
+typedef struct _rcic_t
+{
+	struct _rcic_t *pNext;
+	char *pRomPath;
+	int action;
+	rci_t rci;
+}rcic_t; // Rom Context Info Compiled Type
+
+// A parsed ROM, cached for the life of the backend, and only
+// revalidated with the server, by it's ETag, after it expires
+typedef struct _romc_t
+{
+	struct _romc_t *pNext;
+	char *pRomUrl;
+	yajl_val romRoot;
+	time_t expires;
+	rcic_t *pRcic; // the actions compiled so far
+}romc_t; // Rom Cache Type
+
+static romc_t *gRomCache = NULL;
+
+static void rciStrFree(rci_t *pRci)
+{
+	if(pRci->pUrl != NULL)
+		free(pRci->pUrl);
+	if(pRci->pQuery != NULL)
+		free(pRci->pQuery);
+	if(pRci->pAction != NULL)
+		free((char *)pRci->pAction);
+	if(pRci->pFilterUrl != NULL)
+		free(pRci->pFilterUrl);
+}
+
+// Forget the compiled actions, and the parsed ROM that they refer to
+static void romCacheEntryClear(romc_t *pRomc)
+{
+	while(pRomc->pRcic != NULL)
+	{	rcic_t *pRcic = pRomc->pRcic;
+
+		pRomc->pRcic = pRcic->pNext;
+		rciStrFree(&pRcic->rci);
+		free(pRcic->pRomPath);
+		free(pRcic);
+	}
+
+	yajl_tree_free(pRomc->romRoot);
+	pRomc->romRoot = NULL;
+}
+
+// How long a fetched ROM may be used without revalidation,
+// from the Cache-Control max-age, else RCI_ROM_CACHE_TTL
+static time_t romCacheTtl(char const *pCacheControl)
+{	time_t ttl = RCI_ROM_CACHE_TTL;
 
-			if(fin != NULL)
-			{	char errorBuffer[ERROR_BUFFER_SIZE];
+	if(pCacheControl != NULL)
+	{	char const *pMaxAge = strcasestr(pCacheControl, "max-age=");
+
+		if(strcasestr(pCacheControl, "no-cache") != NULL || strcasestr(pCacheControl, "no-store") != NULL)
+			ttl = 0;
+		else if(pMaxAge != NULL)
+			ttl = atol(pMaxAge + 8);
+	}
 
-				root = yajl_tree_parse_file(fin, READ_BUFFER_SIZE, NULL, errorBuffer, sizeof(errorBuffer));
-				fclose(fin);
+	return ttl;
+}
+
+// Get the cached ROM, fetching, or revalidating it if it has expired
+static romc_t *romCacheGet(char const *pRomUrl)
+{	romc_t *pRomc = gRomCache;
+	time_t now = time(NULL);
+	cfr_t *pCfr = NULL;
+
+	while(pRomc != NULL && strcmp(pRomc->pRomUrl, pRomUrl) != 0)
+		pRomc = pRomc->pNext;
+
+	if(pRomc != NULL && pRomc->romRoot != NULL && now < pRomc->expires)
+		return pRomc;
+
+	// fetch, or revalidate with the ETag of the previous fetch
+	pCfr = curlFetchFile(pRomUrl, NULL);
+	if(pCfr != NULL && pCfr->bFileFetched)
+	{
+		if(pRomc == NULL)
+		{
+			pRomc = calloc(1, sizeof(romc_t));
+			if(pRomc != NULL)
+			{
+				pRomc->pRomUrl = strdup(pRomUrl);
+				pRomc->pNext = gRomCache;
+				gRomCache = pRomc;
 			}
+		}
 
-			// must be an object with schema 2,
-			// else, not the rom we are looking for
-			if(
-				!YAJL_IS_OBJECT(root)
-				 || atoi( ytp_get(root, "romschema", NULL)) != 2
-				)
+		if(pRomc != NULL)
+		{
+			// changed, or never parsed ?
+			if(pCfr->httpResponseCode != 304 || pRomc->romRoot == NULL)
 			{
-				// free and null, if failure
-				yajl_tree_free(root);
-				root = NULL;
+				romCacheEntryClear(pRomc);
+				pRomc->romRoot = romRootParse(pCfr->ccf.pFileName);
 			}
+			pRomc->expires = now + romCacheTtl(pCfr->ccf.pHdrs[HDR_IDX_CACHECONTROL]);
 		}
-		curlCfrFree(pCfr);
 	}
+	else if(pRomc != NULL)
+		romCacheEntryClear(pRomc);
+	curlCfrFree(pCfr);
 
-	return root;
+	return (pRomc != NULL && pRomc->romRoot != NULL ? pRomc : NULL);
+}
+
+// Get a named member of a ROM object node
+static yajl_val rciNodeGet(yajl_val node, char const *pName)
+{	char const *path[] = { pName, NULL };
+
+	return (YAJL_IS_OBJECT(node) && pName != NULL ? yajl_tree_get(node, path, yajl_t_any) : NULL);
+}
+
+// Get a named integer member of a ROM object node, which
+// may be specified as either a json number or a json string
+static int rciNodeGetInt(yajl_val node, char const *pName, int defaultValue)
+{	yajl_val val = rciNodeGet(node, pName);
+	int value = defaultValue;
+
+	if(YAJL_IS_INTEGER(val))
+		value = (int)YAJL_GET_INTEGER(val);
+	else if(YAJL_IS_STRING(val) && *YAJL_GET_STRING(val))
+		value = atoi(YAJL_GET_STRING(val));
+
+	return value;
+}
+
+// Get a named string member of a ROM object node
+static char const *rciNodeGetStr(yajl_val node, char const *pName)
+{
+	return YAJL_GET_STRING(rciNodeGet(node, pName));
+}
+
+// Map a batch format name to RCI_BATCH_FORMAT_xxx
+int rciBatchFormat(char const *pFormat)
+{
+	return (pFormat != NULL && strcasecmp(pFormat, "ndjson") == 0
+		? RCI_BATCH_FORMAT_NDJSON
+		: RCI_BATCH_FORMAT_ARRAY
+		);
+}
+
+// Map a paging type name to RCI_PAGING_xxx
+int rciPagingType(char const *pType)
+{
+	return (pType == NULL ? RCI_PAGING_NONE
+		: strcasecmp(pType, "offset") == 0 ? RCI_PAGING_OFFSET
+		: strcasecmp(pType, "page") == 0 ? RCI_PAGING_PAGE
+		: strcasecmp(pType, "link") == 0 ? RCI_PAGING_LINK
+		: strcasecmp(pType, "cursor") == 0 ? RCI_PAGING_CURSOR
+		: RCI_PAGING_NONE
+		);
 }
 
 void rciFree(rci_t *pRci)
 {
 	if(pRci != NULL)
 	{
-		if(pRci->pUrl != NULL)
-			free(pRci->pUrl);
-		if(pRci->pQuery != NULL)
-			free(pRci->pQuery);
-		if(pRci->pAction != NULL)
-			free(pRci->pAction);
-		if(pRci->romRoot != NULL)
-			yajl_tree_free(pRci->romRoot);
+		// the ROM belongs to the cache
+		rciStrFree(pRci);
 		free(pRci);
 	}
 }
@@ -92,7 +241,12 @@ void rciFree(rci_t *pRci)
 static char *strcatr(char *dst, char const *src)
 {
 	if(src != NULL && *src)
-		dst = strcat(realloc(dst, (dst != NULL ? strlen(dst) : 0) + strlen(src) + 1), src);
+	{
+		if(dst == NULL)
+			dst = strdup(src);
+		else
+			dst = strcat(realloc(dst, strlen(dst) + strlen(src) + 1), src);
+	}
 
 	return  dst;
 }
@@ -107,99 +261,215 @@ static char *strcatrurl(char *dst, char const *src)
 	return dst;
 }
 
-rci_t *rciFetch(char const *pRomUrl, char const *pRomPath, int action)
+// Append the url named parameters of a ROM query array to a url
+static char *rciUrlQueryAppend(char *pUrl, yajl_val rootQuery)
+{
+	// use the query array objects to build a set
+	// of url named parameters with values ?
+	if(YAJL_IS_ARRAY(rootQuery))
+	{	int i,q,first=1;
+		char const *pStrName;
+		char const *pStrValue;
+
+		// each query object
+		for(i=0,q=rootQuery->u.array.len; i<q; i++)
+		{
+			pStrName = ytp_get(rootQuery, i+1, "name", NULL);
+			pStrValue = ytp_get(rootQuery, i+1, "value", NULL);
+			//printf("%s:%d i %u name '%s' value '%s'\n", __func__, __LINE__, i, pStrName, pStrValue);
+			if(
+				pStrName != NULL && *pStrName
+				&& pStrValue != NULL && *pStrValue
+				)
+			{
+
+				if(first)
+				{
+					// This supposes that the url as built above this
+					// code section, doesn't already have paramenters.
+					// TODO - figure out if this has already been done.
+					pUrl = strcatr(pUrl, "?");
+					first = 0;
+				}
+				else
+					pUrl = strcatr(pUrl, "&");
+
+				pUrl = strcatr(pUrl, pStrName);
+				pUrl = strcatr(pUrl, "=");
+				pUrl = strcatr(pUrl, pStrValue);
+			}
+		}
+	}
+
+	return pUrl;
+}
+
+// Find the url parameter name that a column and operator of a
+// where clause maps to, in the "params" array of the action
+// "filter" object, or NULL if the column and operator don't map
+char const *rciFilterParam(rci_t const *pRci, char const *pColumn, char const *pOp)
+{	yajl_val rootParams = (pRci != NULL ? rciNodeGet(pRci->romRootFilter, "params") : NULL);
+	char const *pParam = NULL;
+
+	if(YAJL_IS_ARRAY(rootParams) && pColumn != NULL && pOp != NULL)
+	{	size_t i;
+
+		for(i=0; pParam == NULL && i<rootParams->u.array.len; i++)
+		{	yajl_val rootParam = rootParams->u.array.values[i];
+			char const *pStrColumn = rciNodeGetStr(rootParam, "column");
+			char const *pStrOp = rciNodeGetStr(rootParam, "op");
+
+			if(pStrColumn != NULL && strcmp(pStrColumn, pColumn) == 0
+				&& strcmp((pStrOp != NULL ? pStrOp : "="), pOp) == 0
+				)
+				pParam = rciNodeGetStr(rootParam, "name");
+		}
+	}
+
+	return pParam;
+}
+
+// The url parameter name that a limit maps to, from the
+// action "filter" object, or NULL if a limit is not supported
+char const *rciFilterLimitParam(rci_t const *pRci)
+{
+	return (pRci != NULL ? rciNodeGetStr(pRci->romRootFilter, "limit") : NULL);
+}
+
+// Build the url, and collect the settings, of a rom_path action
+static void rciCompile(rci_t *pRci, char const *pRomUrl, char const *pRomPath, int action)
+{
+	yajl_val rootTable = ytp_get(pRci->romRoot, pRomPath, NULL);
+	yajl_val rootQuery;
+
+	pRci->pAction = strdup(action == RCI_ACTION_INSERT ? "insert"
+		: action == RCI_ACTION_UPDATE ? "update"
+		: action == RCI_ACTION_DELETE ? "delete"
+		: "select"
+		);
+
+	pRci->romRootAction = ytp_get(rootTable, pRci->pAction, NULL);
+	pRci->pMethod = ytp_get(pRci->romRootAction, "method", NULL);
+	pRci->pUrl = strcatr(NULL, ytp_GetPath(pRci->romRoot, "$.host"));
+
+	rootQuery = ytp_get(pRci->romRootAction, "query");
+
+	// optional request batching of row operations
+	{	yajl_val rootBatch = rciNodeGet(pRci->romRootAction, "batch");
+
+		pRci->batchSize = rciNodeGetInt(rootBatch, "size", 0);
+		pRci->batchBytes = rciNodeGetInt(rootBatch, "bytes", 0);
+		pRci->batchFormat = rciBatchFormat(rciNodeGetStr(rootBatch, "format"));
+	}
+
+	// optional pipelining of requests
+	pRci->window = rciNodeGetInt(pRci->romRootAction, "window", 0);
+
+	// optional request body content encoding
+	pRci->pEncoding = rciNodeGetStr(pRci->romRootAction, "encoding");
+
+	// optional paging of selects
+	{	yajl_val rootPaging = rciNodeGet(pRci->romRootAction, "paging");
+
+		pRci->pagingType = rciPagingType(rciNodeGetStr(rootPaging, "type"));
+		pRci->pPagingParam = rciNodeGetStr(rootPaging, "param");
+		pRci->pPagingSizeParam = rciNodeGetStr(rootPaging, "sizeParam");
+		pRci->pPagingHeader = rciNodeGetStr(rootPaging, "header");
+		pRci->pagingSize = rciNodeGetInt(rootPaging, "size", 0);
+		pRci->pagingFirst = rciNodeGetInt(rootPaging, "first", (pRci->pagingType == RCI_PAGING_PAGE ? 1 : 0));
+		pRci->pagingWindow = rciNodeGetInt(rootPaging, "window", 1);
+	}
+
+	// If no host specified in ROM, use the
+	// host specification of the ROM url
+	if(pRci->pUrl == NULL || !*pRci->pUrl)
+	{	urlparts_t parts;
+
+		// split the ROM url into pieces, and use them
+		if(urlParse(pRomUrl, &parts))
+		{
+			if(pRci->pUrl != NULL)
+				free(pRci->pUrl);
+			asprintf(&pRci->pUrl, "%.*s://%.*s"
+				, (int)parts.scheme.len, parts.scheme.p // protocol specification
+				, (int)parts.authority.len, parts.authority.p // host specification
+				);
+		}
+	}
+
+	// concat / build the url based on the path selected
+	pRci->pUrl = strcatrurl(pRci->pUrl, ytp_GetPath(pRci->romRoot, "$.url"));
+	pRci->pUrl = strcatrurl(pRci->pUrl, ytp_get(rootTable, "url", NULL));
+	pRci->pUrl = strcatrurl(pRci->pUrl, ytp_GetPath(pRci->romRootAction, "$.url"));
+
+	// optional operations by filter, ie. where clauses as url parameters
+	pRci->romRootFilter = rciNodeGet(pRci->romRootAction, "filter");
+	if(YAJL_IS_OBJECT(pRci->romRootFilter) && pRci->pUrl != NULL)
+	{
+		pRci->pFilterUrl = strcatrurl(strdup(pRci->pUrl), rciNodeGetStr(pRci->romRootFilter, "url"));
+		pRci->pFilterUrl = rciUrlQueryAppend(pRci->pFilterUrl, rootQuery);
+		pRci->pFilterCountHeader = rciNodeGetStr(pRci->romRootFilter, "countHeader");
+		pRci->bFilterExact = YAJL_IS_TRUE(rciNodeGet(pRci->romRootFilter, "exact"));
+	}
+
+	pRci->pUrl = rciUrlQueryAppend(pRci->pUrl, rootQuery);
+}
+
+// Copy a compiled action, the caller must rciFree() the copy
+static rci_t *rciDup(rci_t const *pSrc)
 {	rci_t *pRci = calloc(1, sizeof(rci_t));
 
 	if(pRci != NULL)
 	{
-		pRci->romRoot = romRootFetch(pRomUrl, pRomPath);
-		// the schema has already been validated
-		if(pRci->romRoot != NULL && action != RCI_ACTION_NONE)
-		{
-			yajl_val rootTable = ytp_get(pRci->romRoot, pRomPath, NULL);
-			yajl_val rootQuery;
+		*pRci = *pSrc;
+		pRci->pUrl = (pSrc->pUrl != NULL ? strdup(pSrc->pUrl) : NULL);
+		pRci->pQuery = (pSrc->pQuery != NULL ? strdup(pSrc->pQuery) : NULL);
+		pRci->pAction = (pSrc->pAction != NULL ? strdup(pSrc->pAction) : NULL);
+		pRci->pFilterUrl = (pSrc->pFilterUrl != NULL ? strdup(pSrc->pFilterUrl) : NULL);
+	}
 
-			pRci->pAction = strdup(action == RCI_ACTION_INSERT ? "insert"
-				: action == RCI_ACTION_UPDATE ? "update"
-				: action == RCI_ACTION_DELETE ? "delete"
-				: "select"
-				);
+	return pRci;
+}
 
-			pRci->romRootAction = ytp_get(rootTable, pRci->pAction, NULL);
-			pRci->pMethod = ytp_get(pRci->romRootAction, "method", NULL);
-			pRci->pUrl = strcatr(NULL, ytp_GetPath(pRci->romRoot, "$.host"));
-
-			rootQuery = ytp_get(pRci->romRootAction, "query");
-
-			// If no host specified in ROM, use the
-			// host specification of the ROM url
-			if(pRci->pUrl == NULL || !*pRci->pUrl)
-			{	// split the ROM url into pieces
-				regexapi_t *pRat = regexapi_url(pRomUrl);
-
-				// use the pieces ?
-				if(pRat != NULL)
-				{	int regexNSubs = regexapi_nsubs(pRat, 0);
-
-					if(regexNSubs >= 2)
-					{
-						if(pRci->pUrl != NULL)
-							free(pRci->pUrl);
-						asprintf(&pRci->pUrl, "%s://%s"
-							, regexapi_sub(pRat, 0, 0) // protocol specification
-							, regexapi_sub(pRat, 0, 1) // host specification
-							);
-					}
-					regexapi_free(pRat);
-				}
-			}
+// Get the rom_path action of the ROM at pRomUrl. The ROM is cached, and
+// each rom_path action is compiled once, so this usually needs no network
+// access, and no json parsing. The yajl_val members of the result refer
+// to the cached ROM, which is valid until the next rciFetch().
+rci_t *rciFetch(char const *pRomUrl, char const *pRomPath, int action)
+{	romc_t *pRomc = (pRomUrl != NULL && pRomPath != NULL && *pRomUrl && *pRomPath ? romCacheGet(pRomUrl) : NULL);
+	rci_t *pRci = NULL;
 
-			// concat / build the url based on the path selected
-			pRci->pUrl = strcatrurl(pRci->pUrl, ytp_GetPath(pRci->romRoot, "$.url"));
-			pRci->pUrl = strcatrurl(pRci->pUrl, ytp_get(rootTable, "url", NULL));
-			pRci->pUrl = strcatrurl(pRci->pUrl, ytp_GetPath(pRci->romRootAction, "$.url"));
+	// the schema has already been validated
+	if(pRomc != NULL)
+	{
+		if(action != RCI_ACTION_NONE)
+		{	rcic_t *pRcic = pRomc->pRcic;
 
-			// use the query array objects to build a set
-			// of url named parameters with values ?
-			if(YAJL_IS_ARRAY(rootQuery))
-			{	int i,q,first=1;
-				char const *pStrName;
-				char const *pStrValue;
+			while(pRcic != NULL && !(pRcic->action == action && strcmp(pRcic->pRomPath, pRomPath) == 0))
+				pRcic = pRcic->pNext;
 
-				// each query object
-				for(i=0,q=rootQuery->u.array.len; i<q; i++)
+			if(pRcic == NULL)
+			{
+				pRcic = calloc(1, sizeof(rcic_t));
+				if(pRcic != NULL)
 				{
-					pStrName = ytp_get(rootQuery, i+1, "name", NULL);
-					pStrValue = ytp_get(rootQuery, i+1, "value", NULL);
-					//printf("%s:%d i %u name '%s' value '%s'\n", __func__, __LINE__, i, pStrName, pStrValue);
-					if(
-						pStrName != NULL && *pStrName
-						&& pStrValue != NULL && *pStrValue
-						)
-					{
-
-						if(first)
-						{
-							// This supposes that the url as built above this
-							// code section, doesn't already have paramenters.
-							// TODO - figure out if this has already been done.
-							pRci->pUrl = strcatr(pRci->pUrl, "?");
-							first = 0;
-						}
-						else
-							pRci->pUrl = strcatr(pRci->pUrl, "&");
-
-						pRci->pUrl = strcatr(pRci->pUrl, pStrName);
-						pRci->pUrl = strcatr(pRci->pUrl, "=");
-						pRci->pUrl = strcatr(pRci->pUrl, pStrValue);
-					}
+					pRcic->pRomPath = strdup(pRomPath);
+					pRcic->action = action;
+					pRcic->rci.romRoot = pRomc->romRoot;
+					rciCompile(&pRcic->rci, pRomUrl, pRomPath, action);
+
+					pRcic->pNext = pRomc->pRcic;
+					pRomc->pRcic = pRcic;
 				}
 			}
+
+			pRci = (pRcic != NULL ? rciDup(&pRcic->rci) : NULL);
 		}
-		else if(pRci->romRoot == NULL)
+		else
 		{
-			rciFree(pRci);
-			pRci = NULL;
+			pRci = calloc(1, sizeof(rci_t));
+			if(pRci != NULL)
+				pRci->romRoot = pRomc->romRoot;
 		}
 	}
 
@@ -60,15 +60,34 @@
 		"select":{
 			"method": "get",
 			"url": "/",
-			"query": [ { "name":"st", "type":"integer"}, { "name":"id", "type":"integer"} ]
+			"query": [ { "name":"st", "type":"integer"}, { "name":"id", "type":"integer"} ],
+			"filter": {
+				"url": "/",
+				"params": [ { "column":"t", "name":"t" }, { "column":"t", "op":">=", "name":"since" } ],
+				"limit": "max",
+				"exact": true
+				},
+			"paging": { "type": "offset", "param": "offset", "size": 1000, "sizeParam": "limit", "window": 4 }
 		},
 		"insert":{
 			"method": "put",
 			"url": "/",
-			"query": [ { "name":"st", "type":"integer"}, { "name":"id", "type":"integer"}, {"name":"data", "type":"integer[]"} ]
+			"query": [ { "name":"st", "type":"integer"}, { "name":"id", "type":"integer"}, {"name":"data", "type":"integer[]"} ],
+			"batch": { "size": 500, "bytes": 1048576, "format": "array" },
+			"window": 8,
+			"encoding": "gzip"
 			},
-		"delete":{ "method": "", "url": "", "schema": [ ] },
-		"update":{ "method": "", "url": "", "schema": [ ] }
+		"delete":{
+			"method": "delete",
+			"url": "/",
+			"batch": { "size": 1000, "format": "array" }
+			},
+		"update":{
+			"method": "put",
+			"url": "/",
+			"filter": { "url": "/where", "params": [ { "column":"st", "name":"state" }, { "column":"id", "name":"id", "op":"=" } ],
+				"countHeader": "X-Rows-Changed", "exact": true }
+			}
 	}
 }
 
@@ -76,19 +95,45 @@
 
 #include <yajl/yajl_tree.h>
 
+// Seconds that a fetched ROM is used without revalidating it with the
+// server, unless the server specifies otherwise with Cache-Control max-age
+#define RCI_ROM_CACHE_TTL 60
+
 typedef struct _rci_t
 {
 	char *pUrl; // must be free()'d
 	char *pQuery; // must be free()'d
 	char const *pMethod;
 	char const *pAction; // must be freed()'d
-	yajl_val romRoot; // must be yajl_free()'d
+	yajl_val romRoot; // do not yajl_free(), belongs to the ROM cache
 	yajl_val romRootAction; // do not yajl_free(), is subnode of romRoot
+	int batchSize; // rows per request, from the action "batch" object, 0 if not specified
+	int batchBytes; // maximum request body size of a batch, 0 if not specified
+	int batchFormat; // RCI_BATCH_FORMAT_xxx
+	int window; // number of requests in flight, from the action "window", 0 if not specified
+	char const *pEncoding; // request body content encoding, from the action "encoding", NULL if not specified
+	yajl_val romRootFilter; // the action "filter" object, NULL if not specified
+	char *pFilterUrl; // url of operations by filter, NULL if the action has no "filter"
+	char const *pFilterCountHeader; // response header with the number of rows that an operation by filter changed, NULL if not specified
+	int bFilterExact; // the server matches rows by the filter params exactly, from the filter "exact", false if not specified
+	int pagingType; // RCI_PAGING_xxx, from the action "paging" object
+	char const *pPagingParam; // url parameter of the offset, page number, or cursor
+	char const *pPagingSizeParam; // url parameter of the page size, NULL if not specified
+	char const *pPagingHeader; // response header with the next cursor
+	int pagingSize; // rows per page, the last page has fewer
+	int pagingFirst; // offset or page number of the first page
+	int pagingWindow; // number of pages fetched concurrently
 } rci_t; // Rom Context Info Type;
 
 enum { RCI_ACTION_NONE, RCI_ACTION_SELECT, RCI_ACTION_INSERT, RCI_ACTION_UPDATE, RCI_ACTION_DELETE };
+enum { RCI_BATCH_FORMAT_ARRAY, RCI_BATCH_FORMAT_NDJSON };
+enum { RCI_PAGING_NONE, RCI_PAGING_OFFSET, RCI_PAGING_PAGE, RCI_PAGING_LINK, RCI_PAGING_CURSOR };
 
 void rciFree(rci_t *pRci);
 rci_t *rciFetch(char const *pRomUrl, char const *pRomPath, int action);
+int rciBatchFormat(char const *pFormat);
+int rciPagingType(char const *pType);
+char const *rciFilterParam(rci_t const *pRci, char const *pColumn, char const *pOp);
+char const *rciFilterLimitParam(rci_t const *pRci);
 
 #endif
@@ -59,43 +59,224 @@ static char const rcsid[] = "@(#)$Id$";
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 #include <regex.h>
 
 #define _IS_REGEXAPI_
 #include "regexapi.h"
 
+#ifdef REGEXAPI_PCRE2
+static uint32_t regexapi_pcre2Options(unsigned int cflags)
+{	uint32_t options = 0;
+
+	// POSIX extended syntax is close enough to PCRE syntax, so only map the modifiers
+	if(cflags & REG_ICASE)
+		options |= PCRE2_CASELESS;
+	if(cflags & REG_NEWLINE)
+		options |= PCRE2_MULTILINE;
+	if(cflags & REG_NOSUB)
+		options |= PCRE2_NO_AUTO_CAPTURE;
+
+	return options;
+}
+#endif
+
+regexapire_t *regexapi_compile(const char *pregex, unsigned int cflags)
+{	regexapire_t *pre = calloc(sizeof(regexapire_t),1);
+
+	if(pre != NULL)
+	{
+#ifdef REGEXAPI_PCRE2
+		int errcode = 0;
+		PCRE2_SIZE erroffset = 0;
+
+		pre->pcode = pcre2_compile((PCRE2_SPTR)pregex, PCRE2_ZERO_TERMINATED, regexapi_pcre2Options(cflags), &errcode, &erroffset, NULL);
+		if(pre->pcode != NULL)
+		{	uint32_t nsubs = 0;
+
+			// if jit is not available, the interpreter is used
+			pcre2_jit_compile(pre->pcode, PCRE2_JIT_COMPLETE);
+			pcre2_pattern_info(pre->pcode, PCRE2_INFO_CAPTURECOUNT, &nsubs);
+			pre->nsubs = nsubs;
+			pre->pmd = pcre2_match_data_create_from_pattern(pre->pcode, NULL);
+			if(pre->pmd == NULL)
+			{
+				pre->rerc = REG_ESPACE;
+				pre->preerr = strdup("out of memory");
+			}
+		}
+		else
+		{	PCRE2_UCHAR errbuf[1024];
+
+			memset(&errbuf,0,sizeof(errbuf));
+			pcre2_get_error_message(errcode, errbuf, sizeof(errbuf));
+			pre->rerc = errcode;
+			pre->preerr = strdup((char *)errbuf);
+		}
+#else
+		pre->rerc = regcomp(&pre->re,pregex,cflags);
+		pre->bCompiled = (pre->rerc == 0);
+		if(pre->rerc == 0)
+		{
+			pre->nsubs = pre->re.re_nsub;
+			pre->presubs = (regmatch_t *)calloc(sizeof(regmatch_t),pre->nsubs+1);
+			if(pre->presubs == NULL)
+			{
+				pre->rerc = REG_ESPACE;
+				pre->preerr = strdup("out of memory");
+			}
+		}
+		else
+		{	char errbuf[1024];
+
+			memset(&errbuf,0,sizeof(errbuf));
+			regerror(pre->rerc,&pre->re,errbuf,sizeof(errbuf));
+			pre->preerr = strdup(errbuf);
+		}
+#endif
+#ifdef _REGEX_DEBUG
+		printf("%s:%d - pregex '%s' cflags 0x%04X rerc %d nsubs %zu\n", __func__, __LINE__, pregex, cflags, pre->rerc, pre->nsubs);
+#endif
+	}
+
+	return pre;
+}
+
+void regexapi_compileFree(regexapire_t *pre)
+{
+	if(pre != NULL)
+	{
+#ifdef REGEXAPI_PCRE2
+		if(pre->pmd != NULL)
+			pcre2_match_data_free(pre->pmd);
+		if(pre->pcode != NULL)
+			pcre2_code_free(pre->pcode);
+#else
+		if(pre->presubs != NULL)
+			free(pre->presubs);
+		if(pre->bCompiled)
+			regfree(&pre->re);
+#endif
+		if(pre->preerr != NULL)
+			free(pre->preerr);
+		free(pre);
+	}
+}
+
+int regexapi_compileErr(regexapire_t *pre)
+{
+	return (pre != NULL ? pre->rerc : REG_ESPACE);
+}
+
+const char *regexapi_compileErrStr(regexapire_t *pre)
+{
+	return (pre != NULL && pre->preerr != NULL ? pre->preerr : "");
+}
+
+size_t regexapi_compileNSubs(regexapire_t *pre)
+{
+	return (pre != NULL ? pre->nsubs : 0);
+}
+
+int regexapi_match(regexapire_t *pre, const char *pstr, size_t start, regexapispan_t *pspans, size_t nspans)
+{	int rc = -1;
+	size_t i;
+
+	if(pre == NULL || pre->rerc != 0 || pstr == NULL)
+		return -1;
+
+	if(nspans > pre->nsubs+1)
+		nspans = pre->nsubs+1;
+
+#ifdef REGEXAPI_PCRE2
+	rc = pcre2_match(pre->pcode, (PCRE2_SPTR)pstr, PCRE2_ZERO_TERMINATED, start, 0, pre->pmd, NULL);
+	if(rc >= 0)
+	{	PCRE2_SIZE *povector = pcre2_get_ovector_pointer(pre->pmd);
+
+		for(i=0; i<nspans; i++)
+		{
+			pspans[i].so = (povector[i*2] == PCRE2_UNSET ? -1 : (long)povector[i*2]);
+			pspans[i].eo = (povector[i*2+1] == PCRE2_UNSET ? -1 : (long)povector[i*2+1]);
+		}
+		rc = nspans;
+	}
+	else
+		rc = (rc == PCRE2_ERROR_NOMATCH ? 0 : -1);
+#else
+	rc = regexec(&pre->re,pstr+start,pre->nsubs+1,pre->presubs,(start > 0 ? REG_NOTBOL : 0));
+	if(rc == 0)
+	{
+		for(i=0; i<nspans; i++)
+		{	regmatch_t *presub = pre->presubs+i;
+
+			pspans[i].so = (presub->rm_so == -1 ? -1 : (long)(presub->rm_so + start));
+			pspans[i].eo = (presub->rm_eo == -1 ? -1 : (long)(presub->rm_eo + start));
+		}
+		rc = nspans;
+	}
+	else
+		rc = (rc == REG_NOMATCH ? 0 : -1);
+#endif
+
+	return rc;
+}
+
 void regexapi_free(regexapi_t *prat)
 {
 	if(prat != NULL)
-	{	unsigned int i,j;
+	{
+		if(prat->ppsubs != NULL)
+		{	size_t i;
 
-		for(i=0; i<prat->matches; i++)
-		{	regexapimatch_t *pmatch = prat->pmatches+i;
-		
-			if(pmatch->nsubs && pmatch->ppsubs != NULL)
-			{
-				for(j=0; j<pmatch->nsubs; j++)
-					free(*(pmatch->ppsubs+j));
-				free(pmatch->ppsubs);
-			}
+			for(i=0; i<prat->matches*prat->nsubs; i++)
+				free(prat->ppsubs[i]);
+			free(prat->ppsubs);
 		}
-		if(prat->matches && prat->pmatches != NULL)
-			free(prat->pmatches);
-		regfree(&prat->re);
+		if(prat->pspans != NULL)
+			free(prat->pspans);
+		if(prat->breOwned)
+			regexapi_compileFree(prat->pre);
 		if(prat->preerr != NULL)
 			free(prat->preerr);
 		free(prat);
 	}
 }
 
+// The sub is copied out of the subject the first time it is asked for
 const char *regexapi_sub(regexapi_t *prat, size_t match, size_t nsub)
-{
-	return (prat != NULL && match < prat->matches && nsub <= (prat->pmatches+match)->nsubs ? *((prat->pmatches+match)->ppsubs+nsub) : NULL);
+{	regexapispan_t const *pspan = NULL;
+	char **ppsub = NULL;
+
+	if(prat == NULL || match >= prat->matches || nsub >= prat->nsubs)
+		return NULL;
+
+	if(prat->ppsubs == NULL)
+	{
+		prat->ppsubs = (char **)calloc(sizeof(char *),prat->matches*prat->nsubs);
+		if(prat->ppsubs == NULL)
+			return NULL;
+	}
+
+	pspan = prat->pspans+(match*prat->nsubs+nsub);
+	ppsub = prat->ppsubs+(match*prat->nsubs+nsub);
+	if(*ppsub == NULL)
+		*ppsub = (pspan->so >= 0 ? strndup(prat->pstr+pspan->so,pspan->eo-pspan->so) : strdup(""));
+
+	return *ppsub;
+}
+
+bool regexapi_subSpan(regexapi_t *prat, size_t match, size_t nsub, regexapispan_t *pspan)
+{	bool bOk = (prat != NULL && match < prat->matches && nsub < prat->nsubs);
+
+	if(bOk)
+		*pspan = *(prat->pspans+(match*prat->nsubs+nsub));
+
+	return bOk;
 }
 
 int regexapi_nsubs(regexapi_t *prat, size_t match)
 {
-	return (prat != NULL && match < prat->matches ? (prat->pmatches+match)->nsubs : 0);
+	return (prat != NULL && match < prat->matches ? prat->nsubs : 0);
 }
 
 int regexapi_matches(regexapi_t *prat)
@@ -116,77 +297,82 @@ const char *regexapi_errStr(regexapi_t *prat)
 static void regexapi_buildErrStr(regexapi_t *prat)
 {
 	if(prat != NULL)
-	{	char errbuf[1024];
-
-		memset(&errbuf,0,sizeof(errbuf));
-		regerror(prat->rerc,&prat->re,errbuf,sizeof(errbuf));
-		prat->preerr = strdup(errbuf);
+	{
+		if(prat->pre != NULL && prat->pre->rerc != 0)
+			prat->preerr = strdup(regexapi_compileErrStr(prat->pre));
+		else
+			prat->preerr = strdup(prat->rerc == REG_NOMATCH ? "No match" : "Match failed");
 	}
 }
 
-regexapi_t *regexapi_exec(const char *pstr, const char *pregex, unsigned int cflags, unsigned int findCount)
-{	regexapi_t *prat = calloc(sizeof(regexapi_t),1);
+// Record the spans of the subs of a match, with the span list grown geometrically
+static bool regexapi_matchAdd(regexapi_t *prat, regexapispan_t const *pspans)
+{
+	if(prat->matches == prat->matchesAlloc)
+	{	unsigned int alloc = (prat->matchesAlloc ? prat->matchesAlloc * 2 : 4);
+		regexapispan_t *pgrown = realloc(prat->pspans,sizeof(regexapispan_t)*prat->nsubs*alloc);
+
+		if(pgrown == NULL)
+			return false;
+		prat->pspans = pgrown;
+		prat->matchesAlloc = alloc;
+	}
 
+	// span 0 is the whole match, which isn't a sub
+	memcpy(prat->pspans+(prat->matches*prat->nsubs),pspans+1,sizeof(regexapispan_t)*prat->nsubs);
+	prat->matches++;
 #ifdef _REGEX_DEBUG
-	printf("%s:%d - pstr '%s' pregex '%s' cflags 0x%04X findCount %u\n" , __func__, __LINE__ , pstr, pregex, cflags, findCount);
+	{	size_t i;
+
+		for(i=1; i<prat->nsubs+1; i++)
+			printf("%s:%d - sub %zu: so %ld eo %ld\n", __func__, __LINE__, i, pspans[i].so, pspans[i].eo);
+	}
 #endif
+
+	return true;
+}
+
+regexapi_t *regexapi_execCompiled(const char *pstr, regexapire_t *pre, unsigned int findCount)
+{	regexapi_t *prat = calloc(sizeof(regexapi_t),1);
+
 	if(prat != NULL)
 	{
-		prat->rerc = regcomp(&prat->re,pregex,cflags);
+		prat->pre = pre;
+		prat->rerc = regexapi_compileErr(pre);
+		prat->pstr = pstr;
+		prat->nsubs = regexapi_compileNSubs(pre);
 
-#ifdef _REGEX_DEBUG
 		if(prat->rerc == 0)
-			printf("%s:%d - regcomp() = %d,  nsub = %d\n", __func__, __LINE__, prat->rerc, prat->re.re_nsub);
-#endif
-		if(prat->rerc == 0)
-		{	size_t i;
-			char *pdst = NULL;
-			regmatch_t *presubs = (regmatch_t *)calloc(sizeof(regmatch_t),prat->re.re_nsub+1);
-			regexapimatch_t *pmatch = NULL;
+		{	size_t nspans = pre->nsubs+1;
+			regexapispan_t *pspans = (regexapispan_t *)calloc(sizeof(regexapispan_t),nspans);
 			size_t last = 0;
+			size_t len = strlen(pstr);
+			int rc = 0;
 
 			// don't allow iteration for more subs than actually exist
-			if(prat->re.re_nsub < findCount)
-				findCount = prat->re.re_nsub;
+			if(pre->nsubs < findCount)
+				findCount = pre->nsubs;
 
-			while((prat->rerc = regexec(&prat->re,pstr+last,prat->re.re_nsub+1,presubs,0)) == 0 && findCount != 0)
+			while(pspans != NULL && findCount != 0 && last <= len
+				&& (rc = regexapi_match(pre,pstr,last,pspans,nspans)) > 0
+				)
 			{
 				findCount --;
-				prat->matches ++;
-				prat->pmatches = realloc(prat->pmatches,sizeof(regexapimatch_t)*prat->matches);
-				pmatch = prat->pmatches+(prat->matches-1);
-#ifdef _REGEX_DEBUG
-				printf("%s:%d - regexec() = %d\n", __func__, __LINE__, prat->rerc);
-#endif
-				pmatch->nsubs = 0;
-				pmatch->ppsubs = (char **)calloc(1,sizeof(char *)*prat->re.re_nsub);
-
-				if(pmatch->ppsubs != NULL)
+				if(!regexapi_matchAdd(prat,pspans))
 				{
-					for(i=1; i<prat->re.re_nsub+1; i++)
-					{	size_t so = (presubs+i)->rm_so + last;
-						size_t eo = (presubs+i)->rm_eo + last;
-						size_t qo = (eo - so);
-
-						pmatch->nsubs++;
-						pdst = *(pmatch->ppsubs+(i-1)) = (char *)calloc(qo+1,1);
-						strncpy(pdst,(pstr+so),qo);
-						*(pdst+qo) = 0;
-
-						if(i == prat->re.re_nsub)
-							last = eo;
-#ifdef _REGEX_DEBUG
-						printf("%s:%d - sub %d: so %d eo %d qo %d - '%*.*s'\n", __func__, __LINE__, i, so, eo, qo, qo, qo, pdst);
-#endif
-					}
+					rc = -1;
+					break;
 				}
+
+				// continue after the match, and don't get stuck on an empty match
+				last = (pspans[0].eo > (long)last ? (size_t)pspans[0].eo : last+1);
 			}
 
-			if(presubs != NULL)
-				free(presubs);
+			if(pspans != NULL)
+				free(pspans);
 
-			if(prat->matches > 0 && prat->rerc == 1)
-				prat->rerc = 0;
+			if(prat->matches == 0)
+				prat->rerc = (rc < 0 || pspans == NULL ? REG_ESPACE : REG_NOMATCH);
 		}
 	}
 
@@ -201,6 +387,18 @@ regexapi_t *regexapi_exec(const char *pstr, const char *pregex, unsigned int cfl
 	return prat;
 }
 
+regexapi_t *regexapi_exec(const char *pstr, const char *pregex, unsigned int cflags, unsigned int findCount)
+{	regexapire_t *pre = regexapi_compile(pregex,cflags);
+	regexapi_t *prat = regexapi_execCompiled(pstr,pre,findCount);
+
+	if(prat != NULL)
+		prat->breOwned = true;
+	else
+		regexapi_compileFree(pre);
+
+	return prat;
+}
+
 int regexapi(const char *pstr, const char *pregex, int cflags)
 {	regexapi_t *prat = regexapi_exec(pstr,pregex,cflags,1);
 	int rc = regexapi_matches(prat) != 0;
@@ -224,7 +422,11 @@ int main(int argc, char **argv)
 		{	int q;
 
 			for(i=0,q=regexapi_nsubs(prat,0); i<q; i++)
-				printf("sub %d: '%s'\n",i+1,regexapi_sub(prat,0,i));
+			{	regexapispan_t span;
+
+				regexapi_subSpan(prat,0,i,&span);
+				printf("sub %d: '%s' at %ld-%ld\n",i+1,regexapi_sub(prat,0,i),span.so,span.eo);
+			}
 		}
 
 		regexapi_free(prat);
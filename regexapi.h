@@ -61,38 +61,85 @@
 extern "C" {
 #endif
 
+	#include <stddef.h>
+	#include <stdbool.h>
 	#include <regex.h>
 
 	#define REGEX_DEFAULT_CFLAGS ( REG_EXTENDED | REG_ICASE )
 	#define REGEX_FIND_ALL ~0 
 
+	// A sub expression match, as offsets into the subject, -1 if not matched
+	typedef struct _regexapispan_t
+	{
+		long so;
+		long eo;
+	}regexapispan_t;
+
 #ifdef _IS_REGEXAPI_
-	typedef struct _regexapimatch_t
+	#ifdef REGEXAPI_PCRE2
+		#define PCRE2_CODE_UNIT_WIDTH 8
+		#include <pcre2.h>
+	#endif
+
+	// A compiled pattern
+	typedef struct _regexapire_t
 	{
+#ifdef REGEXAPI_PCRE2
+		pcre2_code *pcode;
+		pcre2_match_data *pmd;
+#else
+		regex_t re;
+		bool bCompiled;
+		regmatch_t *presubs;
+#endif
 		size_t nsubs;
-		char **ppsubs;
-	}regexapimatch_t;
+		int rerc;
+		char *preerr;
+	}regexapire_t;
 
+	// The matches of an exec, as the spans of their subs, nsubs per match,
+	// the subs are copied out of the subject only when asked for
 	typedef struct _regexapi_t
 	{
-		regex_t re;
+		regexapire_t *pre;
+		bool breOwned;
 		int rerc;
 		char *preerr;
 
+		const char *pstr;
+		size_t nsubs;
 		unsigned int matches;
-		regexapimatch_t *pmatches;
+		unsigned int matchesAlloc;
+		regexapispan_t *pspans;
+		char **ppsubs;
 	}regexapi_t;
 #else
+	typedef struct _regexapire_t regexapire_t;
 	typedef struct _regexapi_t regexapi_t;
 #endif
 
+	// Compile once, and match many times, regexapi_match fills in the
+	// caller's spans, so it allocates nothing
+	regexapire_t *regexapi_compile(const char *pregex, unsigned int cflags);
+	void regexapi_compileFree(regexapire_t *pre);
+	int regexapi_compileErr(regexapire_t *pre);
+	const char *regexapi_compileErrStr(regexapire_t *pre);
+	size_t regexapi_compileNSubs(regexapire_t *pre);
+	// Returns the number of spans filled in, span 0 is the whole match,
+	// 0 for no match, or -1 for an error
+	int regexapi_match(regexapire_t *pre, const char *pstr, size_t start, regexapispan_t *pspans, size_t nspans);
+
+	// An exec records only the spans of its matches, the subject must outlive
+	// the result, as regexapi_sub copies a sub out of it the first time
 	void regexapi_free(regexapi_t *prat);
 	const char *regexapi_sub(regexapi_t *prat, size_t match, size_t nsub);
+	bool regexapi_subSpan(regexapi_t *prat, size_t match, size_t nsub, regexapispan_t *pspan);
 	int regexapi_nsubs(regexapi_t *prat, size_t match);
 	int regexapi_matches(regexapi_t *prat);
 	int regexapi_err(regexapi_t *prat);
 	const char *regexapi_errStr(regexapi_t *prat);
 	regexapi_t *regexapi_exec(const char *pstr, const char *pregex, unsigned int cflags, unsigned int findCount);
+	regexapi_t *regexapi_execCompiled(const char *pstr, regexapire_t *pre, unsigned int findCount);
 
 	// for simplicitly
 	int regexapi(const char *pstr, const char *pregex, int cflags);
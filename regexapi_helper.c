@@ -24,6 +24,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
 
 #include "regexapi.h"
 #include "regexapi_helper.h"
@@ -37,7 +40,7 @@ typedef struct _regexapilist_t
 }regexapilist_t;
 
 #define URLHOSTNAME "([a-z0-9][a-z0-9._-]*[.][a-z]{2,})"
-#define URLHOSTIPV4 "([0-9]{1,3}[.][0-9]{1,3}[.][0.9]{1,3}[.][0-9]{1,3})"
+#define URLHOSTIPV4 "([0-9]{1,3}[.][0-9]{1,3}[.][0-9]{1,3}[.][0-9]{1,3})"
 #define URLHOSTLOCAL "(localhost)"
 #define URLHOST "(" URLHOSTNAME "|" URLHOSTLOCAL "|" URLHOSTIPV4 ")"
 #define URLPORT "(:[0-9]+)*"
@@ -45,7 +48,7 @@ typedef struct _regexapilist_t
 #define URISPEC "/.*"
 
 // http[s]?://([a-z0-9][a-z0-9._-]*[.][a-z]{2,}(:[0-9]+)*)(.*)
-// http[s]?://((([a-z0-9][a-z0-9._-]*[.][a-z]{2,})|(localhost)|([0-9]{1,3}[.][0-9]{1,3}[.][0.9]{1,3}[.][0-9]{1,3}))(:[0-9]+)*)(/.{0,})
+// http[s]?://((([a-z0-9][a-z0-9._-]*[.][a-z]{2,})|(localhost)|([0-9]{1,3}[.][0-9]{1,3}[.][0-9]{1,3}[.][0-9]{1,3}))(:[0-9]+)*)(/.{0,})
 
 // List of valid URL regexes that CURL supports
 static regexapilist_t const regexUrls[] =
@@ -54,17 +57,142 @@ static regexapilist_t const regexUrls[] =
 	{ NULL, 0, 0 },
 };
 
+// The regexUrls patterns, compiled on first use
+static regexapire_t *regexUrlsCompiled[sizeof(regexUrls)/sizeof(regexUrls[0])];
+
 // Supported URL regex validation iterator
-static regexapi_t *regexapi_exec_list(const char *subject, regexapilist_t const *pRegexList)
+static regexapi_t *regexapi_exec_list(const char *subject, regexapilist_t const *pRegexList, regexapire_t **ppCompiled)
 {	regexapi_t *pRat = NULL;
 
 	while(pRat == NULL && pRegexList->pattern != NULL)
-		pRat = regexapi_exec(subject, pRegexList->pattern, pRegexList->flags, pRegexList->findCount);
+	{
+		if(*ppCompiled == NULL)
+			*ppCompiled = regexapi_compile(pRegexList->pattern, pRegexList->flags);
+		pRat = regexapi_execCompiled(subject, *ppCompiled, pRegexList->findCount);
+		pRegexList++;
+		ppCompiled++;
+	}
 
 	return pRat;
 }
 
 regexapi_t *regexapi_url(char const *subject)
 {
-	return regexapi_exec_list(subject, regexUrls);
+	return regexapi_exec_list(subject, regexUrls, regexUrlsCompiled);
+}
+
+// The same urls that regexapi_url matches, without the regex, and without
+// allocations, the parts are slices of the subject
+static bool urlHostIpv4(char const *p, size_t len)
+{	int dots = 0;
+	int digits = 0;
+	size_t i;
+
+	for(i=0; i<len; i++)
+	{
+		if(isdigit((unsigned char)p[i]) && ++digits <= 3)
+			continue;
+		else if(p[i] == '.' && digits > 0 && ++dots <= 3)
+			digits = 0;
+		else
+			return false;
+	}
+
+	return (dots == 3 && digits > 0);
+}
+
+static bool urlHostName(char const *p, size_t len)
+{	size_t i;
+	size_t tld = 0;
+
+	if(len == 0 || !isalnum((unsigned char)p[0]))
+		return false;
+
+	for(i=0; i<len; i++)
+	{
+		if(isalpha((unsigned char)p[i]))
+			tld++;
+		else if(p[i] == '.')
+			tld = 0;
+		else if(isdigit((unsigned char)p[i]) || p[i] == '_' || p[i] == '-')
+			tld = len; // not the top level domain
+		else
+			return false;
+	}
+
+	// at least one dot, and a top level domain of two or more letters
+	return (tld >= 2 && tld < len && memchr(p, '.', len) != NULL);
+}
+
+bool urlParse(char const *subject, urlparts_t *pParts)
+{	char const *p = subject;
+	char const *pHostEnd = NULL;
+
+	memset(pParts, 0, sizeof(urlparts_t));
+
+	if(p == NULL)
+		return false;
+
+	// scheme
+	if(strncasecmp(p, "https://", 8) == 0)
+		pParts->scheme.len = 5;
+	else if(strncasecmp(p, "http://", 7) == 0)
+		pParts->scheme.len = 4;
+	else
+		return false;
+	pParts->scheme.p = p;
+	p += pParts->scheme.len + 3;
+
+	// host and port
+	pParts->authority.p = pParts->host.p = p;
+	pHostEnd = p + strcspn(p, ":/?#");
+	pParts->host.len = pHostEnd - p;
+	p = pHostEnd;
+	if(*p == ':')
+	{
+		pParts->port.p = ++p;
+		while(isdigit((unsigned char)*p))
+			p++;
+		pParts->port.len = p - pParts->port.p;
+		if(pParts->port.len == 0)
+			return false;
+	}
+	pParts->authority.len = p - pParts->authority.p;
+
+	if(!(
+		(pParts->host.len == 9 && strncasecmp(pParts->host.p, "localhost", 9) == 0)
+		|| urlHostIpv4(pParts->host.p, pParts->host.len)
+		|| urlHostName(pParts->host.p, pParts->host.len)
+		))
+		return false;
+
+	if(*p != '\0' && *p != '/' && *p != '?' && *p != '#')
+		return false;
+
+	// path, and the basename of the path
+	pParts->path.p = p;
+	pParts->path.len = strcspn(p, "?#");
+	pParts->basename.p = pParts->path.p;
+	{	char const *pSlash = NULL;
+		size_t i;
+
+		for(i=0; i<pParts->path.len; i++)
+		{
+			if(pParts->path.p[i] == '/')
+				pSlash = &pParts->path.p[i];
+		}
+		if(pSlash != NULL)
+			pParts->basename.p = pSlash + 1;
+	}
+	pParts->basename.len = pParts->path.p + pParts->path.len - pParts->basename.p;
+	p += pParts->path.len;
+
+	// query, without the '?'
+	if(*p == '?')
+	{
+		pParts->query.p = ++p;
+		pParts->query.len = strcspn(p, "#");
+	}
+
+	return true;
 }
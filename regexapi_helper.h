@@ -24,5 +24,28 @@
 #ifndef _REGEXAPI_HELPER_H_
 #define _REGEXAPI_HELPER_H_
 
+#include <stddef.h>
+#include <stdbool.h>
+
 regexapi_t *regexapi_url(char const *subject);
+
+// A part of a url, that is not zero terminated
+typedef struct _urlslice_t
+{
+	char const *p;
+	size_t len;
+}urlslice_t;
+
+typedef struct _urlparts_t
+{
+	urlslice_t scheme;	// http or https
+	urlslice_t authority;	// host and port
+	urlslice_t host;
+	urlslice_t port;	// empty if not specified
+	urlslice_t path;	// empty, or starting with '/'
+	urlslice_t basename;	// the last component of the path
+	urlslice_t query;	// without the '?'
+}urlparts_t;
+
+bool urlParse(char const *subject, urlparts_t *pParts);
 #endif